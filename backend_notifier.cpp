@@ -1,6 +1,44 @@
 #include "backend_notifier.h"
 
-static BackendNotifier& instance() {
-    static BackendNotifier inst;
-    return inst;
+void BackendNotifier::markDirty(int charger_id)
+{
+    std::lock_guard<std::mutex> lock(dirtyMutex);
+    dirty.insert(charger_id);
+}
+
+QList<int> BackendNotifier::takeDirty()
+{
+    QSet<int> taken;
+    {
+        std::lock_guard<std::mutex> lock(dirtyMutex);
+        taken.swap(dirty); // el backend no espera mientras la interfaz repinta
+    }
+
+    return taken.values();
+}
+
+void BackendNotifier::charger_connected(int charger_id)
+{
+    if (charger_id == 1) // la interfaz muestra el cargador 1
+        QMetaObject::invokeMethod(this, "chargerConnected", Qt::QueuedConnection);
+}
+
+void BackendNotifier::charger_disconnected(int charger_id)
+{
+    if (charger_id == 1)
+        QMetaObject::invokeMethod(this, "chargerDisconnected", Qt::QueuedConnection);
+}
+
+void BackendNotifier::boot_notification(int charger_id, const std::string &model, const std::string &vendor)
+{
+    QMetaObject::invokeMethod(this,
+                              "bootNotification",
+                              Qt::QueuedConnection,
+                              Q_ARG(QString, QString::fromStdString(model)),
+                              Q_ARG(QString, QString::fromStdString(vendor)));
+}
+
+void BackendNotifier::charger_changed(int charger_id)
+{
+    markDirty(charger_id);
 }
@@ -2,8 +2,16 @@
 #define BACKEND_NOTIFIER_H
 
 #include <QObject>
+#include <QList>
+#include <QSet>
+#include <mutex>
+#include "nucli_sistema/ocpp_cs/event_sink.h"
 
-class BackendNotifier : public QObject
+/*
+ * Destino de los eventos del núcleo en la interfaz gráfica: los pasa al thread de la interfaz
+ * como señales de Qt. Los eventos del cargador 1 son los de los paneles de la primera pestaña.
+ */
+class BackendNotifier : public QObject, public EventSink
 {
     Q_OBJECT
 public:
@@ -12,17 +20,34 @@ public:
         return inst;
     }
 
+    /*
+     * Cargadores con cambios pendientes de mostrar. El backend marca el cargador después de
+     * cada cambio (desde cualquier thread) y la interfaz recoge el conjunto a ritmo fijo y
+     * relee el último estado de cada uno, así el coste de la interfaz no depende de cuántos
+     * mensajes lleguen: un cargador con cien cambios entre dos frames se repinta una vez.
+     */
+    void markDirty(int charger_id);
+    QList<int> takeDirty();
+
+    // EventSink
+    void charger_connected(int charger_id) override;
+    void charger_disconnected(int charger_id) override;
+    void boot_notification(int charger_id, const std::string &model, const std::string &vendor) override;
+    void charger_changed(int charger_id) override;
+
 signals:
     void chargerConnected();
     void chargerDisconnected();
     void bootNotification(const QString &model, const QString &vendor);
-    void statusNotification(int64_t conn1, int64_t conn2, QString id_tag1, QString id_tag2, int64_t transaction1, int64_t transaction2);
 
 private:
     BackendNotifier() = default;
     ~BackendNotifier() = default;
     BackendNotifier(const BackendNotifier&) = delete;
     BackendNotifier& operator=(const BackendNotifier&) = delete;
+
+    std::mutex dirtyMutex;
+    QSet<int> dirty;
 };
 
 #endif // BACKEND_NOTIFIER_H
@@ -17,32 +17,21 @@ CREATE TABLE IF NOT EXISTS meter_values (
     context TEXT
 );
 
--- Trigger per limitar les dades de meterValues a un màxim de 30
-CREATE TRIGGER max_meter_values BEFORE INSERT ON meter_values
-    BEGIN
-        DELETE FROM meter_values WHERE
-            hora = (SELECT min(hora) FROM meter_values)
-            and (SELECT COUNT(*) FROM meter_values) = 30;
-    END;
+-- Índexs de les gràfiques (per carregador, connector i interval d'hora) i de la neteja per antiguitat
+CREATE INDEX IF NOT EXISTS meter_values_charger_hora ON meter_values(charger_id, connector, hora);
+CREATE INDEX IF NOT EXISTS meter_values_hora ON meter_values(hora);
 
--- Taula de transaccions
+-- Taula de transaccions (transaccio: transactionId, el sistema continua la numeració en arrencar)
 CREATE TABLE IF NOT EXISTS transaccions (
     id INTEGER PRIMARY KEY AUTOINCREMENT,
     charger_id INT NOT NULL,
     estat TEXT NOT NULL,
     connector INT NOT NULL,
     hora TEXT NOT NULL,
-    motiu TEXT NOT NULL
+    motiu TEXT NOT NULL,
+    transaccio INT
 );
 
--- Trigger per limitar les dades de transaccions a un màxim de 30
-CREATE TRIGGER max_transaccions BEFORE INSERT ON transaccions
-    BEGIN
-        DELETE FROM transaccions WHERE
-            hora = (SELECT min(hora) FROM transaccions)
-            and (SELECT COUNT(*) FROM transaccions) = 30;
-    END;
-
 -- Taula d'estats
 CREATE TABLE IF NOT EXISTS estats (
     id INTEGER PRIMARY KEY AUTOINCREMENT,
@@ -53,15 +42,70 @@ CREATE TABLE IF NOT EXISTS estats (
     error_code TEXT NOT NULL
 );
 
--- Trigger per limitar les dades d'estats a un màxim de 30
-CREATE TRIGGER max_estats BEFORE INSERT ON estats
-    BEGIN
-        DELETE FROM estats WHERE
-            hora = (SELECT min(hora) FROM estats)
-            and (SELECT COUNT(*) FROM estats) = 30;
-    END;
+-- Índexs de l'historial (consultes ordenades per hora, amb filtre de carregador o d'estat).
+-- Les files de meter_values, transaccions i estats no tenen límit: el sistema esborra les de més de
+-- HISTORY_RETENTION_DAYS dies (prune_history, amb l'índex d'hora)
+CREATE INDEX IF NOT EXISTS transaccions_hora ON transaccions(hora);
+CREATE INDEX IF NOT EXISTS transaccions_charger_hora ON transaccions(charger_id, hora);
+CREATE INDEX IF NOT EXISTS transaccions_estat_hora ON transaccions(estat, hora);
+CREATE INDEX IF NOT EXISTS transaccions_transaccio ON transaccions(transaccio);
+CREATE INDEX IF NOT EXISTS estats_hora ON estats(hora);
+CREATE INDEX IF NOT EXISTS estats_charger_hora ON estats(charger_id, hora);
+CREATE INDEX IF NOT EXISTS estats_estat_hora ON estats(estat, hora);
 
 -- Insereix dos usuaris
 INSERT INTO usuaris (usuari, contrasenya) VALUES
 ('sergio','7110eda4d09e062aa5e4a390b0a572ac0d2c0220'),
-('usuari','7110eda4d09e062aa5e4a390b0a572ac0d2c0220');
\ No newline at end of file
+('usuari','7110eda4d09e062aa5e4a390b0a572ac0d2c0220');
+
+-- Taula d'idTags autoritzats (expiry_date en format OCPP "AAAA-MM-DDTHH:MM:SSZ", NULL si no caduca)
+CREATE TABLE IF NOT EXISTS autoritzacions (
+    id_tag TEXT PRIMARY KEY NOT NULL COLLATE NOCASE,
+    expiry_date TEXT,
+    parent_id_tag TEXT
+);
+
+-- Insereix els idTags autoritzats per defecte
+INSERT INTO autoritzacions (id_tag) VALUES
+('12345'),
+('D0431F35'),
+('00FFFFFFFF'),
+('idTag_Charger'),
+('100');
+
+-- Taula de chargePointModels que poden fer bootNotification
+CREATE TABLE IF NOT EXISTS models_autoritzats (
+    model TEXT PRIMARY KEY NOT NULL
+);
+
+-- Insereix els chargePointModels per defecte
+INSERT INTO models_autoritzats (model) VALUES
+('MicroOcpp Simulator'),
+('model2'),
+('model3'),
+('model4'),
+('model5');
+
+-- Taula de chargePointVendors que poden fer bootNotification
+CREATE TABLE IF NOT EXISTS fabricants_autoritzats (
+    fabricant TEXT PRIMARY KEY NOT NULL
+);
+
+-- Insereix els chargePointVendors per defecte
+INSERT INTO fabricants_autoritzats (fabricant) VALUES
+('MicroOcpp'),
+('vendor2'),
+('vendor3'),
+('vendor4'),
+('vendor5');
+
+-- Cua de peticions per a carregadors desconnectats (opcio: codi de send_request, caducitat: temps Unix)
+-- identitat: número de sèrie del BootNotification, charger_id només és la posició quan es va guardar
+CREATE TABLE IF NOT EXISTS comandes_pendents (
+    id INTEGER PRIMARY KEY AUTOINCREMENT,
+    charger_id INTEGER NOT NULL,
+    identitat TEXT NOT NULL DEFAULT '',
+    opcio INTEGER NOT NULL,
+    payload TEXT NOT NULL,
+    caducitat INTEGER NOT NULL
+);
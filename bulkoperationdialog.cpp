@@ -0,0 +1,142 @@
+#include "bulkoperationdialog.h"
+#include "ui_bulkoperationdialog.h"
+#include <QListWidgetItem>
+#include <QTableWidgetItem>
+#include <vector>
+#include "nucli_sistema/ocpp_cs/ws_server.h"
+#include "nucli_sistema/ocpp_cs/charger.h"
+
+static QString estadoTexto(enum bulk_state_t state)
+{
+    switch (state) {
+    case BULK_PENDING:     return "Pendiente";
+    case BULK_IN_PROGRESS: return "Enviada";
+    case BULK_ACCEPTED:    return "Aceptada";
+    case BULK_REJECTED:    return "Rechazada";
+    case BULK_FAILED:      return "Fallida";
+    case BULK_CANCELLED:   return "Cancelada";
+    }
+
+    return QString();
+}
+
+BulkOperationDialog::BulkOperationDialog(const QList<int> &selected, QWidget *parent)
+    : QDialog(parent)
+    , ui(new Ui::BulkOperationDialog)
+{
+    ui->setupUi(this);
+    ui->paralelismo->setValue(BULK_MAX_CONCURRENCY);
+
+    // un elemento por cargador, marcados los que estaban seleccionados en la tabla de la flota
+    for (int i = 1; i <= MAX_CHARGERS; i++) {
+        struct ChargerSnapshot snap;
+        get_charger(i)->get_snapshot(snap);
+
+        QListWidgetItem *item = new QListWidgetItem(QString("Cargador %1 (%2)").arg(i).arg(snap.connected ? "conectado" : "no conectado"),
+                                                    ui->lista_cargadores);
+        item->setData(Qt::UserRole, i);
+        item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+        item->setCheckState(selected.contains(i) ? Qt::Checked : Qt::Unchecked);
+    }
+
+    // la clave y el valor solo son de ChangeConfiguration, el connectorId de las demás
+    connect(ui->operacion, &QComboBox::currentTextChanged, this, [this](const QString &op) {
+        bool config = op == "ChangeConfiguration";
+        ui->clave->setEnabled(config);
+        ui->valor->setEnabled(config);
+        ui->conector->setEnabled(!config);
+    });
+    connect(&progressTimer, &QTimer::timeout, this, &BulkOperationDialog::mostrarProgreso);
+}
+
+BulkOperationDialog::~BulkOperationDialog()
+{
+    // las peticiones ya enviadas terminan solas, la operación se libera con la última respuesta
+    if (operation)
+        operation->cancel();
+    delete ui;
+}
+
+void BulkOperationDialog::on_boton_enviar_clicked()
+{
+    std::vector<int> charger_ids;
+    for (int i = 0; i < ui->lista_cargadores->count(); i++) {
+        QListWidgetItem *item = ui->lista_cargadores->item(i);
+        if (item->checkState() == Qt::Checked)
+            charger_ids.push_back(item->data(Qt::UserRole).toInt());
+    }
+
+    if (charger_ids.empty()) {
+        ui->label_resumen->setText("No hay ningún cargador marcado");
+        return;
+    }
+
+    bulk_request_t request;
+    QString op = ui->operacion->currentText();
+    if (op.startsWith("Reset"))
+        request = bulk_reset(op.endsWith("Hard") ? TYPE_HARD : TYPE_SOFT);
+    else if (op.startsWith("ChangeAvailability"))
+        request = bulk_change_availability(ui->conector->value(), op.endsWith("Inoperative") ? TYPE_INOPERATIVE : TYPE_OPERATIVE);
+    else if (op == "UnlockConnector")
+        request = bulk_unlock_connector(ui->conector->value());
+    else if (op == "ChangeConfiguration") {
+        if (ui->clave->text().isEmpty()) {
+            ui->label_resumen->setText("Falta la clave de configuración");
+            return;
+        }
+        request = bulk_change_configuration(ui->clave->text().toStdString(), ui->valor->text().toStdString());
+    }
+    else
+        request = bulk_clear_cache();
+
+    operation = BulkOperation::create(request, charger_ids, ui->paralelismo->value(), ui->intentos->value());
+
+    ui->resultados->setRowCount(charger_ids.size());
+    ui->progreso->setMaximum(charger_ids.size());
+    ui->boton_enviar->setEnabled(false);
+    ui->boton_cancelar->setEnabled(true);
+
+    operation->start();
+    mostrarProgreso();
+    progressTimer.start(100);
+}
+
+void BulkOperationDialog::on_boton_cancelar_clicked()
+{
+    if (operation)
+        operation->cancel();
+    mostrarProgreso();
+}
+
+void BulkOperationDialog::mostrarProgreso()
+{
+    if (!operation)
+        return;
+
+    BulkProgress p = operation->progress();
+
+    for (size_t i = 0; i < p.targets.size(); i++) {
+        const BulkTarget &t = p.targets[i];
+        QString result = QString::fromStdString(t.result);
+        if (t.attempts > 1)
+            result += QString(" (%1 intentos)").arg(t.attempts);
+        QString texts[] = {QString::number(t.charger_id), estadoTexto(t.state), result};
+        for (int c = 0; c < 3; c++) {
+            QTableWidgetItem *item = ui->resultados->item(i, c);
+            if (item == nullptr)
+                ui->resultados->setItem(i, c, new QTableWidgetItem(texts[c]));
+            else if (item->text() != texts[c]) // solo se repintan las celdas que cambian
+                item->setText(texts[c]);
+        }
+    }
+
+    ui->progreso->setValue(p.done);
+    ui->label_resumen->setText(QString("%1 de %2 terminados: %3 aceptados, %4 rechazados o fallidos")
+                                   .arg(p.done).arg(p.total).arg(p.succeeded).arg(p.failed));
+
+    if (p.done == p.total) {
+        progressTimer.stop();
+        ui->boton_enviar->setEnabled(true);
+        ui->boton_cancelar->setEnabled(false);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef BULKOPERATIONDIALOG_H
+#define BULKOPERATIONDIALOG_H
+
+#include <QDialog>
+#include <QList>
+#include <QTimer>
+#include <memory>
+#include "nucli_sistema/ocpp_cs/bulk_operation.h"
+
+namespace Ui {
+class BulkOperationDialog;
+}
+
+/*
+ * Envía una operación (Reset, ChangeAvailability, UnlockConnector, ClearCache o ChangeConfiguration)
+ * a los cargadores marcados, con un límite de cargadores a la vez y de intentos por cargador, y
+ * muestra el resultado de cada uno a medida que llega. La operación sigue en los threads de los
+ * cargadores: el diálogo solo lee el progreso.
+ */
+class BulkOperationDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit BulkOperationDialog(const QList<int> &selected, QWidget *parent = nullptr);
+    ~BulkOperationDialog();
+
+private slots:
+    void on_boton_enviar_clicked();
+    void on_boton_cancelar_clicked();
+    void mostrarProgreso();
+
+private:
+    Ui::BulkOperationDialog *ui;
+    std::shared_ptr<BulkOperation> operation;
+    QTimer progressTimer; // el progreso se lee a ritmo fijo, no en cada respuesta
+};
+
+#endif // BULKOPERATIONDIALOG_H
@@ -1,7 +1,7 @@
 #include <cstdio>
 #include "changeavalilability.h"
 #include "ui_changeavalilability.h"
-#include "nucli_sistema/ocpp_cs/ws_server.h"
+#include "operationrequest.h"
 
 ChangeAvalilability::ChangeAvalilability(int connectorId, QWidget *parent)
     : QDialog(parent)
@@ -20,6 +20,12 @@ void ChangeAvalilability::on_pushButton_clicked()
 {
     char operation[256];
     snprintf(operation, sizeof(operation), "changeAvailability:{\"connectorId\":%d,\"type\":\"%s\"}", connectorId, ui->comboBox->currentText().toUtf8().constData());
-    select_request(operation);
+
+    ui->pushButton->setEnabled(false);
+    ui->label_resultado->setText("Enviando operación...");
+    sendOperation(operation, this, [this](const CallResult &result) {
+        ui->pushButton->setEnabled(true);
+        ui->label_resultado->setText(operationResultText("changeAvailability", result));
+    });
 }
 
@@ -0,0 +1,26 @@
+#include "chargerstate.h"
+#include "ipcclient.h"
+#include "nucli_sistema/ocpp_cs/ws_server.h"
+#include "nucli_sistema/ocpp_cs/fleet_state.h"
+
+bool readChargerSnapshot(int charger_id, ChargerSnapshot &snap)
+{
+    if (IpcClient *client = IpcClient::instance())
+        return client->snapshot(charger_id, snap);
+
+    Charger *charger = get_charger(charger_id);
+    if (charger == NULL)
+        return false;
+
+    // snapshot: copia consistente del cargador sin coger su mutex
+    charger->get_snapshot(snap);
+    return true;
+}
+
+void readChargerPower(int charger_id, std::vector<int32_t> &dest)
+{
+    if (IpcClient *client = IpcClient::instance())
+        client->power(charger_id, dest);
+    else
+        fleet_state.get_power(charger_id, dest);
+}
@@ -0,0 +1,16 @@
+#ifndef CHARGERSTATE_H
+#define CHARGERSTATE_H
+
+#include <vector>
+#include <cstdint>
+#include "nucli_sistema/ocpp_cs/charger.h"
+
+/*
+ * Estado de los cargadores que muestra la interfaz: del núcleo de este proceso o, si la
+ * interfaz está conectada a un ocpp_csd (--connect), el último recibido por IpcClient.
+ * Se llaman desde el thread de la interfaz.
+ */
+bool readChargerSnapshot(int charger_id, ChargerSnapshot &snap);
+void readChargerPower(int charger_id, std::vector<int32_t> &dest); // W de cada conector
+
+#endif // CHARGERSTATE_H
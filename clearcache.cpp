@@ -1,6 +1,7 @@
+#include <cstdio>
 #include "clearcache.h"
 #include "ui_clearcache.h"
-#include "nucli_sistema/ocpp_cs/ws_server.h"
+#include "operationrequest.h"
 
 ClearCache::ClearCache(int connectorId, QWidget *parent)
     : QDialog(parent)
@@ -19,6 +20,12 @@ void ClearCache::on_pushButton_2_clicked()
 {
     char operation[256];
     snprintf(operation, sizeof(operation), "clearCache:{\"connectorId\":%d}", connectorId);
-    select_request(operation);
+
+    ui->pushButton_2->setEnabled(false);
+    ui->label_resultado->setText("Enviando operación...");
+    sendOperation(operation, this, [this](const CallResult &result) {
+        ui->pushButton_2->setEnabled(true);
+        ui->label_resultado->setText(operationResultText("clearCache", result));
+    });
 }
 
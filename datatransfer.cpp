@@ -1,6 +1,7 @@
+#include <cstdio>
 #include "datatransfer.h"
 #include "ui_datatransfer.h"
-#include "nucli_sistema/ocpp_cs/ws_server.h"
+#include "operationrequest.h"
 
 DataTransfer::DataTransfer(int connectorId, QWidget *parent)
     : QDialog(parent)
@@ -19,6 +20,12 @@ void DataTransfer::on_pushButton_clicked()
 {
     char operation[256];
     snprintf(operation, sizeof(operation), "dataTransfer:{\"connectorId\":%d,\"vendorId\":\"%s\",\"messageId\":\"%s\",\"data\":\"%s\"}", connectorId, ui->lineEdit->text().toUtf8().constData(), ui->lineEdit_2->text().toUtf8().constData(), ui->plainTextEdit->toPlainText().toUtf8().constData());
-    select_request(operation);
+
+    ui->pushButton->setEnabled(false);
+    ui->label_resultado->setText("Enviando operación...");
+    sendOperation(operation, this, [this](const CallResult &result) {
+        ui->pushButton->setEnabled(true);
+        ui->label_resultado->setText(operationResultText("dataTransfer", result));
+    });
 }
 
@@ -0,0 +1,57 @@
+#include "fleetdelegate.h"
+#include "fleettablemodel.h"
+#include <QPainter>
+#include <QApplication>
+#include <QStyle>
+#include "nucli_sistema/ocpp_cs/connector_state.h"
+
+FleetDelegate::FleetDelegate(const QHash<int, QPixmap> &iconos, QObject *parent)
+    : QStyledItemDelegate(parent)
+    , iconos{iconos}
+{
+}
+
+void FleetDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    if (index.column() != FleetTableModel::ColStatus) {
+        QStyledItemDelegate::paint(painter, option, index);
+        return;
+    }
+
+    QStyleOptionViewItem opt = option;
+    initStyleOption(&opt, index);
+
+    // fondo y selección como el resto de celdas, sin texto
+    QString text = opt.text;
+    opt.text.clear();
+    const QWidget *widget = opt.widget;
+    QStyle *style = widget ? widget->style() : QApplication::style();
+    style->drawControl(QStyle::CE_ItemViewItem, &opt, painter, widget);
+
+    int size = opt.rect.height() - 4;
+    QRect icon_rect(opt.rect.left() + 2, opt.rect.top() + 2, size, size);
+    painter->drawPixmap(icon_rect, icono(index.data(Qt::UserRole).toInt(), size));
+
+    QRect text_rect = opt.rect.adjusted(size + 8, 0, 0, 0);
+    painter->save();
+    painter->setPen(opt.state & QStyle::State_Selected ? opt.palette.highlightedText().color() : opt.palette.text().color());
+    painter->drawText(text_rect, Qt::AlignLeft | Qt::AlignVCenter, text);
+    painter->restore();
+}
+
+const QPixmap &FleetDelegate::icono(int status, int size) const
+{
+    // la altura de las filas es fija: solo se vuelve a escalar si cambia
+    if (size != icono_size) {
+        iconos_escalados.clear();
+        icono_size = size;
+    }
+
+    auto it = iconos_escalados.find(status);
+    if (it == iconos_escalados.end()) {
+        QPixmap original = iconos.value(status, iconos.value(CONN_UNKNOWN));
+        it = iconos_escalados.insert(status, original.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    }
+
+    return it.value();
+}
@@ -0,0 +1,30 @@
+#ifndef FLEETDELEGATE_H
+#define FLEETDELEGATE_H
+
+#include <QStyledItemDelegate>
+#include <QHash>
+#include <QPixmap>
+
+/*
+ * Pinta la columna de estado de la tabla de la flota con el icono del estado y su nombre.
+ * Los iconos se escalan una sola vez por tamaño de fila y se guardan, así pintar una fila
+ * al hacer scroll no escala ninguna imagen.
+ */
+class FleetDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    FleetDelegate(const QHash<int, QPixmap> &iconos, QObject *parent = nullptr);
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+
+private:
+    const QPixmap &icono(int status, int size) const;
+
+    QHash<int, QPixmap> iconos;                 // CONN_<> -> icono original
+    mutable QHash<int, QPixmap> iconos_escalados; // CONN_<> -> icono escalado a icono_size
+    mutable int icono_size = 0;
+};
+
+#endif // FLEETDELEGATE_H
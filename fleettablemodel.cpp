@@ -0,0 +1,222 @@
+#include "fleettablemodel.h"
+#include <cstring>
+#include <vector>
+#include "chargerstate.h"
+#include "nucli_sistema/ocpp_cs/ws_server.h"
+
+FleetTableModel::FleetTableModel(QObject *parent)
+    : QAbstractTableModel(parent)
+{
+    reload();
+}
+
+int FleetTableModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : rows.size();
+}
+
+int FleetTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant FleetTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= rows.size())
+        return QVariant();
+
+    const FleetRow &r = rows[index.row()];
+
+    // Qt::UserRole: valor sin formato, para ordenar los números como números y para el delegate
+    if (role == Qt::UserRole) {
+        switch (index.column()) {
+        case ColCharger:     return r.charger_id;
+        case ColConnector:   return r.connector;
+        case ColStatus:      return r.status;
+        case ColIdTag:       return r.id_tag;
+        case ColTransaction: return r.transaction;
+        case ColPower:       return r.power_w;
+        }
+    }
+    else if (role == Qt::DisplayRole) {
+        switch (index.column()) {
+        case ColCharger:     return r.charger_id;
+        case ColConnector:   return r.connector == 0 ? QString("Cargador") : QString::number(r.connector);
+        case ColStatus:      return statusName(r.status);
+        case ColIdTag:       return r.id_tag;
+        case ColTransaction: return r.transaction == -1 ? QString() : QString::number(r.transaction);
+        case ColPower:       return QString::number(r.power_w / 1000.0, 'f', 1) + " kW";
+        }
+    }
+    else if (role == Qt::TextAlignmentRole) {
+        if (index.column() == ColPower || index.column() == ColTransaction)
+            return int(Qt::AlignRight | Qt::AlignVCenter);
+    }
+
+    return QVariant();
+}
+
+QVariant FleetTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QAbstractTableModel::headerData(section, orientation, role);
+
+    switch (section) {
+    case ColCharger:     return QString("Cargador");
+    case ColConnector:   return QString("Conector");
+    case ColStatus:      return QString("Estado");
+    case ColIdTag:       return QString("idTag");
+    case ColTransaction: return QString("transactionId");
+    case ColPower:       return QString("Potencia");
+    }
+
+    return QVariant();
+}
+
+QString FleetTableModel::statusName(int status)
+{
+    switch (status) {
+    case CONN_AVAILABLE:      return "Available";
+    case CONN_CHARGING:       return "Charging";
+    case CONN_FAULTED:        return "Faulted";
+    case CONN_FINISHING:      return "Finishing";
+    case CONN_PREPARING:      return "Preparing";
+    case CONN_RESERVED:       return "Reserved";
+    case CONN_SUSPENDED_EV:   return "SuspendedEV";
+    case CONN_SUSPENDED_EVSE: return "SuspendedEVSE";
+    case CONN_UNAVAILABLE:    return "Unavailable";
+    default:                  return "Unknown";
+    }
+}
+
+void FleetTableModel::reload()
+{
+    for (int i = 1; i <= MAX_CHARGERS; i++)
+        updateCharger(i);
+}
+
+void FleetTableModel::updateCharger(int charger_id)
+{
+    // snapshot: copia consistente del cargador sin coger su mutex (está en la pila, no reserva memoria)
+    struct ChargerSnapshot snap;
+    if (!readChargerSnapshot(charger_id, snap))
+        return;
+
+    std::vector<int32_t> power;
+    readChargerPower(charger_id, power);
+
+    QVector<FleetRow> fresh;
+    fresh.reserve(snap.connectors + 1);
+    for (int i = 0; i <= snap.connectors; i++) {
+        FleetRow r;
+        r.charger_id = charger_id;
+        r.connector = i;
+        r.status = snap.status[i];
+        r.id_tag = strcmp(snap.id_tag[i], "no_charging") == 0 ? QString() : QString::fromLatin1(snap.id_tag[i]);
+        r.transaction = snap.transaction[i];
+        r.power_w = (size_t)i < power.size() ? power[i] : 0;
+        fresh.append(r);
+    }
+
+    setChargerRows(charger_id, fresh);
+}
+
+void FleetTableModel::updatePower()
+{
+    std::vector<int32_t> power;
+
+    for (auto it = first_row.constBegin(); it != first_row.constEnd(); ++it) {
+        readChargerPower(it.key(), power);
+
+        // aviso de los tramos de filas seguidas que han cambiado, no de cada fila
+        int changed_from = -1;
+        int row = it.value();
+        for (; row < rows.size() && rows[row].charger_id == it.key(); row++) {
+            int connector = rows[row].connector;
+            int32_t p = (size_t)connector < power.size() ? power[connector] : 0;
+            if (rows[row].power_w != p) {
+                rows[row].power_w = p;
+                if (changed_from == -1)
+                    changed_from = row;
+            }
+            else if (changed_from != -1) {
+                emit dataChanged(index(changed_from, ColPower), index(row - 1, ColPower));
+                changed_from = -1;
+            }
+        }
+        if (changed_from != -1)
+            emit dataChanged(index(changed_from, ColPower), index(row - 1, ColPower));
+    }
+}
+
+void FleetTableModel::setChargerRows(int charger_id, const QVector<FleetRow> &fresh)
+{
+    int first;
+    int count = 0;
+
+    if (first_row.contains(charger_id)) {
+        first = first_row[charger_id];
+        while (first + count < rows.size() && rows[first + count].charger_id == charger_id)
+            count++;
+    }
+    else { // las filas están ordenadas por cargador: inserto delante del primer cargador con id mayor
+        first = 0;
+        while (first < rows.size() && rows[first].charger_id < charger_id)
+            first++;
+    }
+
+    // filas que ya existían: solo aviso de las que cambian
+    int common = qMin(count, (int)fresh.size());
+    for (int i = 0; i < common; i++)
+        updateRow(first + i, fresh[i]);
+
+    // ha cambiado el número de conectores (NumberOfConnectors)
+    if (fresh.size() > count) {
+        beginInsertRows(QModelIndex(), first + count, first + fresh.size() - 1);
+        for (int i = count; i < fresh.size(); i++)
+            rows.insert(first + i, fresh[i]);
+        endInsertRows();
+    }
+    else if (fresh.size() < count) {
+        beginRemoveRows(QModelIndex(), first + fresh.size(), first + count - 1);
+        rows.remove(first + fresh.size(), count - fresh.size());
+        endRemoveRows();
+    }
+
+    if (fresh.size() == count && first_row.contains(charger_id))
+        return;
+
+    // las posiciones de los cargadores siguientes se han movido
+    first_row.clear();
+    for (int i = 0; i < rows.size(); i++) {
+        if (i == 0 || rows[i].charger_id != rows[i - 1].charger_id)
+            first_row[rows[i].charger_id] = i;
+    }
+}
+
+void FleetTableModel::updateRow(int row, const FleetRow &fresh)
+{
+    FleetRow &r = rows[row];
+    int from = ColumnCount;
+    int to = -1;
+
+    auto mark = [&](int column) {
+        from = qMin(from, column);
+        to = qMax(to, column);
+    };
+
+    if (r.status != fresh.status)
+        mark(ColStatus);
+    if (r.id_tag != fresh.id_tag)
+        mark(ColIdTag);
+    if (r.transaction != fresh.transaction)
+        mark(ColTransaction);
+    if (r.power_w != fresh.power_w)
+        mark(ColPower);
+
+    if (to == -1)
+        return;
+
+    r = fresh;
+    emit dataChanged(index(row, from), index(row, to));
+}
@@ -0,0 +1,55 @@
+#ifndef FLEETTABLEMODEL_H
+#define FLEETTABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QVector>
+#include <QHash>
+#include <QString>
+
+// una fila por conector de cada cargador (el conector 0 es el cargador entero)
+struct FleetRow {
+    int charger_id;
+    int connector;
+    int status;        // CONN_<>
+    QString id_tag;    // vacío si no hay transacción
+    qint64 transaction; // -1 si no hay transacción
+    qint32 power_w;    // potencia actual en W
+};
+
+/*
+ * Modelo de la tabla de la flota. Las filas están ordenadas por cargador y conector y las de un
+ * cargador son consecutivas; la vista ordena y filtra con un QSortFilterProxyModel por encima.
+ * Los datos se leen del snapshot de cada cargador (sin bloquear al cargador) y de fleet_state, y
+ * solo se avisa a la vista (dataChanged) de las celdas que han cambiado, así al recibir un
+ * StatusNotification se repinta una fila y no la tabla entera.
+ */
+class FleetTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column { ColCharger, ColConnector, ColStatus, ColIdTag, ColTransaction, ColPower, ColumnCount };
+
+    explicit FleetTableModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    static QString statusName(int status);
+
+public slots:
+    void reload();                      // vuelve a leer todos los cargadores
+    void updateCharger(int charger_id); // vuelve a leer un cargador
+    void updatePower();                 // vuelve a leer la potencia de todos los conectores
+
+private:
+    void setChargerRows(int charger_id, const QVector<FleetRow> &fresh);
+    void updateRow(int row, const FleetRow &fresh);
+
+    QVector<FleetRow> rows;
+    QHash<int, int> first_row; // charger_id -> primera fila del cargador
+};
+
+#endif // FLEETTABLEMODEL_H
@@ -1,6 +1,7 @@
+#include <cstdio>
 #include "getconfiguration.h"
 #include "ui_getconfiguration.h"
-#include "nucli_sistema/ocpp_cs/ws_server.h"
+#include "operationrequest.h"
 #include <QString>
 
 GetConfiguration::GetConfiguration(int connectorId, QWidget *parent)
@@ -67,7 +68,13 @@ void GetConfiguration::on_pushButton_clicked()
 
     keys += "]}";
 
-    const char *operation = keys.toUtf8().constData();
-    select_request(operation);
+    // sendOperation guarda la copia en UTF-8 mientras la usa (antes el puntero de toUtf8() se usaba
+    // después de destruir el QByteArray temporal)
+    ui->pushButton->setEnabled(false);
+    ui->label_resultado->setText("Enviando operación...");
+    sendOperation(keys, this, [this](const CallResult &result) {
+        ui->pushButton->setEnabled(true);
+        ui->label_resultado->setText(operationResultText("getConfiguration", result));
+    });
 }
 
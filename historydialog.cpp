@@ -0,0 +1,80 @@
+#include "historydialog.h"
+#include "ui_historydialog.h"
+#include <QDateTime>
+#include <QHeaderView>
+#include "nucli_sistema/ocpp_cs/ws_server.h"
+
+// la columna hora se guarda con la hora local y una Z al final
+static std::string horaTexto(const QDateTime &time)
+{
+    return time.toString("yyyy-MM-ddTHH:mm:ssZ").toStdString();
+}
+
+HistoryDialog::HistoryDialog(QWidget *parent)
+    : QDialog(parent)
+    , ui(new Ui::HistoryDialog)
+    , model(new HistoryModel(this))
+{
+    ui->setupUi(this);
+    ui->cargador->setMaximum(MAX_CHARGERS);
+
+    QDateTime now = QDateTime::currentDateTime();
+    ui->desde->setDateTime(now.addDays(-1));
+    ui->hasta->setDateTime(now);
+    connect(ui->filtrar_desde, &QCheckBox::toggled, ui->desde, &QWidget::setEnabled);
+    connect(ui->filtrar_hasta, &QCheckBox::toggled, ui->hasta, &QWidget::setEnabled);
+
+    ui->resultados->setModel(model);
+    ui->resultados->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    ui->resultados->horizontalHeader()->setStretchLastSection(true);
+
+    connect(model, &HistoryModel::pageLoaded, this, &HistoryDialog::mostrarPagina);
+    connect(model, &HistoryModel::searchFailed, this, [this]() {
+        ui->boton_buscar->setEnabled(true);
+        ui->label_resumen->setText("Error al leer el historial de la base de datos");
+    });
+
+    on_tabla_currentIndexChanged(ui->tabla->currentIndex());
+    on_boton_buscar_clicked();
+}
+
+HistoryDialog::~HistoryDialog()
+{
+    delete ui;
+}
+
+void HistoryDialog::on_tabla_currentIndexChanged(int index)
+{
+    // los estados de cada tabla, se puede escribir otro
+    ui->estado->clear();
+    ui->estado->addItem("");
+    if (index == HISTORY_STATUS)
+        ui->estado->addItems({"Available", "Preparing", "Charging", "SuspendedEVSE", "SuspendedEV",
+                              "Finishing", "Reserved", "Unavailable", "Faulted"});
+    else
+        ui->estado->addItems({"Start", "Stop"});
+}
+
+void HistoryDialog::on_boton_buscar_clicked()
+{
+    HistoryFilter filter;
+    if (ui->cargador->value() > 0)
+        filter.charger_id = ui->cargador->value();
+    filter.connector = ui->conector->value(); // -1 es "Todos"
+    if (ui->filtrar_desde->isChecked())
+        filter.from = horaTexto(ui->desde->dateTime());
+    if (ui->filtrar_hasta->isChecked())
+        filter.to = horaTexto(ui->hasta->dateTime());
+    filter.state = ui->estado->currentText().trimmed().toStdString();
+
+    ui->boton_buscar->setEnabled(false);
+    ui->label_resumen->setText("Buscando...");
+    model->search(static_cast<history_table_t>(ui->tabla->currentIndex()), filter);
+}
+
+void HistoryDialog::mostrarPagina(int rows, bool more, qint64 ms)
+{
+    ui->boton_buscar->setEnabled(true);
+    ui->label_resumen->setText(QString("%1%2 filas (última página en %3 ms)")
+                                   .arg(rows).arg(more ? "+" : "").arg(ms));
+}
@@ -0,0 +1,33 @@
+#ifndef HISTORYDIALOG_H
+#define HISTORYDIALOG_H
+
+#include <QDialog>
+#include "historymodel.h"
+
+namespace Ui {
+class HistoryDialog;
+}
+
+/*
+ * Historial de estados y transacciones de la base de datos, con filtros de cargador, conector,
+ * intervalo de tiempo y estado. Las filas llegan por páginas a medida que se baja en la tabla.
+ */
+class HistoryDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit HistoryDialog(QWidget *parent = nullptr);
+    ~HistoryDialog();
+
+private slots:
+    void on_boton_buscar_clicked();
+    void on_tabla_currentIndexChanged(int index);
+    void mostrarPagina(int rows, bool more, qint64 ms);
+
+private:
+    Ui::HistoryDialog *ui;
+    HistoryModel *model;
+};
+
+#endif // HISTORYDIALOG_H
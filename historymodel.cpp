@@ -0,0 +1,128 @@
+#include "historymodel.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <thread>
+#include <string>
+#include "ipcclient.h"
+#include "nucli_sistema/ocpp_cs/ws_server.h"
+
+HistoryModel::HistoryModel(QObject *parent)
+    : QAbstractTableModel(parent)
+{
+}
+
+int HistoryModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : static_cast<int>(rows.size());
+}
+
+int HistoryModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant HistoryModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= static_cast<int>(rows.size()) || role != Qt::DisplayRole)
+        return QVariant();
+
+    const HistoryRow &row = rows[index.row()];
+    switch (index.column()) {
+    case ColHora:      return QString::fromStdString(row.hora);
+    case ColCharger:   return row.charger_id;
+    case ColConnector: return row.connector;
+    case ColState:     return QString::fromStdString(row.state);
+    case ColDetail:    return QString::fromStdString(row.detail);
+    }
+
+    return QVariant();
+}
+
+QVariant HistoryModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QVariant();
+
+    switch (section) {
+    case ColHora:      return "Hora";
+    case ColCharger:   return "Cargador";
+    case ColConnector: return "Conector";
+    case ColState:     return "Estado";
+    case ColDetail:    return table == HISTORY_STATUS ? "Código de error" : "Motivo";
+    }
+
+    return QVariant();
+}
+
+bool HistoryModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && more && !loading;
+}
+
+void HistoryModel::fetchMore(const QModelIndex &parent)
+{
+    if (canFetchMore(parent))
+        readPage();
+}
+
+void HistoryModel::search(enum history_table_t table, const HistoryFilter &filter)
+{
+    beginResetModel();
+    this->table = table;
+    this->filter = filter;
+    cursor = HistoryCursor();
+    rows.clear();
+    more = false;
+    generation++;
+    endResetModel();
+    emit headerDataChanged(Qt::Horizontal, ColDetail, ColDetail);
+
+    readPage();
+}
+
+void HistoryModel::readPage()
+{
+    loading = true;
+
+    // la consulta trabaja con copias: el modelo puede cambiar de búsqueda o destruirse antes de acabar
+    QPointer<HistoryModel> self(this);
+    quint64 current = generation;
+    enum history_table_t table = this->table;
+    HistoryFilter filter = this->filter;
+    HistoryCursor cursor = this->cursor;
+
+    // la base de datos del sistema de control, también si está en otro proceso (ocpp_csd)
+    IpcClient *ipc = IpcClient::instance();
+    std::string path = ipc ? ipc->databasePath() : database_path();
+
+    std::thread([=]() mutable {
+        QElapsedTimer timer;
+        timer.start();
+        std::vector<HistoryRow> page;
+        bool more = false;
+        bool ok = !path.empty() && read_history_page(path.c_str(), table, filter, cursor, page, more);
+        qint64 ms = timer.elapsed();
+
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [self, current, ok, cursor, page, more, ms]() {
+            if (!self || self->generation != current)
+                return;
+
+            self->loading = false;
+            if (!ok) {
+                emit self->searchFailed();
+                return;
+            }
+
+            if (!page.empty()) {
+                int first = static_cast<int>(self->rows.size());
+                self->beginInsertRows(QModelIndex(), first, first + static_cast<int>(page.size()) - 1);
+                self->rows.insert(self->rows.end(), page.begin(), page.end());
+                self->endInsertRows();
+            }
+            self->cursor = cursor;
+            self->more = more;
+            emit self->pageLoaded(static_cast<int>(self->rows.size()), more, ms);
+        }, Qt::QueuedConnection);
+    }).detach();
+}
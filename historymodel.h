@@ -0,0 +1,48 @@
+#ifndef HISTORYMODEL_H
+#define HISTORYMODEL_H
+
+#include <QAbstractTableModel>
+#include <vector>
+#include "nucli_sistema/ocpp_cs/history.h"
+
+/*
+ * Modelo del historial de estados o transacciones. Las filas se leen por páginas
+ * (read_history_page) a medida que la vista las necesita (fetchMore) y cada página se lee en
+ * otro thread, así una consulta lenta no bloquea la interfaz. Con una búsqueda nueva, las
+ * páginas que aún lleguen de la anterior se descartan.
+ */
+class HistoryModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column { ColHora, ColCharger, ColConnector, ColState, ColDetail, ColumnCount };
+
+    explicit HistoryModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+
+    void search(enum history_table_t table, const HistoryFilter &filter);
+
+signals:
+    void pageLoaded(int rows, bool more, qint64 ms); // rows: filas totales
+    void searchFailed();
+
+private:
+    void readPage();
+
+    enum history_table_t table = HISTORY_STATUS;
+    HistoryFilter filter;
+    HistoryCursor cursor;    // última fila leída
+    std::vector<HistoryRow> rows;
+    bool more = false;       // quedan filas por leer
+    bool loading = false;    // hay una página leyéndose
+    quint64 generation = 0;  // búsqueda actual, para descartar las páginas de las anteriores
+};
+
+#endif // HISTORYMODEL_H
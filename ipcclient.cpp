@@ -0,0 +1,180 @@
+#include "ipcclient.h"
+#include "backend_notifier.h"
+#include <QMetaObject>
+#include <cstring>
+#include "nucli_sistema/ocpp_cs/ipc_protocol.h"
+
+IpcClient *IpcClient::self = nullptr;
+
+IpcClient *IpcClient::instance()
+{
+    return self;
+}
+
+IpcClient *IpcClient::connectTo(const QString &path, QObject *parent)
+{
+    if (self == nullptr)
+        self = new IpcClient(path, parent);
+
+    return self;
+}
+
+IpcClient::IpcClient(const QString &path, QObject *parent)
+    : QObject(parent)
+    , path(path)
+{
+    connect(&socket, &QLocalSocket::connected, this, &IpcClient::onConnected);
+    connect(&socket, &QLocalSocket::readyRead, this, &IpcClient::onReadyRead);
+    connect(&socket, &QLocalSocket::disconnected, this, &IpcClient::onDisconnected);
+    connect(&socket, &QLocalSocket::errorOccurred, this, [this]() {
+        if (socket.state() == QLocalSocket::UnconnectedState)
+            reconnectTimer.start();
+    });
+
+    reconnectTimer.setInterval(1000);
+    reconnectTimer.setSingleShot(true);
+    connect(&reconnectTimer, &QTimer::timeout, this, [this]() { socket.connectToServer(this->path); });
+
+    socket.connectToServer(path);
+}
+
+bool IpcClient::snapshot(int charger_id, ChargerSnapshot &snap) const
+{
+    auto it = chargers.constFind(charger_id);
+    if (it == chargers.constEnd())
+        return false;
+
+    snap = it->snap;
+    return true;
+}
+
+void IpcClient::power(int charger_id, std::vector<int32_t> &dest) const
+{
+    auto it = chargers.constFind(charger_id);
+    if (it == chargers.constEnd())
+        dest.clear();
+    else
+        dest = it->power;
+}
+
+void IpcClient::sendOperation(const QString &operation, std::function<void(const CallResult &)> done)
+{
+    // como en el mismo proceso, el resultado siempre llega después de volver
+    if (socket.state() != QLocalSocket::ConnectedState) {
+        QMetaObject::invokeMethod(this, [done]() {
+            done({CALL_NOT_SENT, ""});
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    quint32 request_id = nextRequest++;
+    pending.insert(request_id, done);
+
+    IpcWriter w(IPC_COMMAND);
+    w.put_u32(request_id);
+    w.put_str32(operation.toStdString());
+    const std::vector<uint8_t> &frame = w.frame();
+    socket.write(reinterpret_cast<const char *>(frame.data()), frame.size());
+}
+
+std::string IpcClient::databasePath() const
+{
+    return dbPath;
+}
+
+void IpcClient::onConnected()
+{
+    // el sistema de control envía ahora el estado de todos los cargadores
+    in.clear();
+
+    // el historial se lee directamente de su base de datos (ruta absoluta)
+    sendOperation("databasePath", [this](const CallResult &result) {
+        if (result.status == CALL_ANSWERED)
+            dbPath = result.payload;
+    });
+}
+
+void IpcClient::onReadyRead()
+{
+    in.append(socket.readAll());
+
+    qsizetype pos = 0;
+    long len;
+    while ((len = ipc_frame_length(reinterpret_cast<const uint8_t *>(in.constData()) + pos, in.size() - pos)) > 0) {
+        const uint8_t *frame = reinterpret_cast<const uint8_t *>(in.constData()) + pos;
+        handleFrame(frame[4], frame + IPC_HEADER_LEN, len - IPC_HEADER_LEN);
+        pos += len;
+    }
+    in.remove(0, pos);
+
+    if (len < 0)
+        socket.abort(); // mensaje incorrecto: se vuelve a conectar
+}
+
+void IpcClient::onDisconnected()
+{
+    // las operaciones en curso ya no tendrán respuesta
+    auto failed = pending;
+    pending.clear();
+    for (auto &done : failed)
+        done({CALL_NOT_SENT, ""});
+
+    // mientras tanto los cargadores se muestran desconectados
+    for (auto it = chargers.begin(); it != chargers.end(); ++it) {
+        it->snap.connected = false;
+        BackendNotifier::instance().markDirty(it.key());
+    }
+    BackendNotifier::instance().charger_disconnected(1);
+
+    reconnectTimer.start();
+}
+
+void IpcClient::handleFrame(quint8 type, const uint8_t *body, size_t len)
+{
+    IpcReader r(body, len);
+    BackendNotifier &notifier = BackendNotifier::instance();
+
+    switch (type) {
+    case IPC_CHARGER: {
+        ChargerEntry entry;
+        if (!ipc_get_charger(r, entry.snap, entry.power))
+            return;
+        int id = entry.snap.charger_id;
+        bool known = chargers.contains(id);
+        bool was_connected = known && chargers[id].snap.connected;
+        chargers.insert(id, entry);
+
+        // al conectarse la interfaz no recibe los eventos anteriores: salen del primer estado
+        if (entry.snap.connected && !was_connected)
+            notifier.charger_connected(id);
+        if (!known && entry.snap.model[0])
+            notifier.boot_notification(id, entry.snap.model, entry.snap.vendor);
+        notifier.markDirty(id);
+        break;
+    }
+    case IPC_CONNECTED:
+        notifier.charger_connected(r.get_u16());
+        break;
+    case IPC_DISCONNECTED:
+        notifier.charger_disconnected(r.get_u16());
+        break;
+    case IPC_BOOT: {
+        int id = r.get_u16();
+        std::string model = r.get_str();
+        std::string vendor = r.get_str();
+        if (r.ok())
+            notifier.boot_notification(id, model, vendor);
+        break;
+    }
+    case IPC_RESULT: {
+        quint32 request_id = r.get_u32();
+        CallResult result;
+        result.status = static_cast<call_status_t>(r.get_u8());
+        result.payload = r.get_str32();
+        auto done = pending.take(request_id);
+        if (r.ok() && done)
+            done(result);
+        break;
+    }
+    }
+}
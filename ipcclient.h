@@ -0,0 +1,60 @@
+#ifndef IPCCLIENT_H
+#define IPCCLIENT_H
+
+#include <QObject>
+#include <QLocalSocket>
+#include <QByteArray>
+#include <QHash>
+#include <QTimer>
+#include <functional>
+#include <vector>
+#include <string>
+#include "nucli_sistema/ocpp_cs/charger.h"
+
+/*
+ * Conexión de la interfaz con un sistema de control de otro proceso (ocpp_csd) por su socket
+ * Unix (protocolo en ipc_protocol.h). Guarda el último estado recibido de cada cargador y lo
+ * pasa a la interfaz por BackendNotifier, igual que el núcleo del mismo proceso: el resto de
+ * la interfaz lo lee con readChargerSnapshot() sin saber de dónde viene. Si la conexión se
+ * pierde, se vuelve a intentar cada segundo y las operaciones en curso fallan.
+ */
+class IpcClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    static IpcClient *instance(); // nullptr si el sistema de control está en este proceso
+    static IpcClient *connectTo(const QString &path, QObject *parent = nullptr);
+
+    bool snapshot(int charger_id, ChargerSnapshot &snap) const;
+    void power(int charger_id, std::vector<int32_t> &dest) const;
+    void sendOperation(const QString &operation, std::function<void(const CallResult &)> done);
+    std::string databasePath() const; // base de datos del sistema de control, vacío si aún no se sabe
+
+private slots:
+    void onConnected();
+    void onReadyRead();
+    void onDisconnected();
+
+private:
+    explicit IpcClient(const QString &path, QObject *parent);
+    void handleFrame(quint8 type, const uint8_t *body, size_t len);
+
+    struct ChargerEntry {
+        ChargerSnapshot snap;
+        std::vector<int32_t> power;
+    };
+
+    QString path;
+    QLocalSocket socket;
+    QTimer reconnectTimer;
+    QByteArray in; // bytes de un mensaje aún incompleto
+    QHash<int, ChargerEntry> chargers;
+    QHash<quint32, std::function<void(const CallResult &)>> pending; // operaciones esperando IPC_RESULT
+    quint32 nextRequest = 1;
+    std::string dbPath;
+
+    static IpcClient *self;
+};
+
+#endif // IPCCLIENT_H
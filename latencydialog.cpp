@@ -0,0 +1,45 @@
+#include "latencydialog.h"
+#include "ui_latencydialog.h"
+#include <QFontDatabase>
+#include "operationrequest.h"
+#include "nucli_sistema/ocpp_cs/ws_server.h"
+
+LatencyDialog::LatencyDialog(QWidget *parent)
+    : QDialog(parent)
+    , ui(new Ui::LatencyDialog)
+{
+    ui->setupUi(this);
+    ui->cargador->setMaximum(MAX_CHARGERS);
+    ui->tabla->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont)); // columnas alineadas
+
+    connect(ui->boton_actualizar, &QPushButton::clicked, this, &LatencyDialog::actualizar);
+    connect(ui->cargador, &QSpinBox::valueChanged, this, &LatencyDialog::actualizar);
+
+    refreshTimer.setInterval(5000);
+    connect(&refreshTimer, &QTimer::timeout, this, &LatencyDialog::actualizar);
+    refreshTimer.start();
+
+    actualizar();
+}
+
+LatencyDialog::~LatencyDialog()
+{
+    delete ui;
+}
+
+void LatencyDialog::actualizar()
+{
+    if (waiting)
+        return;
+    waiting = true;
+
+    sendOperation(QString("latencyReport:%1").arg(ui->cargador->value()), this, [this](const CallResult &result) {
+        waiting = false;
+        if (result.status != CALL_ANSWERED)
+            ui->tabla->setPlainText(operationStatusText(result));
+        else if (result.payload.empty())
+            ui->tabla->setPlainText("Aún no se ha recibido ningún mensaje");
+        else
+            ui->tabla->setPlainText(QString::fromStdString(result.payload));
+    });
+}
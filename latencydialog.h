@@ -0,0 +1,33 @@
+#ifndef LATENCYDIALOG_H
+#define LATENCYDIALOG_H
+
+#include <QDialog>
+#include <QTimer>
+
+namespace Ui {
+class LatencyDialog;
+}
+
+/*
+ * Latencias de los mensajes recibidos de los cargadores (percentiles por acción y etapa, ver
+ * latency_report). Se piden como una operación más, así funciona también conectada a un
+ * ocpp_csd, y se vuelven a pedir cada pocos segundos.
+ */
+class LatencyDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit LatencyDialog(QWidget *parent = nullptr);
+    ~LatencyDialog();
+
+private slots:
+    void actualizar();
+
+private:
+    Ui::LatencyDialog *ui;
+    QTimer refreshTimer;
+    bool waiting = false; // hay una petición sin respuesta
+};
+
+#endif // LATENCYDIALOG_H
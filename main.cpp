@@ -1,21 +1,52 @@
 #include "mainwindow.h"
 #include <QApplication>
+#include <cstdio>
+#include <cstring>
 #include "web_socket_thread.h"
+#include "backend_notifier.h"
+#include "ipcclient.h"
+#include "nucli_sistema/ocpp_cs/startup.h"
+#include "nucli_sistema/ocpp_cs/event_sink.h"
 
 int main(int argc, char *argv[])
 {
+    // interfaz de un sistema de control que funciona en otro proceso: --connect socket
+    const char *connect_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--connect") == 0) {
+            if (i + 1 == argc) {
+                fprintf(stderr, "Falta la ruta del socket: --connect fichero\n");
+                return 1;
+            }
+            connect_path = argv[++i];
+        }
+    }
+
+    // mismas opciones que el daemon (ocpp_csd)
+    if (connect_path == NULL && !apply_core_options(argc, argv))
+        return 1;
+
     QApplication a(argc, argv);
 
     WebSocketThread wsThread;
-    wsThread.start();
+    if (connect_path) {
+        IpcClient::connectTo(QString::fromLocal8Bit(connect_path), &a);
+    }
+    else {
+        // los eventos del núcleo llegan a la interfaz como señales de BackendNotifier
+        set_event_sink(&BackendNotifier::instance());
+        wsThread.start();
+    }
 
     MainWindow w;
     w.show();
 
     int return_value = a.exec();
 
-    wsThread.quit();
-    wsThread.wait();
+    if (wsThread.isRunning()) {
+        wsThread.quit();
+        wsThread.wait();
+    }
 
     return return_value;
 }
@@ -2,6 +2,9 @@
 #include "ui_mainwindow.h"
 #include "backend_notifier.h"
 #include <QPixmap>
+#include <QLabel>
+#include <QHeaderView>
+#include "fleetdelegate.h"
 #include "changeavalilability.h"
 #include "clearcache.h"
 #include "datatransfer.h"
@@ -10,7 +13,21 @@
 #include "remotestoptransaction.h"
 #include "reset.h"
 #include "unlockconnector.h"
+#include "bulkoperationdialog.h"
+#include "statsdialog.h"
+#include "historydialog.h"
+#include "latencydialog.h"
+#include "meterchart.h"
+#include "chargerstate.h"
+#include "ipcclient.h"
 #include <QDebug>
+#include <QPointer>
+#include <QCoreApplication>
+#include <thread>
+#include "nucli_sistema/ocpp_cs/ws_server.h"
+#include "nucli_sistema/ocpp_cs/policies.h"
+#include "nucli_sistema/ocpp_cs/connector_state.h"
+#include "nucli_sistema/ocpp_cs/charger.h"
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -18,6 +35,15 @@ MainWindow::MainWindow(QWidget *parent)
 {
     ui->setupUi(this);
 
+    // conectada a un ocpp_csd: las medidas, las operaciones en bloque y las listas de
+    // autorización son del núcleo de este proceso, que no está funcionando
+    if (IpcClient::instance()) {
+        ui->tabWidget->removeTab(ui->tabWidget->indexOf(ui->Medidas));
+        ui->actionOperacionesBloque->setEnabled(false);
+        ui->actionRecargarListas->setEnabled(false);
+        setWindowTitle(windowTitle() + " (remoto)");
+    }
+
     iconos["charging"]    = QPixmap(":/resources/img/charging.png");
     iconos["fallada"]     = QPixmap(":/resources/img/fallada.png");
     iconos["unknown"]     = QPixmap(":/resources/img/unknown.png");
@@ -28,10 +54,63 @@ MainWindow::MainWindow(QWidget *parent)
     iconos["suspended_ev"]= QPixmap(":/resources/img/suspended_ev.png");
     iconos["suspended_evse"]= QPixmap(":/resources/img/suspended_evse.png");
 
+    // los iconos de los paneles se escalan una sola vez
+    QHash<int, QPixmap> iconosEstado;
+    for (int s = 0; s <= CONN_UNKNOWN; s++) {
+        iconosEstado[s] = iconoEstado(s);
+        iconosConector[s] = iconosEstado[s].scaled(100, 100, Qt::KeepAspectRatio);
+    }
+
     // pongo imagen predeterminada del estado de los cargadores
-    //QPixmap icon(":/resources/img/unknown.png");
-    ui->label_img_conector1->setPixmap(iconos["unknown"].scaled(100, 100, Qt::KeepAspectRatio));
-    ui->label_img_conector2->setPixmap(iconos["unknown"].scaled(100, 100, Qt::KeepAspectRatio));
+    ui->label_img_conector1->setPixmap(iconosConector[CONN_UNKNOWN]);
+    ui->label_img_conector2->setPixmap(iconosConector[CONN_UNKNOWN]);
+    estadoMostrado[0] = estadoMostrado[1] = CONN_UNKNOWN;
+
+    // tabla de la flota: el proxy ordena y filtra sin tocar el modelo, las filas tienen altura
+    // fija para que la vista no tenga que medir cada fila al hacer scroll
+
+    fleetModel = new FleetTableModel(this);
+    fleetProxy = new QSortFilterProxyModel(this);
+    fleetProxy->setSourceModel(fleetModel);
+    fleetProxy->setSortRole(Qt::UserRole);
+    fleetProxy->setFilterKeyColumn(-1);
+    fleetProxy->setFilterCaseSensitivity(Qt::CaseInsensitive);
+    fleetProxy->setDynamicSortFilter(true);
+
+    ui->tabla_flota->setModel(fleetProxy);
+    ui->tabla_flota->setItemDelegate(new FleetDelegate(iconosEstado, ui->tabla_flota));
+    ui->tabla_flota->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    ui->tabla_flota->verticalHeader()->setDefaultSectionSize(24);
+    ui->tabla_flota->horizontalHeader()->setStretchLastSection(true);
+    ui->tabla_flota->sortByColumn(FleetTableModel::ColCharger, Qt::AscendingOrder);
+
+    connect(ui->filtro_flota, &QLineEdit::textChanged,
+            fleetProxy, &QSortFilterProxyModel::setFilterFixedString);
+
+    connect(&fleetPowerTimer, &QTimer::timeout, fleetModel, &FleetTableModel::updatePower);
+    fleetPowerTimer.start(1000);
+
+    // gráficas de medidas del conector elegido (meter_history guarda las últimas 4 horas)
+    ui->grafica_potencia->setSeries(METER_POWER, "Potencia", "kW", 1000);
+    ui->grafica_corriente->setSeries(METER_CURRENT, "Corriente", "A");
+    ui->grafica_energia->setSeries(METER_ENERGY, "Energía", "kWh", 1000);
+
+    ui->cargador_medidas->setMaximum(MAX_CHARGERS);
+    ui->conector_medidas->setMaximum(CONN_MAX_CONNECTORS);
+    ui->ventana_medidas->addItem("5 minutos", 5 * 60);
+    ui->ventana_medidas->addItem("15 minutos", 15 * 60);
+    ui->ventana_medidas->addItem("1 hora", 60 * 60);
+    ui->ventana_medidas->addItem("4 horas", 4 * 60 * 60);
+    ui->ventana_medidas->setCurrentIndex(1);
+    cambiarMedidas();
+
+    connect(ui->cargador_medidas, &QSpinBox::valueChanged, this, &MainWindow::cambiarMedidas);
+    connect(ui->conector_medidas, &QSpinBox::valueChanged, this, &MainWindow::cambiarMedidas);
+    connect(ui->ventana_medidas, &QComboBox::currentIndexChanged, this, &MainWindow::cambiarMedidas);
+
+    // 25 frames por segundo: como mucho una actualización por cargador cada 40 ms
+    connect(&frameTimer, &QTimer::timeout, this, &MainWindow::onFrame);
+    frameTimer.start(40);
 
     connect(&BackendNotifier::instance(),
             &BackendNotifier::chargerConnected,
@@ -47,11 +126,6 @@ MainWindow::MainWindow(QWidget *parent)
             &BackendNotifier::bootNotification,
             this,
             &MainWindow::onBootNotification);
-
-    connect(&BackendNotifier::instance(),
-            &BackendNotifier::statusNotification,
-            this,
-            &MainWindow::onStatusNotification);
 }
 
 MainWindow::~MainWindow()
@@ -69,8 +143,9 @@ void MainWindow::onChargerDisconnected()
     ui->label_estado_general->setText(QString("ESTADO DEL CARGADOR 1: No conectado"));
     ui->label_model->setText("(chargePointModel: cargador no conectado)");
     ui->label_vendor->setText("(chargePointVendor: cargador no conectado)");
-    ui->label_img_conector1->setPixmap(iconos["unknown"].scaled(100, 100, Qt::KeepAspectRatio));
-    ui->label_img_conector2->setPixmap(iconos["unknown"].scaled(100, 100, Qt::KeepAspectRatio));
+    ui->label_img_conector1->setPixmap(iconosConector[CONN_UNKNOWN]);
+    ui->label_img_conector2->setPixmap(iconosConector[CONN_UNKNOWN]);
+    estadoMostrado[0] = estadoMostrado[1] = CONN_UNKNOWN;
 }
 
 void MainWindow::onBootNotification(const QString &model, const QString &vendor)
@@ -79,137 +154,179 @@ void MainWindow::onBootNotification(const QString &model, const QString &vendor)
     ui->label_vendor->setText(QString("chargePointVendor: %1").arg(vendor));
 }
 
-void MainWindow::onStatusNotification(int64_t conn1, int64_t conn2, QString id_tag1, QString id_tag2, int64_t transaction1, int64_t transaction2)
+QPixmap MainWindow::iconoEstado(qint64 status)
 {
-    qDebug() << "conn1: " << conn1 << '\n';
-    switch (conn1) {
-    case 0:
-        ui->label_img_conector1->setPixmap(iconos["disponible"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
-    case 1:
-        ui->label_img_conector1->setPixmap(iconos["charging"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
-    case 2:
-        ui->label_img_conector1->setPixmap(iconos["fallada"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
-    case 3:
-        ui->label_img_conector1->setPixmap(iconos["finishing"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
-    case 4:
-        ui->label_img_conector1->setPixmap(iconos["preparing"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
-    case 5:
-        ui->label_img_conector1->setPixmap(iconos["suspended_evse"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
-    case 6:
-        ui->label_img_conector1->setPixmap(iconos["suspended_ev"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
-    case 7:
-        ui->label_img_conector1->setPixmap(iconos["no_disponible"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
-    case 8:
-        ui->label_img_conector1->setPixmap(iconos["no_disponible"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
+    switch (status) {
+    case CONN_AVAILABLE:
+        return iconos["disponible"];
+    case CONN_CHARGING:
+        return iconos["charging"];
+    case CONN_FAULTED:
+        return iconos["fallada"];
+    case CONN_FINISHING:
+        return iconos["finishing"];
+    case CONN_PREPARING:
+        return iconos["preparing"];
+    case CONN_SUSPENDED_EV:
+        return iconos["suspended_ev"];
+    case CONN_SUSPENDED_EVSE:
+        return iconos["suspended_evse"];
+    case CONN_RESERVED: // no hay icono de reservado: el conector no está disponible para otros
+    case CONN_UNAVAILABLE:
+        return iconos["no_disponible"];
     default:
-        ui->label_img_conector1->setPixmap(iconos["unknown"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
+        return iconos["unknown"];
     }
+}
 
-    switch (conn2) {
-    case 0:
-        ui->label_img_conector2->setPixmap(iconos["disponible"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
-    case 1:
-        ui->label_img_conector2->setPixmap(iconos["charging"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
-    case 2:
-        ui->label_img_conector2->setPixmap(iconos["fallada"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
-    case 3:
-        ui->label_img_conector2->setPixmap(iconos["finishing"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
-    case 4:
-        ui->label_img_conector2->setPixmap(iconos["suspended_ev"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
-    case 5:
-        ui->label_img_conector2->setPixmap(iconos["suspended_evse"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
-    case 6:
-        ui->label_img_conector2->setPixmap(iconos["disponible"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
-    case 7:
-        ui->label_img_conector2->setPixmap(iconos["no_disponible"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
-    case 8:
-        ui->label_img_conector2->setPixmap(iconos["no_disponible"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
-    default:
-        ui->label_img_conector2->setPixmap(iconos["unknown"].scaled(100, 100, Qt::KeepAspectRatio));
-        break;
+void MainWindow::onFrame()
+{
+    // cada cargador aparece una vez aunque haya cambiado muchas veces desde el frame anterior
+    const QList<int> dirty = BackendNotifier::instance().takeDirty();
+    for (int charger_id : dirty) {
+        fleetModel->updateCharger(charger_id); // solo se repintan las filas que cambian
+        if (charger_id == 1)                   // la pestaña del cargador 1 tiene sus propios paneles
+            mostrarConectores(charger_id);
     }
+}
+
+void MainWindow::mostrarConectores(int charger_id)
+{
+    // último estado publicado por el cargador, sin esperar a su thread
+    struct ChargerSnapshot snap;
+    if (!readChargerSnapshot(charger_id, snap))
+        return;
+
+    // la ventana solo tiene los paneles de los conectores 1 y 2
+    QLabel *img[] = {ui->label_img_conector1, ui->label_img_conector2};
+    QLabel *idTag[] = {ui->label_idTag1, ui->label_idTag2};
+    QLabel *transactionId[] = {ui->label_transactionId1, ui->label_transactionId2};
+
+    for (int i = 0; i < 2; i++) {
+        int conn = i + 1;
+        int estado = snap.connected && conn <= snap.connectors ? snap.status[conn] : CONN_UNKNOWN;
+        QString id_tag = conn <= snap.connectors ? QString::fromLatin1(snap.id_tag[conn]) : "no_charging";
+        qint64 transaction = conn <= snap.connectors ? snap.transaction[conn] : -1;
 
-    if (id_tag1 == "no_charging")
-        ui->label_idTag1->setText("idTag: (cargador sin\nninguna transacción");
-    else
-        ui->label_idTag1->setText(QString("idTag: %1").arg(id_tag1));
-
-    if (id_tag2 == "no_charging")
-        ui->label_idTag2->setText("idTag: (cargador sin\nninguna transacción");
-    else
-        ui->label_idTag2->setText(QString("idTag: %1").arg(id_tag2));
-
-    if (transaction1 == -1)
-        ui->label_transactionId1->setText("transactionId: (cargador sin\nninguna transacción");
-    else
-        ui->label_transactionId1->setText(QString("transactionId: %1").arg(transaction1));
-
-    if (transaction2 == -1)
-        ui->label_transactionId2->setText("transactionId: (cargador sin\nninguna transacción");
-    else
-        ui->label_transactionId2->setText(QString("transactionId: %1").arg(transaction2));
+        if (estado != estadoMostrado[i]) {
+            img[i]->setPixmap(iconosConector.value(estado, iconosConector[CONN_UNKNOWN]));
+            estadoMostrado[i] = estado;
+        }
+
+        if (id_tag == "no_charging")
+            idTag[i]->setText("idTag: (cargador sin\nninguna transacción");
+        else
+            idTag[i]->setText(QString("idTag: %1").arg(id_tag));
+
+        if (transaction == -1)
+            transactionId[i]->setText("transactionId: (cargador sin\nninguna transacción");
+        else
+            transactionId[i]->setText(QString("transactionId: %1").arg(transaction));
+    }
 }
 
 void MainWindow::on_mostrar_operacion1_clicked()
 {
-    if (ui->operaciones1->currentText() == "ChangeAvailability") {
-        ChangeAvalilability changeAvailability(1, this);
-        changeAvailability.setModal(true);
-        changeAvailability.exec();
-    }
-    else if (ui->operaciones1->currentText() == "ClearCache") {
-        ClearCache clearCache(1, this);
-        clearCache.setModal(true);
-        clearCache.exec();
-    }
-    else if (ui->operaciones1->currentText() == "DataTransfer") {
-        DataTransfer dataTransfer(1, this);
-        dataTransfer.setModal(true);
-        dataTransfer.exec();
-    }
-    else if (ui->operaciones1->currentText() == "GetConfiguration") {
-        GetConfiguration getConfiguration(1, this);
-        getConfiguration.setModal(true);
-        getConfiguration.exec();
-    }
-    else if (ui->operaciones1->currentText() == "RemoteStartTransaction") {
-        RemoteStartTransaction remoteStartTransaction(1, this);
-        remoteStartTransaction.setModal(true);
-        remoteStartTransaction.exec();
-    }
-    else if (ui->operaciones1->currentText() == "RemoteStopTransaction") {
-        RemoteStopTransaction remoteStopTransaction(1, this);
-        remoteStopTransaction.setModal(true);
-        remoteStopTransaction.exec();
-    }
-    else if (ui->operaciones1->currentText() == "Reset") {
-        Reset reset(1, this);
-        reset.setModal(true);
-        reset.exec();
-    }
-    else if (ui->operaciones1->currentText() == "UnlockConnector") {
-        UnlockConnector unlockConnector(1, this);
-        unlockConnector.setModal(true);
-        unlockConnector.exec();
+    // los diálogos no son modales: la ventana sigue funcionando mientras se espera la respuesta,
+    // y cada diálogo se borra solo al cerrarlo (la respuesta que llegue después se descarta)
+    QDialog *dialog = nullptr;
+
+    if (ui->operaciones1->currentText() == "ChangeAvailability")
+        dialog = new ChangeAvalilability(1, this);
+    else if (ui->operaciones1->currentText() == "ClearCache")
+        dialog = new ClearCache(1, this);
+    else if (ui->operaciones1->currentText() == "DataTransfer")
+        dialog = new DataTransfer(1, this);
+    else if (ui->operaciones1->currentText() == "GetConfiguration")
+        dialog = new GetConfiguration(1, this);
+    else if (ui->operaciones1->currentText() == "RemoteStartTransaction")
+        dialog = new RemoteStartTransaction(1, this);
+    else if (ui->operaciones1->currentText() == "RemoteStopTransaction")
+        dialog = new RemoteStopTransaction(1, this);
+    else if (ui->operaciones1->currentText() == "Reset")
+        dialog = new Reset(1, this);
+    else if (ui->operaciones1->currentText() == "UnlockConnector")
+        dialog = new UnlockConnector(1, this);
+
+    if (dialog == nullptr)
+        return;
+
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->show();
+}
+
+
+void MainWindow::on_actionRecargarListas_triggered()
+{
+    ui->actionRecargarListas->setEnabled(false);
+    ui->statusbar->showMessage("Recargando listas de autorización...");
+
+    // la recarga se hace en otro thread, los cargadores siguen usando las listas anteriores mientras tanto.
+    // El thread no usa la ventana, que se puede cerrar antes de que acabe
+    QPointer<MainWindow> self(this);
+    std::thread([self]() {
+        bool ok = reload_policies(database_path());
+        uint64_t version = policies_version();
+
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [self, ok, version]() {
+            if (!self)
+                return;
+
+            self->ui->actionRecargarListas->setEnabled(true);
+            if (ok)
+                self->ui->statusbar->showMessage(QString("Listas de autorización recargadas (versión %1)").arg(version), 5000);
+            else
+                self->ui->statusbar->showMessage("Error al recargar las listas de autorización", 5000);
+        }, Qt::QueuedConnection);
+    }).detach();
+}
+
+void MainWindow::on_actionOperacionesBloque_triggered()
+{
+    // los cargadores de las filas seleccionadas en la tabla de la flota salen ya marcados
+    QList<int> selected;
+    const QModelIndexList rows = ui->tabla_flota->selectionModel()->selectedRows(FleetTableModel::ColCharger);
+    for (const QModelIndex &index : rows) {
+        int charger_id = index.data(Qt::UserRole).toInt();
+        if (!selected.contains(charger_id))
+            selected.append(charger_id);
     }
+
+    BulkOperationDialog *dialog = new BulkOperationDialog(selected, this);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->show();
+}
+
+void MainWindow::on_actionEstadisticas_triggered()
+{
+    StatsDialog *dialog = new StatsDialog(this);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->show();
+}
+
+void MainWindow::on_actionHistorial_triggered()
+{
+    // se lee de la base de datos, también conectada a un ocpp_csd (el socket es local)
+    HistoryDialog *dialog = new HistoryDialog(this);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->show();
 }
 
+void MainWindow::on_actionLatencias_triggered()
+{
+    LatencyDialog *dialog = new LatencyDialog(this);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->show();
+}
+
+void MainWindow::cambiarMedidas()
+{
+    int charger_id = ui->cargador_medidas->value();
+    int connector = ui->conector_medidas->value();
+    int window = ui->ventana_medidas->currentData().toInt();
+
+    for (MeterChart *chart : {ui->grafica_potencia, ui->grafica_corriente, ui->grafica_energia}) {
+        chart->setSource(charger_id, connector);
+        chart->setWindow(window);
+    }
+}
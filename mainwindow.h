@@ -2,6 +2,12 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QSortFilterProxyModel>
+#include <QTimer>
+#include <QMap>
+#include <QHash>
+#include <QPixmap>
+#include "fleettablemodel.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -21,13 +27,32 @@ public slots:
     void onChargerConnected();
     void onChargerDisconnected();
     void onBootNotification(const QString &model, const QString &vendor);
-    void onStatusNotification(int64_t conn1, int64_t conn2, QString id_tag1, QString id_tag2, int64_t transaction1, int64_t transaction2);
+    void onFrame(); // aplica los cambios acumulados desde el frame anterior
 
 private slots:
     void on_mostrar_operacion1_clicked();
+    void on_actionRecargarListas_triggered();
+    void on_actionOperacionesBloque_triggered();
+    void on_actionEstadisticas_triggered();
+    void on_actionHistorial_triggered();
+    void on_actionLatencias_triggered();
+    void cambiarMedidas(); // cargador, conector o intervalo de las gráficas
 
 private:
+    QPixmap iconoEstado(qint64 status);
+    void mostrarConectores(int charger_id);
+
     Ui::MainWindow *ui;
     QMap<QString, QPixmap> iconos;
+    QHash<int, QPixmap> iconosConector; // iconos de estado ya escalados para los paneles de los conectores
+    int estadoMostrado[2];              // estado que muestra cada panel, para no repintar si no cambia
+
+    // los cambios del backend se aplican a ritmo fijo (BackendNotifier::takeDirty)
+    QTimer frameTimer;
+
+    // pestaña de la flota: una fila por conector de cada cargador
+    FleetTableModel *fleetModel;
+    QSortFilterProxyModel *fleetProxy;
+    QTimer fleetPowerTimer; // la potencia llega con MeterValues, se relee cada segundo
 };
 #endif // MAINWINDOW_H
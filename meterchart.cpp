@@ -0,0 +1,143 @@
+#include "meterchart.h"
+#include <QPainter>
+#include <QPaintEvent>
+#include <QResizeEvent>
+#include <QLineF>
+#include <cmath>
+#include <ctime>
+
+// márgenes del área de la gráfica: título arriba, escala a la izquierda y tiempo abajo
+static const int MARGIN_LEFT = 56;
+static const int MARGIN_TOP = 20;
+static const int MARGIN_RIGHT = 8;
+static const int MARGIN_BOTTOM = 18;
+
+MeterChart::MeterChart(QWidget *parent)
+    : QWidget(parent)
+{
+    setAttribute(Qt::WA_OpaquePaintEvent); // se pinta todo el fondo, Qt no tiene que borrarlo antes
+
+    // solo se repinta si la gráfica se ve (update() no hace nada con el widget oculto)
+    connect(&refreshTimer, &QTimer::timeout, this, QOverload<>::of(&QWidget::update));
+    refreshTimer.start(1000);
+}
+
+void MeterChart::setSeries(meter_series_t series, const QString &title, const QString &unit, double scale)
+{
+    this->series = series;
+    this->title = title;
+    this->unit = unit;
+    this->scale = scale;
+    update();
+}
+
+void MeterChart::setSource(int charger_id, int connector)
+{
+    this->charger_id = charger_id;
+    this->connector = connector;
+    update();
+}
+
+void MeterChart::setWindow(int seconds)
+{
+    window = qMax(seconds, 1);
+    update();
+}
+
+QSize MeterChart::sizeHint() const
+{
+    return QSize(400, 150);
+}
+
+void MeterChart::resizeEvent(QResizeEvent *event)
+{
+    int columns = qMax(event->size().width() - MARGIN_LEFT - MARGIN_RIGHT, 0);
+    mins.resize(columns);
+    maxs.resize(columns);
+    QWidget::resizeEvent(event);
+}
+
+void MeterChart::paintEvent(QPaintEvent *)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), palette().base());
+
+    QRect area(MARGIN_LEFT, MARGIN_TOP, mins.size(), height() - MARGIN_TOP - MARGIN_BOTTOM);
+
+    // título con el último valor
+    QString text = title;
+    MeterSample last;
+    if (meter_history.last(charger_id, connector, series, last))
+        text += QString(": %1 %2").arg(last.value / scale, 0, 'f', 2).arg(unit);
+    painter.setPen(palette().text().color());
+    painter.drawText(QRect(MARGIN_LEFT, 0, area.width(), MARGIN_TOP), Qt::AlignLeft | Qt::AlignVCenter, text);
+
+    painter.setPen(palette().mid().color());
+    painter.drawRect(area.adjusted(0, 0, -1, -1));
+
+    if (area.width() <= 0 || area.height() <= 0)
+        return;
+
+    time_t to = time(NULL) + 1;
+    time_t from = to - window;
+    int filled = meter_history.decimate(charger_id, connector, series, from, to, mins.size(), mins.data(), maxs.data());
+
+    painter.setPen(palette().text().color());
+    painter.drawText(QRect(MARGIN_LEFT, area.bottom(), area.width(), MARGIN_BOTTOM), Qt::AlignLeft | Qt::AlignVCenter,
+                     QString("-%1 min").arg(window / 60.0, 0, 'f', window < 60 ? 1 : 0));
+    painter.drawText(QRect(MARGIN_LEFT, area.bottom(), area.width(), MARGIN_BOTTOM), Qt::AlignRight | Qt::AlignVCenter,
+                     "ahora");
+
+    if (filled == 0) {
+        painter.drawText(area, Qt::AlignCenter, "Sin medidas");
+        return;
+    }
+
+    // escala vertical con todos los valores del intervalo
+    float lo = INFINITY, hi = -INFINITY;
+    for (int i = 0; i < mins.size(); i++) {
+        if (!std::isnan(mins[i])) {
+            lo = qMin(lo, mins[i]);
+            hi = qMax(hi, maxs[i]);
+        }
+    }
+    if (hi - lo < 1e-3f) { // valor constante: lo centro
+        lo -= 1;
+        hi += 1;
+    }
+
+    painter.drawText(QRect(0, area.top(), MARGIN_LEFT - 4, 16), Qt::AlignRight | Qt::AlignTop,
+                     QString::number(hi / scale, 'g', 4));
+    painter.drawText(QRect(0, area.bottom() - 16, MARGIN_LEFT - 4, 16), Qt::AlignRight | Qt::AlignBottom,
+                     QString::number(lo / scale, 'g', 4));
+
+    double ky = (area.height() - 1) / double(hi - lo);
+    auto y = [&](float v) { return area.bottom() - (v - lo) * ky; };
+
+    // una línea vertical por columna, del mínimo al máximo; se alarga hasta la columna anterior
+    // para que la traza sea continua cuando el valor cambia de golpe
+    QVector<QLineF> lines;
+    lines.reserve(filled);
+    float prev_min = NAN, prev_max = NAN;
+    for (int i = 0; i < mins.size(); i++) {
+        if (std::isnan(mins[i]))
+            continue;
+
+        float a = mins[i], b = maxs[i];
+        if (!std::isnan(prev_min)) {
+            a = qMin(a, prev_max);
+            b = qMax(b, prev_min);
+        }
+        double x = area.left() + i + 0.5;
+        double ya = y(a), yb = y(b);
+        if (ya - yb < 1) // como mínimo un píxel, una línea de largo 0 no se pinta
+            yb = ya - 1;
+        lines.append(QLineF(x, ya, x, yb));
+
+        prev_min = mins[i];
+        prev_max = maxs[i];
+    }
+
+    painter.setPen(QPen(palette().highlight().color(), 1));
+    painter.drawLines(lines);
+}
@@ -0,0 +1,47 @@
+#ifndef METERCHART_H
+#define METERCHART_H
+
+#include <QWidget>
+#include <QTimer>
+#include <QVector>
+#include "nucli_sistema/ocpp_cs/meter_history.h"
+
+/*
+ * Gráfica en tiempo real de una magnitud (potencia, corriente o energía) de un conector.
+ * Cada segundo pide a meter_history el mínimo y el máximo de cada columna de píxeles del
+ * intervalo que se muestra y pinta una línea vertical por columna: el coste de pintar depende
+ * del ancho del widget y no del número de muestras, y los picos no se pierden al reducir.
+ */
+class MeterChart : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit MeterChart(QWidget *parent = nullptr);
+
+    void setSeries(meter_series_t series, const QString &title, const QString &unit, double scale = 1);
+    void setSource(int charger_id, int connector);
+    void setWindow(int seconds); // segundos que se muestran, hasta ahora
+
+    QSize sizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+
+private:
+    meter_series_t series = METER_POWER;
+    QString title;
+    QString unit;
+    double scale = 1; // el valor mostrado es el guardado entre scale (p.ej. W -> kW)
+
+    int charger_id = 1;
+    int connector = 1;
+    int window = 900;
+
+    QVector<float> mins; // una columna por píxel del área de la gráfica, se reservan al cambiar de tamaño
+    QVector<float> maxs;
+    QTimer refreshTimer;
+};
+
+#endif // METERCHART_H
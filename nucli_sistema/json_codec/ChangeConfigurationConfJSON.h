@@ -0,0 +1,20 @@
+#ifndef _CHANGECONFIGURATIONCONFJSON_H_
+#define _CHANGECONFIGURATIONCONFJSON_H_
+
+#include <cJSON.h>
+
+enum Status_ChangeConfiguration {
+    STATUS_CHANGE_CONFIGURATION_ACCEPTED,
+    STATUS_CHANGE_CONFIGURATION_NOT_SUPPORTED,
+    STATUS_CHANGE_CONFIGURATION_REBOOT_REQUIRED,
+    STATUS_CHANGE_CONFIGURATION_REJECTED,
+};
+
+struct ChangeConfigurationConf {
+    enum Status_ChangeConfiguration status;
+};
+
+struct ChangeConfigurationConf * cJSON_ParseChangeConfigurationConf(const char * s);
+char * cJSON_PrintChangeConfigurationConf(const struct ChangeConfigurationConf * x);
+
+#endif
@@ -0,0 +1,130 @@
+/**
+ * stdout
+ * This file has been autogenerated using quicktype https://github.com/quicktype/quicktype - DO NOT EDIT
+ * This file depends of https://github.com/DaveGamble/cJSON, https://github.com/joelguittet/c-list and https://github.com/joelguittet/c-hashtable
+ * To parse json data from json string use the following: struct <type> * data = cJSON_Parse<type>(<string>);
+ * To get json data from cJSON object use the following: struct <type> * data = cJSON_Get<type>Value(<cjson>);
+ * To get cJSON object from json data use the following: cJSON * cjson = cJSON_Create<type>(<data>);
+ * To print json string from json data use the following: char * string = cJSON_Print<type>(<data>);
+ * To delete json data use the following: cJSON_Delete<type>(<data>);
+ */
+
+#ifndef __STDOUT__
+#define __STDOUT__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cJSON.h>
+#include <hashtable.h>
+#include <list.h>
+#include "ChangeConfigurationReqJSON.h"
+#include "mystrdup.h"
+
+#ifndef cJSON_Bool
+#define cJSON_Bool (cJSON_True | cJSON_False)
+#endif
+#ifndef cJSON_Map
+#define cJSON_Map (1 << 16)
+#endif
+#ifndef cJSON_Enum
+#define cJSON_Enum (1 << 17)
+#endif
+
+static struct ChangeConfigurationReq * cJSON_GetChangeConfigurationReqValue(const cJSON * j);
+static cJSON * cJSON_CreateChangeConfigurationReq(const struct ChangeConfigurationReq * x);
+static void cJSON_DeleteChangeConfigurationReq(struct ChangeConfigurationReq * x);
+
+struct ChangeConfigurationReq * cJSON_ParseChangeConfigurationReq(const char * s) {
+    struct ChangeConfigurationReq * x = NULL;
+    if (NULL != s) {
+        cJSON * j = cJSON_Parse(s);
+        if (NULL != j) {
+            x = cJSON_GetChangeConfigurationReqValue(j);
+            cJSON_Delete(j);
+        }
+    }
+    return x;
+}
+
+static struct ChangeConfigurationReq * cJSON_GetChangeConfigurationReqValue(const cJSON * j) {
+    struct ChangeConfigurationReq * x = NULL;
+    if (NULL != j) {
+        if (NULL != (x = cJSON_malloc(sizeof(struct ChangeConfigurationReq)))) {
+            memset(x, 0, sizeof(struct ChangeConfigurationReq));
+            if (cJSON_HasObjectItem(j, "key")) {
+                x->key = mystrdup(cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(j, "key")));
+            }
+            else {
+                if (NULL != (x->key = cJSON_malloc(sizeof(char)))) {
+                    x->key[0] = '\0';
+                }
+            }
+            if (cJSON_HasObjectItem(j, "value")) {
+                x->value = mystrdup(cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(j, "value")));
+            }
+            else {
+                if (NULL != (x->value = cJSON_malloc(sizeof(char)))) {
+                    x->value[0] = '\0';
+                }
+            }
+        }
+    }
+    return x;
+}
+
+static cJSON * cJSON_CreateChangeConfigurationReq(const struct ChangeConfigurationReq * x) {
+    cJSON * j = NULL;
+    if (NULL != x) {
+        if (NULL != (j = cJSON_CreateObject())) {
+            if (NULL != x->key) {
+                cJSON_AddStringToObject(j, "key", x->key);
+            }
+            else {
+                cJSON_AddStringToObject(j, "key", "");
+            }
+            if (NULL != x->value) {
+                cJSON_AddStringToObject(j, "value", x->value);
+            }
+            else {
+                cJSON_AddStringToObject(j, "value", "");
+            }
+        }
+    }
+    return j;
+}
+
+char * cJSON_PrintChangeConfigurationReq(const struct ChangeConfigurationReq * x) {
+    char * s = NULL;
+    if (NULL != x) {
+        cJSON * j = cJSON_CreateChangeConfigurationReq(x);
+        if (NULL != j) {
+            s = cJSON_Print(j);
+            cJSON_Delete(j);
+        }
+    }
+    return s;
+}
+
+static void cJSON_DeleteChangeConfigurationReq(struct ChangeConfigurationReq * x) {
+    if (NULL != x) {
+        if (NULL != x->key) {
+            cJSON_free(x->key);
+        }
+        if (NULL != x->value) {
+            cJSON_free(x->value);
+        }
+        cJSON_free(x);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STDOUT__ */
@@ -0,0 +1,669 @@
+/*
+ *  FILE
+ *      auth_list.cpp - lista de idTags autorizados
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Lista de idTags autorizados. Se guarda en la tabla autoritzacions de la base de datos
+ *      y se carga al iniciar el sistema en un IdTagSet (tabla hash con direccionamiento abierto),
+ *      de manera que el Authorize, StartTransaction y StopTransaction no recorren la lista.
+ *      También permite importar idTags en bloque de un fichero CSV.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+#include <mutex>
+#include <syslog.h>
+#include <sqlite3.h>
+#include "auth_list.h"
+
+#define MAX_LOAD_NUM 7  // factor de carga máximo de la tabla: MAX_LOAD_NUM / MAX_LOAD_DEN
+#define MAX_LOAD_DEN 10
+#define MIN_CAPACITY 16
+
+using namespace std;
+
+
+// idTags que se insertan al crear la tabla por primera vez
+static const char *default_id_tags[] = {
+    "12345",
+    "D0431F35",
+    "00FFFFFFFF",
+    "idTag_Charger",
+    "100"
+};
+
+// conexión y consulta de lookup_auth_record, abiertas en la primera búsqueda
+static mutex lookup_mtx;
+static string lookup_path;
+static sqlite3 *lookup_db = NULL;
+static sqlite3_stmt *lookup_stmt = NULL;
+
+static bool open_auth_table(const char *db_path, sqlite3 **db);
+static bool migrate_auth_collation(sqlite3 *db);
+static char canonical(char c);
+
+/*
+ *  NAME
+ *      canonical - Forma canónica de un carácter de un idTag.
+ *  SYNOPSIS
+ *      static char canonical(char c);
+ *  DESCRIPTION
+ *      Los idTags son CiString20 (no distinguen mayúsculas y minúsculas): todas las comparaciones
+ *      de idTags del sistema usan la mayúscula ASCII de cada carácter, como COLLATE NOCASE de la
+ *      tabla autoritzacions.
+ *  RETURN VALUE
+ *      El carácter en mayúscula.
+ */
+static char canonical(char c)
+{
+    return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+}
+
+/*
+ *  NAME
+ *      id_tag_key - Devuelve la forma canónica de un idTag.
+ *  SYNOPSIS
+ *      string id_tag_key(const string &id_tag);
+ *  DESCRIPTION
+ *      Devuelve el idTag en mayúsculas ASCII. Es la clave de los idTags en IdTagSet, la caché
+ *      de IdTagInfo, el índice de transacciones y las consultas al sistema externo, de manera
+ *      que todos coinciden en qué idTags son el mismo.
+ *  RETURN VALUE
+ *      Un string con la clave.
+ */
+string id_tag_key(const string &id_tag)
+{
+    string k = id_tag;
+    for (auto &c : k)
+        c = canonical(c);
+
+    return k;
+}
+
+/*
+ *  NAME
+ *      IdTagSet - Constructor de la clase IdTagSet
+ *  SYNOPSIS
+ *      IdTagSet();
+ *  DESCRIPTION
+ *      IdTagSet - Constructor de la clase IdTagSet. Crea el conjunto vacío.
+ *  RETURN VALUE
+ *      Nada.
+ */
+IdTagSet::IdTagSet() : table(MIN_CAPACITY), count{0} {}
+
+/*
+ *  NAME
+ *      pack - Pasa un idTag a ancho fijo.
+ *  SYNOPSIS
+ *      static bool pack(const char *id_tag, slot_t &dest);
+ *  DESCRIPTION
+ *      Copia la forma canónica del idTag (ver id_tag_key) en dest rellenando con '\0' hasta
+ *      ID_TAG_LEN bytes.
+ *  RETURN VALUE
+ *      Devuelve true si todo va bien.
+ *      Devuelve false si el idTag es NULL, está vacío o es más largo que ID_TAG_LEN.
+ */
+bool IdTagSet::pack(const char *id_tag, slot_t &dest)
+{
+    if (id_tag == NULL)
+        return false;
+
+    size_t len = strnlen(id_tag, ID_TAG_LEN + 1);
+    if (len == 0 || len > ID_TAG_LEN)
+        return false;
+
+    memset(dest.tag, 0, sizeof(dest.tag));
+    for (size_t i = 0; i < len; i++)
+        dest.tag[i] = canonical(id_tag[i]);
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      hash - Calcula el hash de un idTag.
+ *  SYNOPSIS
+ *      static uint64_t hash(const slot_t &key);
+ *  DESCRIPTION
+ *      Calcula el hash FNV-1a de los ID_TAG_LEN bytes del idTag.
+ *  RETURN VALUE
+ *      El hash.
+ */
+uint64_t IdTagSet::hash(const slot_t &key)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < ID_TAG_LEN; i++) {
+        h ^= static_cast<unsigned char>(key.tag[i]);
+        h *= 1099511628211ULL;
+    }
+
+    return h ^ (h >> 32);
+}
+
+/*
+ *  NAME
+ *      rehash - Cambia la capacidad de la tabla.
+ *  SYNOPSIS
+ *      void rehash(size_t new_capacity);
+ *  DESCRIPTION
+ *      Crea una tabla nueva con new_capacity posiciones (potencia de 2) y vuelve a insertar
+ *      todos los idTags.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void IdTagSet::rehash(size_t new_capacity)
+{
+    vector<slot_t> old(new_capacity);
+    old.swap(table);
+
+    size_t mask = table.size() - 1;
+    for (auto &elem : old) {
+        if (elem.tag[0] == '\0')
+            continue;
+
+        size_t i = hash(elem) & mask;
+        while (table[i].tag[0] != '\0')
+            i = (i + 1) & mask;
+        table[i] = elem;
+    }
+}
+
+/*
+ *  NAME
+ *      reserve - Prepara la tabla para n idTags.
+ *  SYNOPSIS
+ *      void reserve(size_t n);
+ *  DESCRIPTION
+ *      Aumenta la capacidad de la tabla para poder guardar n idTags sin superar el factor
+ *      de carga máximo. Se usa antes de una carga en bloque para no hacer rehash durante la carga.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void IdTagSet::reserve(size_t n)
+{
+    size_t capacity = table.size();
+    while (n * MAX_LOAD_DEN > capacity * MAX_LOAD_NUM)
+        capacity *= 2;
+
+    if (capacity != table.size())
+        rehash(capacity);
+}
+
+/*
+ *  NAME
+ *      insert - Añade un idTag.
+ *  SYNOPSIS
+ *      bool insert(const char *id_tag);
+ *  DESCRIPTION
+ *      Añade un idTag al conjunto. Si se supera el factor de carga máximo se dobla la capacidad.
+ *  RETURN VALUE
+ *      Devuelve true si se ha añadido.
+ *      Devuelve false si el idTag no es válido o ya estaba.
+ */
+bool IdTagSet::insert(const char *id_tag)
+{
+    slot_t key;
+    if (!pack(id_tag, key))
+        return false;
+
+    reserve(count + 1);
+
+    size_t mask = table.size() - 1;
+    size_t i = hash(key) & mask;
+    while (table[i].tag[0] != '\0') {
+        if (memcmp(table[i].tag, key.tag, ID_TAG_LEN) == 0) // ya estaba
+            return false;
+        i = (i + 1) & mask;
+    }
+
+    table[i] = key;
+    count++;
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      contains - Indica si un idTag está en el conjunto.
+ *  SYNOPSIS
+ *      bool contains(const char *id_tag) const;
+ *  DESCRIPTION
+ *      Busca el idTag en la tabla. No distingue mayúsculas y minúsculas.
+ *  RETURN VALUE
+ *      Devuelve true si está.
+ *      Devuelve false en caso contrario.
+ */
+bool IdTagSet::contains(const char *id_tag) const
+{
+    slot_t key;
+    if (!pack(id_tag, key))
+        return false;
+
+    size_t mask = table.size() - 1;
+    size_t i = hash(key) & mask;
+    while (table[i].tag[0] != '\0') {
+        if (memcmp(table[i].tag, key.tag, ID_TAG_LEN) == 0)
+            return true;
+        i = (i + 1) & mask;
+    }
+
+    return false;
+}
+
+/*
+ *  NAME
+ *      clear - Vacía el conjunto.
+ *  SYNOPSIS
+ *      void clear();
+ *  DESCRIPTION
+ *      Vacía el conjunto y libera la tabla.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void IdTagSet::clear()
+{
+    vector<slot_t>(MIN_CAPACITY).swap(table);
+    count = 0;
+}
+
+/*
+ *  NAME
+ *      size - Devuelve el número de idTags.
+ *  SYNOPSIS
+ *      size_t size() const;
+ *  DESCRIPTION
+ *      Devuelve el número de idTags del conjunto.
+ *  RETURN VALUE
+ *      El número de idTags.
+ */
+size_t IdTagSet::size() const
+{
+    return count;
+}
+
+/*
+ *  NAME
+ *      memory_usage - Devuelve los bytes ocupados por la tabla.
+ *  SYNOPSIS
+ *      size_t memory_usage() const;
+ *  DESCRIPTION
+ *      Devuelve los bytes ocupados por la tabla, incluidas las posiciones vacías.
+ *  RETURN VALUE
+ *      El número de bytes.
+ */
+size_t IdTagSet::memory_usage() const
+{
+    return sizeof(*this) + table.size() * sizeof(slot_t);
+}
+
+/*
+ *  NAME
+ *      memory_per_tag - Devuelve los bytes por idTag.
+ *  SYNOPSIS
+ *      double memory_per_tag() const;
+ *  DESCRIPTION
+ *      Devuelve los bytes ocupados por la tabla divididos por el número de idTags.
+ *      Con el factor de carga entre 0.35 y 0.7 queda entre 29 y 58 bytes por idTag.
+ *  RETURN VALUE
+ *      Los bytes por idTag, 0 si el conjunto está vacío.
+ */
+double IdTagSet::memory_per_tag() const
+{
+    if (count == 0)
+        return 0;
+
+    return static_cast<double>(memory_usage()) / count;
+}
+
+/*
+ *  NAME
+ *      open_auth_table - Abre la base de datos y crea la tabla autoritzacions.
+ *  SYNOPSIS
+ *      static bool open_auth_table(const char *db_path, sqlite3 **db);
+ *  DESCRIPTION
+ *      Abre la base de datos y crea la tabla autoritzacions si no existe. Si se acaba de
+ *      crear, inserta los idTags por defecto. Si la tabla es de una versión anterior,
+ *      le añade las columnas expiry_date y parent_id_tag y, si su id_tag distingue
+ *      mayúsculas, la rehace con COLLATE NOCASE (migrate_auth_collation).
+ *  RETURN VALUE
+ *      Devuelve true si todo va bien.
+ *      Devuelve false en caso contrario.
+ */
+static bool open_auth_table(const char *db_path, sqlite3 **db)
+{
+    int rc = sqlite3_open(db_path, db);
+    if (rc != SQLITE_OK) {
+        syslog(LOG_ERR, "%s: ERROR opening SQLite DB: %s\n", __func__, sqlite3_errmsg(*db));
+        sqlite3_close(*db);
+        return false;
+    }
+    sqlite3_busy_timeout(*db, 1000);
+
+    // miro si la tabla existe para insertar los idTags por defecto solo la primera vez
+    sqlite3_stmt *stmt;
+    bool exists = false;
+    bool nocase = false;
+    if (sqlite3_prepare_v2(*db, "SELECT sql FROM sqlite_master WHERE type = 'table' AND name = 'autoritzacions';",
+        -1, &stmt, NULL) == SQLITE_OK) {
+
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char *sql = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+            exists = true;
+            nocase = sql && strcasestr(sql, "COLLATE NOCASE");
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    if (!exists) {
+        char *errmsg;
+        rc = sqlite3_exec(*db, "CREATE TABLE IF NOT EXISTS autoritzacions (id_tag TEXT PRIMARY KEY NOT NULL COLLATE NOCASE, "
+                               "expiry_date TEXT, parent_id_tag TEXT);", 0, 0, &errmsg);
+        if (rc != SQLITE_OK) {
+            syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, errmsg);
+            sqlite3_free(errmsg);
+            sqlite3_close(*db);
+            return false;
+        }
+
+        for (auto id_tag : default_id_tags) {
+            char query[128];
+            snprintf(query, sizeof(query), "INSERT OR IGNORE INTO autoritzacions(id_tag) VALUES('%s');", id_tag);
+            sqlite3_exec(*db, query, 0, 0, NULL);
+        }
+
+        return true;
+    }
+
+    if (sqlite3_prepare_v2(*db, "SELECT 1 FROM pragma_table_info('autoritzacions') WHERE name = 'expiry_date';",
+        -1, &stmt, NULL) == SQLITE_OK) {
+
+        // tabla sin expiry_date ni parent_id_tag (versión anterior)
+        bool migrated = (sqlite3_step(stmt) == SQLITE_ROW);
+        sqlite3_finalize(stmt);
+
+        if (!migrated) {
+            sqlite3_exec(*db, "ALTER TABLE autoritzacions ADD COLUMN expiry_date TEXT;", 0, 0, NULL);
+            sqlite3_exec(*db, "ALTER TABLE autoritzacions ADD COLUMN parent_id_tag TEXT;", 0, 0, NULL);
+        }
+    }
+
+    if (!nocase && !migrate_auth_collation(*db)) {
+        sqlite3_close(*db);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      migrate_auth_collation - Rehace la tabla autoritzacions sin distinguir mayúsculas.
+ *  SYNOPSIS
+ *      static bool migrate_auth_collation(sqlite3 *db);
+ *  DESCRIPTION
+ *      Las tablas anteriores declaraban id_tag con la comparación binaria: la clave primaria
+ *      dejaba guardar "abc" y "ABC" como dos idTags y una búsqueda con COLLATE NOCASE no podía
+ *      usar su índice (recorría toda la tabla). SQLite no permite cambiar la comparación de una
+ *      columna, así que se crea la tabla con id_tag COLLATE NOCASE, se copian las filas (de los
+ *      idTags repetidos se queda el primero que se insertó) y se sustituye, todo en una
+ *      transacción.
+ *  RETURN VALUE
+ *      Devuelve true si todo va bien.
+ *      Devuelve false en caso contrario (la tabla no cambia).
+ */
+static bool migrate_auth_collation(sqlite3 *db)
+{
+    long before = 0;
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM autoritzacions;", -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            before = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+
+    char *errmsg;
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;"
+                         "CREATE TABLE autoritzacions_nocase (id_tag TEXT PRIMARY KEY NOT NULL COLLATE NOCASE, "
+                         "expiry_date TEXT, parent_id_tag TEXT);"
+                         "INSERT OR IGNORE INTO autoritzacions_nocase(id_tag, expiry_date, parent_id_tag) "
+                         "SELECT id_tag, expiry_date, parent_id_tag FROM autoritzacions ORDER BY rowid;",
+                     0, 0, &errmsg) != SQLITE_OK) {
+
+        syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, errmsg);
+        sqlite3_free(errmsg);
+        sqlite3_exec(db, "ROLLBACK;", 0, 0, NULL);
+        return false;
+    }
+
+    long kept = sqlite3_changes(db);
+
+    if (sqlite3_exec(db, "DROP TABLE autoritzacions;"
+                         "ALTER TABLE autoritzacions_nocase RENAME TO autoritzacions;"
+                         "COMMIT;", 0, 0, &errmsg) != SQLITE_OK) {
+
+        syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, errmsg);
+        sqlite3_free(errmsg);
+        sqlite3_exec(db, "ROLLBACK;", 0, 0, NULL);
+        return false;
+    }
+
+    syslog(LOG_NOTICE, "%s: autoritzacions sin distinguir mayúsculas: %ld idTags, %ld repetidos eliminados",
+           __func__, kept, before - kept);
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      load_auth_list - Carga la lista de idTags de la base de datos.
+ *  SYNOPSIS
+ *      bool load_auth_list(const char *db_path, IdTagSet &dest);
+ *  DESCRIPTION
+ *      Lee todos los idTags de la tabla autoritzacions y los carga en dest,
+ *      reservando antes la capacidad necesaria.
+ *  RETURN VALUE
+ *      Devuelve true si todo va bien.
+ *      Devuelve false en caso contrario (dest no se modifica).
+ */
+bool load_auth_list(const char *db_path, IdTagSet &dest)
+{
+    sqlite3 *db;
+    if (!open_auth_table(db_path, &db))
+        return false;
+
+    IdTagSet tags;
+    sqlite3_stmt *stmt;
+
+    // reservo la capacidad para no hacer rehash
+    if (sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM autoritzacions;", -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            tags.reserve(sqlite3_column_int64(stmt, 0));
+        sqlite3_finalize(stmt);
+    }
+
+    if (sqlite3_prepare_v2(db, "SELECT id_tag FROM autoritzacions;", -1, &stmt, NULL) != SQLITE_OK) {
+        syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return false;
+    }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+        tags.insert(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)));
+
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+
+    dest = tags;
+    syslog(LOG_INFO, "%s: %zu idTags cargados (%.1f bytes/idTag)", __func__, dest.size(), dest.memory_per_tag());
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      import_auth_list_csv - Importa idTags de un fichero CSV.
+ *  SYNOPSIS
+ *      long import_auth_list_csv(const char *db_path, const char *csv_path);
+ *  DESCRIPTION
+ *      Importa en la tabla autoritzacions los idTags de la primera columna de un fichero CSV,
+ *      un idTag por línea. Se ignoran la cabecera "idTag", las líneas vacías y los idTags de
+ *      más de ID_TAG_LEN caracteres. De las líneas más largas que el buffer solo se lee la
+ *      primera columna, el resto se descarta. Los idTags que ya están en la tabla, sin distinguir
+ *      mayúsculas, también se ignoran. Todo se inserta en una sola transacción.
+ *  RETURN VALUE
+ *      Si todo va bien, devuelve el número de idTags nuevos insertados.
+ *      En caso contrario, retorna -1.
+ */
+long import_auth_list_csv(const char *db_path, const char *csv_path)
+{
+    FILE *csv = fopen(csv_path, "r");
+    if (csv == NULL) {
+        syslog(LOG_ERR, "%s: no se puede abrir %s\n", __func__, csv_path);
+        return -1;
+    }
+
+    sqlite3 *db;
+    if (!open_auth_table(db_path, &db)) {
+        fclose(csv);
+        return -1;
+    }
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO autoritzacions(id_tag) VALUES(?);", -1, &stmt, NULL) != SQLITE_OK) {
+        syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        fclose(csv);
+        return -1;
+    }
+
+    sqlite3_exec(db, "BEGIN TRANSACTION;", 0, 0, NULL);
+
+    long inserted = 0;
+    long skipped = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), csv)) {
+        // línea más larga que el buffer: el resto no es otro idTag, lo descarto
+        if (strchr(line, '\n') == NULL) {
+            int c;
+            while ((c = fgetc(csv)) != EOF && c != '\n')
+                ;
+        }
+
+        // me quedo con la primera columna sin comillas ni espacios
+        char *id_tag = line + strspn(line, " \t\"");
+        id_tag[strcspn(id_tag, ",;\"\r\n \t")] = '\0';
+
+        if (id_tag[0] == '\0' || strcasecmp(id_tag, "idTag") == 0)
+            continue;
+
+        if (strlen(id_tag) > ID_TAG_LEN) {
+            skipped++;
+            continue;
+        }
+
+        sqlite3_bind_text(stmt, 1, id_tag, -1, SQLITE_TRANSIENT);
+        if (sqlite3_step(stmt) == SQLITE_DONE)
+            inserted += sqlite3_changes(db);
+        sqlite3_reset(stmt);
+    }
+
+    sqlite3_exec(db, "COMMIT;", 0, 0, NULL);
+
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    fclose(csv);
+
+    syslog(LOG_INFO, "%s: %ld idTags importados, %ld ignorados", __func__, inserted, skipped);
+
+    return inserted;
+}
+
+/*
+ *  NAME
+ *      close_lookup - Cierra la conexión de lookup_auth_record.
+ *  SYNOPSIS
+ *      static void close_lookup();
+ *  DESCRIPTION
+ *      Libera la consulta preparada y cierra la conexión. Se llama con lookup_mtx bloqueado.
+ *  RETURN VALUE
+ *      Nada.
+ */
+static void close_lookup()
+{
+    sqlite3_finalize(lookup_stmt);
+    sqlite3_close(lookup_db);
+    lookup_stmt = NULL;
+    lookup_db = NULL;
+    lookup_path.clear();
+}
+
+/*
+ *  NAME
+ *      lookup_auth_record - Busca los datos de un idTag en la base de datos.
+ *  SYNOPSIS
+ *      int lookup_auth_record(const char *db_path, const char *id_tag, string &expiry_date, string &parent_id_tag);
+ *  DESCRIPTION
+ *      Busca un idTag en la tabla autoritzacions y copia su expiryDate (formato OCPP,
+ *      p.ej. "2025-12-31T23:59:59Z") y su parentIdTag. Si no tienen valor quedan vacíos.
+ *      La búsqueda usa el índice de la clave primaria (id_tag es COLLATE NOCASE). La conexión
+ *      y la consulta preparada se abren la primera vez y se reutilizan en las siguientes
+ *      búsquedas; si hay un error se cierran y se vuelven a abrir en la próxima.
+ *  RETURN VALUE
+ *      Devuelve 1 si el idTag está en la tabla.
+ *      Devuelve 0 si no está.
+ *      Devuelve -1 en caso de error.
+ */
+int lookup_auth_record(const char *db_path, const char *id_tag, string &expiry_date, string &parent_id_tag)
+{
+    lock_guard<mutex> lock(lookup_mtx);
+
+    if (lookup_db == NULL || lookup_path != db_path) {
+        close_lookup();
+
+        if (!open_auth_table(db_path, &lookup_db)) {
+            lookup_db = NULL;
+            return -1;
+        }
+
+        if (sqlite3_prepare_v2(lookup_db, "SELECT expiry_date, parent_id_tag FROM autoritzacions WHERE id_tag = ?;",
+            -1, &lookup_stmt, NULL) != SQLITE_OK) {
+
+            syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, sqlite3_errmsg(lookup_db));
+            close_lookup();
+            return -1;
+        }
+        lookup_path = db_path;
+    }
+
+    sqlite3_bind_text(lookup_stmt, 1, id_tag, -1, SQLITE_STATIC);
+
+    int found = 0;
+    expiry_date.clear();
+    parent_id_tag.clear();
+    int rc = sqlite3_step(lookup_stmt);
+    if (rc == SQLITE_ROW) {
+        found = 1;
+        if (sqlite3_column_text(lookup_stmt, 0))
+            expiry_date = reinterpret_cast<const char *>(sqlite3_column_text(lookup_stmt, 0));
+        if (sqlite3_column_text(lookup_stmt, 1))
+            parent_id_tag = reinterpret_cast<const char *>(sqlite3_column_text(lookup_stmt, 1));
+    }
+    else if (rc != SQLITE_DONE) {
+        syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, sqlite3_errmsg(lookup_db));
+        found = -1;
+    }
+
+    sqlite3_reset(lookup_stmt);
+    sqlite3_clear_bindings(lookup_stmt);
+    if (found < 0)
+        close_lookup();
+
+    return found;
+}
@@ -0,0 +1,65 @@
+/*
+ *  FILE
+ *      auth_list.h - header de auth_list.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de auth_list.cpp, declaración de la lista de idTags autorizados (IdTagSet)
+ *      y de las funciones para cargarla de la base de datos e importarla de un CSV.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _AUTH_LIST_H_
+#define _AUTH_LIST_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <string>
+
+#ifndef ID_TAG_LEN
+#define ID_TAG_LEN 20 // medida establecida para el protocolo
+#endif
+
+using namespace std;
+
+/*
+ * Conjunto de idTags con direccionamiento abierto (sondeo lineal). Cada posición guarda el idTag
+ * con ancho fijo de ID_TAG_LEN bytes (rellenado con '\0'), sin punteros ni memoria dinámica por tag,
+ * de manera que una búsqueda es un hash y unas pocas comparaciones de 20 bytes contiguos. Los
+ * idTags se guardan en su forma canónica (id_tag_key), así que no distingue mayúsculas.
+ */
+class IdTagSet {
+public:
+    IdTagSet();
+
+    void reserve(size_t n);               // prepara la tabla para n idTags sin rehash
+    bool insert(const char *id_tag);      // añade un idTag
+    bool contains(const char *id_tag) const; // indica si un idTag está en el conjunto
+    void clear();                         // vacía el conjunto
+
+    size_t size() const;                  // número de idTags
+    size_t memory_usage() const;          // bytes ocupados por la tabla
+    double memory_per_tag() const;        // bytes por idTag
+private:
+    struct slot_t {
+        char tag[ID_TAG_LEN]; // idTag rellenado con '\0', vacío si tag[0] == '\0'
+    };
+
+    static bool pack(const char *id_tag, slot_t &dest); // pasa un idTag a ancho fijo
+    static uint64_t hash(const slot_t &key);
+    void rehash(size_t new_capacity);
+
+    vector<slot_t> table; // tabla, la capacidad siempre es potencia de 2
+    size_t count;         // idTags guardados
+};
+
+string id_tag_key(const string &id_tag); // forma canónica de un idTag, para compararlos
+bool load_auth_list(const char *db_path, IdTagSet &dest);
+long import_auth_list_csv(const char *db_path, const char *csv_path);
+int lookup_auth_record(const char *db_path, const char *id_tag, string &expiry_date, string &parent_id_tag);
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ *  FILE
+ *      auth_stand_in.cpp - sistema de autorización externo de pruebas
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Servidor HTTP local que contesta GET /authorize?idTag=<idTag> con un AuthorizeConf de OCPP,
+ *      usando la lista de autorización y la tabla autoritzacions. Permite añadir un retardo a cada
+ *      respuesta para probar la autorización externa con un sistema lento (timeouts, agrupación
+ *      de consultas de un mismo idTag).
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <cstdlib>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "auth_stand_in.h"
+#include "auth_list.h"
+#include "policies.h"
+#include "ws_server.h"
+#include "lib_json_includes.h"
+
+using namespace std;
+
+static void handle_connection(int fd, int delay_ms);
+static string get_id_tag(const char *request);
+
+/*
+ *  NAME
+ *      start_auth_stand_in - Arranca el sistema de autorización de pruebas.
+ *  SYNOPSIS
+ *      bool start_auth_stand_in(int port, int delay_ms);
+ *  DESCRIPTION
+ *      Arranca un servidor HTTP en 127.0.0.1:port, en un thread propio. Cada petición se
+ *      contesta en su propio thread después de esperar delay_ms.
+ *  RETURN VALUE
+ *      Devuelve true si el servidor ha arrancado.
+ *      Devuelve false en caso contrario.
+ */
+bool start_auth_stand_in(int port, int delay_ms)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        syslog(LOG_ERR, "%s: socket: %s", __func__, strerror(errno));
+        return false;
+    }
+
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        syslog(LOG_ERR, "%s: no se puede escuchar en el puerto %d: %s", __func__, port, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    syslog(LOG_INFO, "%s: autorización de pruebas en http://127.0.0.1:%d/authorize (retardo %d ms)", __func__, port, delay_ms);
+
+    thread([fd, delay_ms]() {
+        for (;;) {
+            int client = accept(fd, NULL, NULL);
+            if (client < 0)
+                continue;
+            thread(handle_connection, client, delay_ms).detach();
+        }
+    }).detach();
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      handle_connection - Contesta una petición.
+ *  SYNOPSIS
+ *      static void handle_connection(int fd, int delay_ms);
+ *  DESCRIPTION
+ *      Lee la petición, espera delay_ms y contesta con el idTagInfo del idTag.
+ *  RETURN VALUE
+ *      Nada.
+ */
+static void handle_connection(int fd, int delay_ms)
+{
+    char request[1024];
+    ssize_t n = recv(fd, request, sizeof(request) - 1, 0);
+    if (n <= 0) {
+        close(fd);
+        return;
+    }
+    request[n] = '\0';
+
+    string id_tag = get_id_tag(request);
+    if (id_tag.empty()) {
+        const char *bad_request = "HTTP/1.0 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+        send(fd, bad_request, strlen(bad_request), MSG_NOSIGNAL);
+        close(fd);
+        return;
+    }
+
+    if (delay_ms > 0)
+        this_thread::sleep_for(chrono::milliseconds(delay_ms));
+
+    // mismo resultado que la autorización local
+    string expiry_date, parent_id_tag;
+    struct IdTagInfo info;
+    struct AuthorizeConf conf;
+    bool listed;
+    {
+        PolicyGuard policies;
+        listed = policies->auth_list.contains(id_tag.c_str());
+    }
+
+    info.status = STATUS_INVALID;
+    if (listed && lookup_auth_record(database_path(), id_tag.c_str(), expiry_date, parent_id_tag) > 0)
+        info.status = STATUS_ACCEPTED;
+
+    struct tm tm_expiry = {};
+    if (info.status == STATUS_ACCEPTED && !expiry_date.empty() &&
+        strptime(expiry_date.c_str(), "%Y-%m-%dT%H:%M:%S", &tm_expiry) != NULL && timegm(&tm_expiry) <= time(NULL))
+        info.status = STATUS_EXPIRED;
+
+    info.expiry_date = expiry_date.empty() ? NULL : const_cast<char *>(expiry_date.c_str());
+    info.parent_id_tag = parent_id_tag.empty() ? NULL : const_cast<char *>(parent_id_tag.c_str());
+    conf.id_tag_info = &info;
+
+    char *body = cJSON_PrintAuthorizeConf(&conf);
+    char header[128];
+    snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n\r\n",
+             body ? strlen(body) : 0);
+
+    send(fd, header, strlen(header), MSG_NOSIGNAL);
+    if (body)
+        send(fd, body, strlen(body), MSG_NOSIGNAL);
+
+    free(body);
+    close(fd);
+}
+
+/*
+ *  NAME
+ *      get_id_tag - Obtiene el idTag de la petición.
+ *  SYNOPSIS
+ *      static string get_id_tag(const char *request);
+ *  DESCRIPTION
+ *      Obtiene el parámetro idTag de la primera línea de la petición (GET /authorize?idTag=...),
+ *      decodificando los %XX.
+ *  RETURN VALUE
+ *      El idTag, vacío si no hay.
+ */
+static string get_id_tag(const char *request)
+{
+    const char *param = strstr(request, "idTag=");
+    const char *eol = strstr(request, "\r\n");
+    if (param == NULL || (eol != NULL && param > eol))
+        return "";
+
+    string id_tag;
+    for (const char *p = param + 6; *p && *p != ' ' && *p != '&' && *p != '\r'; p++) {
+        if (*p == '%' && p[1] && p[2]) {
+            char hex[3] = {p[1], p[2], '\0'};
+            id_tag += static_cast<char>(strtol(hex, NULL, 16));
+            p += 2;
+        }
+        else {
+            id_tag += *p;
+        }
+    }
+
+    return id_tag;
+}
@@ -0,0 +1,20 @@
+/*
+ *  FILE
+ *      auth_stand_in.h - header de auth_stand_in.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de auth_stand_in.cpp, servidor HTTP local que hace de sistema de autorización
+ *      externo para hacer pruebas.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _AUTH_STAND_IN_H_
+#define _AUTH_STAND_IN_H_
+
+bool start_auth_stand_in(int port, int delay_ms);
+
+#endif
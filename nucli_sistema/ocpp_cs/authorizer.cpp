@@ -0,0 +1,537 @@
+/*
+ *  FILE
+ *      authorizer.cpp - autorización de idTags con un sistema externo
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Permite validar los idTags con un sistema externo (p.ej. el servicio de facturación) sin
+ *      bloquear el thread de los cargadores. Las consultas se hacen en un grupo de threads propio,
+ *      las de un mismo idTag se agrupan y, si el sistema externo no contesta a tiempo, se usa la
+ *      autorización local (caché de IdTagInfo y lista de autorización).
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <syslog.h>
+#include <sys/socket.h>
+#include <cJSON.h>
+#include "authorizer.h"
+#include "policies.h"
+#include "auth_list.h"
+
+using namespace std;
+
+AuthorizationService authorization_service;
+
+static string url_encode(const string &s);
+
+/*
+ *  NAME
+ *      HttpAuthorizer - Constructor de la clase HttpAuthorizer
+ *  SYNOPSIS
+ *      HttpAuthorizer(const string &host, int port, const string &path, int timeout_ms);
+ *  DESCRIPTION
+ *      Crea el cliente del sistema de autorización HTTP en host:port/path. Cada consulta
+ *      (conexión, envío y respuesta) dura como máximo timeout_ms.
+ *  RETURN VALUE
+ *      Nada.
+ */
+HttpAuthorizer::HttpAuthorizer(const string &host, int port, const string &path, int timeout_ms)
+    : host(host), port(port), path(path), timeout_ms(timeout_ms)
+{
+}
+
+/*
+ *  NAME
+ *      from_url - Crea un HttpAuthorizer a partir de una URL.
+ *  SYNOPSIS
+ *      static unique_ptr<HttpAuthorizer> from_url(const string &url, int timeout_ms);
+ *  DESCRIPTION
+ *      Crea un HttpAuthorizer a partir de una URL del tipo http://host:port/path
+ *      (si no hay puerto se usa el 80 y si no hay path, /authorize).
+ *  RETURN VALUE
+ *      El HttpAuthorizer creado.
+ *      NULL si la URL no es válida.
+ */
+unique_ptr<HttpAuthorizer> HttpAuthorizer::from_url(const string &url, int timeout_ms)
+{
+    const string scheme = "http://";
+    if (url.compare(0, scheme.size(), scheme) != 0) {
+        syslog(LOG_ERR, "%s: URL no soportada: %s", __func__, url.c_str());
+        return nullptr;
+    }
+
+    string rest = url.substr(scheme.size());
+    string path = "/authorize";
+    size_t slash = rest.find('/');
+    if (slash != string::npos) {
+        path = rest.substr(slash);
+        rest = rest.substr(0, slash);
+    }
+
+    int port = 80;
+    size_t colon = rest.find(':');
+    if (colon != string::npos) {
+        port = atoi(rest.substr(colon + 1).c_str());
+        rest = rest.substr(0, colon);
+    }
+
+    if (rest.empty() || port <= 0 || port > 65535) {
+        syslog(LOG_ERR, "%s: URL no válida: %s", __func__, url.c_str());
+        return nullptr;
+    }
+
+    return make_unique<HttpAuthorizer>(rest, port, path, timeout_ms);
+}
+
+/*
+ *  NAME
+ *      name - Devuelve el nombre del sistema de autorización.
+ *  SYNOPSIS
+ *      string name() const;
+ *  DESCRIPTION
+ *      Devuelve la URL del sistema de autorización, para los logs.
+ *  RETURN VALUE
+ *      Un string con el nombre.
+ */
+string HttpAuthorizer::name() const
+{
+    return "http://" + host + ":" + to_string(port) + path;
+}
+
+/*
+ *  NAME
+ *      connect_to_host - Abre la conexión con el sistema de autorización.
+ *  SYNOPSIS
+ *      int connect_to_host() const;
+ *  DESCRIPTION
+ *      Abre una conexión TCP con host:port esperando como máximo timeout_ms, y configura
+ *      el mismo timeout para el envío y la recepción.
+ *  RETURN VALUE
+ *      El socket conectado.
+ *      -1 en caso de error.
+ */
+int HttpAuthorizer::connect_to_host() const
+{
+    struct addrinfo hints = {}, *res;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &res) != 0) {
+        syslog(LOG_ERR, "%s: no se ha podido resolver %s", __func__, host.c_str());
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai != NULL && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+
+        // connect no bloqueante para poder limitar el tiempo de conexión
+        int flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+        int rc = connect(fd, ai->ai_addr, ai->ai_addrlen);
+        if (rc < 0 && errno == EINPROGRESS) {
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (poll(&pfd, 1, timeout_ms) == 1 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0)
+                rc = 0;
+        }
+
+        if (rc < 0) {
+            close(fd);
+            fd = -1;
+            continue;
+        }
+
+        fcntl(fd, F_SETFL, flags);
+        struct timeval tv = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+
+    freeaddrinfo(res);
+
+    return fd;
+}
+
+/*
+ *  NAME
+ *      authorize - Consulta un idTag al sistema de autorización HTTP.
+ *  SYNOPSIS
+ *      bool authorize(const string &id_tag, IdTagRecord &dest);
+ *  DESCRIPTION
+ *      Envía GET <path>?idTag=<idTag> y copia el idTagInfo de la respuesta en dest.
+ *      Es bloqueante, como máximo timeout_ms por cada operación de red.
+ *  RETURN VALUE
+ *      Devuelve true si el sistema ha contestado con un idTagInfo válido.
+ *      Devuelve false en caso contrario.
+ */
+bool HttpAuthorizer::authorize(const string &id_tag, IdTagRecord &dest)
+{
+    int fd = connect_to_host();
+    if (fd < 0) {
+        syslog(LOG_WARNING, "%s: no se ha podido conectar con %s", __func__, name().c_str());
+        return false;
+    }
+
+    char request[512];
+    int len = snprintf(request, sizeof(request),
+                       "GET %s?idTag=%s HTTP/1.0\r\nHost: %s\r\nAccept: application/json\r\nConnection: close\r\n\r\n",
+                       path.c_str(), url_encode(id_tag).c_str(), host.c_str());
+
+    if (len <= 0 || len >= (int) sizeof(request) || send(fd, request, len, MSG_NOSIGNAL) != len) {
+        close(fd);
+        return false;
+    }
+
+    // leo la respuesta hasta que se cierra la conexión
+    string response;
+    char buffer[1024];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0 && response.size() < 8192)
+        response.append(buffer, n);
+    close(fd);
+
+    if (n < 0) { // timeout o error
+        syslog(LOG_WARNING, "%s: %s no ha contestado", __func__, name().c_str());
+        return false;
+    }
+
+    int status_code = 0;
+    size_t body = response.find("\r\n\r\n");
+    if (sscanf(response.c_str(), "HTTP/%*d.%*d %d", &status_code) != 1 || status_code != 200 || body == string::npos) {
+        syslog(LOG_WARNING, "%s: respuesta no válida de %s (%d)", __func__, name().c_str(), status_code);
+        return false;
+    }
+
+    cJSON *json = cJSON_Parse(response.c_str() + body + 4);
+    cJSON *info = cJSON_GetObjectItemCaseSensitive(json, "idTagInfo");
+    const char *status = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(info, "status"));
+    const char *expiry_date = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(info, "expiryDate"));
+    const char *parent_id_tag = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(info, "parentIdTag"));
+
+    bool ok = true;
+    if (status && strcmp(status, "Accepted") == 0)
+        dest.status = STATUS_ACCEPTED;
+    else if (status && strcmp(status, "Blocked") == 0)
+        dest.status = STATUS_BLOCKED;
+    else if (status && strcmp(status, "Expired") == 0)
+        dest.status = STATUS_EXPIRED;
+    else if (status && strcmp(status, "Invalid") == 0)
+        dest.status = STATUS_INVALID;
+    else
+        ok = false;
+
+    dest.expiry_date = expiry_date ? expiry_date : "";
+    dest.parent_id_tag = parent_id_tag ? parent_id_tag : "";
+
+    cJSON_Delete(json);
+
+    if (!ok)
+        syslog(LOG_WARNING, "%s: idTagInfo no válido de %s", __func__, name().c_str());
+
+    return ok;
+}
+
+/*
+ *  NAME
+ *      AuthorizationService - Constructor de la clase AuthorizationService
+ *  SYNOPSIS
+ *      AuthorizationService();
+ *  DESCRIPTION
+ *      Crea el servicio sin sistema externo: se autoriza solo con la caché y la lista local.
+ *  RETURN VALUE
+ *      Nada.
+ */
+AuthorizationService::AuthorizationService()
+    : timeout_ms(AUTH_TIMEOUT_MS), next_generation(1), stopping(false)
+{
+}
+
+/*
+ *  NAME
+ *      ~AuthorizationService - Destructor de la clase AuthorizationService
+ *  SYNOPSIS
+ *      ~AuthorizationService();
+ *  DESCRIPTION
+ *      Para los threads del servicio.
+ *  RETURN VALUE
+ *      Nada.
+ */
+AuthorizationService::~AuthorizationService()
+{
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+    }
+    work_cv.notify_all();
+    timer_cv.notify_all();
+
+    for (auto &t : threads)
+        t.join();
+}
+
+/*
+ *  NAME
+ *      set_authorizer - Configura el sistema de autorización externo.
+ *  SYNOPSIS
+ *      void set_authorizer(unique_ptr<ExternalAuthorizer> authorizer, int timeout_ms);
+ *  DESCRIPTION
+ *      Configura el sistema de autorización externo y el tiempo máximo de espera a su respuesta.
+ *      Con NULL se vuelve a la autorización local. Los threads se crean la primera vez.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void AuthorizationService::set_authorizer(unique_ptr<ExternalAuthorizer> authorizer, int timeout_ms)
+{
+    if (authorizer)
+        syslog(LOG_INFO, "%s: autorización externa %s (timeout %d ms)", __func__, authorizer->name().c_str(), timeout_ms);
+
+    lock_guard<mutex> lock(mtx);
+
+    this->authorizer = move(authorizer);
+    this->timeout_ms = timeout_ms;
+
+    if (this->authorizer && threads.empty())
+        start_threads();
+}
+
+/*
+ *  NAME
+ *      start_threads - Crea los threads del servicio.
+ *  SYNOPSIS
+ *      void start_threads();
+ *  DESCRIPTION
+ *      Crea AUTH_WORKERS threads que hacen las consultas y un thread para los timeouts.
+ *      Se llama con el mutex cogido.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void AuthorizationService::start_threads()
+{
+    for (int i = 0; i < AUTH_WORKERS; i++)
+        threads.emplace_back(&AuthorizationService::worker_loop, this);
+
+    threads.emplace_back(&AuthorizationService::timer_loop, this);
+}
+
+/*
+ *  NAME
+ *      authorize - Autoriza un idTag.
+ *  SYNOPSIS
+ *      void authorize(const string &id_tag, auth_callback_t done);
+ *  DESCRIPTION
+ *      Autoriza un idTag y llama a done con el resultado. Si no hay sistema externo o el idTag
+ *      está en la caché, done se llama directamente. Si no, la consulta se encola (o se agrupa con
+ *      la que ya está en curso para el mismo idTag) y done se llama desde otro thread cuando llega
+ *      la respuesta o el timeout. No bloquea nunca.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void AuthorizationService::authorize(const string &id_tag, auth_callback_t done)
+{
+    IdTagRecord record;
+
+    {
+        lock_guard<mutex> lock(mtx);
+        if (!authorizer) {
+            record = authorize_id_tag(id_tag.c_str());
+            done(record);
+            return;
+        }
+    }
+
+    if (id_tag_cache.lookup(id_tag, policies_version(), record)) {
+        done(record);
+        return;
+    }
+
+    string key = id_tag_key(id_tag);
+
+    lock_guard<mutex> lock(mtx);
+
+    auto it = pending.find(key);
+    if (it != pending.end()) { // ya hay una consulta en curso de este idTag
+        it->second.waiters.push_back(move(done));
+        num_coalesced++;
+        return;
+    }
+
+    pending_t p;
+    p.id_tag = id_tag;
+    p.generation = next_generation++;
+    p.deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+    p.waiters.push_back(move(done));
+
+    queue.emplace_back(key, p.generation);
+    pending.emplace(key, move(p));
+
+    work_cv.notify_one();
+    timer_cv.notify_one();
+}
+
+/*
+ *  NAME
+ *      finish - Contesta una consulta.
+ *  SYNOPSIS
+ *      void finish(const string &key, uint64_t generation, const IdTagRecord *record);
+ *  DESCRIPTION
+ *      Contesta a todos los que esperan la consulta de un idTag. Si record es NULL (timeout o
+ *      error del sistema externo) se contesta con la autorización local. Si la consulta ya se ha
+ *      contestado (p.ej. por timeout) no hace nada.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void AuthorizationService::finish(const string &key, uint64_t generation, const IdTagRecord *record)
+{
+    vector<auth_callback_t> waiters;
+    string id_tag;
+
+    {
+        lock_guard<mutex> lock(mtx);
+        auto it = pending.find(key);
+        if (it == pending.end() || it->second.generation != generation)
+            return;
+
+        waiters = move(it->second.waiters);
+        id_tag = it->second.id_tag;
+        pending.erase(it);
+    }
+
+    IdTagRecord result = record ? *record : authorize_id_tag(id_tag.c_str());
+    for (auto &done : waiters)
+        done(result);
+}
+
+/*
+ *  NAME
+ *      worker_loop - Bucle de los threads que hacen las consultas.
+ *  SYNOPSIS
+ *      void worker_loop();
+ *  DESCRIPTION
+ *      Saca las consultas de la cola, las envía al sistema externo y guarda la respuesta en la
+ *      caché de IdTagInfo (aunque la consulta ya se haya contestado por timeout).
+ *  RETURN VALUE
+ *      Nada.
+ */
+void AuthorizationService::worker_loop()
+{
+    for (;;) {
+        string key, id_tag;
+        uint64_t generation;
+        shared_ptr<ExternalAuthorizer> auth;
+
+        {
+            unique_lock<mutex> lock(mtx);
+            work_cv.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping)
+                return;
+
+            key = queue.front().first;
+            generation = queue.front().second;
+            queue.pop_front();
+
+            auto it = pending.find(key);
+            if (it == pending.end() || it->second.generation != generation) // ya contestada por timeout
+                continue;
+
+            id_tag = it->second.id_tag;
+            auth = authorizer;
+        }
+
+        IdTagRecord record;
+        bool ok = auth && auth->authorize(id_tag, record);
+        if (ok)
+            id_tag_cache.store(id_tag, policies_version(), record);
+
+        finish(key, generation, ok ? &record : nullptr);
+    }
+}
+
+/*
+ *  NAME
+ *      timer_loop - Bucle del thread de los timeouts.
+ *  SYNOPSIS
+ *      void timer_loop();
+ *  DESCRIPTION
+ *      Espera al timeout más próximo y contesta las consultas que lo han superado
+ *      con la autorización local.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void AuthorizationService::timer_loop()
+{
+    unique_lock<mutex> lock(mtx);
+
+    while (!stopping) {
+        if (pending.empty()) {
+            timer_cv.wait(lock);
+            continue;
+        }
+
+        auto now = chrono::steady_clock::now();
+        deadline_t next = deadline_t::max();
+        vector<pair<string, uint64_t>> expired;
+        for (auto &elem : pending) {
+            if (elem.second.deadline <= now)
+                expired.emplace_back(elem.first, elem.second.generation);
+            else if (elem.second.deadline < next)
+                next = elem.second.deadline;
+        }
+
+        if (expired.empty()) {
+            timer_cv.wait_until(lock, next);
+            continue;
+        }
+
+        lock.unlock();
+        for (auto &elem : expired) {
+            num_timeouts++;
+            syslog(LOG_WARNING, "%s: timeout de la autorización externa, se usa la local", __func__);
+            finish(elem.first, elem.second, nullptr);
+        }
+        lock.lock();
+    }
+}
+
+/*
+ *  NAME
+ *      url_encode - Codifica un string para una URL.
+ *  SYNOPSIS
+ *      static string url_encode(const string &s);
+ *  DESCRIPTION
+ *      Codifica con %XX todos los caracteres que no son alfanuméricos ni -_.~
+ *  RETURN VALUE
+ *      Un string con el resultado.
+ */
+static string url_encode(const string &s)
+{
+    string result;
+    char hex[4];
+
+    for (unsigned char c : s) {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            result += c;
+        }
+        else {
+            snprintf(hex, sizeof(hex), "%%%02X", c);
+            result += hex;
+        }
+    }
+
+    return result;
+}
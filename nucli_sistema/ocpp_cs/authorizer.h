@@ -0,0 +1,121 @@
+/*
+ *  FILE
+ *      authorizer.h - header de authorizer.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de authorizer.cpp, declaración de la interfaz de autorización externa
+ *      (p.ej. el servicio de facturación), del cliente HTTP y del servicio asíncrono que
+ *      agrupa las consultas de un mismo idTag.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _AUTHORIZER_H_
+#define _AUTHORIZER_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include "id_tag_cache.h"
+
+#define AUTH_TIMEOUT_MS 2000 // tiempo máximo de espera a la autorización externa
+#define AUTH_WORKERS    4    // consultas simultáneas a la autorización externa
+
+using namespace std;
+
+/*
+ * Interfaz de un sistema de autorización externo. authorize() puede bloquear (se ejecuta en
+ * los threads del AuthorizationService, nunca en el de un cargador). Devuelve false si no ha
+ * podido consultar el sistema externo, en ese caso se usa la autorización local.
+ */
+class ExternalAuthorizer {
+public:
+    virtual ~ExternalAuthorizer() = default;
+    virtual bool authorize(const string &id_tag, IdTagRecord &dest) = 0;
+    virtual string name() const = 0;
+};
+
+/*
+ * Autorización externa por HTTP: GET <path>?idTag=<idTag> y la respuesta es un AuthorizeConf
+ * de OCPP ({"idTagInfo":{"status":"Accepted",...}}).
+ */
+class HttpAuthorizer : public ExternalAuthorizer {
+public:
+    HttpAuthorizer(const string &host, int port, const string &path, int timeout_ms);
+    static unique_ptr<HttpAuthorizer> from_url(const string &url, int timeout_ms); // url: http://host:port/path
+
+    bool authorize(const string &id_tag, IdTagRecord &dest) override;
+    string name() const override;
+private:
+    int connect_to_host() const;
+
+    string host;
+    int port;
+    string path;
+    int timeout_ms;
+};
+
+// resultado de una autorización
+typedef function<void(const IdTagRecord &record)> auth_callback_t;
+
+/*
+ * Servicio de autorización asíncrono. Las consultas al sistema externo se hacen en un grupo de
+ * threads propio, de manera que un sistema lento no bloquea el thread de ningún cargador.
+ * Las consultas simultáneas de un mismo idTag se agrupan en una sola, y si no llega la respuesta
+ * antes del timeout se contesta con la autorización local (caché y lista de autorización).
+ */
+class AuthorizationService {
+public:
+    AuthorizationService();
+    ~AuthorizationService();
+
+    void set_authorizer(unique_ptr<ExternalAuthorizer> authorizer, int timeout_ms = AUTH_TIMEOUT_MS);
+    void authorize(const string &id_tag, auth_callback_t done); // autoriza un idTag, done se llama una vez
+
+    uint64_t coalesced() const { return num_coalesced; } // consultas agrupadas con otra en curso
+    uint64_t timeouts() const { return num_timeouts; }   // consultas contestadas por timeout
+private:
+    typedef chrono::steady_clock::time_point deadline_t;
+
+    struct pending_t {
+        string id_tag;                   // idTag tal como lo ha enviado el cargador
+        uint64_t generation;             // distingue la consulta de una posterior del mismo idTag
+        deadline_t deadline;             // instante del timeout
+        vector<auth_callback_t> waiters; // a quien se le tiene que contestar
+    };
+
+    void worker_loop();
+    void timer_loop();
+    void start_threads();
+    void finish(const string &key, uint64_t generation, const IdTagRecord *record); // contesta una consulta
+
+    mutex mtx;
+    condition_variable work_cv;
+    condition_variable timer_cv;
+    shared_ptr<ExternalAuthorizer> authorizer;    // NULL si solo hay autorización local
+    int timeout_ms;
+    unordered_map<string, pending_t> pending;     // idTag (en mayúsculas) -> consulta en curso
+    deque<pair<string, uint64_t>> queue;          // consultas pendientes de enviar
+    uint64_t next_generation;
+    bool stopping;
+    vector<thread> threads;
+
+    atomic<uint64_t> num_coalesced{0};
+    atomic<uint64_t> num_timeouts{0};
+};
+
+// servicio de autorización compartido por todos los cargadores
+extern AuthorizationService authorization_service;
+
+#endif
@@ -0,0 +1,495 @@
+/*
+ *  FILE
+ *      bulk_operation.cpp - operaciones en bloque
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Envía una misma petición a un grupo de cargadores con un número limitado de peticiones
+ *      a la vez, recogiendo el resultado de cada cargador e informando del progreso.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <algorithm>
+#include <syslog.h>
+#include "bulk_operation.h"
+#include "charger_ops.h"
+#include "ws_server.h"
+
+using namespace std;
+
+/*
+ *  NAME
+ *      call_failed - Resultado de una petición que no ha tenido respuesta.
+ *  SYNOPSIS
+ *      static struct BulkOutcome call_failed(enum call_status_t status);
+ *  DESCRIPTION
+ *      Traduce el estado de una petición sin respuesta válida a BULK_FAILED con el motivo.
+ *  RETURN VALUE
+ *      El resultado.
+ */
+static struct BulkOutcome call_failed(enum call_status_t status)
+{
+    if (status == CALL_ERROR)
+        return {BULK_FAILED, "CALLERROR o respuesta incorrecta"};
+    if (status == CALL_TIMEOUT)
+        return {BULK_FAILED, "timeout"};
+
+    return {BULK_FAILED, "no enviado"};
+}
+
+/*
+ *  NAME
+ *      reset_task, change_availability_task, unlock_connector_task, clear_cache_task,
+ *      change_configuration_task
+ *  SYNOPSIS
+ *      static Task<struct BulkOutcome> reset_task(Charger &charger, enum Type_Reset type);
+ *      static Task<struct BulkOutcome> change_availability_task(Charger &charger, int64_t connector_id, enum Type type);
+ *      static Task<struct BulkOutcome> unlock_connector_task(Charger &charger, int64_t connector_id);
+ *      static Task<struct BulkOutcome> clear_cache_task(Charger &charger);
+ *      static Task<struct BulkOutcome> change_configuration_task(Charger &charger, string key, string value);
+ *  DESCRIPTION
+ *      Envían la petición al cargador con su corutina de charger_ops.h y pasan el status del
+ *      Conf a BULK_ACCEPTED o BULK_REJECTED. Los parámetros se copian en la corutina, no
+ *      dependen del bulk_request_t que las ha creado.
+ *  RETURN VALUE
+ *      El resultado en el cargador.
+ */
+static Task<struct BulkOutcome> reset_task(Charger &charger, enum Type_Reset type)
+{
+    OcppResult<struct ResetConf> r = co_await async_reset(charger, type);
+    if (r.status != CALL_ANSWERED)
+        co_return call_failed(r.status);
+
+    if (r.conf.status == STATUS_RESET_ACCEPTED)
+        co_return BulkOutcome{BULK_ACCEPTED, "Accepted"};
+    co_return BulkOutcome{BULK_REJECTED, "Rejected"};
+}
+
+static Task<struct BulkOutcome> change_availability_task(Charger &charger, int64_t connector_id, enum Type type)
+{
+    OcppResult<struct ChangeAvailabilityConf> r = co_await async_change_availability(charger, connector_id, type);
+    if (r.status != CALL_ANSWERED)
+        co_return call_failed(r.status);
+
+    if (r.conf.status == STATUS_AVAILABILITY_ACCEPTED)
+        co_return BulkOutcome{BULK_ACCEPTED, "Accepted"};
+    if (r.conf.status == STATUS_AVAILABILITY_SCHEDULED)
+        co_return BulkOutcome{BULK_ACCEPTED, "Scheduled"};
+    co_return BulkOutcome{BULK_REJECTED, "Rejected"};
+}
+
+static Task<struct BulkOutcome> unlock_connector_task(Charger &charger, int64_t connector_id)
+{
+    OcppResult<struct UnlockConnectorConf> r = co_await async_unlock_connector(charger, connector_id);
+    if (r.status != CALL_ANSWERED)
+        co_return call_failed(r.status);
+
+    if (r.conf.status == STATUS_UNLOCK_UNLOCKED)
+        co_return BulkOutcome{BULK_ACCEPTED, "Unlocked"};
+    if (r.conf.status == STATUS_UNLOCK_UNLOCK_FAILED)
+        co_return BulkOutcome{BULK_REJECTED, "UnlockFailed"};
+    co_return BulkOutcome{BULK_REJECTED, "NotSupported"};
+}
+
+static Task<struct BulkOutcome> clear_cache_task(Charger &charger)
+{
+    OcppResult<struct ClearCacheConf> r = co_await async_clear_cache(charger);
+    if (r.status != CALL_ANSWERED)
+        co_return call_failed(r.status);
+
+    if (r.conf.status == STATUS_CACHE_ACCEPTED)
+        co_return BulkOutcome{BULK_ACCEPTED, "Accepted"};
+    co_return BulkOutcome{BULK_REJECTED, "Rejected"};
+}
+
+static Task<struct BulkOutcome> change_configuration_task(Charger &charger, string key, string value)
+{
+    // medidas de OCPP (CiString50 y CiString500), el cargador rechazaría la petición
+    if (key.empty() || key.size() > 50 || value.size() > 500)
+        co_return BulkOutcome{BULK_REJECTED, "clave o valor incorrectos"};
+
+    OcppResult<struct ChangeConfigurationConf> r = co_await async_change_configuration(charger, key, value);
+    if (r.status != CALL_ANSWERED)
+        co_return call_failed(r.status);
+
+    switch (r.conf.status) {
+        case STATUS_CHANGE_CONFIGURATION_ACCEPTED:
+            co_return BulkOutcome{BULK_ACCEPTED, "Accepted"};
+        case STATUS_CHANGE_CONFIGURATION_REBOOT_REQUIRED:
+            co_return BulkOutcome{BULK_ACCEPTED, "RebootRequired"};
+        case STATUS_CHANGE_CONFIGURATION_NOT_SUPPORTED:
+            co_return BulkOutcome{BULK_REJECTED, "NotSupported"};
+        default:
+            co_return BulkOutcome{BULK_REJECTED, "Rejected"};
+    }
+}
+
+/*
+ *  NAME
+ *      bulk_reset, bulk_change_availability, bulk_unlock_connector, bulk_clear_cache,
+ *      bulk_change_configuration
+ *  SYNOPSIS
+ *      bulk_request_t bulk_reset(enum Type_Reset type);
+ *      bulk_request_t bulk_change_availability(int64_t connector_id, enum Type type);
+ *      bulk_request_t bulk_unlock_connector(int64_t connector_id);
+ *      bulk_request_t bulk_clear_cache();
+ *      bulk_request_t bulk_change_configuration(const string &key, const string &value);
+ *  DESCRIPTION
+ *      Peticiones de las operaciones en bloque. En cada cargador se llama a la petición, que
+ *      empieza la corutina de la operación.
+ *  RETURN VALUE
+ *      La petición, para BulkOperation::create.
+ */
+bulk_request_t bulk_reset(enum Type_Reset type)
+{
+    return [type](Charger &charger) { return reset_task(charger, type); };
+}
+
+bulk_request_t bulk_change_availability(int64_t connector_id, enum Type type)
+{
+    return [connector_id, type](Charger &charger) { return change_availability_task(charger, connector_id, type); };
+}
+
+bulk_request_t bulk_unlock_connector(int64_t connector_id)
+{
+    return [connector_id](Charger &charger) { return unlock_connector_task(charger, connector_id); };
+}
+
+bulk_request_t bulk_clear_cache()
+{
+    return [](Charger &charger) { return clear_cache_task(charger); };
+}
+
+bulk_request_t bulk_change_configuration(const string &key, const string &value)
+{
+    return [key, value](Charger &charger) { return change_configuration_task(charger, key, value); };
+}
+
+/*
+ *  NAME
+ *      create - Crea una operación en bloque.
+ *  SYNOPSIS
+ *      static shared_ptr<BulkOperation> create(bulk_request_t request, const vector<int> &charger_ids,
+ *                                              int max_concurrency, int max_attempts, int backoff_ms);
+ *  DESCRIPTION
+ *      Prepara el envío de la petición request a los cargadores charger_ids.
+ *      No se envía nada hasta llamar a start().
+ *  RETURN VALUE
+ *      La operación.
+ */
+shared_ptr<BulkOperation> BulkOperation::create(bulk_request_t request, const vector<int> &charger_ids,
+                                                int max_concurrency, int max_attempts, int backoff_ms)
+{
+    return shared_ptr<BulkOperation>(new BulkOperation(request, charger_ids, max_concurrency, max_attempts, backoff_ms));
+}
+
+/*
+ *  NAME
+ *      BulkOperation - Constructor de la clase BulkOperation
+ *  SYNOPSIS
+ *      BulkOperation(bulk_request_t request, const vector<int> &charger_ids, int max_concurrency,
+ *                    int max_attempts, int backoff_ms);
+ *  DESCRIPTION
+ *      Inicializa la operación con todos los cargadores pendientes.
+ *  RETURN VALUE
+ *      Nada.
+ */
+BulkOperation::BulkOperation(bulk_request_t request, const vector<int> &charger_ids, int max_concurrency,
+                             int max_attempts, int backoff_ms)
+    : request(request), max_concurrency(max(max_concurrency, 1)), max_attempts(max(max_attempts, 1)),
+      backoff_ms(backoff_ms), remaining(charger_ids.size()), cancelled(false)
+{
+    for (int charger_id : charger_ids)
+        targets.push_back({charger_id, BULK_PENDING, 0, ""});
+
+    retry_at.assign(targets.size(), chrono::steady_clock::now());
+}
+
+/*
+ *  NAME
+ *      start - Empieza la operación.
+ *  SYNOPSIS
+ *      void start(bulk_callback_t on_progress);
+ *  DESCRIPTION
+ *      Lanza max_concurrency corutinas (como mucho una por cargador), que envían las primeras
+ *      peticiones desde este thread. El resto se envían desde los threads de los cargadores a
+ *      medida que van terminando las anteriores.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void BulkOperation::start(bulk_callback_t on_progress)
+{
+    this->on_progress = on_progress;
+
+    size_t num_workers = min(static_cast<size_t>(max_concurrency), targets.size());
+    syslog(LOG_INFO, "%s: petición a %zu cargadores, %zu a la vez, %d intentos", __func__, targets.size(),
+           num_workers, max_attempts);
+
+    for (size_t i = 0; i < num_workers; i++)
+        worker(shared_from_this()).detach();
+}
+
+/*
+ *  NAME
+ *      cancel - Cancela la operación.
+ *  SYNOPSIS
+ *      void cancel();
+ *  DESCRIPTION
+ *      Los cargadores pendientes (también los que esperan a reintentar) pasan a BULK_CANCELLED.
+ *      Las peticiones que ya se han enviado terminan normalmente, pero si fallan ya no se
+ *      reintentan: finish() lo decide con el mismo mutex, así que ningún cargador se queda
+ *      pendiente.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void BulkOperation::cancel()
+{
+    unique_lock<mutex> lock(mtx);
+    if (cancelled)
+        return;
+    cancelled = true;
+
+    for (auto &target : targets) {
+        if (target.state == BULK_PENDING) {
+            target.state = BULK_CANCELLED;
+            target.result = target.attempts > 0 ? "cancelado (" + target.result + ")" : "cancelado";
+            remaining--;
+        }
+    }
+
+    notify(lock);
+}
+
+/*
+ *  NAME
+ *      wait - Espera a que termine la operación.
+ *  SYNOPSIS
+ *      void wait();
+ *  DESCRIPTION
+ *      Espera a que todos los cargadores estén en un estado final. No se puede llamar
+ *      desde on_progress ni desde el thread de un cargador.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void BulkOperation::wait()
+{
+    unique_lock<mutex> lock(mtx);
+
+    cv.wait(lock, [this]() { return remaining == 0; });
+}
+
+/*
+ *  NAME
+ *      finished - Indica si la operación ha terminado.
+ *  SYNOPSIS
+ *      bool finished() const;
+ *  DESCRIPTION
+ *      Indica si todos los cargadores están en un estado final.
+ *  RETURN VALUE
+ *      Devuelve true si ha terminado.
+ *      Devuelve false en caso contrario.
+ */
+bool BulkOperation::finished() const
+{
+    lock_guard<mutex> lock(mtx);
+
+    return remaining == 0;
+}
+
+/*
+ *  NAME
+ *      progress - Devuelve el progreso de la operación.
+ *  SYNOPSIS
+ *      BulkProgress progress() const;
+ *  DESCRIPTION
+ *      Devuelve una copia del estado de cada cargador y los totales.
+ *  RETURN VALUE
+ *      El progreso.
+ */
+BulkProgress BulkOperation::progress() const
+{
+    lock_guard<mutex> lock(mtx);
+
+    return progress_locked();
+}
+
+/*
+ *  NAME
+ *      progress_locked - Calcula el progreso de la operación.
+ *  SYNOPSIS
+ *      BulkProgress progress_locked() const;
+ *  DESCRIPTION
+ *      Calcula el progreso de la operación. Se llama con el mutex cogido.
+ *  RETURN VALUE
+ *      El progreso.
+ */
+BulkProgress BulkOperation::progress_locked() const
+{
+    BulkProgress p = {targets.size(), 0, 0, 0, targets};
+
+    for (auto &target : targets) {
+        if (target.state == BULK_ACCEPTED)
+            p.succeeded++;
+        else if (target.state != BULK_PENDING && target.state != BULK_IN_PROGRESS)
+            p.failed++;
+    }
+    p.done = p.succeeded + p.failed;
+
+    return p;
+}
+
+/*
+ *  NAME
+ *      notify - Avisa de un cambio de estado.
+ *  SYNOPSIS
+ *      void notify(unique_lock<mutex> &lock);
+ *  DESCRIPTION
+ *      Despierta a wait() y llama a on_progress con el progreso actual. Se llama con el mutex
+ *      cogido y lo suelta antes de llamar a on_progress.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void BulkOperation::notify(unique_lock<mutex> &lock)
+{
+    BulkProgress p;
+    if (on_progress)
+        p = progress_locked();
+    lock.unlock();
+
+    cv.notify_all();
+    if (on_progress)
+        on_progress(p);
+}
+
+/*
+ *  NAME
+ *      finish - Guarda el resultado de un intento.
+ *  SYNOPSIS
+ *      void finish(size_t index, const struct BulkOutcome &outcome, bool retry);
+ *  DESCRIPTION
+ *      Guarda el resultado del intento en el cargador index. Si ha fallado, retry es true y
+ *      quedan intentos, el cargador vuelve a BULK_PENDING hasta que pase la espera (backoff_ms,
+ *      que se dobla en cada intento, como mucho BULK_MAX_BACKOFF_MS), salvo si la operación se
+ *      ha cancelado, que pasa a BULK_CANCELLED.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void BulkOperation::finish(size_t index, const struct BulkOutcome &outcome, bool retry)
+{
+    unique_lock<mutex> lock(mtx);
+    BulkTarget &target = targets[index];
+
+    target.result = outcome.result;
+    target.state = outcome.state;
+    if (outcome.state == BULK_FAILED && retry && target.attempts < max_attempts) {
+        if (cancelled) {
+            target.state = BULK_CANCELLED;
+            target.result = "cancelado (" + outcome.result + ")";
+        }
+        else {
+            long delay = min(static_cast<long>(backoff_ms) << min(target.attempts - 1, 20), static_cast<long>(BULK_MAX_BACKOFF_MS));
+            syslog(LOG_DEBUG, "%s: cargador %d, intento %d fallido (%s), reintento en %ld ms",
+                   __func__, target.charger_id, target.attempts, outcome.result.c_str(), delay);
+
+            target.state = BULK_PENDING;
+            retry_at[index] = chrono::steady_clock::now() + chrono::milliseconds(delay);
+        }
+    }
+    else if (outcome.state == BULK_FAILED && target.attempts > 1) {
+        syslog(LOG_WARNING, "%s: cargador %d fallido después de %d intentos (%s)",
+               __func__, target.charger_id, target.attempts, outcome.result.c_str());
+    }
+
+    if (target.state != BULK_PENDING)
+        remaining--;
+
+    notify(lock);
+}
+
+/*
+ *  NAME
+ *      next_target - Coge el próximo cargador.
+ *  SYNOPSIS
+ *      bool next_target(size_t &index, int &charger_id, chrono::milliseconds &delay);
+ *  DESCRIPTION
+ *      Busca el cargador pendiente que lleva más tiempo esperando. Si ya le toca lo marca como
+ *      BULK_IN_PROGRESS, cuenta el intento y devuelve su posición y su id con delay a 0; si no,
+ *      devuelve en delay lo que falta para su reintento y no lo coge.
+ *  RETURN VALUE
+ *      Devuelve true si se ha cogido un cargador o hay que esperar delay.
+ *      Devuelve false si no queda ninguno pendiente o se ha cancelado la operación.
+ */
+bool BulkOperation::next_target(size_t &index, int &charger_id, chrono::milliseconds &delay)
+{
+    lock_guard<mutex> lock(mtx);
+
+    if (cancelled)
+        return false;
+
+    bool found = false;
+    for (size_t i = 0; i < targets.size(); i++) {
+        if (targets[i].state == BULK_PENDING && (!found || retry_at[i] < retry_at[index])) {
+            index = i;
+            found = true;
+        }
+    }
+    if (!found) // los que quedan están en curso en otras corutinas, que harán sus reintentos
+        return false;
+
+    time_point_t now = chrono::steady_clock::now();
+    if (retry_at[index] > now) {
+        delay = chrono::duration_cast<chrono::milliseconds>(retry_at[index] - now) + chrono::milliseconds(1);
+        return true;
+    }
+
+    delay = chrono::milliseconds(0);
+    charger_id = targets[index].charger_id;
+    targets[index].state = BULK_IN_PROGRESS;
+    targets[index].attempts++;
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      worker - Corutina que envía las peticiones de la operación.
+ *  SYNOPSIS
+ *      static Task<void> worker(shared_ptr<BulkOperation> self);
+ *  DESCRIPTION
+ *      Va cogiendo cargadores y esperando la respuesta de cada uno con co_await, sin bloquear
+ *      ningún thread, hasta que no queda ninguno. Los cargadores desconectados o sin
+ *      BootNotification aceptado fallan sin enviar nada (y se reintentan si quedan intentos).
+ *      Las esperas entre intentos son un co_await Delay. self mantiene viva la operación
+ *      mientras queden corutinas.
+ *  RETURN VALUE
+ *      Nada.
+ */
+Task<void> BulkOperation::worker(shared_ptr<BulkOperation> self)
+{
+    size_t index;
+    int charger_id;
+    chrono::milliseconds delay;
+
+    while (self->next_target(index, charger_id, delay)) {
+        if (delay.count() > 0) {
+            co_await Delay(delay);
+            continue;
+        }
+
+        Charger *charger = get_charger(charger_id);
+        if (charger == NULL) {
+            self->finish(index, {BULK_FAILED, "cargador inexistente"}, false);
+            continue;
+        }
+        if (charger->get_client() == static_cast<ws_cli_conn_t>(-1) || charger->get_boot().status != STATUS_BOOT_ACCEPTED) {
+            self->finish(index, {BULK_FAILED, "desconectado"}, true);
+            continue;
+        }
+
+        struct BulkOutcome outcome = co_await self->request(*charger);
+        self->finish(index, outcome, true);
+    }
+}
@@ -0,0 +1,127 @@
+/*
+ *  FILE
+ *      bulk_operation.h - header de bulk_operation.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de bulk_operation.cpp, declaración de las operaciones en bloque (una misma petición
+ *      enviada a un grupo de cargadores).
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _BULK_OPERATION_H_
+#define _BULK_OPERATION_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "charger.h"
+#include "ocpp_task.h"
+#include "lib_json_includes.h"
+
+#define BULK_MAX_CONCURRENCY 10    // peticiones en curso a la vez por defecto
+#define BULK_BACKOFF_MS      2000  // espera antes del primer reintento, se dobla en cada reintento
+#define BULK_MAX_BACKOFF_MS  60000 // espera máxima entre dos intentos
+
+using namespace std;
+
+// estado de la operación en un cargador
+enum bulk_state_t {
+    BULK_PENDING,     // aún no se ha enviado (o esperando a reintentar)
+    BULK_IN_PROGRESS, // petición en la cola del cargador o esperando la respuesta
+    BULK_ACCEPTED,    // el cargador ha aceptado la petición (Accepted, Scheduled, RebootRequired...)
+    BULK_REJECTED,    // el cargador ha contestado con otro status (definitivo, no se reintenta)
+    BULK_FAILED,      // desconectado, timeout, CALLERROR o respuesta incorrecta en todos los intentos
+    BULK_CANCELLED    // cancelada antes de enviarse
+};
+
+// un cargador de la operación
+struct BulkTarget {
+    int charger_id;
+    enum bulk_state_t state;
+    int attempts;  // intentos hechos
+    string result; // status de la respuesta o motivo del último fallo
+};
+
+// progreso de la operación
+struct BulkProgress {
+    size_t total;
+    size_t done;      // cargadores en un estado final
+    size_t succeeded; // ACCEPTED
+    size_t failed;    // REJECTED, FAILED o CANCELLED
+    vector<BulkTarget> targets;
+};
+
+// resultado de la petición en un cargador: BULK_ACCEPTED, BULK_REJECTED o BULK_FAILED
+struct BulkOutcome {
+    enum bulk_state_t state;
+    string result;
+};
+
+typedef function<void(const BulkProgress &progress)> bulk_callback_t;
+
+// petición de la operación: una corutina por cargador (charger_ops.h) que devuelve su resultado
+typedef function<Task<struct BulkOutcome>(Charger &charger)> bulk_request_t;
+
+bulk_request_t bulk_reset(enum Type_Reset type);
+bulk_request_t bulk_change_availability(int64_t connector_id, enum Type type);
+bulk_request_t bulk_unlock_connector(int64_t connector_id);
+bulk_request_t bulk_clear_cache();
+bulk_request_t bulk_change_configuration(const string &key, const string &value);
+
+/*
+ * Envía una misma petición (p.ej. un Reset) a un grupo de cargadores con como mucho max_concurrency
+ * peticiones en curso a la vez. No usa threads propios: hay max_concurrency corutinas que van
+ * cogiendo cargadores y esperan cada respuesta con co_await, así que después de la primera
+ * petición siguen en los threads de los cargadores. Si un cargador falla (desconectado, timeout
+ * o CALLERROR) se vuelve a intentar hasta max_attempts veces, con una espera que empieza en
+ * backoff_ms y se dobla en cada intento; mientras espera, su lugar lo ocupa otro cargador. Una
+ * respuesta con otro status es definitiva. Cada vez que cambia el estado de un cargador se llama
+ * a on_progress (desde los threads de los cargadores). Se crea con create() porque las corutinas guardan una
+ * referencia a la operación, así se puede soltar sin esperar las respuestas que faltan.
+ */
+class BulkOperation : public enable_shared_from_this<BulkOperation> {
+public:
+    static shared_ptr<BulkOperation> create(bulk_request_t request, const vector<int> &charger_ids,
+                                            int max_concurrency = BULK_MAX_CONCURRENCY, int max_attempts = 1,
+                                            int backoff_ms = BULK_BACKOFF_MS);
+
+    void start(bulk_callback_t on_progress = nullptr); // empieza a enviar
+    void cancel();  // no se envía ninguna petición más (las que están en curso terminan)
+    void wait();    // espera a que todos los cargadores estén en un estado final
+    bool finished() const;
+    BulkProgress progress() const;
+private:
+    typedef chrono::steady_clock::time_point time_point_t;
+
+    BulkOperation(bulk_request_t request, const vector<int> &charger_ids, int max_concurrency, int max_attempts,
+                  int backoff_ms);
+
+    static Task<void> worker(shared_ptr<BulkOperation> self); // envía peticiones hasta que no quedan
+    bool next_target(size_t &index, int &charger_id, chrono::milliseconds &delay); // coge el próximo cargador
+    void finish(size_t index, const struct BulkOutcome &outcome, bool retry);      // resultado de un intento
+    void notify(unique_lock<mutex> &lock);
+    BulkProgress progress_locked() const;
+
+    bulk_request_t request;
+    int max_concurrency;
+    int max_attempts;
+    int backoff_ms;
+
+    mutable mutex mtx;
+    condition_variable cv;
+    vector<BulkTarget> targets;
+    vector<time_point_t> retry_at; // instante a partir del cual se puede intentar cada cargador
+    size_t remaining;              // cargadores que aún no están en un estado final
+    bool cancelled;
+    bulk_callback_t on_progress;
+};
+
+#endif
@@ -15,45 +15,26 @@
 #include <ctime>
 #include <syslog.h>
 #include <algorithm>
+#include <future>
 #include <sqlite3.h>
-#include <QObject>
 #include "charger.h"
 #include "utils.h"
 #include "lib_json_includes.h"
 #include "ws_server.h"
-#include "../../backend_notifier.h"
+#include "transaction_index.h"
+#include "policies.h"
+#include "authorizer.h"
+#include "config_store.h"
+#include "offline_queue.h"
+#include "fleet_state.h"
+#include "meter_history.h"
+#include "event_sink.h"
+#include "latency.h"
 
 #define TIMEOUT_TIME 10 // tiempo de timeout para mensajes sin respuesta
 
 using namespace std;
 
-// lista de idTags, los cuales se podran autorizar
-vector<string> auth_list = {
-    "12345",
-    "D0431F35",
-    "00FFFFFFFF",
-    "idTag_Charger",
-    "100"
-};
-
-// lista de chargePointModels
-vector<string> cp_models = {
-    "MicroOcpp Simulator",
-    "model2",
-    "model3",
-    "model4",
-    "model5"
-};
-
-// lista de chargePointVendors
-vector<string> cp_vendors = {
-    "MicroOcpp",
-    "vendor2",
-    "vendor3",
-    "vendor4",
-    "vendor5"
-};
-
 /*
  *  NAME
  *      Charger - Constructor de la clase Charger
@@ -68,6 +49,10 @@ Charger::Charger(int ch_id, ws_cli_conn_t cl) : charger_id{ch_id}, client{cl}, e
 {
     current_transaction_id = 0;
     current_unique_id = 0;
+    outstanding_unique_id = 0;
+    call_result = {CALL_PENDING, ""};
+    queue_stats = {};
+    stopping = false;
 
     boot.status = STATUS_BOOT_REJECTED; /* hasta que no llega un BootNotification el estado es REJECTED para no poder
                                            iniciar ninguna operacin */
@@ -80,20 +65,11 @@ Charger::Charger(int ch_id, ws_cli_conn_t cl) : charger_id{ch_id}, client{cl}, e
 
     current_id_tag = ""; // inicializo el idTag para evitar errores
 
-    for (auto &transaction : transaction_list) // Inicializo la lista de transacciones a -1 inidicando que no hay ninguna
-        transaction = -1;
-
-    for (auto &conn : current_id_tags) // Inicializo la lista de los idTags de los conectores a "no_charging", indicando que no estan cargando
-        conn = "no_charging";
-
-    for (int i = 0; i < NUM_CONNECTORS + 1; i++)
-        syslog(LOG_DEBUG, "idTag%d: %s", i, current_id_tags[i].c_str());
-
-    for (auto &status : connectors_status) // Inicializo la lista de los status de los connectores a CONN_UNKNOWN, indicando que el estado no se conoce
-        status = CONN_UNKNOWN;
-
-    for (int i = 0; i < NUM_CONNECTORS + 1; i++)
-        syslog(LOG_DEBUG, "conn%d: %ld", i, connectors_status[i]);
+    // connectors empieza con NUM_CONNECTORS conectores en CONN_UNKNOWN y sin transaccin, hasta conocer NumberOfConnectors
+    connectors_known = false;
+    if (cl != static_cast<ws_cli_conn_t>(-1)) // en fleet_state solo estn los cargadores conectados
+        fleet_state.set_connectors(charger_id, connectors.get_connectors());
+    publish_snapshot();
 }
 
 /*
@@ -110,6 +86,10 @@ Charger::Charger(int ch_id, ws_cli_conn_t cl) : charger_id{ch_id}, client{cl}, e
  */
 void Charger::system_on_receive(const char *req)
 {
+    latency_begin(); // tiempo de cada etapa del mensaje, ver latency_report()
+
+    fleet_state.touch(charger_id, time(NULL)); // para detectar los cargadores que dejan de enviar mensajes
+
     // Paso req a string
     string s_req = req;
 
@@ -123,45 +103,261 @@ void Charger::system_on_receive(const char *req)
 
     // Compruebo el tipo de mensaje
     switch (req_header.message_type_id) {
-        case '2': // CALL
+        case '2': { // CALL
+            string cached;
+            if (dedup.lookup(req_header.unique_id, req_header.action, req_header.payload_hash, cached)) { // reenvo de un mensaje ya contestado
+                syslog(LOG_INFO, "%s: %s reenviado (uniqueId %s), se contesta con la respuesta guardada",
+                       __func__, req_header.action.c_str(), req_header.unique_id.c_str());
+                ws_send("CALL RESULT", &cached[0], client);
+                break;
+            }
+
             printf("proc_call\n");
             proc_call(req_header, request.payload); // se procesa el mensaje
             break;
+        }
 
         case '3': // CALLRESULT
+            latency_stage(LAT_HANDLE);
             printf("proc_call_result\n");
             proc_call_result(req_header, request.payload); // se procesa el mensaje
             break;
 
         case '4': // CALLERROR
+            latency_stage(LAT_HANDLE);
             syslog(LOG_WARNING, "CALL ERROR RECEIVED");
             printf("proc_call_error\n");
-            tx_state = ready_to_send; // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
+            {
+                string unique_id = req_header.unique_id;
+                remove_quotes(unique_id);
+
+                // si no corresponde a la peticin en curso no hace nada
+                finish_call(strtoull(unique_id.c_str(), NULL, 10), CALL_ERROR);
+            }
             break;
 
         default: // NOT IMPLEMENTED
             // Envio el mensaje al cargador
             printf("default\n");
+            latency_stage(LAT_HANDLE);
             ws_send("CALL ERROR", "[ERROR]: \"NotImplemented\",\"Requested Action is not known by receiver\"", client);
     }
+
+    // las respuestas y los errores no llevan la accin
+    if (req_header.message_type_id == '2')
+        latency_end(charger_id, req_header.action);
+    else
+        latency_end(charger_id, req_header.message_type_id == '3' ? "CALLRESULT" :
+                                req_header.message_type_id == '4' ? "CALLERROR" : "Other");
 }
 
 /*
  *  NAME
- *      send_request - Gestiona el envio de peticiones
+ *      ~Charger - Destructor de la clase Charger
  *  SYNOPSIS
- *      void send_request(int option, char *payload);
+ *      ~Charger();
+ *  DESCRIPTION
+ *      Para el thread de envo de peticiones. Las peticiones que an estaban en la cola
+ *      terminan como CALL_NOT_SENT.
+ *  RETURN VALUE
+ *      Nada.
+ */
+Charger::~Charger()
+{
+    {
+        lock_guard<mutex> lock(queue_mtx);
+        stopping = true;
+    }
+    queue_cv.notify_all();
+
+    if (dispatcher.joinable())
+        dispatcher.join();
+}
+
+/*
+ *  NAME
+ *      enqueue_request - Pone una peticin en la cola del cargador.
+ *  SYNOPSIS
+ *      void enqueue_request(int option, string payload, call_callback_t done);
+ *  DESCRIPTION
+ *      Pone una peticin al final de la cola del cargador y vuelve sin esperar. Las peticiones
+ *      se envan por orden, de una en una (OCPP solo permite una peticin sin respuesta por
+ *      cargador), desde un thread propio de cada cargador, de manera que varios cargadores
+ *      pueden tener una peticin en curso a la vez. Cuando termina se llama a done (si no es
+ *      NULL) desde el thread del cargador; done no puede llamar a send_request del mismo cargador.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void Charger::enqueue_request(int option, string payload, call_callback_t done)
+{
+    {
+        lock_guard<mutex> lock(queue_mtx);
+
+        if (!stopping) {
+            if (!dispatcher.joinable()) // el thread se crea con la primera peticin
+                dispatcher = thread(&Charger::dispatcher_loop, this);
+
+            command_queue.push_back({option, payload, done, chrono::steady_clock::now()});
+            queue_cv.notify_one();
+            return;
+        }
+    }
+
+    if (done) // el cargador se est destruyendo
+        done({CALL_NOT_SENT, ""});
+}
+
+/*
+ *  NAME
+ *      send_request - Envia una peticin al cargador y espera la respuesta.
+ *  SYNOPSIS
+ *      struct CallResult send_request(int option, string payload);
+ *  DESCRIPTION
+ *      Pone la peticin en la cola del cargador (enqueue_request) y espera a que se haya
+ *      enviado y contestado, o a que termine por timeout. No se puede llamar desde el
+ *      thread del cargador (callback de enqueue_request).
+ *  RETURN VALUE
+ *      El resultado de la peticin: si ha llegado la respuesta (y su payload),
+ *      un CALLERROR, el timeout o si no se ha podido enviar.
+ */
+struct CallResult Charger::send_request(int option, string payload)
+{
+    promise<struct CallResult> result;
+    future<struct CallResult> done = result.get_future();
+
+    enqueue_request(option, payload, [&result](const struct CallResult &r) { result.set_value(r); });
+
+    return done.get();
+}
+
+/*
+ *  NAME
+ *      get_queue_stats - Devuelve el estado de la cola de peticiones.
+ *  SYNOPSIS
+ *      struct CommandQueueStats get_queue_stats();
+ *  DESCRIPTION
+ *      Devuelve cuntas peticiones esperan en la cola, si hay una en curso y el tiempo
+ *      que han tenido que esperar las peticiones enviadas hasta ahora.
+ *  RETURN VALUE
+ *      El estado de la cola.
+ */
+struct CommandQueueStats Charger::get_queue_stats()
+{
+    lock_guard<mutex> lock(queue_mtx);
+
+    struct CommandQueueStats stats = queue_stats;
+    stats.depth = command_queue.size();
+    if (!command_queue.empty())
+        stats.oldest_wait_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - command_queue.front().enqueued).count();
+
+    return stats;
+}
+
+/*
+ *  NAME
+ *      dispatcher_loop - Bucle del thread de envo de peticiones.
+ *  SYNOPSIS
+ *      void dispatcher_loop();
+ *  DESCRIPTION
+ *      Saca las peticiones de la cola por orden y las enva (execute_request), esperando
+ *      la respuesta de cada una antes de enviar la siguiente.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void Charger::dispatcher_loop()
+{
+    for (;;) {
+        struct queued_call_t call;
+        {
+            unique_lock<mutex> lock(queue_mtx);
+            queue_cv.wait(lock, [this] { return stopping || !command_queue.empty(); });
+            if (stopping)
+                break;
+
+            call = command_queue.front();
+            command_queue.pop_front();
+
+            double wait_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - call.enqueued).count();
+            queue_stats.sent++;
+            queue_stats.total_wait_ms += wait_ms;
+            queue_stats.max_wait_ms = max(queue_stats.max_wait_ms, wait_ms);
+            queue_stats.in_flight = true;
+        }
+
+        struct CallResult result = execute_request(call.option, call.payload);
+
+        {
+            lock_guard<mutex> lock(queue_mtx);
+            queue_stats.in_flight = false;
+        }
+
+        if (call.done)
+            call.done(result);
+    }
+
+    // las peticiones que quedan no se enviarn
+    deque<struct queued_call_t> pending;
+    {
+        lock_guard<mutex> lock(queue_mtx);
+        pending.swap(command_queue);
+    }
+    for (auto &call : pending) {
+        if (call.done)
+            call.done({CALL_NOT_SENT, ""});
+    }
+}
+
+/*
+ *  NAME
+ *      finish_call - Da por terminada la peticin en curso.
+ *  SYNOPSIS
+ *      void finish_call(uint64_t unique_id, enum call_status_t status, const string &payload = "");
+ *  DESCRIPTION
+ *      Guarda el resultado de la peticin con uniqueId unique_id (CALL_ANSWERED con la respuesta,
+ *      o CALL_ERROR si el cargador ha contestado con un CALLERROR o con una respuesta no vlida)
+ *      y despierta a execute_request, que ya puede enviar la siguiente. Si unique_id ya no es el
+ *      de la peticin en curso (p.ej. ha llegado despus del timeout) no hace nada.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void Charger::finish_call(uint64_t unique_id, enum call_status_t status, const string &payload)
+{
+    {
+        lock_guard<mutex> lock(result_mtx);
+        if (outstanding_unique_id == 0 || unique_id != outstanding_unique_id)
+            return;
+
+        call_result = {status, payload};
+        tx_state = ready_to_send;
+        outstanding_unique_id = 0;
+    }
+    result_cv.notify_all();
+}
+
+/*
+ *  NAME
+ *      execute_request - Gestiona el envio de peticiones
+ *  SYNOPSIS
+ *      struct CallResult execute_request(int option, string payload);
  *  DESCRIPTION
  *      Gestiona el envio de peticiones, filtrando por tipo de peticin
  *      que se debe enviar. Controla los errores de los mensajes antes de enviarlos,
- *      y en caso que no haya envia la peticin.
+ *      y en caso que no haya envia la peticin. Espera la respuesta hasta TIMEOUT_TIME.
+ *      Solo se llama desde el thread de envo del cargador (dispatcher_loop).
  *  RETURN VALUE
- *      Nada.
+ *      El resultado de la peticin: si ha llegado la respuesta (y su payload),
+ *      un CALLERROR, el timeout o si no se ha podido enviar.
  */
-void Charger::send_request(int option, string payload)
+struct CallResult Charger::execute_request(int option, string payload)
 {
-    time_t start = time(NULL); // aqu ir la hora a la que se ha enviado la request
-    char message[256];
+    ws_cli_conn_t cl = client; // el thread del WebSocket lo cambia si el cargador se reconecta
+    if (cl == static_cast<ws_cli_conn_t>(-1)) { // cargador desconectado
+        syslog(LOG_WARNING, "%s: cargador %d desconectado", __func__, charger_id);
+        return {CALL_NOT_SENT, ""};
+    }
+
+    current_tx_request = ""; // se rellena si el payload es correcto
+    char message[1024];
     switch (option) {
         case '1': // ChangeAvailability
             // Compruebo si el mensaje que se ha pasado no est vacio
@@ -173,9 +369,7 @@ void Charger::send_request(int option, string payload)
                 else { // Mensaje escrito correctamente . Formo el mensaje completo y lo envio al cargador
                     remove_spaces(payload);
                     snprintf(message, sizeof(message), "[2,\"%lu\",\"ChangeAvailability\",%s]", ++current_unique_id, payload.c_str());
-                    ws_send("CALL", message, client);
                     current_tx_request = "\"ChangeAvailability\""; // actualizo el tipo de mensaje del cual espero la respuesta
-                    tx_state = sent; // cambio el estado a sent
                 }
             }
             else // No se ha podido leer . Error
@@ -186,9 +380,7 @@ void Charger::send_request(int option, string payload)
         case '2': // ClearCache
             // En este caso no hace falta formar ningun struct porque el mensaje est vacio, se responde directamente
             snprintf(message, sizeof(message), "[2,\"%lu\",\"ClearCache\",{}]", ++current_unique_id);
-            ws_send("CALL", message, client);
             current_tx_request = "\"ClearCache\""; // actualizo el tipo de mensaje del cual espero la respuesta
-            tx_state = sent; // cambio el estado a sent
             break;
 
         case '3': // DataTransfer
@@ -202,9 +394,7 @@ void Charger::send_request(int option, string payload)
                 else { // Mensaje escrito correctamente . Formo el mensaje completo y lo envio al cargador
                     remove_spaces(payload);
                     snprintf(message, sizeof(message), "[2,\"%lu\",\"DataTransfer\",%s]", ++current_unique_id, payload.c_str());
-                    ws_send("CALL", message, client);
                     current_tx_request = "\"DataTransfer\""; // actualizo el tipo de mensaje del cual espero la respuesta
-                    tx_state = sent; // cambio el estado a sent
                 }
             }
             else // No se ha podido leer . Error
@@ -218,9 +408,7 @@ void Charger::send_request(int option, string payload)
                 // Mensaje escrito correctamente . Formo el mensaje completo y lo envio al cargador
                 remove_spaces(payload);
                 snprintf(message, sizeof(message), "[2,\"%lu\",\"GetConfiguration\",%s]", ++current_unique_id, payload.c_str());
-                ws_send("CALL", message, client);
                 current_tx_request = "\"GetConfiguration\""; // actualizo el tipo de mensaje del cual espero la respuesta
-                tx_state = sent; // cambio el estado a sent
 
             }
             else // No se ha podido leer . Error
@@ -239,10 +427,9 @@ void Charger::send_request(int option, string payload)
                 else { // Mensaje escrito correctamente . Formo el mensaje completo y lo envio al cargador
                     remove_spaces(payload);
                     snprintf(message, sizeof(message), "[2,\"%lu\",\"RemoteStartTransaction\",%s]", ++current_unique_id, payload.c_str());
-                    ws_send("CALL", message, client);
                     current_tx_request = "\"RemoteStartTransaction\""; // actualizo el tipo de mensaje del cual espero la respuesta
+                    lock_guard<mutex> lock(state_mtx); // lo lee el thread del WebSocket
                     current_id_tag = request->id_tag;
-                    tx_state = sent; // cambio el estado a sent
                 }
             }
             else // No se ha podido leer . Error
@@ -261,9 +448,7 @@ void Charger::send_request(int option, string payload)
                 else { // Mensaje escrito correctamente . Formo el mensaje completo y lo envio al cargador
                     remove_spaces(payload);
                     snprintf(message, sizeof(message), "[2,\"%lu\",\"RemoteStopTransaction\",%s]", ++current_unique_id, payload.c_str());
-                    ws_send("CALL", message, client);
                     current_tx_request = "\"RemoteStopTransaction\""; // actualizo el tipo de mensaje del cual espero la respuesta
-                    tx_state = sent; // cambio el estado a sent
                 }
             }
             else // No se ha podido leer . Error
@@ -282,9 +467,7 @@ void Charger::send_request(int option, string payload)
                 else { // Mensaje escrito correctamente . Formo el mensaje completo y lo envio al cargador
                     remove_spaces(payload);
                     snprintf(message, sizeof(message), "[2,\"%lu\",\"Reset\",%s]", ++current_unique_id, payload.c_str());
-                    ws_send("CALL", message, client);
                     current_tx_request = "\"Reset\""; // actualizo el tipo de mensaje del cual espero la respuesta
-                    tx_state = sent; // cambio el estado a sent
                 }
             }
             else // No se ha podido leer . Error
@@ -303,9 +486,39 @@ void Charger::send_request(int option, string payload)
                 else { // Mensaje escrito correctamente . Formo el mensaje completo y lo envio al cargador
                     remove_spaces(payload);
                     snprintf(message, sizeof(message), "[2,\"%lu\",\"UnlockConnector\",%s]", ++current_unique_id, payload.c_str());
-                    ws_send("CALL", message, client);
                     current_tx_request = "\"UnlockConnector\""; // actualizo el tipo de mensaje del cual espero la respuesta
-                    tx_state = sent; // cambio el estado a sent
+                }
+            }
+            else // No se ha podido leer . Error
+                syslog(LOG_WARNING, "Payload for Action is syntactically incorrect or not conform the PDU structure for Action");
+
+            break;
+
+        case '9': // ChangeConfiguration
+            // Compruebo si el mensaje que se ha pasado no est vacio
+            if (payload.c_str() && (payload.size() > 1)) { // Se ha podido leer
+                struct ChangeConfigurationReq *request = cJSON_ParseChangeConfigurationReq(payload.c_str()); // Lo paso a string para comprobar si los campos son correcctos
+
+                if (request == NULL || request->key == NULL || request->value == NULL || strcmp(request->key, "") == 0 ||
+                    strlen(request->key) > 50 || strlen(request->value) > 500) { // Falta un camp obligatori o es massa llarg . Error
+                    syslog(LOG_WARNING, "Payload for Action is syntactically incorrect or not conform the PDU structure for Action");
+                }
+                else { // Mensaje escrito correctamente . Formo el mensaje completo y lo envio al cargador
+                    // se vuelve a generar el payload en vez de usar remove_spaces, el valor puede tener espacios
+                    char *json = cJSON_PrintChangeConfigurationReq(request);
+                    payload = json ? json : "";
+                    free(json);
+                    payload.erase(remove_if(payload.begin(), payload.end(), [](char c) { return c == '\n' || c == '\t'; }), payload.end());
+
+                    snprintf(message, sizeof(message), "[2,\"%lu\",\"ChangeConfiguration\",%s]", ++current_unique_id, payload.c_str());
+                    current_tx_request = "\"ChangeConfiguration\""; // actualizo el tipo de mensaje del cual espero la respuesta
+                    current_change_configuration = {request->key, request->value};
+                }
+
+                if (request) {
+                    free(request->key);
+                    free(request->value);
+                    free(request);
                 }
             }
             else // No se ha podido leer . Error
@@ -318,17 +531,31 @@ void Charger::send_request(int option, string payload)
             syslog(LOG_WARNING, "Invalid option");
     }
 
-    // Timeout desprs d'enviar una petici
-    struct timespec request = {0, 10000000}; // defineix un sleep de 10 ms per anar comprovant el temps de timeout
-    // comprovo si ha passat el temps de timeout
-    while (tx_state == sent) { // si l'estat torna a ser ready_to_send, surt, sin es posa a ready_to_send aqu desprs del temps de timeout
-        time_t now = time(NULL); // temps actual
-        if (difftime(now, start) >= TIMEOUT_TIME) { // ja ha passat el temps de timeout . surto del bucle i deixo enviar una altra petici
-            tx_state = ready_to_send;
-            syslog(LOG_WARNING, "Timeout");
-        }
-        nanosleep(&request, NULL); // dejo un tiempo de sleep para dejar trabajar al otro thread
+    if (current_tx_request.empty()) // no se ha enviado nada
+        return {CALL_NOT_SENT, ""};
+
+    // registro la peticin antes de enviarla, la respuesta puede llegar antes de que ws_send vuelva
+    {
+        lock_guard<mutex> lock(result_mtx);
+        call_result = {CALL_PENDING, ""};
+        outstanding_unique_id = current_unique_id;
+        outstanding_action = current_tx_request;
+        tx_state = sent;
+    }
+    ws_send("CALL", message, cl);
+
+    // espero la respuesta (finish_call) o el timeout
+    unique_lock<mutex> lock(result_mtx);
+    if (!result_cv.wait_for(lock, chrono::seconds(TIMEOUT_TIME), [this] { return tx_state == ready_to_send; })) {
+        tx_state = ready_to_send;
+        outstanding_unique_id = 0; // una respuesta posterior ya no corresponde a ninguna peticin
+        syslog(LOG_WARNING, "Timeout");
     }
+
+    if (call_result.status == CALL_PENDING)
+        call_result.status = CALL_TIMEOUT;
+
+    return call_result;
 }
 
 /*
@@ -348,47 +575,115 @@ int Charger::get_charger_id()
 
 /*
  *  NAME
- *      get_connectors_status - Devuelve el vector de connectors_status.
+ *      get_connectors_status - Devuelve el estado de cada conector.
  *  SYNOPSIS
  *      vector<int64_t> get_connectors_status();
  *  DESCRIPTION
- *      Devuelve el vector de connectors_status.
+ *      Devuelve el estado (CONN_<>) de cada conector, incluido el conector 0, a partir
+ *      del ltimo snapshot publicado.
  *  RETURN VALUE
- *      Un vector correspondiente a connectors_status.
+ *      Un vector con el estado de cada conector.
  */
 vector<int64_t> Charger::get_connectors_status()
 {
-    return connectors_status;
+    struct ChargerSnapshot snap;
+    get_snapshot(snap);
+
+    return vector<int64_t>(snap.status, snap.status + snap.connectors + 1);
 }
 
 /*
  *  NAME
- *      get_current_id_tags - Devuelve el vector de current_id_tags.
+ *      get_current_id_tags - Devuelve el idTag de la transaccin de cada conector.
  *  SYNOPSIS
  *      vector<string> get_current_id_tags();
  *  DESCRIPTION
- *      Devuelve el vector de current_id_tags.
+ *      Devuelve el idTag de la transaccin en curso de cada conector, a partir del ltimo
+ *      snapshot publicado.
  *  RETURN VALUE
- *      Un vector correspondiente a current_id_tags.
+ *      Un vector con el idTag de cada conector ("no_charging" si no est cargando).
  */
 vector<string> Charger::get_current_id_tags()
 {
-    return current_id_tags;
+    struct ChargerSnapshot snap;
+    get_snapshot(snap);
+
+    return vector<string>(snap.id_tag, snap.id_tag + snap.connectors + 1);
 }
 
 /*
  *  NAME
- *      get_current_id_tags - Devuelve el vector de transaction_list.
+ *      get_transaction_list - Devuelve el transactionId en curso de cada conector.
  *  SYNOPSIS
  *      vector<int64_t> get_transaction_list();
  *  DESCRIPTION
- *      Devuelve el vector de transaction_list.
+ *      Devuelve el transactionId de la transaccin en curso de cada conector, a partir del
+ *      ltimo snapshot publicado.
  *  RETURN VALUE
- *      Un vector correspondiente a transaction_list.
+ *      Un vector con el transactionId de cada conector (-1 si no hay ninguna).
  */
 vector<int64_t> Charger::get_transaction_list()
 {
-    return transaction_list;
+    struct ChargerSnapshot snap;
+    get_snapshot(snap);
+
+    return vector<int64_t>(snap.transaction, snap.transaction + snap.connectors + 1);
+}
+
+/*
+ *  NAME
+ *      get_snapshot - Devuelve una copia consistente del estado del cargador.
+ *  SYNOPSIS
+ *      uint64_t get_snapshot(struct ChargerSnapshot &dest) const;
+ *  DESCRIPTION
+ *      Copia en dest el ltimo estado publicado (publish_snapshot). Se puede llamar
+ *      desde cualquier thread: no coge ningn mutex ni reserva memoria, y nunca devuelve un
+ *      estado a medio actualizar.
+ *  RETURN VALUE
+ *      La versin del snapshot (cuntas veces se ha publicado).
+ */
+uint64_t Charger::get_snapshot(struct ChargerSnapshot &dest) const
+{
+    return snapshot.read(dest);
+}
+
+/*
+ *  NAME
+ *      publish_snapshot - Publica el estado del cargador.
+ *  SYNOPSIS
+ *      void publish_snapshot();
+ *  DESCRIPTION
+ *      Forma un ChargerSnapshot con el estado actual de los conectores, el boot y el cargador
+ *      y lo publica para los lectores de otros threads. Se llama despus de cada cambio, tambin
+ *      desde el thread de otro cargador (delete_transaction_id): el estado se lee y se escribe en
+ *      el SeqLock con state_mtx cogido, as no se lee a medio cambiar ni se publica un estado ms
+ *      viejo encima de uno ms nuevo.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void Charger::publish_snapshot()
+{
+    struct ChargerSnapshot snap;
+    memset(&snap, 0, sizeof(snap));
+
+    unique_lock<mutex> lock(state_mtx);
+    snap.charger_id = charger_id;
+    snap.connectors = connectors.get_connectors();
+    snap.connected = client != static_cast<ws_cli_conn_t>(-1);
+    snap.boot_status = boot.status;
+    snprintf(snap.vendor, sizeof(snap.vendor), "%s", current_vendor.c_str());
+    snprintf(snap.model, sizeof(snap.model), "%s", current_model.c_str());
+
+    for (int i = 0; i <= snap.connectors; i++) {
+        snap.status[i] = connectors.get_status(i);
+        snap.transaction[i] = connectors.transaction_id(i);
+        snprintf(snap.id_tag[i], sizeof(snap.id_tag[i]), "%s", connector_id_tag(i).c_str());
+    }
+
+    snapshot.write(snap);
+    lock.unlock();
+
+    event_sink().charger_changed(charger_id); // la interfaz lo relee en el siguiente frame
 }
 
 /*
@@ -418,6 +713,7 @@ ws_cli_conn_t Charger::get_client()
  */
 struct BootNotificationConf Charger::get_boot()
 {
+    lock_guard<mutex> lock(state_mtx); // lo leen otros threads (cola offline, configuracin)
     return boot;
 }
 
@@ -433,7 +729,10 @@ struct BootNotificationConf Charger::get_boot()
  */
 string Charger::get_current_vendor()
 {
-    return current_vendor;
+    struct ChargerSnapshot snap;
+    get_snapshot(snap);
+
+    return snap.vendor;
 }
 
 /*
@@ -448,7 +747,50 @@ string Charger::get_current_vendor()
  */
 string Charger::get_current_model()
 {
-    return current_model;
+    struct ChargerSnapshot snap;
+    get_snapshot(snap);
+
+    return snap.model;
+}
+
+/*
+ *  NAME
+ *      get_identity - Devuelve la identidad del cargador.
+ *  SYNOPSIS
+ *      string get_identity();
+ *  DESCRIPTION
+ *      Devuelve la identidad del cargador que se ha conectado en esta posicin: el
+ *      chargePointSerialNumber de su ltimo BootNotification aceptado, o el chargeBoxSerialNumber
+ *      si no lo enva. Se conserva al desconectarse, as se le pueden guardar peticiones
+ *      (offline_queue). La URL de conexin (chargePointIdentity) no llega del servidor WebSocket.
+ *  RETURN VALUE
+ *      La identidad, vaca si no se conoce.
+ */
+string Charger::get_identity()
+{
+    lock_guard<mutex> lock(state_mtx);
+    return identity;
+}
+
+/*
+ *  NAME
+ *      reset_boot - Vuelve a esperar un BootNotification.
+ *  SYNOPSIS
+ *      void reset_boot();
+ *  DESCRIPTION
+ *      Deja el estado del boot en REJECTED, como al crear el cargador, cuando se cierra la
+ *      conexin. Hasta el BootNotification de la conexin siguiente no se le envan peticiones
+ *      guardadas ni se aceptan otros mensajes.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void Charger::reset_boot()
+{
+    {
+        lock_guard<mutex> lock(state_mtx);
+        boot.status = STATUS_BOOT_REJECTED;
+    }
+    publish_snapshot();
 }
 
 /*
@@ -457,14 +799,29 @@ string Charger::get_current_model()
  *  SYNOPSIS
  *      void set_client(ws_cli_conn_t cl);
  *  DESCRIPTION
- *      Modifica el client del WebSocket.
+ *      Modifica el client del WebSocket. Al desconectarse (cl = -1) se liberan las posiciones
+ *      del cargador en fleet_state, y al conectarse se vuelven a reservar con el estado conocido
+ *      de los conectores.
  *  RETURN VALUE
  *      Nada.
  */
 void Charger::set_client(ws_cli_conn_t cl)
 {
     client = cl;
-    printf("client = %ld\n", client);
+    error = ErrorMessage(cl); // los mensajes de error van al nuevo cliente
+    printf("client = %ld\n", cl);
+
+    {
+        lock_guard<mutex> lock(state_mtx);
+        if (cl == static_cast<ws_cli_conn_t>(-1))
+            fleet_state.release(charger_id);
+        else {
+            fleet_state.set_connectors(charger_id, connectors.get_connectors());
+            for (int i = 0; i <= connectors.get_connectors(); i++)
+                fleet_state.set_connector(charger_id, i, connectors.get_status(i), connectors.transaction_id(i));
+        }
+    }
+    publish_snapshot();
 }
 
 /*
@@ -479,7 +836,11 @@ void Charger::set_client(ws_cli_conn_t cl)
  */
 void Charger::set_current_vendor(string vendor)
 {
-    current_vendor = vendor;
+    {
+        lock_guard<mutex> lock(state_mtx);
+        current_vendor = vendor;
+    }
+    publish_snapshot();
 }
 
 /*
@@ -494,7 +855,11 @@ void Charger::set_current_vendor(string vendor)
  */
 void Charger::set_current_model(string model)
 {
-    current_model = model;
+    {
+        lock_guard<mutex> lock(state_mtx);
+        current_model = model;
+    }
+    publish_snapshot();
 }
 
 /*
@@ -511,7 +876,7 @@ void Charger::set_current_model(string model)
  */
 void Charger::proc_call(struct header_st &header, string payload)
 {
-    if (boot.status == STATUS_BOOT_REJECTED && (header.action != "\"BootNotification\"")) // cargador no inicializado . Error
+    if (get_boot().status == STATUS_BOOT_REJECTED && (header.action != "\"BootNotification\"")) // cargador no inicializado . Error
         error.generic_error(header.unique_id.c_str());
     else {
         if (header.action == "\"Authorize\"")  {
@@ -564,81 +929,101 @@ void Charger::proc_call_result(const struct header_st &header, string payload)
 {
     string unique_id = header.unique_id; // hago una copia del uniqueId
     remove_quotes(unique_id);
+    uint64_t id = strtoull(unique_id.c_str(), NULL, 10);
+
+    // busco la peticin a la que corresponde la respuesta por su uniqueId. El resultado se guarda
+    // con finish_call cuando se ha validado la respuesta: CALL_ERROR si no es vlida
+    string action;
+    {
+        lock_guard<mutex> lock(result_mtx);
+        if (outstanding_unique_id != 0 && id == outstanding_unique_id)
+            action = outstanding_action;
+    }
 
-    if (strtol(unique_id.c_str(), NULL, 10) != static_cast<long>(current_unique_id)) { // el uniqueId de la respuesta no es el mismo que el de la peticin . Error
+    if (action.empty()) { // el uniqueId no es el de la peticin en curso (p.ej. respuesta despus del timeout) . se ignora
         syslog(LOG_WARNING, "The uniqueId of this response is not in accordance with the uniqueId of the request");
-        tx_state = ready_to_send; // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
     }
     else { // el tipo de mensaje y el uniqueId de la respuesta corresponden al de la peticin . ahora miro que tipo de mensjae es y lo proceso
-        if (current_tx_request == "\"ChangeAvailability\"") {
+        if (action == "\"ChangeAvailability\"") {
             // Paso el string a struct JSON
             struct ChangeAvailabilityConf *change_availability_conf_payload = cJSON_ParseChangeAvailabilityConf(payload.c_str());
 
             // Compuebo errores antes de enviar la respuesta
             if (change_availability_conf_payload == NULL) { // Error: FormationViolation
                 error.formation_violation(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else if (change_availability_conf_payload->status == -2) { // Error: TypeConstraintViolation
                 error.type_constraint_violation(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else if (change_availability_conf_payload->status == -1) { // Error: ProtocolError
                 error.protocol_error(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else { // No errors
                 syslog(LOG_DEBUG, "ChangeAvailability: No errors");
-                tx_state = ready_to_send; // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
+                finish_call(id, CALL_ANSWERED, payload); // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
             }
         }
-        else if (current_tx_request == "\"ClearCache\"") {
+        else if (action == "\"ClearCache\"") {
             // Paso el string a struct JSON
             struct ClearCacheConf *clear_cache_conf_payload = cJSON_ParseClearCacheConf(payload.c_str());
 
             // Compuebo errores antes de enviar la respuesta
             if (clear_cache_conf_payload == NULL) { // Error: FormationViolation
                 error.formation_violation(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else if (clear_cache_conf_payload->status == -1) { // Error: ProtocolError
                 error.protocol_error(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else if (clear_cache_conf_payload->status == -2) { // Error: TypeConstraintViolation
                 error.type_constraint_violation(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else { // No errors
                 syslog(LOG_DEBUG, "ClearCache: No errors");
-                tx_state = ready_to_send; // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
+                finish_call(id, CALL_ANSWERED, payload); // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
             }
         }
-        else if (current_tx_request == "\"DataTransfer\"") {
+        else if (action == "\"DataTransfer\"") {
             // Paso el string a struct JSON
             struct DataTransferConf *data_transfer_conf_payload = cJSON_ParseDataTransferConf(payload.c_str());
 
             // Compuebo errores antes de enviar la respuesta
             if (data_transfer_conf_payload == NULL) { // Error: FormationViolation
                 error.formation_violation(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else if (data_transfer_conf_payload->status == -1) { // Error: ProtocolError
                 error.protocol_error(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else if (data_transfer_conf_payload->status == -2 ||
                 (data_transfer_conf_payload->data && strcmp(data_transfer_conf_payload->data, "err") == 0)) { // Error: TypeConstraintViolation
 
                 error.type_constraint_violation(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else if ((data_transfer_conf_payload->data && strcmp(data_transfer_conf_payload->data, "") == 0)) {// Error: PropertyConstraintViolation
                 error.property_constraint_violation(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else { // No errors
                 syslog(LOG_DEBUG, "DataTransfer: No errors");
-                tx_state = ready_to_send; // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
+                finish_call(id, CALL_ANSWERED, payload); // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
             }
         }
-        else if (current_tx_request == "\"GetConfiguration\"") {
+        else if (action == "\"GetConfiguration\"") {
             // Paso el string a struct JSON
             struct GetConfigurationConf *get_configuration_conf_payload = cJSON_ParseGetConfigurationConf(payload.c_str());
 
             // Compuebo errores antes de enviar la respuesta
             if (get_configuration_conf_payload == NULL) { // Error: FormationViolation
                 error.formation_violation(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
                 return;
             }
 
@@ -654,82 +1039,27 @@ void Charger::proc_call_result(const struct header_st &header, string payload)
                         strcmp(configuration_key->key, "") == 0) { // Error: ProtocolError
 
                         error.protocol_error(header.unique_id.c_str());
+                        finish_call(id, CALL_ERROR);
                         return;
                     }
                     else if (configuration_key->key && strcmp(configuration_key->key, "err") == 0) { // Error: TypeConstraintViolation
                         error.type_constraint_violation(header.unique_id.c_str());
+                        finish_call(id, CALL_ERROR);
                         return;
                     }
                     else if ((configuration_key->key && strlen(configuration_key->key) > 50) ||
                              (configuration_key->value && strlen(configuration_key->value) > 500)) { // Error: OccurrenceConstraintViolation
 
                         error.occurrence_constraint_violation(header.unique_id.c_str());
+                        finish_call(id, CALL_ERROR);
                         return;
                     }
-                    else { // No errors
-                        if (strcmp(configuration_key->key, "AuthorizeRemoteTxRequests") == 0) {
-                            conf_keys.AuthorizeRemoteTxRequests = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "ClockAlignedDataInterval") == 0) {
-                            conf_keys.ClockAlignedDataInterval = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "ConnectionTimeOut") == 0) {
-                            conf_keys.ConnectionTimeOut = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "ConnectorPhaseRotation") == 0) {
-                            conf_keys.ConnectorPhaseRotation = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "GetConfigurationMaxKeys") == 0) {
-                            conf_keys.GetConfigurationMaxKeys = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "HeartbeatInterval") == 0) {
-                            conf_keys.HeartbeatInterval = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "LocalAuthorizeOffline") == 0) {
-                            conf_keys.LocalAuthorizeOffline = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "LocalPreAuthorize") == 0) {
-                            conf_keys.LocalPreAuthorize = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "MeterValuesAlignedData") == 0) {
-                            conf_keys.MeterValuesAlignedData = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "MeterValuesSampledData") == 0) {
-                            conf_keys.MeterValuesSampledData = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "MeterValueSampleInterval") == 0) {
-                            conf_keys.MeterValueSampleInterval = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "NumberOfConnectors") == 0) {
-                            conf_keys.NumberOfConnectors = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "ResetRetries") == 0) {
-                            conf_keys.ResetRetries = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "StopTransactionOnEVSideDisconnect") == 0) {
-                            conf_keys.StopTransactionOnEVSideDisconnect = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "StopTransactionOnInvalidId") == 0) {
-                            conf_keys.StopTransactionOnInvalidId = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "StopTxnAligneData") == 0) {
-                            conf_keys.StopTxnAligneData = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "StopTxnSampledData") == 0) {
-                            conf_keys.StopTxnSampledData = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "SupportedFeatureProfiles") == 0) {
-                            conf_keys.SupportedFeatureProfiles = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "TransactionMessageAtempts") == 0) {
-                            conf_keys.TransactionMessageAtempts = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "TransactionMessageRetryInterval") == 0) {
-                            conf_keys.TransactionMessageRetryInterval = configuration_key->value;
-                        }
-                        else if (strcmp(configuration_key->key, "UnlockConnectorOnEVSideDisconnect") == 0) {
-                            conf_keys.UnlockConnectorOnEVSideDisconnect = configuration_key->value;
-                        }
+                    else { // No errors -> guardo la clave, tambin las propias del fabricante
+                        config_store.update(charger_id, configuration_key->key,
+                                            configuration_key->value ? configuration_key->value : "", configuration_key->readonly);
+
+                        if (strcmp(configuration_key->key, "NumberOfConnectors") == 0 && configuration_key->value)
+                            set_number_of_connectors(configuration_key->value);
                     }
                 }
             }
@@ -744,90 +1074,132 @@ void Charger::proc_call_result(const struct header_st &header, string payload)
 
                     if (strlen(unknown_key) > 500) { // Error: OccurrenceConstraintViolation
                         error.occurrence_constraint_violation(header.unique_id.c_str());
+                        finish_call(id, CALL_ERROR);
                         return;
                     }
+
+                    config_store.mark_unknown(charger_id, unknown_key);
                 }
             }
 
             // No errors
             syslog(LOG_DEBUG, "GetConfiguration: No errors");
-            tx_state = ready_to_send; // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
+            finish_call(id, CALL_ANSWERED, payload); // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
         }
-        else if (current_tx_request == "\"RemoteStartTransaction\"") {
+        else if (action == "\"RemoteStartTransaction\"") {
             // Paso el string a struct JSON
             struct RemoteStartTransactionConf *remote_start_conf_payload = cJSON_ParseRemoteStartTransactionConf(payload.c_str());
 
             // Compuebo errores antes de enviar la respuesta
             if (remote_start_conf_payload == NULL) { // Error: FormationViolation
                 error.formation_violation(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else if (remote_start_conf_payload->status == -1) { // Error: ProtocolError
                 error.protocol_error(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else if (remote_start_conf_payload->status == -2) { // Error: TypeConstraintViolation
                 error.type_constraint_violation(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else { // No errors
                 syslog(LOG_DEBUG, "RemoteStartTransaction: No errors");
-                tx_state = ready_to_send; // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
+                finish_call(id, CALL_ANSWERED, payload); // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
             }
         }
-        else if (current_tx_request == "\"RemoteStopTransaction\"") {
+        else if (action == "\"RemoteStopTransaction\"") {
             // Paso el string a struct JSON
             struct RemoteStopTransactionConf *remote_stop_conf_payload = cJSON_ParseRemoteStopTransactionConf(payload.c_str());
 
             // Compuebo errores antes de enviar la respuesta
             if (remote_stop_conf_payload == NULL) { // Error: FormationViolation
                 error.formation_violation(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else if (remote_stop_conf_payload->status == -1) { // Error: ProtocolError
                 error.protocol_error(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else if (remote_stop_conf_payload->status == -2) { // Error: TypeConstraintViolation
                 error.type_constraint_violation(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else { // No errors
                 syslog(LOG_DEBUG, "RemoteStopTransaction: No errors");
-                tx_state = ready_to_send; // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
+                finish_call(id, CALL_ANSWERED, payload); // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
             }
         }
-        else if (current_tx_request == "\"Reset\"") {
+        else if (action == "\"Reset\"") {
             // Paso el string a struct JSON
             struct ResetConf *reset_conf_payload = cJSON_ParseResetConf(payload.c_str());
 
             // Compuebo errores antes de enviar la respuesta
             if (reset_conf_payload == NULL) { // Error: FormationViolation
                 error.formation_violation(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else if (reset_conf_payload->status == -1) { // Error: ProtocolError
                 error.protocol_error(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else if (reset_conf_payload->status == -2) { // Error: TypeConstraintViolation
                 error.type_constraint_violation(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else { // No errors
                 syslog(LOG_DEBUG, "Reset: No errors");
-                tx_state = ready_to_send; // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
+                finish_call(id, CALL_ANSWERED, payload); // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
             }
         }
-        else if (current_tx_request == "\"UnlockConnector\"") {
+        else if (action == "\"UnlockConnector\"") {
             // Paso el string a struct JSON
             struct UnlockConnectorConf *unlock_connector_conf_payload = cJSON_ParseUnlockConnectorConf(payload.c_str());
 
             // Compuebo errores antes de enviar la respuesta
             if (unlock_connector_conf_payload == NULL) { // Error: FormationViolation
                 error.formation_violation(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else if (unlock_connector_conf_payload->status == -1) { // Error: ProtocolError
                 error.protocol_error(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else if (unlock_connector_conf_payload->status == -2) { // Error: TypeConstraintViolation
                 error.type_constraint_violation(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
             }
             else { // No errors
                 syslog(LOG_DEBUG, "UnlockConnector: No errors");
-                tx_state = ready_to_send; // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
+                finish_call(id, CALL_ANSWERED, payload); // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
+            }
+        }
+        else if (action == "\"ChangeConfiguration\"") {
+            // Paso el string a struct JSON
+            struct ChangeConfigurationConf *change_configuration_conf_payload = cJSON_ParseChangeConfigurationConf(payload.c_str());
+
+            // Compuebo errores antes de enviar la respuesta
+            if (change_configuration_conf_payload == NULL) { // Error: FormationViolation
+                error.formation_violation(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
+            }
+            else if (change_configuration_conf_payload->status == -1) { // Error: ProtocolError
+                error.protocol_error(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
+            }
+            else if (change_configuration_conf_payload->status == -2) { // Error: TypeConstraintViolation
+                error.type_constraint_violation(header.unique_id.c_str());
+                finish_call(id, CALL_ERROR);
+            }
+            else { // No errors -> si se ha aceptado, el valor nuevo ya es el del cargador
+                if (change_configuration_conf_payload->status == STATUS_CHANGE_CONFIGURATION_ACCEPTED ||
+                    change_configuration_conf_payload->status == STATUS_CHANGE_CONFIGURATION_REBOOT_REQUIRED)
+                    config_store.update(charger_id, current_change_configuration.first, current_change_configuration.second, false);
+
+                syslog(LOG_DEBUG, "ChangeConfiguration: No errors");
+                finish_call(id, CALL_ANSWERED, payload); // cambio el estado a disponible para enviar, ya que ha llegado la respuesta . se para el timeout y deja enviar otra peticin
             }
+            free(change_configuration_conf_payload);
         }
         // Not supported
         else { // Error: NotSupported
@@ -836,10 +1208,44 @@ void Charger::proc_call_result(const struct header_st &header, string payload)
 
             // Envio el missatge al carregador
             ws_send("CALL ERROR", message, client);
+            finish_call(id, CALL_ERROR);
         }
     }
 }
 
+/*
+ *  NAME
+ *      send_call_result - Enva la respuesta a un mensaje del cargador.
+ *  SYNOPSIS
+ *      void send_call_result(const struct header_st &header, char *message, ws_cli_conn_t cl);
+ *  DESCRIPTION
+ *      Enva un CALLRESULT al cargador y lo guarda en la cach de reenvos, para contestar
+ *      igual si el cargador vuelve a enviar el mismo mensaje (header es el del mensaje).
+ *  RETURN VALUE
+ *      Nada.
+ */
+void Charger::send_call_result(const struct header_st &header, char *message, ws_cli_conn_t cl)
+{
+    dedup.store(header.unique_id, header.action, header.payload_hash, message);
+    ws_send("CALL RESULT", message, cl);
+}
+
+/*
+ *  NAME
+ *      get_duplicates_suppressed - Devuelve los reenvos contestados con la cach.
+ *  SYNOPSIS
+ *      uint64_t get_duplicates_suppressed();
+ *  DESCRIPTION
+ *      Devuelve cuntos mensajes reenviados por el cargador se han contestado con la
+ *      respuesta guardada, sin volver a procesarlos.
+ *  RETURN VALUE
+ *      El nmero de reenvos.
+ */
+uint64_t Charger::get_duplicates_suppressed()
+{
+    return dedup.suppressed();
+}
+
 /*
  *  NAME
  *      check_concurrent_tx_id_tag - Comprueba si ya se ha iniciado una carga con un idTag concreto.
@@ -853,33 +1259,26 @@ void Charger::proc_call_result(const struct header_st &header, string payload)
  */
 bool Charger::check_concurrent_tx_id_tag(string id_tag)
 {
-    for (auto elem : current_id_tags) {
-        if (strcasecmp(elem.c_str(), id_tag.c_str()) == 0)
-            return true;
-    }
-
-    return false;
+    return transaction_index.id_tag_active(id_tag); // el idTag puede estar cargando en cualquier cargador
 }
 
 /*
  *  NAME
- *      check_transaction_id - Comprueba si un transactionId se encuentra en la transaction_list.
+ *      check_transaction_id - Comprueba si un transactionId es una transaccin activa de este cargador.
  *  SYNOPSIS
  *      check_transaction_id(int64_t transaction_id)
  *  DESCRIPTION
- *      Comprueba si un transactionId se encuentra en la transaction_list del sistema de control.
+ *      Comprueba en el transaction_index si un transactionId es una transaccin activa
+ *      iniciada en este cargador.
  *  RETURN VALUE
  *      Devuelve true si es valido.
  *      Devuelve false en caso contrari.
  */
 bool Charger::check_transaction_id(int64_t transaction_id)
 {
-    for (auto elem : transaction_list) {
-        if (elem == transaction_id)
-            return true;
-    }
+    TransactionInfo info;
 
-    return false;
+    return transaction_index.find(transaction_id, info) && info.charger_id == charger_id;
 }
 
 /*
@@ -888,37 +1287,174 @@ bool Charger::check_transaction_id(int64_t transaction_id)
  *  SYNOPSIS
  *      void delete_transaction_id(int64_t transaction_id);
  *  DESCRIPTION
- *      Borra el transactionId de la transactionList del sistema de control.
+ *      Borra el transactionId del transaction_index y libera el conector del cargador
+ *      donde se inici la transaccin.
  *  RETURN VALUE
  *      Nada.
  */
 void Charger::delete_transaction_id(int64_t transaction_id)
 {
-    for (auto elem : transaction_list) {
-        if (elem == transaction_id)
-            elem = -1;
+    transaction_index.end(transaction_id);
+
+    int connector;
+    {
+        lock_guard<mutex> lock(state_mtx); // se llama tambin desde el thread de otro cargador
+        connector = connectors.find_transaction(transaction_id);
+        if (connector > 0) {
+            connectors.stop(connector, transaction_id);
+            fleet_state.set_power(charger_id, connector, 0); // sin transaccin el conector ya no carga
+        }
     }
+
+    if (connector > 0)
+        publish_connector(connector);
 }
 
 /*
  *  NAME
- *      check_id_tag - Comprueba si el idTag est en la auth_list.
+ *      connector_id_tag - Devuelve el idTag de la transaccin en curso de un conector.
  *  SYNOPSIS
- *      bool check_id_tag(char *id_tag)
+ *      string connector_id_tag(int connector);
  *  DESCRIPTION
- *      Comprueba si el idTag est en la auth_lis.
+ *      Busca en el transaction_index el idTag con el que se inici la transaccin en curso
+ *      del conector.
  *  RETURN VALUE
- *      Devuelve true si est.
- *      Devuelve false en caso contrario.
+ *      El idTag, "no_charging" si el conector no tiene ninguna transaccin en curso.
  */
-bool Charger::check_id_tag(char *id_tag)
+string Charger::connector_id_tag(int connector)
 {
-    int cnt = count(auth_list.begin(), auth_list.end(), id_tag);
+    struct TransactionInfo tx;
+    if (connectors.in_transaction(connector) && transaction_index.find(connectors.transaction_id(connector), tx))
+        return tx.id_tag;
 
-    if (cnt > 0)
+    return "no_charging";
+}
+
+/*
+ *  NAME
+ *      get_current_id_tag - Devuelve el current idTag.
+ *  SYNOPSIS
+ *      string get_current_id_tag();
+ *  DESCRIPTION
+ *      Devuelve una copia del idTag del ltimo Authorize aceptado (o del ltimo
+ *      RemoteStartTransaction), que se cambia desde otros threads.
+ *  RETURN VALUE
+ *      Un string correspondiente al current idTag.
+ */
+string Charger::get_current_id_tag()
+{
+    lock_guard<mutex> lock(state_mtx);
+    return current_id_tag;
+}
+
+/*
+ *  NAME
+ *      set_number_of_connectors - Aplica la clave NumberOfConnectors.
+ *  SYNOPSIS
+ *      void set_number_of_connectors(const string &value);
+ *  DESCRIPTION
+ *      Cambia el nmero de conectores del cargador al valor de la clave de configuracin
+ *      NumberOfConnectors. A partir de aqu ya no se aceptan connectorId mayores. Si alguno de
+ *      los conectores que sobran tiene una transaccin en curso, el valor se ignora.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void Charger::set_number_of_connectors(const string &value)
+{
+    char *end;
+    long n = strtol(value.c_str(), &end, 10);
+
+    unique_lock<mutex> lock(state_mtx);
+    if (value.empty() || *end != '\0' || n < 1 || n > CONN_MAX_CONNECTORS || !connectors.set_connectors((int)n)) {
+        syslog(LOG_WARNING, "%s: NumberOfConnectors no vlido (%s) o con transacciones en los conectores que sobran en el cargador %d",
+               __func__, value.c_str(), charger_id);
+        return;
+    }
+
+    connectors_known = true;
+    fleet_state.set_connectors(charger_id, n);
+    lock.unlock();
+
+    publish_snapshot();
+    syslog(LOG_DEBUG, "%s: cargador %d con %ld conectores", __func__, charger_id, n);
+}
+
+/*
+ *  NAME
+ *      accept_connector - Comprueba un connectorId recibido del cargador.
+ *  SYNOPSIS
+ *      bool accept_connector(int64_t connector);
+ *  DESCRIPTION
+ *      Comprueba que el connectorId existe en el cargador. Mientras no se conoce NumberOfConnectors,
+ *      un connectorId mayor que los conectores actuales (hasta CONN_MAX_CONNECTORS) hace crecer
+ *      el nmero de conectores en lugar de rechazarse.
+ *  RETURN VALUE
+ *      Devuelve true si es vlido.
+ *      Devuelve false en caso contrario.
+ */
+bool Charger::accept_connector(int64_t connector)
+{
+    unique_lock<mutex> lock(state_mtx);
+    if (connector <= connectors.get_connectors())
         return true;
-    else
+
+    if (connectors_known || connector > CONN_MAX_CONNECTORS)
+        return false;
+
+    syslog(LOG_NOTICE, "%s: el cargador %d tiene como mnimo %ld conectores", __func__, charger_id, connector);
+    if (!connectors.set_connectors(connector))
         return false;
+
+    fleet_state.set_connectors(charger_id, connector);
+    lock.unlock();
+
+    publish_snapshot();
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      publish_connector - Copia el estado de un conector a fleet_state.
+ *  SYNOPSIS
+ *      void publish_connector(int connector);
+ *  DESCRIPTION
+ *      Copia el estado y la transaccin en curso de un conector a fleet_state despus de
+ *      cada cambio, para que las consultas de toda la flota no tengan que recorrer los cargadores.
+ *      Se copia con state_mtx cogido para que fleet_state acabe con el ltimo estado aunque dos
+ *      threads cambien el cargador a la vez.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void Charger::publish_connector(int connector)
+{
+    {
+        lock_guard<mutex> lock(state_mtx);
+        fleet_state.set_connector(charger_id, connector, connectors.get_status(connector), connectors.transaction_id(connector));
+    }
+    publish_snapshot();
+}
+
+/*
+ *  NAME
+ *      check_id_tag - Comprueba si el idTag est autorizado.
+ *  SYNOPSIS
+ *      bool check_id_tag(char *id_tag, struct IdTagRecord *record);
+ *  DESCRIPTION
+ *      Comprueba si el idTag est autorizado (en la auth_list y sin caducar), pasando por
+ *      la cach de IdTagInfo. Si record no es NULL, se copia en l el IdTagInfo del idTag.
+ *  RETURN VALUE
+ *      Devuelve true si est autorizado (Accepted).
+ *      Devuelve false en caso contrario.
+ */
+bool Charger::check_id_tag(char *id_tag, struct IdTagRecord *record)
+{
+    IdTagRecord tmp = authorize_id_tag(id_tag);
+
+    if (record)
+        *record = tmp;
+
+    return tmp.status == STATUS_ACCEPTED;
 }
 
 /*
@@ -937,6 +1473,7 @@ void Charger::authorize(struct header_st &header, string payload)
 {
     // Paso el string a struct JSON
     struct AuthorizeReq *auth_req_payload = cJSON_ParseAuthorizeReq(payload.c_str());
+    latency_stage(LAT_VALIDATE);
 
     // Compruebo errores antes de enviar la respuesta
     if (auth_req_payload == NULL) { // Error: FormationViolation
@@ -952,36 +1489,62 @@ void Charger::authorize(struct header_st &header, string payload)
         error.occurrence_constraint_violation(header.unique_id.c_str());
     }
     else { // No errors -> CALLRESULT
-        struct AuthorizeConf auth_conf;
-        struct IdTagInfo info;
-
-        // Compruebo si el idTag esta en la auth_list para autoritzar o no
-        if (check_id_tag(auth_req_payload->id_tag)) { // est a la llista -> ACCEPTED
-            current_id_tag = auth_req_payload->id_tag; // Actualizo el current idTag
-            info.status = STATUS_ACCEPTED; // Aado el idTagInfo
-            syslog(LOG_DEBUG, "%s: Accepted", __func__);
-        }
-        else { // no esta en la llista -> INVALID
-            info.status = STATUS_INVALID; // Aado l'idTagInfo
-            syslog(LOG_WARNING, "%s: Invalid", __func__);
-        }
+        latency_stage(LAT_HANDLE);
+        // la autorizacin puede ser externa, la respuesta se enva cuando llega sin bloquear este thread
+        struct header_st hdr = header;
+        string id_tag = auth_req_payload->id_tag;
+        ws_cli_conn_t cl = client;
+
+        authorization_service.authorize(id_tag, [this, hdr, id_tag, cl](const IdTagRecord &record) {
+            send_authorize_conf(hdr, id_tag, record, cl);
+        });
+    }
 
-        info.expiry_date = NULL;
-        info.parent_id_tag = NULL;
-        auth_conf.id_tag_info = &info;
+    // Libero la memoria
+    free(auth_req_payload);
+}
 
-        // Formo el mensaje
-        char message[256];
-        string tmp = cJSON_PrintAuthorizeConf(&auth_conf);
-        remove_spaces(tmp);
-        snprintf(message, sizeof(message), "[3,%s,%s]", header.unique_id.c_str(), tmp.c_str());
+/*
+ *  NAME
+ *      send_authorize_conf - enva la respuesta de un Authorize
+ *  SYNOPSIS
+ *      void send_authorize_conf(const struct header_st &header, const string &id_tag, const IdTagRecord &record, ws_cli_conn_t cl);
+ *  DESCRIPTION
+ *      Enva el AuthorizeConf con el IdTagInfo obtenido de la autorizacin y, si se ha aceptado,
+ *      actualiza el current idTag. Se llama desde el thread del cargador o desde el del
+ *      servicio de autorizacin cuando contesta el sistema externo.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void Charger::send_authorize_conf(const struct header_st &header, const string &id_tag, const IdTagRecord &record, ws_cli_conn_t cl)
+{
+    struct AuthorizeConf auth_conf;
+    struct IdTagInfo info;
 
-        // Envio el mensaje al cargador
-        ws_send("CALL RESULT", message, client);
+    if (record.status == STATUS_ACCEPTED) { // ACCEPTED
+        lock_guard<mutex> lock(state_mtx); // puede ser el thread del servicio de autorizacin
+        current_id_tag = id_tag; // Actualizo el current idTag
+        syslog(LOG_DEBUG, "%s: Accepted", __func__);
+    }
+    else { // no esta en la llista o ha caducado -> INVALID, EXPIRED o BLOCKED
+        syslog(LOG_WARNING, "%s: %s", __func__, record.status == STATUS_EXPIRED ? "Expired" :
+                                               record.status == STATUS_BLOCKED ? "Blocked" : "Invalid");
     }
 
-    // Libero la memoria
-    free(auth_req_payload);
+    // Aado el idTagInfo
+    info.status = record.status;
+    info.expiry_date = record.expiry_date.empty() ? NULL : const_cast<char *>(record.expiry_date.c_str());
+    info.parent_id_tag = record.parent_id_tag.empty() ? NULL : const_cast<char *>(record.parent_id_tag.c_str());
+    auth_conf.id_tag_info = &info;
+
+    // Formo el mensaje
+    char message[256];
+    string tmp = cJSON_PrintAuthorizeConf(&auth_conf);
+    remove_spaces(tmp);
+    snprintf(message, sizeof(message), "[3,%s,%s]", header.unique_id.c_str(), tmp.c_str());
+
+    // Envio el mensaje al cargador
+    send_call_result(header, message, cl);
 }
 
 /*
@@ -1000,6 +1563,7 @@ void Charger::boot_notification(struct header_st &header, string payload)
 {
     // Paso el string a struct JSON
     struct BootNotificationReq *boot_req_payload = cJSON_ParseBootNotificationReq(payload.c_str());
+    latency_stage(LAT_VALIDATE);
 
     // Compruebo errores antes de enviar la respuesta
     if (boot_req_payload == NULL) { // Error: FormationViolation
@@ -1045,6 +1609,7 @@ void Charger::boot_notification(struct header_st &header, string payload)
         error.occurrence_constraint_violation(header.unique_id.c_str());
     }
     else { // No errors -> CALLRESULT
+        latency_stage(LAT_HANDLE);
         struct BootNotificationConf boot_conf;
 
         // Obtengo el current time
@@ -1058,7 +1623,20 @@ void Charger::boot_notification(struct header_st &header, string payload)
         // Intervalo de Hearbeat i Status
         boot_conf.interval = HEARTBEAT_INTERVAL;
         boot_conf.status = STATUS_BOOT_ACCEPTED;
-        boot.status = STATUS_BOOT_ACCEPTED; // actualizo el status global del cargador
+        {
+            lock_guard<mutex> lock(state_mtx);
+            boot.status = STATUS_BOOT_ACCEPTED; // actualizo el status global del cargador
+            // las peticiones guardadas van por identidad, se cambia a la vez que se acepta
+            identity = boot_req_payload->charge_point_serial_number ? boot_req_payload->charge_point_serial_number :
+                       boot_req_payload->charge_box_serial_number ? boot_req_payload->charge_box_serial_number : "";
+        }
+        // si ya se conoce NumberOfConnectors de una conexin anterior lo uso hasta que llegue el nuevo valor
+        struct ConfigEntry number_of_connectors;
+        if (config_store.get(charger_id, "NumberOfConnectors", number_of_connectors) && !number_of_connectors.unknown)
+            set_number_of_connectors(number_of_connectors.value);
+        config_store.mark_stale(charger_id); // despus de reiniciar la configuracin puede haber cambiado
+        dedup.clear(); // los uniqueId vuelven a empezar, las respuestas guardadas ya no corresponden
+        offline_queue.charger_accepted(get_identity()); // se le envan las peticiones guardadas mientras estaba desconectado
 
         // Formo el mensaje
         char message[256];
@@ -1068,16 +1646,16 @@ void Charger::boot_notification(struct header_st &header, string payload)
         snprintf(message, sizeof(message), "[3,%s,{\"currentTime\":\"%s\",\"interval\":%ld,\"status\":\"Accepted\"}]", header.unique_id.c_str(), boot_conf.current_time, boot_conf.interval);
 
         // Envio el mensaje al cargador
-        ws_send("CALL RESULT", message, client);
+        send_call_result(header, message, client);
 
-        current_vendor = boot_req_payload->charge_point_vendor; // actualizo el vendor del cargador
-        current_model = boot_req_payload->charge_point_model; // actualizo el model del cargador
+        {
+            lock_guard<mutex> lock(state_mtx);
+            current_vendor = boot_req_payload->charge_point_vendor; // actualizo el vendor del cargador
+            current_model = boot_req_payload->charge_point_model; // actualizo el model del cargador
+        }
+        publish_snapshot();
 
-        QMetaObject::invokeMethod(&BackendNotifier::instance(),
-                                  "bootNotification",
-                                  Qt::QueuedConnection,
-                                  Q_ARG(QString, QString::fromStdString(current_model)),
-                                  Q_ARG(QString, QString::fromStdString(current_vendor)));
+        event_sink().boot_notification(charger_id, boot_req_payload->charge_point_model, boot_req_payload->charge_point_vendor);
 
         // Libero la memria
         free(boot_conf.current_time);
@@ -1103,6 +1681,7 @@ void Charger::data_transfer(struct header_st &header, string payload)
 {
     // Paso el string a struct JSON
     struct DataTransferReq *data_payload = cJSON_ParseDataTransferReq(payload.c_str());
+    latency_stage(LAT_VALIDATE);
 
     // Compruebo errores antes de enviar la respuesta
     if (data_payload == NULL) { // Error: FormationViolation
@@ -1130,6 +1709,7 @@ void Charger::data_transfer(struct header_st &header, string payload)
         error.occurrence_constraint_violation(header.unique_id.c_str());
     }
     else { // No errors -> CALLRESULT
+        latency_stage(LAT_HANDLE);
         struct DataTransferConf data_conf;
 
         // Status a desconocido, debido a que no hay ningun fabricante de punto de carga con el qual establecer el significado de esta peticin.
@@ -1143,7 +1723,7 @@ void Charger::data_transfer(struct header_st &header, string payload)
         snprintf(message, sizeof(message), "[3,%s,%s]", header.unique_id.c_str(), tmp.c_str());
 
         // Envio el mensaje al cargador
-        ws_send("CALL RESULT", message, client);
+        send_call_result(header, message, client);
     }
 
     // Libero la memria
@@ -1166,6 +1746,7 @@ void Charger::heartbeat(struct header_st &header, string payload)
 {
     // Paso el string a struct JSON
     struct HeartbeatReq *heartbeat_req = cJSON_ParseHeartbeatReq(payload.c_str());
+    latency_stage(LAT_VALIDATE);
 
     // Compruebo errores antes de enviar la respuesta
     if (heartbeat_req == NULL) { // Error: FormationViolation
@@ -1175,6 +1756,7 @@ void Charger::heartbeat(struct header_st &header, string payload)
         error.protocol_error(header.unique_id.c_str());
     }
     else { // No errors -> CALLRESULT
+        latency_stage(LAT_HANDLE);
         struct HeartbeatConf heartbeat_conf;
 
         // timestamp
@@ -1192,7 +1774,7 @@ void Charger::heartbeat(struct header_st &header, string payload)
         snprintf(message, sizeof(message), "[3,%s,%s]", header.unique_id.c_str(), tmp.c_str());
 
         // Envio el mensaje al cargador
-        ws_send("CALL RESULT", message, client);
+        send_call_result(header, message, client);
     }
 
     // Libero la memria
@@ -1215,6 +1797,7 @@ void Charger::meter_values(struct header_st &header, string payload)
 {
     // Paso el string a struct JSON
     struct MeterValuesReq *meter_values_req = cJSON_ParseMeterValuesReq(payload.c_str());
+    latency_stage(LAT_VALIDATE);
 
     // Compruebo errores antes de enviar la respuesta
     if (meter_values_req == NULL) { // Error: FormationViolation
@@ -1268,6 +1851,7 @@ void Charger::meter_values(struct header_st &header, string payload)
             }
 
             char *hora = meter_value->timestamp; // variable que tengo que guardar en la base de datos
+            time_t sample_time = timegm(&timestamp_st) - timestamp_st.tm_gmtoff; // timestamp en UTC, para meter_history
 
             if (meter_value->sampled_value && list_get_count(meter_value->sampled_value)) {
                 size_t count = list_get_count(meter_value->sampled_value);
@@ -1303,9 +1887,9 @@ void Charger::meter_values(struct header_st &header, string payload)
                     }
                     // guardo las variables que tengo que guardar en la base de datos
                     char *valor = sampled_value->value;
-                    char unit[16];
-                    char measurand[32];
-                    char context[32];
+                    char unit[16] = "";      // vacos si el cargador no los enva
+                    char measurand[32] = ""; // (measurand vaco: Energy.Active.Import.Register)
+                    char context[32] = "";
                     if (sampled_value->unit) {
                         switch (*sampled_value->unit) {
                             case 0:
@@ -1471,12 +2055,31 @@ void Charger::meter_values(struct header_st &header, string payload)
                         }
                     }
 
+                    // la potencia activa importada es la potencia actual del conector (measurand 13: Power.Active.Import, unit 8: kW, 15: W)
+                    if (sampled_value->measurand && *sampled_value->measurand == 13 &&
+                        (sampled_value->unit == NULL || *sampled_value->unit == 8 || *sampled_value->unit == 15)) {
+
+                        double potencia = atof(valor);
+                        if (sampled_value->unit && *sampled_value->unit == 8)
+                            potencia *= 1000;
+                        fleet_state.set_power(charger_id, connector, (int32_t)potencia);
+                    }
+
+                    // histrico en memoria, antes de la base de datos: solo los valores totales (sin phase)
+                    enum meter_series_t series;
+                    double scale;
+                    if (sampled_value->phase == NULL &&
+                        MeterHistory::series_of(sampled_value->measurand ? *sampled_value->measurand : -1,
+                                                sampled_value->unit ? *sampled_value->unit : -1, series, scale))
+                        meter_history.add(charger_id, connector, series, sample_time, atof(valor) * scale);
+
                     // guardo la informacin en la base de datos
+                    latency_stage(LAT_PERSIST);
                     sqlite3 *db;
                     int rc;
                     char *errmsg;
 
-                    rc = sqlite3_open(DATABASE_PATH, &db);
+                    rc = sqlite3_open(database_path(), &db);
                     if (rc != SQLITE_OK) {
                         syslog(LOG_ERR, "%s: ERROR opening SQLite DB in memory: %s\n", __func__, sqlite3_errmsg(db));
                     }
@@ -1493,6 +2096,7 @@ void Charger::meter_values(struct header_st &header, string payload)
                     }
 
                     sqlite3_close(db);  // tanca la base de dades correctament
+                    latency_stage(LAT_VALIDATE); // sigue con el siguiente valor
                 }
             }
             else { // Error: ProtocolError
@@ -1506,13 +2110,14 @@ void Charger::meter_values(struct header_st &header, string payload)
         return;
     }
     // No errors -> CALLRESULT
+    latency_stage(LAT_HANDLE);
 
     // Formo el mensaje
     char message[256];
     snprintf(message, sizeof(message), "[3,%s,{}]", header.unique_id.c_str());
 
     // Envio el mensaje al cargador
-    ws_send("CALL RESULT", message, client);
+    send_call_result(header, message, client);
 
     // Libero la memria
     free(meter_values_req);
@@ -1534,10 +2139,17 @@ void Charger::start_transaction(struct header_st &header, string payload)
 {
     // Paso el string a struct JSON
     struct StartTransactionReq *start_transaction_req = cJSON_ParseStartTransactionReq(payload.c_str());
+    latency_stage(LAT_VALIDATE);
 
     struct tm timestamp_st;
     memset(&timestamp_st, 0, sizeof(timestamp_st));
 
+    int num_connectors;
+    {
+        lock_guard<mutex> lock(state_mtx);
+        num_connectors = connectors.get_connectors();
+    }
+
     // Compruebo errores antes de enviar la respuesta
     if (start_transaction_req == NULL) { // Error: FormationViolation
         error.formation_violation(header.unique_id.c_str());
@@ -1560,7 +2172,7 @@ void Charger::start_transaction(struct header_st &header, string payload)
         error.type_constraint_violation(header.unique_id.c_str());
     }
     else if ((start_transaction_req->reservation_id && *start_transaction_req->reservation_id == -1) ||
-              start_transaction_req->connector_id > NUM_CONNECTORS ||
+              start_transaction_req->connector_id > num_connectors ||
               start_transaction_req->connector_id == 0 ||
               ocpp_strptime(start_transaction_req->timestamp, "%Y-%m-%dT%H:%M:%S%z", &timestamp_st, 19) == NULL) { // Error: PropertyConstraintViolation
 
@@ -1570,57 +2182,81 @@ void Charger::start_transaction(struct header_st &header, string payload)
         error.occurrence_constraint_violation(header.unique_id.c_str());
     }
     else { // No errors -> CALLRESULT
+        latency_stage(LAT_HANDLE);
         struct StartTransactionConf start_transaction_conf;
         struct IdTagInfo_Start info;
+        struct IdTagRecord record;
 
         // Compruebo si el idTag es el del authorize y si est en la auth_list
-        if (check_id_tag(start_transaction_req->id_tag) &&
-            (strcasecmp(start_transaction_req->id_tag, current_id_tag.c_str())) == 0) { // idTag vlido
-
-            // compruebo si el conector ya est en una transacci activa
-            if (transaction_list[start_transaction_req->connector_id] != -1 ||
+        if (check_id_tag(start_transaction_req->id_tag, &record) &&
+            (strcasecmp(start_transaction_req->id_tag, get_current_id_tag().c_str())) == 0) { // idTag vlido
+
+            // compruebo con la mquina de estados si el conector puede empezar una transaccin
+            enum conn_result_t conn;
+            {
+                lock_guard<mutex> lock(state_mtx);
+                conn = connectors.check_start(start_transaction_req->connector_id);
+            }
+            if (conn == CONN_BUSY ||
                 check_concurrent_tx_id_tag(start_transaction_req->id_tag)) { // conector ya en una transacci activa -> ConcurrentTx
                 // Afegeixo l'idTagInfo
                 info.status = STATUS_START_CONCURRENT_TX;
                 info.expiry_date = NULL;
                 info.parent_id_tag = NULL;
                 start_transaction_conf.id_tag_info = &info;
-                start_transaction_conf.transaction_id = ++current_transaction_id;
+                start_transaction_conf.transaction_id = 0; // no se ha iniciado ninguna transaccin
                 syslog(LOG_WARNING, "%s: concurrentTx", __func__);
             }
-            else if (connectors_status[0] == CONN_UNAVAILABLE ||
-                connectors_status[start_transaction_req->connector_id] == CONN_FAULTED ||
-                connectors_status[start_transaction_req->connector_id] == CONN_SUSPENDED_EV ||
-                connectors_status[start_transaction_req->connector_id] == CONN_SUSPENDED_EVSE ||
-                connectors_status[start_transaction_req->connector_id] == CONN_UNAVAILABLE) {
+            else if (conn != CONN_OK) { // el conector o el cargador no estn disponibles
 
                 // Aado el idTagInfo
                 info.status = STATUS_START_INVALID;
                 info.expiry_date = NULL;
                 info.parent_id_tag = NULL;
                 start_transaction_conf.id_tag_info = &info;
-                start_transaction_conf.transaction_id = ++current_transaction_id;
+                start_transaction_conf.transaction_id = 0;
                 syslog(LOG_WARNING, "%s: connector no disponible", __func__);
             }
-            else { // conector vlido para cargar -> Accepted
-                // Aado el idTagInfo
-                info.status = STATUS_START_ACCEPTED;
-                info.expiry_date = NULL;
-                info.parent_id_tag = NULL;
+            else { // conector vlido para cargar
+                // registro la transaccin en el ndice global, que le asigna el transactionId; si otro
+                // cargador ha iniciado una con el mismo idTag a la vez falla -> ConcurrentTx
+                struct TransactionInfo tx;
+                tx.transaction_id = 0;
+                tx.charger_id = charger_id;
+                tx.connector_id = start_transaction_req->connector_id;
+                tx.id_tag = start_transaction_req->id_tag;
+                tx.meter_start = start_transaction_req->meter_start;
+                tx.start_time = timegm(&timestamp_st) - timestamp_st.tm_gmtoff; // timestamp en UTC
+
+                info.expiry_date = record.expiry_date.empty() ? NULL : const_cast<char *>(record.expiry_date.c_str());
+                info.parent_id_tag = record.parent_id_tag.empty() ? NULL : const_cast<char *>(record.parent_id_tag.c_str());
                 start_transaction_conf.id_tag_info = &info;
-                start_transaction_conf.transaction_id = ++current_transaction_id;
-                current_id_tags[start_transaction_req->connector_id] = start_transaction_req->id_tag; // Guardo el idTag a la respectiva posicin
-                                                                                                       // del conector en current_id_tags para cuando se pare la transaccin
-                syslog(LOG_DEBUG, "%s: Accepted", __func__);
+                start_transaction_conf.transaction_id = 0;
+
+                if (transaction_index.begin(tx)) { // Accepted
+                    info.status = STATUS_START_ACCEPTED;
+                    start_transaction_conf.transaction_id = current_transaction_id = tx.transaction_id;
+                    {
+                        lock_guard<mutex> lock(state_mtx);
+                        connectors.start(start_transaction_req->connector_id, tx.transaction_id); // el idTag queda en el transaction_index
+                    }
+                    publish_connector(start_transaction_req->connector_id);
+                    syslog(LOG_DEBUG, "%s: Accepted", __func__);
+                }
+                else { // ConcurrentTx
+                    info.status = STATUS_START_CONCURRENT_TX;
+                    syslog(LOG_WARNING, "%s: concurrentTx", __func__);
+                }
             }
         }
-        else { // idTag no reconocido -> Invalid
+        else { // idTag no reconocido -> Invalid (o Expired/Blocked si la cach lo indica)
             // Aado l'idTagInfo
-            info.status = STATUS_START_INVALID;
+            info.status = record.status == STATUS_EXPIRED ? STATUS_START_EXPIRED :
+                          record.status == STATUS_BLOCKED ? STATUS_START_BLOCKED : STATUS_START_INVALID;
             info.expiry_date = NULL;
             info.parent_id_tag = NULL;
             start_transaction_conf.id_tag_info = &info;
-            start_transaction_conf.transaction_id = ++current_transaction_id;
+            start_transaction_conf.transaction_id = 0;
             syslog(LOG_WARNING, "%s: idTag no vlido", __func__);
         }
 
@@ -1631,7 +2267,7 @@ void Charger::start_transaction(struct header_st &header, string payload)
         snprintf(message, sizeof(message), "[3,%s,%s]", header.unique_id.c_str(), tmp.c_str());
 
         // Envio el missatge al carregador
-        ws_send("CALL RESULT", message, client);
+        send_call_result(header, message, client);
     }
 
     // Allibero la memria
@@ -1654,6 +2290,7 @@ void Charger::stop_transaction(struct header_st &header, string payload)
 {
     // Paso el string a struct JSON
     struct StopTransactionReq *stop_transaction_req = cJSON_ParseStopTransactionReq(payload.c_str());
+    latency_stage(LAT_VALIDATE);
 
     // Compruebo errores antes de enviar la respuesta
     if (stop_transaction_req == NULL) { // Error: FormationViolation
@@ -1764,22 +2401,31 @@ void Charger::stop_transaction(struct header_st &header, string payload)
     }
 
     // No errors -> CALLRESULT
+    latency_stage(LAT_HANDLE);
 
     struct StopTransactionConf stop_transaction_conf;
     struct IdTagInfo_Stop info;
 
     int connector = -1; // aqui pongo el conector de esta transacccin
+    int tx_charger_id = charger_id; // cargador donde se inici la transaccin
+    string tx_id_tag; // idTag con el que se inici la transaccin
+    bool released = false; // el conector ya ha pasado a Available (ver status_notification)
 
     // busco el connector de esta transaccin
-    for (int i = 0; i <= NUM_CONNECTORS; i++) {
-        if (stop_transaction_req->id_tag && (strcasecmp(stop_transaction_req->id_tag, current_id_tags[i].c_str()) == 0))
-            connector = i;
+    {
+        lock_guard<mutex> lock(state_mtx);
+        connector = connectors.find_transaction(stop_transaction_req->transaction_id);
     }
 
-    // busco si el transactionId es correcto
-    for (int i = 0; i <= NUM_CONNECTORS; i++) {
-        if (stop_transaction_req->transaction_id == transaction_list[i])
-            connector = i;
+    // busco si el transactionId es correcto en el ndice global, puede ser de otro cargador (p.ej. si se ha reconectado en otra posicin)
+    struct TransactionInfo tx;
+    if (transaction_index.find(stop_transaction_req->transaction_id, tx)) {
+        connector = tx.connector_id;
+        tx_charger_id = tx.charger_id;
+        tx_id_tag = tx.id_tag;
+        released = tx.id_tag_released;
+        if (tx_charger_id != charger_id)
+            syslog(LOG_NOTICE, "%s: transactionId %ld iniciado en el cargador %d", __func__, tx.transaction_id, tx_charger_id);
     }
 
     if (connector < 0) // el transactionId no es correcto
@@ -1788,8 +2434,8 @@ void Charger::stop_transaction(struct header_st &header, string payload)
     // Compruebo si hay idTag
     if (stop_transaction_req->id_tag) { // hay idTag
         if (check_id_tag(stop_transaction_req->id_tag)) { // idTag en la auth list
-            if (connector > 0 && (strcasecmp(stop_transaction_req->id_tag, current_id_tags[connector].c_str()) == 0) &&
-                (strcasecmp(stop_transaction_req->id_tag, current_id_tag.c_str()) == 0)) { // idTag vlido
+            if (connector > 0 && (strcasecmp(stop_transaction_req->id_tag, tx_id_tag.c_str()) == 0) &&
+                (released || strcasecmp(stop_transaction_req->id_tag, get_current_id_tag().c_str()) == 0)) { // idTag vlido
                 info.status = STATUS_STOP_ACCEPTED;
                 info.expiry_date = NULL;
                 info.parent_id_tag = NULL;
@@ -1821,7 +2467,7 @@ void Charger::stop_transaction(struct header_st &header, string payload)
         snprintf(message, sizeof(message), "[3,%s,%s]", header.unique_id.c_str(), tmp.c_str());
 
         // Envio el mensaje al cargador
-        ws_send("CALL RESULT", message, client);
+        send_call_result(header, message, client);
     }
     else { // no hay idTag
         syslog(LOG_DEBUG, "%s: Accepted", __func__);
@@ -1830,93 +2476,110 @@ void Charger::stop_transaction(struct header_st &header, string payload)
         snprintf(message, sizeof(message), "[3,%s,{}]", header.unique_id.c_str());
 
         // Envio el missatge al carregador
-        ws_send("CALL RESULT", message, client);
-    }
-
-    if (connector > 0) { // solo en este caso guardo en la base de datos para evitar errores
-        current_id_tags[connector] = "no_charging"; // actualizo la current_id_tags
-        transaction_list[connector] = -1;
-
-        char motiu[32];
-        if (stop_transaction_req->reason) {
-            switch (*stop_transaction_req->reason) {
-                case 0:
-                    snprintf(motiu, sizeof(motiu), "%s", "DeAuthorized");
-                    break;
-                case 1:
-                    snprintf(motiu, sizeof(motiu), "%s", "EmergencyStop");
-                    break;
-                case 2:
-                    snprintf(motiu, sizeof(motiu), "%s", "EVDisconnect");
-                    break;
-                case 3:
-                    snprintf(motiu, sizeof(motiu), "%s", "HardReset");
-                    break;
-                case 4:
-                    snprintf(motiu, sizeof(motiu), "%s", "Local");
-                    break;
-                case 5:
-                    snprintf(motiu, sizeof(motiu), "%s", "Other");
-                    break;
-                case 6:
-                    snprintf(motiu, sizeof(motiu), "%s", "PowerLoss");
-                    break;
-                case 7:
-                    snprintf(motiu, sizeof(motiu), "%s", "Reboot");
-                    break;
-                case 8:
-                    snprintf(motiu, sizeof(motiu), "%s", "Remote");
-                    break;
-                case 9:
-                    snprintf(motiu, sizeof(motiu), "%s", "SoftReset");
-                    break;
-                case 10:
-                    snprintf(motiu, sizeof(motiu), "%s", "UnlockCommand");
-                    break;
-                default:
-                    snprintf(motiu, sizeof(motiu), "%s", "No especificat");
-                    break;
-            }
-        }
-        else
-            snprintf(motiu, sizeof(motiu), "%s", "");
-
-        // guardo la hora actual para ponerla en la base de datos
-        time_t t = time(NULL);
-        struct tm *currentTime = localtime(&t);
-        char *hora = static_cast<char *>(malloc(64));
-        snprintf(hora, 64, "\%04d-%02d-%02dT%02d:%02d:%02dZ",
-        currentTime->tm_year + 1900, currentTime->tm_mon + 1, currentTime->tm_mday,
-        currentTime->tm_hour, currentTime->tm_min, currentTime->tm_sec);
-
-        // guardo la informacin en la base de datos
-        sqlite3 *db;
-        int rc;
-        char *errmsg;
+        send_call_result(header, message, client);
+    }
 
-        rc = sqlite3_open(DATABASE_PATH, &db);
-        if (rc != SQLITE_OK) {
-            syslog(LOG_ERR, "%s: ERROR opening SQLite DB in memory: %s\n", __func__, sqlite3_errmsg(db));
+    if (connector > 0 && tx_charger_id == charger_id && !released) { // con released el conector ya est en Available
+        enum conn_result_t conn;
+        {
+            lock_guard<mutex> lock(state_mtx);
+            conn = connectors.stop(connector, stop_transaction_req->transaction_id);
+            fleet_state.set_power(charger_id, connector, 0); // el ltimo MeterValues ya no vale
         }
+        if (conn != CONN_OK) // StopTransaction sin StartTransaction en el conector
+            syslog(LOG_WARNING, "%s: transactionId %ld no est en curso en el conector %d", __func__, stop_transaction_req->transaction_id, connector);
+        publish_connector(connector);
+    }
 
-        char query[500];
-        snprintf(query, sizeof(query), "INSERT INTO transaccions(charger_id, estat, connector, hora, motiu)"
-            "VALUES(%d, 'Stop', '%d', '%s', '%s');", charger_id, connector, hora, motiu);
-        rc = sqlite3_exec(db, query, 0, 0, &errmsg);
-        if (rc != SQLITE_OK) {
-            fprintf(stderr, "SQL error: %s\n", errmsg);
-            sqlite3_free(errmsg);
-        } else {
-            syslog(LOG_DEBUG, "%s: SQL statement executed successfully", __func__);
+    // el Stop se guarda aunque no se conozca el conector (p.ej. si la transaccin es de antes de
+    // arrancar el sistema), con el conector 0
+    if (connector < 0)
+        connector = 0;
+
+    char motiu[32];
+    if (stop_transaction_req->reason) {
+        switch (*stop_transaction_req->reason) {
+            case 0:
+                snprintf(motiu, sizeof(motiu), "%s", "DeAuthorized");
+                break;
+            case 1:
+                snprintf(motiu, sizeof(motiu), "%s", "EmergencyStop");
+                break;
+            case 2:
+                snprintf(motiu, sizeof(motiu), "%s", "EVDisconnect");
+                break;
+            case 3:
+                snprintf(motiu, sizeof(motiu), "%s", "HardReset");
+                break;
+            case 4:
+                snprintf(motiu, sizeof(motiu), "%s", "Local");
+                break;
+            case 5:
+                snprintf(motiu, sizeof(motiu), "%s", "Other");
+                break;
+            case 6:
+                snprintf(motiu, sizeof(motiu), "%s", "PowerLoss");
+                break;
+            case 7:
+                snprintf(motiu, sizeof(motiu), "%s", "Reboot");
+                break;
+            case 8:
+                snprintf(motiu, sizeof(motiu), "%s", "Remote");
+                break;
+            case 9:
+                snprintf(motiu, sizeof(motiu), "%s", "SoftReset");
+                break;
+            case 10:
+                snprintf(motiu, sizeof(motiu), "%s", "UnlockCommand");
+                break;
+            default:
+                snprintf(motiu, sizeof(motiu), "%s", "No especificat");
+                break;
         }
+    }
+    else
+        snprintf(motiu, sizeof(motiu), "%s", "");
+
+    // guardo la hora actual para ponerla en la base de datos
+    time_t t = time(NULL);
+    struct tm *currentTime = localtime(&t);
+    char *hora = static_cast<char *>(malloc(64));
+    snprintf(hora, 64, "\%04d-%02d-%02dT%02d:%02d:%02dZ",
+    currentTime->tm_year + 1900, currentTime->tm_mon + 1, currentTime->tm_mday,
+    currentTime->tm_hour, currentTime->tm_min, currentTime->tm_sec);
+
+    // guardo la informacin en la base de datos
+    latency_stage(LAT_PERSIST);
+    sqlite3 *db;
+    int rc;
+    char *errmsg;
+
+    rc = sqlite3_open(database_path(), &db);
+    if (rc != SQLITE_OK) {
+        syslog(LOG_ERR, "%s: ERROR opening SQLite DB in memory: %s\n", __func__, sqlite3_errmsg(db));
+    }
 
-        sqlite3_close(db); // tanca la base de dades correctament
-        free(hora);
+    char query[500];
+    snprintf(query, sizeof(query), "INSERT INTO transaccions(charger_id, estat, connector, hora, motiu, transaccio)"
+        "VALUES(%d, 'Stop', '%d', '%s', '%s', %ld);", tx_charger_id, connector, hora, motiu, stop_transaction_req->transaction_id);
+    rc = sqlite3_exec(db, query, 0, 0, &errmsg);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", errmsg);
+        sqlite3_free(errmsg);
+    } else {
+        syslog(LOG_DEBUG, "%s: SQL statement executed successfully", __func__);
     }
 
-    // Borro el transactionId de la transaction_list
-    if (stop_transaction_req->transaction_id <= NUM_CONNECTORS)
-        delete_transaction_id(stop_transaction_req->transaction_id);
+    sqlite3_close(db); // tanca la base de dades correctament
+    latency_stage(LAT_HANDLE);
+    free(hora);
+
+    // Borro el transactionId del transaction_index y de los conectores del cargador donde se inici
+    Charger *owner = (tx_charger_id == charger_id) ? this : get_charger(tx_charger_id);
+    if (owner)
+        owner->delete_transaction_id(stop_transaction_req->transaction_id);
+    else
+        transaction_index.end(stop_transaction_req->transaction_id);
 
     // Libero la memria
     free(stop_transaction_req);
@@ -1938,6 +2601,7 @@ void Charger::status_notification(struct header_st &header, string payload)
 {
     // Paso el string a struct JSON
     struct StatusNotificationReq *status_req = cJSON_ParseStatusNotificationReq(payload.c_str());
+    latency_stage(LAT_VALIDATE);
 
     // Compruebo errores antes de enviar la respuesta
     if (status_req == NULL) { // Error: FormationViolation
@@ -1956,7 +2620,7 @@ void Charger::status_notification(struct header_st &header, string payload)
 
         error.type_constraint_violation(header.unique_id.c_str());
     }
-    else if (status_req->connector_id > NUM_CONNECTORS ||
+    else if (!accept_connector(status_req->connector_id) ||
             (status_req->vendor_error_code && strcmp(status_req->vendor_error_code, "") == 0) ||
             (status_req->info && strcmp(status_req->info, "") == 0) ||
             (status_req->timestamp && strcmp(status_req->timestamp, "") == 0) ||
@@ -1971,7 +2635,28 @@ void Charger::status_notification(struct header_st &header, string payload)
         error.occurrence_constraint_violation(header.unique_id.c_str());
     }
     else { // No errors
-        connectors_status[status_req->connector_id] = status_req->status;
+        latency_stage(LAT_HANDLE);
+        // aplico la transicin, el estado que enva el cargador manda aunque no siga la secuencia esperada
+        enum conn_result_t conn;
+        int64_t dropped = -1; // transaccin cuyo conector pasa a Available sin StopTransaction
+        int64_t charging_tx = -1; // transaccin en curso si empieza a cargar, para guardarla con el Start
+        {
+            lock_guard<mutex> lock(state_mtx);
+            if (status_req->status == CONN_AVAILABLE && connectors.in_transaction(status_req->connector_id)) {
+                dropped = connectors.transaction_id(status_req->connector_id);
+                fleet_state.set_power(charger_id, status_req->connector_id, 0);
+            }
+            conn = connectors.status(status_req->connector_id, status_req->status);
+            if (status_req->status == CONN_CHARGING && connectors.in_transaction(status_req->connector_id))
+                charging_tx = connectors.transaction_id(status_req->connector_id);
+        }
+        if (conn == CONN_IRREGULAR)
+            syslog(LOG_WARNING, "%s: transicin irregular del conector %ld a %d", __func__, status_req->connector_id, status_req->status);
+        if (dropped != -1) { // el idTag deja de estar cargando, la transaccin sigue en el ndice hasta su StopTransaction
+            syslog(LOG_NOTICE, "%s: transactionId %ld sin StopTransaction y conector %ld en Available", __func__, dropped, status_req->connector_id);
+            transaction_index.release_id_tag(dropped);
+        }
+        publish_connector(status_req->connector_id);
 
         // miro el error code para guardarlo en la base de datos
         char error[32];
@@ -2073,11 +2758,12 @@ void Charger::status_notification(struct header_st &header, string payload)
         currentTime->tm_hour, currentTime->tm_min, currentTime->tm_sec);
 
         // guardo el estado en la base de datos
+        latency_stage(LAT_PERSIST);
         sqlite3 *db;
         int rc;
         char *errmsg;
 
-        rc = sqlite3_open(DATABASE_PATH, &db);
+        rc = sqlite3_open(database_path(), &db);
         if (rc != SQLITE_OK) {
             syslog(LOG_ERR, "%s: ERROR opening SQLite DB in memory: %s\n", __func__, sqlite3_errmsg(db));
         }
@@ -2095,22 +2781,20 @@ void Charger::status_notification(struct header_st &header, string payload)
 
         sqlite3_close(db);  // cierra la base de datos correctamente
 
-        if (status_req->status == STATUS_STATUS_AVAILABLE) {
-            current_id_tags[status_req->connector_id] = "no_charging"; // actualizo la current_id_tags
-            transaction_list[status_req->connector_id] = -1;
-        }
-        else if (status_req->status == STATUS_STATUS_CHARGING) {
-            transaction_list[status_req->connector_id] = current_transaction_id; // Guardo el transactionId en la respectiva posicin
-                                                                                             // del conector en transaction_list
-
-            rc = sqlite3_open(DATABASE_PATH, &db);
+        if (status_req->status == STATUS_STATUS_CHARGING) {
+            rc = sqlite3_open(database_path(), &db);
             if (rc != SQLITE_OK) {
                 syslog(LOG_ERR, "%s: ERROR opening SQLite DB in memory: %s\n", __func__, sqlite3_errmsg(db));
             }
 
+            // el transactionId solo se conoce si el StartTransaction ha llegado antes
+            char transaccio[24] = "NULL";
+            if (charging_tx != -1)
+                snprintf(transaccio, sizeof(transaccio), "%ld", charging_tx);
+
             memset(query, 0, sizeof(query));
-            snprintf(query, sizeof(query), "INSERT INTO transaccions(charger_id, estat, connector, hora, motiu)"
-                "VALUES(%d, 'Start', %ld, '%s', '%s');", charger_id, status_req->connector_id, hora, "");
+            snprintf(query, sizeof(query), "INSERT INTO transaccions(charger_id, estat, connector, hora, motiu, transaccio)"
+                "VALUES(%d, 'Start', %ld, '%s', '%s', %s);", charger_id, status_req->connector_id, hora, "", transaccio);
             rc = sqlite3_exec(db, query, 0, 0, &errmsg);
             if (rc != SQLITE_OK) {
                 fprintf(stderr, "SQL error: %s\n", errmsg);
@@ -2121,23 +2805,14 @@ void Charger::status_notification(struct header_st &header, string payload)
 
             sqlite3_close(db); // tanca la base de dades correctament
         }
+        latency_stage(LAT_HANDLE);
 
         // Formo el missatge
         char message[256];
         snprintf(message, sizeof(message), "[3,%s,{}]", header.unique_id.c_str());
 
         // Envio el mensaje al cargador
-        ws_send("CALL RESULT", message, client);
-
-        QMetaObject::invokeMethod(&BackendNotifier::instance(),
-                                  "statusNotification",
-                                  Qt::QueuedConnection,
-                                  Q_ARG(int64_t, connectors_status[1]),
-                                  Q_ARG(int64_t, connectors_status[2]),
-                                  Q_ARG(QString, QString::fromStdString(current_id_tags[1])),
-                                  Q_ARG(QString, QString::fromStdString(current_id_tags[2])),
-                                  Q_ARG(int64_t, transaction_list[1]),
-                                  Q_ARG(int64_t, transaction_list[2]));
+        send_call_result(header, message, client);
 
         free(hora);
     }
@@ -14,30 +14,27 @@
 #ifndef _CHARGER_H_
 #define _CHARGER_H_
 
-#define NUM_CONNECTORS 2
-
 #define ID_TAG_LEN 20 // medida establecida para el protocolo
 
 #define HEARTBEAT_INTERVAL 86400
 
-// posibles estados de los connectores
-#define CONN_AVAILABLE 0
-#define CONN_CHARGING 1
-#define CONN_FAULTED 2
-#define CONN_FINISHING 3
-#define CONN_PREPARING 4
-#define CONN_RESERVED 5
-#define CONN_SUSPENDED_EV 6
-#define CONN_SUSPENDED_EVSE 7
-#define CONN_UNAVAILABLE 8
-#define CONN_UNKNOWN 9
-
 #include <ws.h>
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <mutex>
+#include <deque>
+#include <functional>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <atomic>
 #include "error_message.h"
 #include "BootNotificationConfJSON.h"
+#include "id_tag_cache.h"
+#include "dedup_cache.h"
+#include "connector_state.h" // NUM_CONNECTORS y los estados CONN_<>
+#include "seqlock.h"
 
 using namespace std;
 
@@ -50,46 +47,58 @@ enum tx_state_t {
     sent
 };
 
-// llista d'idTags, els quals es podran autoritzar
-extern vector<string> auth_list;
-
-// llista de chargePointModels, els quals podran fer bootNotification
-extern vector<string> cp_models;
-
-// llista de chargePointVendors, els quals podran fer bootNotification
-extern vector<string> cp_vendors;
-
-// claves de configuracin del punto de crga
-typedef struct {
-    string AuthorizeRemoteTxRequests;
-    string ClockAlignedDataInterval;
-    string ConnectionTimeOut;
-    string ConnectorPhaseRotation;
-    string GetConfigurationMaxKeys;
-    string HeartbeatInterval;
-    string LocalAuthorizeOffline;
-    string LocalPreAuthorize;
-    string MeterValuesAlignedData;
-    string MeterValuesSampledData;
-    string MeterValueSampleInterval;
-    string NumberOfConnectors;
-    string ResetRetries;
-    string StopTransactionOnEVSideDisconnect;
-    string StopTransactionOnInvalidId;
-    string StopTxnAligneData;
-    string StopTxnSampledData;
-    string SupportedFeatureProfiles;
-    string TransactionMessageAtempts;
-    string TransactionMessageRetryInterval;
-    string UnlockConnectorOnEVSideDisconnect;
-} ConfigurationKeys;
+// cmo ha terminado una peticin enviada al cargador
+enum call_status_t {
+    CALL_PENDING,   // enviada, an sin respuesta
+    CALL_ANSWERED,  // ha llegado el CALLRESULT (payload tiene la respuesta)
+    CALL_ERROR,     // ha llegado un CALLERROR
+    CALL_TIMEOUT,   // no ha llegado ninguna respuesta antes del timeout
+    CALL_NOT_SENT   // payload incorrecto o cargador desconectado, no se ha enviado
+};
+
+// resultado de send_request
+struct CallResult {
+    enum call_status_t status;
+    string payload; // payload del CALLRESULT
+};
+
+// se llama cuando termina una peticin puesta en la cola con enqueue_request
+typedef function<void(const struct CallResult &result)> call_callback_t;
+
+// estado de la cola de peticiones de un cargador
+struct CommandQueueStats {
+    size_t depth;          // peticiones esperando en la cola
+    bool in_flight;        // hay una peticin enviada esperando la respuesta
+    uint64_t sent;         // peticiones sacadas de la cola
+    double total_wait_ms;  // suma del tiempo en la cola de las peticiones sacadas
+    double max_wait_ms;    // mximo tiempo en la cola
+    double oldest_wait_ms; // tiempo que lleva esperando la primera de la cola
+};
+
+// copia del estado de un cargador para los lectores de otros threads (GUI, mtricas...), sin punteros ni strings
+struct ChargerSnapshot {
+    int charger_id;
+    int connectors;                                            // nmero de conectores, sin contar el 0
+    bool connected;                                            // hay un cliente WebSocket
+    int boot_status;                                           // STATUS_BOOT_<>
+    char vendor[ID_TAG_LEN + 1];                               // chargePointVendor (CiString20)
+    char model[ID_TAG_LEN + 1];                                // chargePointModel (CiString20)
+    uint8_t status[CONN_MAX_CONNECTORS + 1];                   // CONN_<> de cada conector
+    int64_t transaction[CONN_MAX_CONNECTORS + 1];              // transactionId en curso, -1 si no hay
+    char id_tag[CONN_MAX_CONNECTORS + 1][ID_TAG_LEN + 1];      // idTag de la transaccin, "no_charging" si no hay
+};
 
 class Charger {
 public:
     Charger(int ch_id, ws_cli_conn_t cl); // constructor, inicializa informacin del cargador conectado al sistema
+    ~Charger(); // para el thread de envo de peticiones
 
     void system_on_receive(const char *req); // filtra el mensaje recibido por tipo de mensaje
-    void send_request(int option, string payload); // envia una peticin al cargador
+    struct CallResult send_request(int option, string payload); // envia una peticin al cargador y espera la respuesta
+    void enqueue_request(int option, string payload, call_callback_t done = nullptr); // pone una peticin en la cola, sin esperar
+    struct CommandQueueStats get_queue_stats(); // estado de la cola de peticiones
+    uint64_t get_duplicates_suppressed(); // mensajes reenviados contestados con la cach
+    uint64_t get_snapshot(struct ChargerSnapshot &dest) const; // copia consistente del estado, sin bloquear
 
     int get_charger_id(); // devuelve el charger_id
     vector<int64_t> get_connectors_status(); // devuelve el vector de connectors_status
@@ -99,37 +108,73 @@ public:
     struct BootNotificationConf get_boot(); // devuelve el boot_status
     string get_current_vendor(); // devuelve el current_vendor
     string get_current_model(); // devuelve el current model
+    string get_identity(); // devuelve la identidad del cargador
 
     void set_client(ws_cli_conn_t cl); // modifica el client del WebSocket
+    void reset_boot(); // vuelve a esperar un BootNotification (al desconectarse)
     void set_current_vendor(string vendor); // modifica el current_vendor
     void set_current_model(string model); // modifica el ccurrent model
 private:
     // Atributos
     int charger_id;                                       // identificador del cargador
-    ws_cli_conn_t client;                                 // identifiador del cliente ws
-    vector<int64_t> connectors_status = vector<int64_t>(NUM_CONNECTORS + 1); // aqui van los status de cada conector, los cualas pueden ser cualquiera de los defines CONN_<>
-    vector<string> current_id_tags = vector<string>(NUM_CONNECTORS + 1);   // idTag de las transacciones activas
+    atomic<ws_cli_conn_t> client;                         // identifiador del cliente ws, lo lee tambin el thread dispatcher
+    ConnectorStates connectors;                           // estado de cada conector y transaccin en curso
+    mutable mutex state_mtx;                              // protege connectors, boot, current_<>, identity y el escritor de snapshot, que tambin usan otros threads
+    SeqLock<struct ChargerSnapshot> snapshot;             // ltimo estado publicado, lo leen los otros threads
+    bool connectors_known;                                // ya se conoce NumberOfConnectors del cargador
     struct BootNotificationConf boot;                     // para ver el status general del cargador
     string current_id_tag;                                // idTag recibido en la autentificacin para aceptar o no transacciones
     string current_vendor;                                // para ver el vendor al cual est connectado
     string current_model;                                 // para ver el model al cual est connectado
-    vector<int64_t> transaction_list = vector<int64_t>(NUM_CONNECTORS + 1);         // aqui van los transactionId de los conectores que estan en una transaccin activa
+    string identity;                                      // chargePointSerialNumber (o chargeBoxSerialNumber) del ltimo BootNotification
     int64_t current_transaction_id;                       // el ltimo transactionId que se ha utilitzado
     string current_tx_request;                            // la request activa que se ha transmitido al cargador para verificar la respectiva respuesta
     uint64_t current_unique_id;                           // unique_id actual que va incrementando cada vez que el sistema envia una request
     enum tx_state_t tx_state;                             // estado del sistema
-    ConfigurationKeys conf_keys;                          // claves de configuracin del punto de carga
+    mutex result_mtx;                                     // protege tx_state, call_result y la peticin en curso
+    condition_variable result_cv;                         // avisa de que ha llegado la respuesta
+    struct CallResult call_result;                        // resultado de la ltima peticin enviada
+    uint64_t outstanding_unique_id;                       // uniqueId de la peticin en curso (0 si no hay)
+    string outstanding_action;                            // tipo de la peticin en curso
+    pair<string, string> current_change_configuration;    // clave y valor del ltimo ChangeConfiguration enviado
     ErrorMessage error;
+    DedupCache dedup;                                     // respuestas a los ltimos mensajes, para los reenvos
+
+    // cola de peticiones al cargador, se envan de una en una desde el thread dispatcher
+    struct queued_call_t {
+        int option;
+        string payload;
+        call_callback_t done;
+        chrono::steady_clock::time_point enqueued;
+    };
+    mutex queue_mtx;
+    condition_variable queue_cv;
+    deque<struct queued_call_t> command_queue;
+    struct CommandQueueStats queue_stats;
+    bool stopping;
+    thread dispatcher;
+
+    struct CallResult execute_request(int option, string payload);
+    void dispatcher_loop();
+    void finish_call(uint64_t unique_id, enum call_status_t status, const string &payload = "");
 
     void proc_call(struct header_st &header, string payload);
     void proc_call_result(const struct header_st &header, string payload);
     bool check_concurrent_tx_id_tag(string id_tag);
     bool check_transaction_id(int64_t transaction_id);
     void delete_transaction_id(int64_t transaction_id);
-    bool check_id_tag(char *id_tag);
+    string connector_id_tag(int connector); // idTag de la transaccin en curso de un conector
+    string get_current_id_tag(); // copia de current_id_tag
+    void set_number_of_connectors(const string &value); // aplica la clave NumberOfConnectors
+    bool accept_connector(int64_t connector); // comprueba un connectorId recibido del cargador
+    void publish_connector(int connector); // copia el estado de un conector a fleet_state y al snapshot
+    void publish_snapshot(); // publica el estado del cargador para los lectores
+    bool check_id_tag(char *id_tag, struct IdTagRecord *record = nullptr);
 
     // handler de cada tipo de peticin
     void authorize(struct header_st &header, string payload);
+    void send_call_result(const struct header_st &header, char *message, ws_cli_conn_t cl);
+    void send_authorize_conf(const struct header_st &header, const string &id_tag, const IdTagRecord &record, ws_cli_conn_t cl);
     void boot_notification(struct header_st &header, string payload);
     void data_transfer(struct header_st &header, string payload);
     void heartbeat(struct header_st &header, string payload);
@@ -0,0 +1,184 @@
+/*
+ *  FILE
+ *      charger_ops.cpp - peticiones al cargador como corutinas
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Peticiones del sistema al cargador escritas como corutinas de C++20: cada una envía la
+ *      petición, se suspende hasta la respuesta sin bloquear ningún thread y devuelve el Conf.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <cstdlib>
+#include "charger_ops.h"
+
+using namespace std;
+
+/*
+ *  NAME
+ *      CallAwaiter - Constructor de la clase CallAwaiter
+ *  SYNOPSIS
+ *      CallAwaiter(Charger &charger, int option, string payload);
+ *  DESCRIPTION
+ *      Guarda la petición que se enviará al hacer co_await.
+ *  RETURN VALUE
+ *      Nada.
+ */
+CallAwaiter::CallAwaiter(Charger &charger, int option, string payload)
+    : charger{charger}, option{option}, payload{std::move(payload)}, result{CALL_PENDING, ""}
+{
+}
+
+/*
+ *  NAME
+ *      await_suspend - Envía la petición y suspende la corutina.
+ *  SYNOPSIS
+ *      void await_suspend(coroutine_handle<> h);
+ *  DESCRIPTION
+ *      Pone la petición en la cola del cargador. Cuando termina, el thread del cargador guarda
+ *      el resultado y reanuda la corutina. Después de enqueue_request no se puede tocar this:
+ *      la corutina puede haberse reanudado (y terminado) en el otro thread.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void CallAwaiter::await_suspend(coroutine_handle<> h)
+{
+    charger.enqueue_request(option, std::move(payload), [this, h](const struct CallResult &r) {
+        result = r;
+        h.resume();
+    });
+}
+
+/*
+ *  NAME
+ *      print_payload - Pasa el JSON de una petición a string.
+ *  SYNOPSIS
+ *      static string print_payload(char *json);
+ *  DESCRIPTION
+ *      Copia el JSON generado por un cJSON_Print<>Req y lo libera.
+ *  RETURN VALUE
+ *      El JSON, vacío si json es NULL (enqueue_request lo devolverá como CALL_NOT_SENT).
+ */
+static string print_payload(char *json)
+{
+    string payload = json ? json : "";
+    free(json);
+
+    return payload;
+}
+
+/*
+ *  NAME
+ *      call_typed - Envía una petición y parsea la respuesta.
+ *  SYNOPSIS
+ *      template <typename Conf>
+ *      static Task<OcppResult<Conf>> call_typed(Charger &charger, int option, string payload, Conf *(*parse)(const char *));
+ *  DESCRIPTION
+ *      Espera la respuesta de la petición y la parsea con parse. Todas las respuestas que
+ *      devuelve esta función solo tienen un campo status.
+ *  RETURN VALUE
+ *      El resultado con el Conf. Si la respuesta no se puede parsear el estado es CALL_ERROR.
+ */
+template <typename Conf>
+static Task<OcppResult<Conf>> call_typed(Charger &charger, int option, string payload, Conf *(*parse)(const char *))
+{
+    struct CallResult r = co_await CallAwaiter(charger, option, std::move(payload));
+    OcppResult<Conf> result{r.status, {}};
+
+    if (r.status == CALL_ANSWERED) {
+        Conf *conf = parse(r.payload.c_str());
+        if (conf && static_cast<int>(conf->status) >= 0)
+            result.conf = *conf;
+        else
+            result.status = CALL_ERROR; // respuesta mal formada
+        free(conf);
+    }
+
+    co_return result;
+}
+
+/*
+ *  NAME
+ *      async_change_availability - Envía un ChangeAvailability.
+ *  SYNOPSIS
+ *      Task<OcppResult<struct ChangeAvailabilityConf>> async_change_availability(Charger &charger, int64_t connector_id, enum Type type);
+ *  DESCRIPTION
+ *      Cambia la disponibilidad de un conector (0 = todo el cargador).
+ *  RETURN VALUE
+ *      El resultado con el ChangeAvailabilityConf.
+ */
+Task<OcppResult<struct ChangeAvailabilityConf>> async_change_availability(Charger &charger, int64_t connector_id, enum Type type)
+{
+    struct ChangeAvailabilityReq req = {connector_id, type};
+
+    return call_typed(charger, '1', print_payload(cJSON_PrintChangeAvailabilityReq(&req)), cJSON_ParseChangeAvailabilityConf);
+}
+
+/*
+ *  NAME
+ *      async_clear_cache - Envía un ClearCache.
+ *  SYNOPSIS
+ *      Task<OcppResult<struct ClearCacheConf>> async_clear_cache(Charger &charger);
+ *  DESCRIPTION
+ *      Pide al cargador que borre su caché de autorizaciones.
+ *  RETURN VALUE
+ *      El resultado con el ClearCacheConf.
+ */
+Task<OcppResult<struct ClearCacheConf>> async_clear_cache(Charger &charger)
+{
+    return call_typed(charger, '2', "{}", cJSON_ParseClearCacheConf);
+}
+
+/*
+ *  NAME
+ *      async_reset - Envía un Reset.
+ *  SYNOPSIS
+ *      Task<OcppResult<struct ResetConf>> async_reset(Charger &charger, enum Type_Reset type);
+ *  DESCRIPTION
+ *      Pide al cargador un reinicio TYPE_SOFT o TYPE_HARD.
+ *  RETURN VALUE
+ *      El resultado con el ResetConf.
+ */
+Task<OcppResult<struct ResetConf>> async_reset(Charger &charger, enum Type_Reset type)
+{
+    struct ResetReq req = {type};
+
+    return call_typed(charger, '7', print_payload(cJSON_PrintResetReq(&req)), cJSON_ParseResetConf);
+}
+
+/*
+ *  NAME
+ *      async_unlock_connector - Envía un UnlockConnector.
+ *  SYNOPSIS
+ *      Task<OcppResult<struct UnlockConnectorConf>> async_unlock_connector(Charger &charger, int64_t connector_id);
+ *  DESCRIPTION
+ *      Pide al cargador que desbloquee un conector.
+ *  RETURN VALUE
+ *      El resultado con el UnlockConnectorConf.
+ */
+Task<OcppResult<struct UnlockConnectorConf>> async_unlock_connector(Charger &charger, int64_t connector_id)
+{
+    struct UnlockConnectorReq req = {connector_id};
+
+    return call_typed(charger, '8', print_payload(cJSON_PrintUnlockConnectorReq(&req)), cJSON_ParseUnlockConnectorConf);
+}
+
+/*
+ *  NAME
+ *      async_change_configuration - Envía un ChangeConfiguration.
+ *  SYNOPSIS
+ *      Task<OcppResult<struct ChangeConfigurationConf>> async_change_configuration(Charger &charger, string key, string value);
+ *  DESCRIPTION
+ *      Cambia una clave de configuración del cargador.
+ *  RETURN VALUE
+ *      El resultado con el ChangeConfigurationConf.
+ */
+Task<OcppResult<struct ChangeConfigurationConf>> async_change_configuration(Charger &charger, string key, string value)
+{
+    struct ChangeConfigurationReq req = {const_cast<char *>(key.c_str()), const_cast<char *>(value.c_str())};
+
+    return call_typed(charger, '9', print_payload(cJSON_PrintChangeConfigurationReq(&req)), cJSON_ParseChangeConfigurationConf);
+}
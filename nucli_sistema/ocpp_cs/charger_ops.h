@@ -0,0 +1,65 @@
+/*
+ *  FILE
+ *      charger_ops.h - header de charger_ops.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de charger_ops.cpp, declaración de las peticiones al cargador como corutinas
+ *      que devuelven la respuesta ya parseada.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _CHARGER_OPS_H_
+#define _CHARGER_OPS_H_
+
+#include <string>
+#include <coroutine>
+#include "charger.h"
+#include "ocpp_task.h"
+#include "lib_json_includes.h"
+
+using namespace std;
+
+// resultado de una petición: conf solo es válido si status es CALL_ANSWERED
+template <typename Conf>
+struct OcppResult {
+    enum call_status_t status; // CALL_ANSWERED, CALL_ERROR (también si la respuesta no se puede parsear), CALL_TIMEOUT o CALL_NOT_SENT
+    Conf conf;
+};
+
+/*
+ * Espera la respuesta de una petición sin bloquear el thread: co_await pone la petición en la
+ * cola del cargador (enqueue_request) y suspende la corutina, que se reanuda desde el thread del
+ * cargador cuando llega el CALLRESULT o el CALLERROR, o cuando salta el timeout. Lo que hace la
+ * corutina después se ejecuta en ese thread hasta el siguiente co_await, así que no puede
+ * bloquearse (p.ej. con send_request) o retrasaría las peticiones del cargador.
+ */
+class CallAwaiter {
+public:
+    CallAwaiter(Charger &charger, int option, string payload);
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(coroutine_handle<> h);
+    struct CallResult await_resume() { return std::move(result); }
+private:
+    Charger &charger;
+    int option;              // tipo de petición (como en send_request)
+    string payload;
+    struct CallResult result;
+};
+
+/*
+ * Peticiones del sistema al cargador. Cada una es una corutina: co_await async_reset(*charger, TYPE_SOFT)
+ * devuelve el ResetConf. Las operaciones en bloque (bulk_operation.h) las usan para enviar una
+ * petición a muchos cargadores sin ningún thread esperando las respuestas.
+ */
+Task<OcppResult<struct ChangeAvailabilityConf>> async_change_availability(Charger &charger, int64_t connector_id, enum Type type);
+Task<OcppResult<struct ClearCacheConf>> async_clear_cache(Charger &charger);
+Task<OcppResult<struct ResetConf>> async_reset(Charger &charger, enum Type_Reset type);
+Task<OcppResult<struct UnlockConnectorConf>> async_unlock_connector(Charger &charger, int64_t connector_id);
+Task<OcppResult<struct ChangeConfigurationConf>> async_change_configuration(Charger &charger, string key, string value);
+
+#endif
@@ -0,0 +1,371 @@
+/*
+ *  FILE
+ *      config_store.cpp - claves de configuración de los cargadores
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Almacén de las claves de configuración de todos los cargadores, llenado con las respuestas
+ *      de GetConfiguration. Permite consultar la configuración de un cargador sin enviarle ninguna
+ *      petición. Un thread comprueba periódicamente qué claves son antiguas y solo pide esas.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <syslog.h>
+#include "config_store.h"
+#include "charger.h"
+#include "ws_server.h"
+
+using namespace std;
+
+ConfigStore config_store;
+
+const char *standard_config_keys[] = {
+    "AuthorizeRemoteTxRequests",
+    "ClockAlignedDataInterval",
+    "ConnectionTimeOut",
+    "ConnectorPhaseRotation",
+    "GetConfigurationMaxKeys",
+    "HeartbeatInterval",
+    "LocalAuthorizeOffline",
+    "LocalPreAuthorize",
+    "MeterValuesAlignedData",
+    "MeterValuesSampledData",
+    "MeterValueSampleInterval",
+    "NumberOfConnectors",
+    "ResetRetries",
+    "StopTransactionOnEVSideDisconnect",
+    "StopTransactionOnInvalidId",
+    "StopTxnAlignedData",
+    "StopTxnSampledData",
+    "SupportedFeatureProfiles",
+    "TransactionMessageAttempts",
+    "TransactionMessageRetryInterval",
+    "UnlockConnectorOnEVSideDisconnect"
+};
+const size_t num_standard_config_keys = sizeof(standard_config_keys) / sizeof(standard_config_keys[0]);
+
+static void refresh_loop();
+static void refresh_charger(Charger *charger);
+
+/*
+ *  NAME
+ *      update - Guarda una clave recibida.
+ *  SYNOPSIS
+ *      void update(int charger_id, const string &key, const string &value, bool readonly);
+ *  DESCRIPTION
+ *      Guarda el valor de una clave recibida en un GetConfigurationConf. Si el valor ha
+ *      cambiado (o es nuevo) la clave pasa a tener una versión nueva.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void ConfigStore::update(int charger_id, const string &key, const string &value, bool readonly)
+{
+    unique_lock<shared_mutex> lock(mtx);
+
+    auto &keys = chargers[charger_id];
+    auto it = keys.find(key);
+    if (it == keys.end() || it->second.unknown || it->second.value != value || it->second.readonly != readonly)
+        keys[key] = {value, readonly, false, ++last_version, time(NULL)};
+    else
+        it->second.updated = time(NULL);
+}
+
+/*
+ *  NAME
+ *      mark_unknown - Guarda una clave que el cargador no conoce.
+ *  SYNOPSIS
+ *      void mark_unknown(int charger_id, const string &key);
+ *  DESCRIPTION
+ *      Guarda una clave contestada como unknownKey, para no volver a pedirla
+ *      hasta que sea antigua.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void ConfigStore::mark_unknown(int charger_id, const string &key)
+{
+    unique_lock<shared_mutex> lock(mtx);
+
+    auto &keys = chargers[charger_id];
+    auto it = keys.find(key);
+    if (it == keys.end() || !it->second.unknown)
+        keys[key] = {"", false, true, ++last_version, time(NULL)};
+    else
+        it->second.updated = time(NULL);
+}
+
+/*
+ *  NAME
+ *      mark_stale - Marca todas las claves de un cargador como antiguas.
+ *  SYNOPSIS
+ *      void mark_stale(int charger_id);
+ *  DESCRIPTION
+ *      Marca todas las claves de un cargador como antiguas, de manera que se volverán a pedir
+ *      en la próxima actualización. Los valores se mantienen hasta entonces.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void ConfigStore::mark_stale(int charger_id)
+{
+    unique_lock<shared_mutex> lock(mtx);
+
+    auto it = chargers.find(charger_id);
+    if (it != chargers.end()) {
+        for (auto &elem : it->second)
+            elem.second.updated = 0;
+    }
+}
+
+/*
+ *  NAME
+ *      forget - Elimina todas las claves de un cargador.
+ *  SYNOPSIS
+ *      void forget(int charger_id);
+ *  DESCRIPTION
+ *      Elimina todas las claves de un cargador.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void ConfigStore::forget(int charger_id)
+{
+    unique_lock<shared_mutex> lock(mtx);
+
+    chargers.erase(charger_id);
+}
+
+/*
+ *  NAME
+ *      get - Devuelve el valor de una clave.
+ *  SYNOPSIS
+ *      bool get(int charger_id, const string &key, ConfigEntry &dest) const;
+ *  DESCRIPTION
+ *      Copia en dest el último valor recibido de una clave de un cargador.
+ *  RETURN VALUE
+ *      Devuelve true si la clave se ha recibido alguna vez.
+ *      Devuelve false en caso contrario.
+ */
+bool ConfigStore::get(int charger_id, const string &key, ConfigEntry &dest) const
+{
+    shared_lock<shared_mutex> lock(mtx);
+
+    auto ch = chargers.find(charger_id);
+    if (ch == chargers.end())
+        return false;
+
+    auto it = ch->second.find(key);
+    if (it == ch->second.end())
+        return false;
+
+    dest = it->second;
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      get_all - Devuelve todas las claves de un cargador.
+ *  SYNOPSIS
+ *      map<string, ConfigEntry> get_all(int charger_id) const;
+ *  DESCRIPTION
+ *      Devuelve una copia de todas las claves recibidas de un cargador, ordenadas por nombre.
+ *  RETURN VALUE
+ *      Un map con las claves (vacío si no se ha recibido ninguna).
+ */
+map<string, ConfigEntry> ConfigStore::get_all(int charger_id) const
+{
+    shared_lock<shared_mutex> lock(mtx);
+
+    auto ch = chargers.find(charger_id);
+    if (ch == chargers.end())
+        return {};
+
+    return ch->second;
+}
+
+/*
+ *  NAME
+ *      changed_since - Devuelve las claves que han cambiado después de una versión.
+ *  SYNOPSIS
+ *      map<string, ConfigEntry> changed_since(int charger_id, uint64_t version) const;
+ *  DESCRIPTION
+ *      Devuelve las claves de un cargador cuyo valor ha cambiado después de version
+ *      (p.ej. la versión de la última consulta).
+ *  RETURN VALUE
+ *      Un map con las claves.
+ */
+map<string, ConfigEntry> ConfigStore::changed_since(int charger_id, uint64_t version) const
+{
+    map<string, ConfigEntry> result;
+
+    shared_lock<shared_mutex> lock(mtx);
+
+    auto ch = chargers.find(charger_id);
+    if (ch != chargers.end()) {
+        for (auto &elem : ch->second) {
+            if (elem.second.version > version)
+                result.insert(elem);
+        }
+    }
+
+    return result;
+}
+
+/*
+ *  NAME
+ *      stale_keys - Devuelve las claves que se tienen que volver a pedir.
+ *  SYNOPSIS
+ *      vector<string> stale_keys(int charger_id, int max_age) const;
+ *  DESCRIPTION
+ *      Devuelve las claves de un cargador recibidas hace más de max_age segundos
+ *      y las claves estándar que aún no se han recibido.
+ *  RETURN VALUE
+ *      Un vector con las claves.
+ */
+vector<string> ConfigStore::stale_keys(int charger_id, int max_age) const
+{
+    vector<string> result;
+    time_t limit = time(NULL) - max_age;
+
+    shared_lock<shared_mutex> lock(mtx);
+
+    auto ch = chargers.find(charger_id);
+    if (ch == chargers.end()) {
+        result.assign(standard_config_keys, standard_config_keys + num_standard_config_keys);
+        return result;
+    }
+
+    for (auto &elem : ch->second) {
+        if (elem.second.updated <= limit)
+            result.push_back(elem.first);
+    }
+
+    for (size_t i = 0; i < num_standard_config_keys; i++) {
+        if (!ch->second.count(standard_config_keys[i]))
+            result.push_back(standard_config_keys[i]);
+    }
+
+    return result;
+}
+
+/*
+ *  NAME
+ *      empty - Indica si no se ha recibido ninguna clave de un cargador.
+ *  SYNOPSIS
+ *      bool empty(int charger_id) const;
+ *  DESCRIPTION
+ *      Indica si no se ha recibido ninguna clave de un cargador.
+ *  RETURN VALUE
+ *      Devuelve true si no hay ninguna.
+ *      Devuelve false en caso contrario.
+ */
+bool ConfigStore::empty(int charger_id) const
+{
+    shared_lock<shared_mutex> lock(mtx);
+
+    auto ch = chargers.find(charger_id);
+
+    return ch == chargers.end() || ch->second.empty();
+}
+
+/*
+ *  NAME
+ *      version - Devuelve la versión actual del almacén.
+ *  SYNOPSIS
+ *      uint64_t version() const;
+ *  DESCRIPTION
+ *      Devuelve la versión del último cambio de cualquier clave de cualquier cargador.
+ *  RETURN VALUE
+ *      La versión.
+ */
+uint64_t ConfigStore::version() const
+{
+    shared_lock<shared_mutex> lock(mtx);
+
+    return last_version;
+}
+
+/*
+ *  NAME
+ *      start_config_refresh - Arranca la actualización periódica de las claves.
+ *  SYNOPSIS
+ *      void start_config_refresh();
+ *  DESCRIPTION
+ *      Arranca un thread que cada CONFIG_REFRESH_PERIOD segundos pide a cada cargador
+ *      conectado las claves que tienen más de CONFIG_MAX_AGE segundos.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void start_config_refresh()
+{
+    thread(refresh_loop).detach();
+}
+
+/*
+ *  NAME
+ *      refresh_loop - Bucle de la actualización periódica de las claves.
+ *  SYNOPSIS
+ *      static void refresh_loop();
+ *  DESCRIPTION
+ *      Recorre todos los cargadores cada CONFIG_REFRESH_PERIOD segundos.
+ *  RETURN VALUE
+ *      Nada.
+ */
+static void refresh_loop()
+{
+    for (;;) {
+        this_thread::sleep_for(chrono::seconds(CONFIG_REFRESH_PERIOD));
+
+        for (int i = 1; i <= MAX_CHARGERS; i++) {
+            Charger *charger = get_charger(i);
+            if (charger && charger->get_client() != static_cast<ws_cli_conn_t>(-1) &&
+                charger->get_boot().status == STATUS_BOOT_ACCEPTED)
+                refresh_charger(charger);
+        }
+    }
+}
+
+/*
+ *  NAME
+ *      refresh_charger - Pide a un cargador sus claves antiguas.
+ *  SYNOPSIS
+ *      static void refresh_charger(Charger *charger);
+ *  DESCRIPTION
+ *      Si no se ha recibido ninguna clave del cargador, le pide todas (GetConfiguration sin key).
+ *      Si no, le pide solo las claves antiguas, en tantos GetConfiguration como haga falta para
+ *      que ningún payload supere CONFIG_MAX_PAYLOAD.
+ *  RETURN VALUE
+ *      Nada.
+ */
+static void refresh_charger(Charger *charger)
+{
+    int charger_id = charger->get_charger_id();
+
+    if (config_store.empty(charger_id)) {
+        syslog(LOG_DEBUG, "%s: cargador %d, se piden todas las claves", __func__, charger_id);
+        charger->send_request('4', "{}");
+        return;
+    }
+
+    vector<string> keys = config_store.stale_keys(charger_id, CONFIG_MAX_AGE);
+    if (keys.empty())
+        return;
+
+    syslog(LOG_DEBUG, "%s: cargador %d, %zu claves antiguas", __func__, charger_id, keys.size());
+
+    string payload;
+    for (auto &key : keys) {
+        string item = "\"" + key + "\"";
+        if (!payload.empty() && payload.size() + item.size() + 3 > CONFIG_MAX_PAYLOAD) {
+            charger->send_request('4', "{\"key\":[" + payload + "]}");
+            payload.clear();
+        }
+        payload += (payload.empty() ? "" : ",") + item;
+    }
+
+    charger->send_request('4', "{\"key\":[" + payload + "]}");
+}
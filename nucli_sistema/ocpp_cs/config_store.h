@@ -0,0 +1,75 @@
+/*
+ *  FILE
+ *      config_store.h - header de config_store.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de config_store.cpp, declaración del almacén de las claves de configuración
+ *      de todos los cargadores y de su actualización periódica.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _CONFIG_STORE_H_
+#define _CONFIG_STORE_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <shared_mutex>
+#include <cstdint>
+#include <ctime>
+
+#define CONFIG_MAX_AGE        3600 // segundos a partir de los cuales una clave se vuelve a pedir
+#define CONFIG_REFRESH_PERIOD 60   // segundos entre dos comprobaciones de claves antiguas
+#define CONFIG_MAX_PAYLOAD    900  // medida máxima del payload de un GetConfiguration
+
+using namespace std;
+
+// valor de una clave de configuración de un cargador
+struct ConfigEntry {
+    string value;    // último valor recibido
+    bool readonly;   // la clave no se puede modificar con ChangeConfiguration
+    bool unknown;    // el cargador ha contestado la clave como unknownKey
+    uint64_t version; // versión del almacén en la que ha cambiado el valor
+    time_t updated;   // última vez que se ha recibido (aunque no haya cambiado)
+};
+
+/*
+ * Almacén de las claves de configuración de todos los cargadores. Se llena con cada
+ * GetConfigurationConf, guardando también las claves propias del fabricante. Cada clave
+ * tiene la versión en la que ha cambiado su valor (un contador global que solo crece),
+ * de manera que se puede saber qué ha cambiado desde una versión dada.
+ */
+class ConfigStore {
+public:
+    void update(int charger_id, const string &key, const string &value, bool readonly); // guarda una clave recibida
+    void mark_unknown(int charger_id, const string &key); // guarda una clave que el cargador no conoce
+    void mark_stale(int charger_id); // fuerza a volver a pedir todas las claves (p.ej. al reiniciar)
+    void forget(int charger_id); // elimina todas las claves de un cargador
+
+    bool get(int charger_id, const string &key, ConfigEntry &dest) const; // valor de una clave
+    map<string, ConfigEntry> get_all(int charger_id) const; // todas las claves de un cargador
+    map<string, ConfigEntry> changed_since(int charger_id, uint64_t version) const; // claves cambiadas después de version
+    vector<string> stale_keys(int charger_id, int max_age) const; // claves que se tienen que volver a pedir
+    bool empty(int charger_id) const; // no se ha recibido ninguna clave
+    uint64_t version() const; // versión actual del almacén
+private:
+    mutable shared_mutex mtx;
+    unordered_map<int, map<string, ConfigEntry>> chargers; // charger_id -> clave -> valor
+    uint64_t last_version = 0;
+};
+
+// claves de configuración de todo el sistema
+extern ConfigStore config_store;
+
+// claves estándar de OCPP 1.6 que se piden a todos los cargadores
+extern const char *standard_config_keys[];
+extern const size_t num_standard_config_keys;
+
+void start_config_refresh();
+
+#endif
@@ -0,0 +1,302 @@
+/*
+ *  FILE
+ *      connector_state.cpp - máquina de estados de los conectores
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Estado de los conectores de un cargador y de sus transacciones, validando cada
+ *      StatusNotification, StartTransaction y StopTransaction como una transición.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <algorithm>
+#include "connector_state.h"
+
+using namespace std;
+
+#define BIT(s) (1u << (s))
+
+/*
+ * Transiciones de estado permitidas por OCPP 1.6 (tabla de la sección 4.9): status_transitions[a]
+ * tiene el bit b activo si se puede pasar de a a b. Repetir el mismo estado siempre se permite y
+ * desde CONN_UNKNOWN (antes del primer StatusNotification) se puede ir a cualquier estado.
+ */
+static const uint16_t status_transitions[CONN_UNKNOWN + 1] = {
+    /* CONN_AVAILABLE */      BIT(CONN_PREPARING) | BIT(CONN_CHARGING) | BIT(CONN_SUSPENDED_EV) | BIT(CONN_SUSPENDED_EVSE) |
+                              BIT(CONN_RESERVED) | BIT(CONN_UNAVAILABLE) | BIT(CONN_FAULTED),
+    /* CONN_CHARGING */       BIT(CONN_AVAILABLE) | BIT(CONN_SUSPENDED_EV) | BIT(CONN_SUSPENDED_EVSE) | BIT(CONN_FINISHING) |
+                              BIT(CONN_UNAVAILABLE) | BIT(CONN_FAULTED),
+    /* CONN_FAULTED */        BIT(CONN_AVAILABLE) | BIT(CONN_PREPARING) | BIT(CONN_CHARGING) | BIT(CONN_SUSPENDED_EV) |
+                              BIT(CONN_SUSPENDED_EVSE) | BIT(CONN_FINISHING) | BIT(CONN_RESERVED) | BIT(CONN_UNAVAILABLE),
+    /* CONN_FINISHING */      BIT(CONN_AVAILABLE) | BIT(CONN_PREPARING) | BIT(CONN_UNAVAILABLE) | BIT(CONN_FAULTED),
+    /* CONN_PREPARING */      BIT(CONN_AVAILABLE) | BIT(CONN_CHARGING) | BIT(CONN_SUSPENDED_EV) | BIT(CONN_SUSPENDED_EVSE) |
+                              BIT(CONN_FINISHING) | BIT(CONN_FAULTED),
+    /* CONN_RESERVED */       BIT(CONN_AVAILABLE) | BIT(CONN_PREPARING) | BIT(CONN_UNAVAILABLE) | BIT(CONN_FAULTED),
+    /* CONN_SUSPENDED_EV */   BIT(CONN_AVAILABLE) | BIT(CONN_CHARGING) | BIT(CONN_SUSPENDED_EVSE) | BIT(CONN_FINISHING) |
+                              BIT(CONN_UNAVAILABLE) | BIT(CONN_FAULTED),
+    /* CONN_SUSPENDED_EVSE */ BIT(CONN_AVAILABLE) | BIT(CONN_CHARGING) | BIT(CONN_SUSPENDED_EV) | BIT(CONN_FINISHING) |
+                              BIT(CONN_UNAVAILABLE) | BIT(CONN_FAULTED),
+    /* CONN_UNAVAILABLE */    BIT(CONN_AVAILABLE) | BIT(CONN_PREPARING) | BIT(CONN_CHARGING) | BIT(CONN_SUSPENDED_EV) |
+                              BIT(CONN_SUSPENDED_EVSE) | BIT(CONN_FAULTED),
+    /* CONN_UNKNOWN */        0x3ff
+};
+
+// estados del conector en los que no se puede iniciar una transacción
+static const uint16_t start_blocked = BIT(CONN_FAULTED) | BIT(CONN_SUSPENDED_EV) | BIT(CONN_SUSPENDED_EVSE) | BIT(CONN_UNAVAILABLE);
+
+/*
+ *  NAME
+ *      ConnectorStates - Constructor de la clase ConnectorStates
+ *  SYNOPSIS
+ *      ConnectorStates(int connectors = NUM_CONNECTORS);
+ *  DESCRIPTION
+ *      Inicializa connectors conectores (más el 0) a CONN_UNKNOWN y sin transacción.
+ *  RETURN VALUE
+ *      Nada.
+ */
+ConnectorStates::ConnectorStates(int connectors) : state{inline_state}, transaction{inline_transaction}, count{0}
+{
+    for (int i = 0; i <= CONN_INLINE_MAX; i++) {
+        inline_state[i] = CONN_UNKNOWN;
+        inline_transaction[i] = -1;
+    }
+
+    if (!set_connectors(connectors))
+        set_connectors(NUM_CONNECTORS);
+}
+
+/*
+ *  NAME
+ *      set_connectors - Cambia el número de conectores.
+ *  SYNOPSIS
+ *      bool set_connectors(int connectors);
+ *  DESCRIPTION
+ *      Cambia el número de conectores del cargador. Los conectores que ya existían conservan su
+ *      estado y su transacción, los nuevos empiezan en CONN_UNKNOWN y los que sobran se descartan,
+ *      pero no si alguno tiene una transacción en curso (su StopTransaction ya no lo encontraría).
+ *      Hasta CONN_INLINE_MAX conectores se usa el almacenamiento interno, con más se reserva en el heap.
+ *  RETURN VALUE
+ *      Devuelve true si todo va bien.
+ *      Devuelve false si el número de conectores no es válido o si se quitaría un conector con
+ *      una transacción en curso.
+ */
+bool ConnectorStates::set_connectors(int connectors)
+{
+    if (connectors < 1 || connectors > CONN_MAX_CONNECTORS)
+        return false;
+
+    if (connectors == count)
+        return true;
+
+    for (int i = connectors + 1; i <= count; i++)
+        if (state[i] & CONN_TX_BIT)
+            return false;
+
+    int keep = min(count, connectors) + 1; // conectores que conservan el estado, contando el 0
+
+    if (connectors <= CONN_INLINE_MAX) {
+        if (state != inline_state) { // vuelvo al almacenamiento interno
+            copy(state, state + keep, inline_state);
+            copy(transaction, transaction + keep, inline_transaction);
+            state = inline_state;
+            transaction = inline_transaction;
+            heap_state.reset();
+            heap_transaction.reset();
+        }
+
+        for (int i = keep; i <= CONN_INLINE_MAX; i++) {
+            inline_state[i] = CONN_UNKNOWN;
+            inline_transaction[i] = -1;
+        }
+    }
+    else {
+        unique_ptr<uint8_t[]> new_state(new uint8_t[connectors + 1]);
+        unique_ptr<int64_t[]> new_transaction(new int64_t[connectors + 1]);
+
+        copy(state, state + keep, new_state.get());
+        copy(transaction, transaction + keep, new_transaction.get());
+        fill(new_state.get() + keep, new_state.get() + connectors + 1, (uint8_t)CONN_UNKNOWN);
+        fill(new_transaction.get() + keep, new_transaction.get() + connectors + 1, (int64_t)-1);
+
+        heap_state = move(new_state);
+        heap_transaction = move(new_transaction);
+        state = heap_state.get();
+        transaction = heap_transaction.get();
+    }
+
+    count = connectors;
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      status - Aplica un StatusNotification.
+ *  SYNOPSIS
+ *      enum conn_result_t status(int connector, int status);
+ *  DESCRIPTION
+ *      Cambia el estado OCPP de un conector. El estado que envía el cargador siempre se aplica,
+ *      aunque la transición no esté permitida (p.ej. si se ha perdido una notificación). Pasar
+ *      a Available termina la transacción en curso del conector.
+ *  RETURN VALUE
+ *      CONN_OK si la transición está permitida, CONN_IRREGULAR si no,
+ *      CONN_BAD_CONNECTOR si el conector o el estado no son válidos.
+ */
+enum conn_result_t ConnectorStates::status(int connector, int status)
+{
+    if (!valid_connector(connector) || status < CONN_AVAILABLE || status >= CONN_UNKNOWN)
+        return CONN_BAD_CONNECTOR;
+
+    int from = state[connector] & CONN_STATUS_MASK;
+    enum conn_result_t result = (from == status || (status_transitions[from] & BIT(status))) ? CONN_OK : CONN_IRREGULAR;
+
+    if (status == CONN_AVAILABLE) {
+        state[connector] = CONN_AVAILABLE;
+        transaction[connector] = -1;
+    }
+    else
+        state[connector] = (state[connector] & CONN_TX_BIT) | status;
+
+    return result;
+}
+
+/*
+ *  NAME
+ *      check_start - Comprueba si se puede iniciar una transacción en un conector.
+ *  SYNOPSIS
+ *      enum conn_result_t check_start(int connector) const;
+ *  DESCRIPTION
+ *      Comprueba que el conector no tiene ninguna transacción en curso y que ni él ni el
+ *      cargador (conector 0) están en un estado que no permite cargar.
+ *  RETURN VALUE
+ *      CONN_OK si se puede iniciar, CONN_BUSY, CONN_NOT_AVAILABLE o CONN_BAD_CONNECTOR si no.
+ */
+enum conn_result_t ConnectorStates::check_start(int connector) const
+{
+    if (!valid_connector(connector) || connector == 0)
+        return CONN_BAD_CONNECTOR;
+
+    if (state[connector] & CONN_TX_BIT)
+        return CONN_BUSY;
+
+    if ((state[0] & CONN_STATUS_MASK) == CONN_UNAVAILABLE || (start_blocked & BIT(state[connector] & CONN_STATUS_MASK)))
+        return CONN_NOT_AVAILABLE;
+
+    return CONN_OK;
+}
+
+/*
+ *  NAME
+ *      start - Aplica un StartTransaction aceptado.
+ *  SYNOPSIS
+ *      enum conn_result_t start(int connector, int64_t transaction_id);
+ *  DESCRIPTION
+ *      Marca que el conector tiene la transacción transaction_id en curso, si check_start lo permite.
+ *  RETURN VALUE
+ *      El resultado de check_start.
+ */
+enum conn_result_t ConnectorStates::start(int connector, int64_t transaction_id)
+{
+    enum conn_result_t result = check_start(connector);
+    if (result != CONN_OK)
+        return result;
+
+    state[connector] |= CONN_TX_BIT;
+    transaction[connector] = transaction_id;
+
+    return CONN_OK;
+}
+
+/*
+ *  NAME
+ *      stop - Aplica un StopTransaction.
+ *  SYNOPSIS
+ *      enum conn_result_t stop(int connector, int64_t transaction_id);
+ *  DESCRIPTION
+ *      Termina la transacción en curso del conector, que tiene que ser transaction_id.
+ *  RETURN VALUE
+ *      CONN_OK si todo va bien, CONN_NO_TRANSACTION si el conector no tiene esa transacción
+ *      en curso, CONN_BAD_CONNECTOR si el conector no es válido.
+ */
+enum conn_result_t ConnectorStates::stop(int connector, int64_t transaction_id)
+{
+    if (!valid_connector(connector) || connector == 0)
+        return CONN_BAD_CONNECTOR;
+
+    if (!(state[connector] & CONN_TX_BIT) || transaction[connector] != transaction_id)
+        return CONN_NO_TRANSACTION;
+
+    state[connector] &= CONN_STATUS_MASK;
+    transaction[connector] = -1;
+
+    return CONN_OK;
+}
+
+/*
+ *  NAME
+ *      get_status - Devuelve el estado de un conector.
+ *  SYNOPSIS
+ *      int get_status(int connector) const;
+ *  DESCRIPTION
+ *      Devuelve el estado OCPP de un conector.
+ *  RETURN VALUE
+ *      El estado (CONN_<>), CONN_UNKNOWN si el conector no es válido.
+ */
+int ConnectorStates::get_status(int connector) const
+{
+    return valid_connector(connector) ? (state[connector] & CONN_STATUS_MASK) : CONN_UNKNOWN;
+}
+
+/*
+ *  NAME
+ *      in_transaction - Indica si un conector tiene una transacción en curso.
+ *  SYNOPSIS
+ *      bool in_transaction(int connector) const;
+ *  DESCRIPTION
+ *      Indica si un conector tiene una transacción en curso.
+ *  RETURN VALUE
+ *      Devuelve true si tiene una transacción en curso.
+ *      Devuelve false en caso contrario.
+ */
+bool ConnectorStates::in_transaction(int connector) const
+{
+    return valid_connector(connector) && (state[connector] & CONN_TX_BIT);
+}
+
+/*
+ *  NAME
+ *      transaction_id - Devuelve la transacción en curso de un conector.
+ *  SYNOPSIS
+ *      int64_t transaction_id(int connector) const;
+ *  DESCRIPTION
+ *      Devuelve el transactionId de la transacción en curso de un conector.
+ *  RETURN VALUE
+ *      El transactionId, -1 si no hay ninguna.
+ */
+int64_t ConnectorStates::transaction_id(int connector) const
+{
+    return valid_connector(connector) ? transaction[connector] : -1;
+}
+
+/*
+ *  NAME
+ *      find_transaction - Busca el conector de una transacción.
+ *  SYNOPSIS
+ *      int find_transaction(int64_t transaction_id) const;
+ *  DESCRIPTION
+ *      Busca en qué conector está en curso la transacción transaction_id.
+ *  RETURN VALUE
+ *      El conector, -1 si no está en curso en ningún conector.
+ */
+int ConnectorStates::find_transaction(int64_t transaction_id) const
+{
+    for (int i = 1; i <= count; i++) {
+        if ((state[i] & CONN_TX_BIT) && transaction[i] == transaction_id)
+            return i;
+    }
+
+    return -1;
+}
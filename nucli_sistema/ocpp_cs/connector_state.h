@@ -0,0 +1,92 @@
+/*
+ *  FILE
+ *      connector_state.h - header de connector_state.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de connector_state.cpp, declaración de la máquina de estados de los conectores
+ *      de un cargador (estado del conector y transacción en curso).
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _CONNECTOR_STATE_H_
+#define _CONNECTOR_STATE_H_
+
+#include <cstdint>
+#include <memory>
+
+#define NUM_CONNECTORS      2  // conectores que se suponen hasta conocer NumberOfConnectors
+#define CONN_INLINE_MAX     8  // conectores que se guardan dentro del objeto, a partir de aquí en el heap
+#define CONN_MAX_CONNECTORS 64 // máximo de conectores que se aceptan de un cargador
+
+// posibles estados de los connectores
+#define CONN_AVAILABLE 0
+#define CONN_CHARGING 1
+#define CONN_FAULTED 2
+#define CONN_FINISHING 3
+#define CONN_PREPARING 4
+#define CONN_RESERVED 5
+#define CONN_SUSPENDED_EV 6
+#define CONN_SUSPENDED_EVSE 7
+#define CONN_UNAVAILABLE 8
+#define CONN_UNKNOWN 9
+
+using namespace std;
+
+// resultado de aplicar un evento a un conector
+enum conn_result_t {
+    CONN_OK,             // transición válida
+    CONN_IRREGULAR,      // StatusNotification fuera de secuencia, se aplica igualmente (el cargador manda)
+    CONN_BUSY,           // StartTransaction con una transacción ya en curso en el conector
+    CONN_NOT_AVAILABLE,  // StartTransaction con el conector (o el cargador) no disponible
+    CONN_NO_TRANSACTION, // StopTransaction sin transacción en curso en el conector
+    CONN_BAD_CONNECTOR   // conector fuera de rango
+};
+
+/*
+ * Máquina de estados de los conectores de un cargador. El estado de cada conector ocupa un byte:
+ * los 4 bits bajos son el estado OCPP (CONN_<>) y el bit CONN_TX_BIT indica que hay una transacción
+ * en curso. Cada evento se valida consultando una tabla (máscara de transiciones permitidas por
+ * estado), sin comparar cadenas ni recorrer listas. El conector 0 es el cargador entero: solo
+ * tiene estado, nunca transacción.
+ * El número de conectores se decide en tiempo de ejecución. Hasta CONN_INLINE_MAX conectores el
+ * estado está dentro del propio objeto (sin reservar memoria), con más se pasa a dos arrays en el heap.
+ * No tiene ningún lock: set_connectors cambia los arrays, así que el Charger hace todos los accesos
+ * con su state_mtx cogido.
+ */
+class ConnectorStates {
+public:
+    ConnectorStates(int connectors = NUM_CONNECTORS);
+    ConnectorStates(const ConnectorStates &) = delete;
+    ConnectorStates &operator=(const ConnectorStates &) = delete;
+
+    bool set_connectors(int connectors); // cambia el número de conectores, conserva el estado de los que quedan
+    int get_connectors() const { return count; }
+
+    enum conn_result_t status(int connector, int status);             // StatusNotification
+    enum conn_result_t check_start(int connector) const;              // se puede iniciar una transacción?
+    enum conn_result_t start(int connector, int64_t transaction_id);  // StartTransaction aceptado
+    enum conn_result_t stop(int connector, int64_t transaction_id);   // StopTransaction
+
+    int get_status(int connector) const;            // estado OCPP del conector (CONN_<>)
+    bool in_transaction(int connector) const;       // hay una transacción en curso
+    int64_t transaction_id(int connector) const;    // transactionId en curso, -1 si no hay
+    int find_transaction(int64_t transaction_id) const; // conector de una transacción, -1 si no está
+    bool valid_connector(int connector) const { return connector >= 0 && connector <= count; }
+private:
+    static const uint8_t CONN_STATUS_MASK = 0x0f;
+    static const uint8_t CONN_TX_BIT = 0x10;
+
+    uint8_t *state;       // estado compacto de cada conector (apunta a inline_state o a heap_state)
+    int64_t *transaction; // transactionId en curso de cada conector, -1 si no hay (inline_transaction o heap_transaction)
+    unique_ptr<uint8_t[]> heap_state;       // solo con más de CONN_INLINE_MAX conectores
+    unique_ptr<int64_t[]> heap_transaction;
+    int64_t inline_transaction[CONN_INLINE_MAX + 1];
+    int count; // número de conectores, sin contar el 0
+    uint8_t inline_state[CONN_INLINE_MAX + 1];
+};
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ *  FILE
+ *      daemon.cpp - sistema de control sin interfaz gráfica
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Programa principal del daemon (ocpp_csd): arranca el servidor WebSocket del núcleo sin
+ *      Qt ni display, escribe los eventos en el syslog y termina con SIGINT o SIGTERM. Se
+ *      ejecuta en primer plano, para que lo gestione systemd o similar. Las interfaces de
+ *      operador se conectan por el socket Unix --ipc-socket (por defecto IPC_DEFAULT_PATH).
+ *      La base de datos es la de --db, resuelta al arrancar (ver apply_core_options).
+ *      Con SIGUSR1 escribe en el syslog las latencias de los mensajes recibidos.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <thread>
+#include <pthread.h>
+#include <syslog.h>
+#include "ws_server.h"
+#include "event_sink.h"
+#include "startup.h"
+#include "ipc_server.h"
+#include "ipc_protocol.h"
+#include "latency.h"
+#include "transaction_index.h"
+#include "id_tag_cache.h"
+#include "fleet_state.h"
+
+using namespace std;
+
+/*
+ * Eventos del núcleo al syslog. charger_changed() llega con cada mensaje de un cargador y no
+ * se escribe.
+ */
+class SyslogSink : public EventSink {
+public:
+    void charger_connected(int charger_id) override
+    {
+        syslog(LOG_NOTICE, "cargador %d conectado", charger_id);
+    }
+
+    void charger_disconnected(int charger_id) override
+    {
+        syslog(LOG_NOTICE, "cargador %d desconectado", charger_id);
+    }
+
+    void boot_notification(int charger_id, const string &model, const string &vendor) override
+    {
+        syslog(LOG_NOTICE, "cargador %d: BootNotification aceptado (%s, %s)", charger_id, vendor.c_str(), model.c_str());
+    }
+};
+
+// escribe un informe de texto (latency_report...) al syslog, una línea por mensaje
+static void log_report(const string &report)
+{
+    size_t begin = 0, end;
+    while ((end = report.find('\n', begin)) != string::npos) {
+        syslog(LOG_NOTICE, "%s", report.substr(begin, end - begin).c_str());
+        begin = end + 1;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // las señales se bloquean antes de crear ningún thread (los threads las heredan) y
+    // solo las recibe el sigwait() de abajo
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    if (!apply_core_options(argc, argv))
+        return EXIT_FAILURE;
+
+    const char *ipc_path = IPC_DEFAULT_PATH;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--ipc-socket") == 0) {
+            if (i + 1 == argc) {
+                fprintf(stderr, "Falta la ruta del socket: --ipc-socket fichero\n");
+                return EXIT_FAILURE;
+            }
+            ipc_path = argv[++i];
+        }
+    }
+
+    // los eventos van al syslog y a las interfaces conectadas
+    static SyslogSink sink;
+    static IpcServer ipc(&sink);
+    if (!ipc.start(ipc_path))
+        return EXIT_FAILURE;
+    set_event_sink(&ipc);
+
+    thread server(web_socket_server); // ws_socket() no vuelve
+    server.detach();
+
+    // SIGUSR1: latencias (una línea por acción y etapa), transacciones activas, resumen de la flota,
+    // colas y reenvíos de los cargadores y caché de idTags al syslog
+    int sig;
+    while (sigwait(&signals, &sig) == 0 && sig == SIGUSR1) {
+        log_report(latency_report());
+        log_report(transaction_report());
+        log_report(fleet_report());
+        log_report(charger_report());
+        log_report(auth_cache_report());
+    }
+    syslog(LOG_NOTICE, "señal %d recibida, el sistema de control termina", sig);
+
+    ipc.stop(); // borra el socket
+
+    // sin destructores de objetos globales: los threads de los cargadores aún los pueden usar
+    closelog();
+    quick_exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,127 @@
+/*
+ *  FILE
+ *      dedup_cache.cpp - caché de respuestas para los mensajes reenviados
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Guarda las respuestas a los últimos mensajes de un cargador, de manera que un mensaje
+ *      reenviado con el mismo uniqueId se contesta igual sin volver a ejecutar el handler.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include "dedup_cache.h"
+
+using namespace std;
+
+/*
+ *  NAME
+ *      DedupCache - Constructor de la clase DedupCache
+ *  SYNOPSIS
+ *      DedupCache(size_t capacity);
+ *  DESCRIPTION
+ *      Crea una caché vacía de capacity respuestas.
+ *  RETURN VALUE
+ *      Nada.
+ */
+DedupCache::DedupCache(size_t capacity) : ring(capacity > 0 ? capacity : 1), next(0), num_suppressed(0)
+{
+    index.reserve(ring.size());
+}
+
+/*
+ *  NAME
+ *      lookup - Busca un mensaje ya contestado.
+ *  SYNOPSIS
+ *      bool lookup(const string &unique_id, const string &action, size_t payload_hash, string &response);
+ *  DESCRIPTION
+ *      Busca si ya se ha contestado un mensaje con el mismo uniqueId, action y hash del payload
+ *      y, si es así, copia la respuesta en response y lo cuenta como reenvío.
+ *  RETURN VALUE
+ *      Devuelve true si el mensaje es un reenvío.
+ *      Devuelve false en caso contrario.
+ */
+bool DedupCache::lookup(const string &unique_id, const string &action, size_t payload_hash, string &response)
+{
+    lock_guard<mutex> lock(mtx);
+
+    auto it = index.find(unique_id);
+    if (it == index.end() || ring[it->second].action != action || ring[it->second].payload_hash != payload_hash)
+        return false;
+
+    response = ring[it->second].response;
+    num_suppressed++;
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      store - Guarda la respuesta a un mensaje.
+ *  SYNOPSIS
+ *      void store(const string &unique_id, const string &action, size_t payload_hash, const string &response);
+ *  DESCRIPTION
+ *      Guarda la respuesta enviada a un mensaje en la posición más antigua del buffer.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void DedupCache::store(const string &unique_id, const string &action, size_t payload_hash, const string &response)
+{
+    lock_guard<mutex> lock(mtx);
+
+    auto it = index.find(unique_id);
+    if (it != index.end()) { // mismo uniqueId, se sustituye
+        ring[it->second].action = action;
+        ring[it->second].payload_hash = payload_hash;
+        ring[it->second].response = response;
+        return;
+    }
+
+    entry_t &entry = ring[next];
+    if (!entry.unique_id.empty())
+        index.erase(entry.unique_id);
+
+    entry = {unique_id, action, payload_hash, response};
+    index[unique_id] = next;
+    next = (next + 1) % ring.size();
+}
+
+/*
+ *  NAME
+ *      clear - Olvida todas las respuestas.
+ *  SYNOPSIS
+ *      void clear();
+ *  DESCRIPTION
+ *      Vacía la caché, p.ej. cuando el cargador se reinicia y vuelve a numerar los uniqueId.
+ *      El contador de reenvíos se conserva.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void DedupCache::clear()
+{
+    lock_guard<mutex> lock(mtx);
+
+    for (entry_t &entry : ring)
+        entry = entry_t();
+    index.clear();
+    next = 0;
+}
+
+/*
+ *  NAME
+ *      suppressed - Devuelve los reenvíos contestados con la caché.
+ *  SYNOPSIS
+ *      uint64_t suppressed() const;
+ *  DESCRIPTION
+ *      Devuelve cuántos mensajes reenviados se han contestado sin volver a procesarlos.
+ *  RETURN VALUE
+ *      El número de reenvíos.
+ */
+uint64_t DedupCache::suppressed() const
+{
+    lock_guard<mutex> lock(mtx);
+
+    return num_suppressed;
+}
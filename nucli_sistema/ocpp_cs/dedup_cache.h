@@ -0,0 +1,59 @@
+/*
+ *  FILE
+ *      dedup_cache.h - header de dedup_cache.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de dedup_cache.cpp, declaración de la caché de respuestas a los últimos
+ *      mensajes de un cargador, para contestar los reenvíos sin volver a procesarlos.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _DEDUP_CACHE_H_
+#define _DEDUP_CACHE_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+
+#define DEDUP_RING_SIZE 32 // respuestas que se guardan por cargador
+
+using namespace std;
+
+/*
+ * Respuestas (CALLRESULT) a los últimos DEDUP_RING_SIZE mensajes de un cargador, en un buffer
+ * circular con un índice por uniqueId. Si el cargador reenvía un mensaje con el mismo uniqueId,
+ * action y payload (p.ej. un StopTransaction o MeterValues después de un corte de red), se le
+ * contesta con la respuesta guardada sin volver a parsearlo, validarlo ni guardarlo en la base de
+ * datos. Del payload solo se guarda el hash: un uniqueId repetido con otro payload (un cargador
+ * que vuelve a contar desde 1) es un mensaje nuevo. Se vacía en cada BootNotification.
+ */
+class DedupCache {
+public:
+    DedupCache(size_t capacity = DEDUP_RING_SIZE);
+
+    bool lookup(const string &unique_id, const string &action, size_t payload_hash, string &response); // busca un mensaje ya contestado
+    void store(const string &unique_id, const string &action, size_t payload_hash, const string &response); // guarda una respuesta
+    void clear(); // olvida todas las respuestas
+    uint64_t suppressed() const; // reenvíos contestados con la caché
+private:
+    struct entry_t {
+        string unique_id;
+        string action;
+        size_t payload_hash;
+        string response;
+    };
+
+    mutable mutex mtx;
+    vector<entry_t> ring;
+    size_t next;                           // posición que se sobrescribe en el próximo store
+    unordered_map<string, size_t> index;   // uniqueId -> posición en ring
+    uint64_t num_suppressed;
+};
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ *  FILE
+ *      event_sink.cpp - destino de los eventos del núcleo
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Guarda el EventSink al que el núcleo del sistema de control envía sus eventos.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <atomic>
+#include "event_sink.h"
+
+using namespace std;
+
+static EventSink no_sink; // descarta los eventos hasta que se instala otro
+static atomic<EventSink *> current_sink{&no_sink};
+
+/*
+ *  NAME
+ *      set_event_sink - Instala el destino de los eventos.
+ *  SYNOPSIS
+ *      void set_event_sink(EventSink *sink);
+ *  DESCRIPTION
+ *      Los eventos del núcleo se envían a sink a partir de ahora. Se tiene que llamar antes de
+ *      arrancar el servidor, y sink tiene que existir mientras el servidor funcione.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void set_event_sink(EventSink *sink)
+{
+    current_sink.store(sink ? sink : &no_sink, memory_order_release);
+}
+
+/*
+ *  NAME
+ *      event_sink - Devuelve el destino de los eventos.
+ *  SYNOPSIS
+ *      EventSink &event_sink();
+ *  DESCRIPTION
+ *      Devuelve el EventSink instalado, o uno que no hace nada si no hay ninguno.
+ *  RETURN VALUE
+ *      El destino de los eventos.
+ */
+EventSink &event_sink()
+{
+    return *current_sink.load(memory_order_acquire);
+}
@@ -0,0 +1,41 @@
+/*
+ *  FILE
+ *      event_sink.h - header de event_sink.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de event_sink.cpp, declaración de la interfaz por la que el núcleo del sistema de
+ *      control avisa de sus eventos a quien lo usa (la interfaz gráfica o el daemon).
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _EVENT_SINK_H_
+#define _EVENT_SINK_H_
+
+#include <string>
+
+using namespace std;
+
+/*
+ * Eventos del núcleo. El núcleo no sabe quién lo usa: la interfaz gráfica pasa los eventos a
+ * Qt y el daemon los escribe en el syslog. Los métodos se llaman desde los threads del servidor
+ * y de los cargadores, así que no pueden bloquear; charger_changed() se llama después de cada
+ * mensaje que cambia un cargador y tiene que ser especialmente barato. Por defecto no hacen nada.
+ */
+class EventSink {
+public:
+    virtual ~EventSink() = default;
+
+    virtual void charger_connected(int charger_id) {}
+    virtual void charger_disconnected(int charger_id) {}
+    virtual void boot_notification(int charger_id, const string &model, const string &vendor) {}
+    virtual void charger_changed(int charger_id) {} // nuevo snapshot del cargador
+};
+
+void set_event_sink(EventSink *sink); // NULL: los eventos se descartan
+EventSink &event_sink();
+
+#endif
@@ -0,0 +1,444 @@
+/*
+ *  FILE
+ *      fleet_state.cpp - estado de los conectores de todo el sistema
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Estado de todos los conectores guardado por columnas (struct of arrays), actualizado por
+ *      los cargadores y consultado por toda la flota de una vez.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <mutex>
+#include <algorithm>
+#include <cstdio>
+#include "fleet_state.h"
+#include "charger.h" // HEARTBEAT_INTERVAL
+
+using namespace std;
+
+FleetState fleet_state;
+
+/*
+ *  NAME
+ *      set_connectors - Reserva las posiciones de un cargador.
+ *  SYNOPSIS
+ *      void set_connectors(int charger_id, int connectors);
+ *  DESCRIPTION
+ *      Reserva connectors + 1 posiciones consecutivas para un cargador. Si el cargador ya tenía
+ *      posiciones con otro número de conectores, se mueven a las nuevas conservando los valores
+ *      de los conectores que quedan y las antiguas se dejan libres para otro cargador.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void FleetState::set_connectors(int charger_id, int connectors)
+{
+    unique_lock<shared_mutex> lock(mtx);
+
+    uint32_t count = connectors + 1;
+    auto it = chargers.find(charger_id);
+    if (it != chargers.end() && it->second.count == count)
+        return;
+
+    uint32_t base = allocate(count);
+    for (uint32_t i = 0; i < count; i++) {
+        charger[base + i] = charger_id;
+        connector[base + i] = i;
+        status[base + i] = CONN_UNKNOWN | (i == 0 ? FLEET_CHARGER_BIT : 0);
+        transaction[base + i] = -1;
+        last_seen[base + i] = 0;
+        power[base + i] = 0;
+    }
+
+    if (it != chargers.end()) { // copio los conectores que quedan y libero las posiciones antiguas
+        FleetSlots old = it->second;
+        uint32_t keep = min(old.count, count);
+        copy(status.begin() + old.base, status.begin() + old.base + keep, status.begin() + base);
+        copy(transaction.begin() + old.base, transaction.begin() + old.base + keep, transaction.begin() + base);
+        copy(last_seen.begin() + old.base, last_seen.begin() + old.base + keep, last_seen.begin() + base);
+        copy(power.begin() + old.base, power.begin() + old.base + keep, power.begin() + base);
+        free_slots_of(old);
+    }
+
+    chargers[charger_id] = {base, count};
+}
+
+/*
+ *  NAME
+ *      release - Deja libres las posiciones de un cargador.
+ *  SYNOPSIS
+ *      void release(int charger_id);
+ *  DESCRIPTION
+ *      Deja libres las posiciones de un cargador que se ha desconectado, así sus conectores ya
+ *      no cuentan en las consultas de la flota y las posiciones se pueden dar a otro cargador.
+ *      Cuando se vuelve a conectar se reservan otra vez con set_connectors.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void FleetState::release(int charger_id)
+{
+    unique_lock<shared_mutex> lock(mtx);
+
+    auto it = chargers.find(charger_id);
+    if (it == chargers.end())
+        return;
+
+    free_slots_of(it->second);
+    chargers.erase(it);
+}
+
+/*
+ *  NAME
+ *      set_connector - Actualiza el estado y la transacción de un conector.
+ *  SYNOPSIS
+ *      void set_connector(int charger_id, int connector, int status, int64_t transaction_id);
+ *  DESCRIPTION
+ *      Actualiza el estado (CONN_<>) y el transactionId en curso de un conector.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void FleetState::set_connector(int charger_id, int connector, int status, int64_t transaction_id)
+{
+    unique_lock<shared_mutex> lock(mtx);
+
+    uint32_t slot;
+    if (!find_slot(charger_id, connector, slot))
+        return;
+
+    this->status[slot] = status | (connector == 0 ? FLEET_CHARGER_BIT : 0); // así los recorridos no cuentan el conector 0
+    transaction[slot] = transaction_id;
+    last_seen[slot] = time(NULL);
+}
+
+/*
+ *  NAME
+ *      set_power - Actualiza la potencia de un conector.
+ *  SYNOPSIS
+ *      void set_power(int charger_id, int connector, int32_t power_w);
+ *  DESCRIPTION
+ *      Actualiza la potencia actual (en W) de un conector.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void FleetState::set_power(int charger_id, int connector, int32_t power_w)
+{
+    unique_lock<shared_mutex> lock(mtx);
+
+    uint32_t slot;
+    if (!find_slot(charger_id, connector, slot))
+        return;
+
+    power[slot] = power_w;
+    last_seen[slot] = time(NULL);
+}
+
+/*
+ *  NAME
+ *      touch - Indica que se ha recibido un mensaje de un cargador.
+ *  SYNOPSIS
+ *      void touch(int charger_id, time_t now);
+ *  DESCRIPTION
+ *      Guarda la hora del último mensaje recibido en la posición del conector 0 del cargador.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void FleetState::touch(int charger_id, time_t now)
+{
+    unique_lock<shared_mutex> lock(mtx);
+
+    uint32_t slot;
+    if (find_slot(charger_id, 0, slot))
+        last_seen[slot] = now;
+}
+
+/*
+ *  NAME
+ *      status_histogram - Cuenta los conectores en cada estado.
+ *  SYNOPSIS
+ *      void status_histogram(size_t counts[CONN_UNKNOWN + 1]) const;
+ *  DESCRIPTION
+ *      Cuenta los conectores de toda la flota (sin contar los conectores 0) en cada estado,
+ *      counts[s] es el número de conectores en el estado s.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void FleetState::status_histogram(size_t counts[CONN_UNKNOWN + 1]) const
+{
+    shared_lock<shared_mutex> lock(mtx);
+
+    // cuatro histogramas para que dos posiciones seguidas con el mismo estado no dependan una de la otra
+    uint32_t hist[4][256] = {{0}};
+    const uint8_t *st = status.data();
+    size_t n = status.size();
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        hist[0][st[i]]++;
+        hist[1][st[i + 1]]++;
+        hist[2][st[i + 2]]++;
+        hist[3][st[i + 3]]++;
+    }
+    for (; i < n; i++)
+        hist[0][st[i]]++;
+
+    for (int s = 0; s <= CONN_UNKNOWN; s++) // los conectores 0 están en s | FLEET_CHARGER_BIT y no se cuentan
+        counts[s] = (size_t)hist[0][s] + hist[1][s] + hist[2][s] + hist[3][s];
+}
+
+/*
+ *  NAME
+ *      active_transactions - Cuenta los conectores con una transacción en curso.
+ *  SYNOPSIS
+ *      size_t active_transactions() const;
+ *  DESCRIPTION
+ *      Cuenta los conectores de toda la flota que tienen una transacción en curso.
+ *  RETURN VALUE
+ *      El número de conectores.
+ */
+size_t FleetState::active_transactions() const
+{
+    shared_lock<shared_mutex> lock(mtx);
+
+    const int64_t *tx = transaction.data();
+    size_t n = transaction.size();
+    int64_t total = 0;
+
+    for (size_t i = 0; i < n; i++) // -1 sin transacción: sumo el bit de signo invertido
+        total += (uint64_t)~tx[i] >> 63;
+
+    return total;
+}
+
+/*
+ *  NAME
+ *      total_power - Suma la potencia de todos los conectores.
+ *  SYNOPSIS
+ *      int64_t total_power() const;
+ *  DESCRIPTION
+ *      Suma la potencia actual de todos los conectores de la flota.
+ *  RETURN VALUE
+ *      La potencia total en W.
+ */
+int64_t FleetState::total_power() const
+{
+    shared_lock<shared_mutex> lock(mtx);
+
+    const int32_t *pw = power.data();
+    size_t n = power.size();
+    int64_t total = 0;
+
+    for (size_t i = 0; i < n; i++)
+        total += pw[i];
+
+    return total;
+}
+
+/*
+ *  NAME
+ *      overdue_chargers - Busca los cargadores sin mensajes desde una hora.
+ *  SYNOPSIS
+ *      vector<int> overdue_chargers(time_t cutoff) const;
+ *  DESCRIPTION
+ *      Busca los cargadores cuyo último mensaje (guardado en el conector 0) es anterior a cutoff,
+ *      p.ej. ahora menos dos veces el intervalo de Heartbeat.
+ *  RETURN VALUE
+ *      Los charger_id de los cargadores.
+ */
+vector<int> FleetState::overdue_chargers(time_t cutoff) const
+{
+    shared_lock<shared_mutex> lock(mtx);
+
+    const int64_t *seen = last_seen.data();
+    const uint8_t *st = status.data();
+    const int32_t *ch = charger.data();
+    size_t n = last_seen.size();
+    vector<int> overdue;
+
+    for (size_t i = 0; i < n; i++) {
+        if ((seen[i] < cutoff) & ((st[i] & FLEET_CHARGER_BIT) != 0) & (st[i] != FLEET_SLOT_FREE))
+            overdue.push_back(ch[i]);
+    }
+
+    return overdue;
+}
+
+/*
+ *  NAME
+ *      get_power - Devuelve la potencia de los conectores de un cargador.
+ *  SYNOPSIS
+ *      bool get_power(int charger_id, vector<int32_t> &dest) const;
+ *  DESCRIPTION
+ *      Copia en dest la potencia actual (en W) de cada conector de un cargador, la posición es
+ *      el connectorId (0 = cargador entero). Coge el mutex una sola vez para todo el cargador.
+ *  RETURN VALUE
+ *      Devuelve true si el cargador tiene posiciones.
+ *      Devuelve false si no, y dest queda vacío.
+ */
+bool FleetState::get_power(int charger_id, vector<int32_t> &dest) const
+{
+    shared_lock<shared_mutex> lock(mtx);
+
+    dest.clear();
+    auto it = chargers.find(charger_id);
+    if (it == chargers.end())
+        return false;
+
+    dest.assign(power.begin() + it->second.base, power.begin() + it->second.base + it->second.count);
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      num_slots - Devuelve el número de posiciones reservadas.
+ *  SYNOPSIS
+ *      size_t num_slots() const;
+ *  DESCRIPTION
+ *      Devuelve el número de posiciones de las columnas, libres o no.
+ *  RETURN VALUE
+ *      El número de posiciones.
+ */
+size_t FleetState::num_slots() const
+{
+    shared_lock<shared_mutex> lock(mtx);
+
+    return status.size();
+}
+
+/*
+ *  NAME
+ *      allocate - Reserva posiciones consecutivas.
+ *  SYNOPSIS
+ *      uint32_t allocate(uint32_t count);
+ *  DESCRIPTION
+ *      Reutiliza un hueco libre de exactamente count posiciones o, si no hay, añade count
+ *      posiciones al final de todas las columnas. Se llama con el mutex cogido.
+ *  RETURN VALUE
+ *      La primera posición reservada.
+ */
+uint32_t FleetState::allocate(uint32_t count)
+{
+    auto it = free_slots.find(count);
+    if (it != free_slots.end() && !it->second.empty()) {
+        uint32_t base = it->second.back();
+        it->second.pop_back();
+        return base;
+    }
+
+    uint32_t base = status.size();
+    size_t size = base + count;
+    charger.resize(size, -1);
+    connector.resize(size, 0);
+    status.resize(size, FLEET_SLOT_FREE);
+    transaction.resize(size, -1);
+    last_seen.resize(size, 0);
+    power.resize(size, 0);
+
+    return base;
+}
+
+/*
+ *  NAME
+ *      find_slot - Busca la posición de un conector.
+ *  SYNOPSIS
+ *      bool find_slot(int charger_id, int connector, uint32_t &slot) const;
+ *  DESCRIPTION
+ *      Busca la posición de un conector de un cargador. Se llama con el mutex cogido.
+ *  RETURN VALUE
+ *      Devuelve true si la encuentra.
+ *      Devuelve false si el cargador o el conector no existen.
+ */
+bool FleetState::find_slot(int charger_id, int connector, uint32_t &slot) const
+{
+    auto it = chargers.find(charger_id);
+    if (it == chargers.end() || connector < 0 || (uint32_t)connector >= it->second.count)
+        return false;
+
+    slot = it->second.base + connector;
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      free_slots_of - Libera las posiciones de un cargador.
+ *  SYNOPSIS
+ *      void free_slots_of(const FleetSlots &slots);
+ *  DESCRIPTION
+ *      Marca como libres las posiciones y las añade a free_slots para reutilizarlas. No quita
+ *      el cargador de chargers. Se llama con el mutex cogido.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void FleetState::free_slots_of(const FleetSlots &slots)
+{
+    for (uint32_t i = slots.base; i < slots.base + slots.count; i++) {
+        charger[i] = -1;
+        status[i] = FLEET_SLOT_FREE;
+        transaction[i] = -1;
+        power[i] = 0;
+    }
+    free_slots[slots.count].push_back(slots.base);
+}
+
+/*
+ *  NAME
+ *      fleet_report - Devuelve el resumen de la flota en texto.
+ *  SYNOPSIS
+ *      string fleet_report();
+ *  DESCRIPTION
+ *      Los conectores en cada estado, los que tienen una transacción en curso, la potencia total
+ *      y los cargadores que no han enviado ningún mensaje en FLEET_OVERDUE_HEARTBEATS intervalos
+ *      de Heartbeat (conectados pero sin dar señales de vida).
+ *  RETURN VALUE
+ *      El texto, vacío si no hay ningún cargador conectado.
+ */
+string fleet_report()
+{
+    static const char *status_names[CONN_UNKNOWN + 1] = {
+        "Available", "Charging", "Faulted", "Finishing", "Preparing",
+        "Reserved", "SuspendedEV", "SuspendedEVSE", "Unavailable", "Unknown"
+    };
+
+    if (fleet_state.num_slots() == 0)
+        return "";
+
+    string report;
+    char line[160];
+
+    size_t counts[CONN_UNKNOWN + 1];
+    fleet_state.status_histogram(counts);
+    size_t connectors = 0;
+    for (int s = 0; s <= CONN_UNKNOWN; s++)
+        connectors += counts[s];
+
+    snprintf(line, sizeof(line), "%-22s %8zu\n", "conectores", connectors);
+    report += line;
+    for (int s = 0; s <= CONN_UNKNOWN; s++) {
+        if (counts[s] == 0)
+            continue;
+        snprintf(line, sizeof(line), "  %-20s %8zu\n", status_names[s], counts[s]);
+        report += line;
+    }
+
+    snprintf(line, sizeof(line), "%-22s %8zu\n", "transacciones", fleet_state.active_transactions());
+    report += line;
+    snprintf(line, sizeof(line), "%-22s %8.1f\n", "potencia total kW", fleet_state.total_power() / 1000.0);
+    report += line;
+
+    int overdue_after = FLEET_OVERDUE_HEARTBEATS * HEARTBEAT_INTERVAL;
+    vector<int> overdue = fleet_state.overdue_chargers(time(NULL) - overdue_after);
+    sort(overdue.begin(), overdue.end());
+    snprintf(line, sizeof(line), "sin mensajes en %d h: ", overdue_after / 3600);
+    report += line;
+    if (overdue.empty())
+        report += "ninguno";
+    for (size_t i = 0; i < overdue.size(); i++)
+        report += (i ? ", " : "") + to_string(overdue[i]);
+    report += "\n";
+
+    return report;
+}
@@ -0,0 +1,84 @@
+/*
+ *  FILE
+ *      fleet_state.h - header de fleet_state.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de fleet_state.cpp, declaración del estado de todos los conectores del sistema
+ *      guardado por columnas.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _FLEET_STATE_H_
+#define _FLEET_STATE_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <shared_mutex>
+#include <cstdint>
+#include <ctime>
+#include "connector_state.h"
+
+#define FLEET_SLOT_FREE   0xff // estado de una posición que no pertenece a ningún cargador
+#define FLEET_CHARGER_BIT 0x80 // marca en la columna de estado del conector 0 (el cargador entero)
+#define FLEET_OVERDUE_HEARTBEATS 2 // intervalos de Heartbeat sin mensajes para dar un cargador por perdido
+
+using namespace std;
+
+// posiciones de un cargador en las columnas: base es el conector 0, count incluye el conector 0
+struct FleetSlots {
+    uint32_t base;
+    uint32_t count;
+};
+
+/*
+ * Estado de todos los conectores del sistema, para poder hacer consultas sobre toda la flota
+ * sin recorrer los objetos Charger. Cada conector tiene una posición fija y los campos que se
+ * consultan a menudo (estado, transactionId, última vez que se ha recibido algo y potencia) están
+ * en columnas separadas y contiguas, de manera que un recorrido solo lee la columna que necesita
+ * y el compilador lo puede vectorizar. Los conectores de un cargador ocupan posiciones consecutivas,
+ * empezando por el conector 0 (el cargador entero).
+ */
+class FleetState {
+public:
+    void set_connectors(int charger_id, int connectors); // reserva las posiciones de un cargador
+    void release(int charger_id); // deja libres las posiciones de un cargador desconectado
+    void set_connector(int charger_id, int connector, int status, int64_t transaction_id); // estado y transacción
+    void set_power(int charger_id, int connector, int32_t power_w); // potencia actual en W
+    void touch(int charger_id, time_t now); // se ha recibido un mensaje del cargador
+
+    void status_histogram(size_t counts[CONN_UNKNOWN + 1]) const; // conectores en cada estado
+    size_t active_transactions() const; // conectores con una transacción en curso
+    int64_t total_power() const; // suma de la potencia de todos los conectores, en W
+    vector<int> overdue_chargers(time_t cutoff) const; // cargadores sin mensajes desde cutoff
+    bool get_power(int charger_id, vector<int32_t> &dest) const; // potencia de cada conector de un cargador
+    size_t num_slots() const; // posiciones reservadas
+private:
+    uint32_t allocate(uint32_t count); // se llama con el mutex cogido
+    void free_slots_of(const FleetSlots &slots); // se llama con el mutex cogido
+    bool find_slot(int charger_id, int connector, uint32_t &slot) const; // se llama con el mutex cogido
+
+    mutable shared_mutex mtx;
+    unordered_map<int, FleetSlots> chargers;    // charger_id -> posiciones
+    map<uint32_t, vector<uint32_t>> free_slots; // posiciones libres: count -> bases
+
+    // columnas, una entrada por conector
+    vector<int32_t> charger;      // charger_id, -1 si la posición está libre
+    vector<uint8_t> connector;    // connectorId dentro del cargador
+    vector<uint8_t> status;       // CONN_<> (| FLEET_CHARGER_BIT en el conector 0), FLEET_SLOT_FREE si está libre
+    vector<int64_t> transaction;  // transactionId en curso, -1 si no hay
+    vector<int64_t> last_seen;    // última vez que se ha recibido algo del conector
+    vector<int32_t> power;        // potencia actual en W
+};
+
+// estado de los conectores de todo el sistema
+extern FleetState fleet_state;
+
+string fleet_report(); // resumen de la flota en texto
+
+#endif
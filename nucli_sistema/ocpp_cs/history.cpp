@@ -0,0 +1,287 @@
+/*
+ *  FILE
+ *      history.cpp - historial de estados y transacciones
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Consultas paginadas de las tablas estats y transaccions, que escriben los threads de los
+ *      cargadores, para el historial de la interfaz.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <syslog.h>
+#include <sqlite3.h>
+#include <ctime>
+#include <thread>
+#include <chrono>
+#include "history.h"
+
+using namespace std;
+
+static const char *table_name[] = {"estats", "transaccions"};
+static const char *detail_column[] = {"error_code", "motiu"};
+static const char *pruned_tables[] = {"estats", "transaccions", "meter_values"};
+
+/*
+ * Índices de las consultas: todas van ordenadas por (hora, id) y el id está en todos los índices
+ * de SQLite, así que la primera página sale sin ordenar la tabla con o sin filtro de cargador o
+ * de estado. El de hora también lo usa la limpieza del historial (prune_history). Las gráficas
+ * leen meter_values por cargador, conector e intervalo de hora (MeterHistory::read_db).
+ *
+ * Las bases de datos anteriores limitaban cada tabla a 30 filas con un trigger que en cada
+ * INSERT contaba la tabla y buscaba la fila más antigua: se quitan, ahora las filas se borran
+ * por antigüedad. El índice de transaccio es para el mayor transactionId al arrancar
+ * (TransactionIndex::restore_last_id).
+ */
+static const char *history_schema =
+    "PRAGMA journal_mode = WAL;"
+    "DROP TRIGGER IF EXISTS max_estats;"
+    "DROP TRIGGER IF EXISTS max_transaccions;"
+    "DROP TRIGGER IF EXISTS max_meter_values;"
+    "CREATE INDEX IF NOT EXISTS meter_values_charger_hora ON meter_values(charger_id, connector, hora);"
+    "CREATE INDEX IF NOT EXISTS meter_values_hora ON meter_values(hora);"
+    "CREATE INDEX IF NOT EXISTS estats_hora ON estats(hora);"
+    "CREATE INDEX IF NOT EXISTS estats_charger_hora ON estats(charger_id, hora);"
+    "CREATE INDEX IF NOT EXISTS estats_estat_hora ON estats(estat, hora);"
+    "CREATE INDEX IF NOT EXISTS transaccions_hora ON transaccions(hora);"
+    "CREATE INDEX IF NOT EXISTS transaccions_charger_hora ON transaccions(charger_id, hora);"
+    "CREATE INDEX IF NOT EXISTS transaccions_estat_hora ON transaccions(estat, hora);"
+    "CREATE INDEX IF NOT EXISTS transaccions_transaccio ON transaccions(transaccio);";
+
+/*
+ *  NAME
+ *      prepare_history_db - Prepara la base de datos para las consultas del historial.
+ *  SYNOPSIS
+ *      bool prepare_history_db(const char *db_path);
+ *  DESCRIPTION
+ *      Crea los índices de las consultas si no existen (bases de datos anteriores), añade a
+ *      transaccions la columna transaccio si no la tiene, quita los triggers que limitaban las
+ *      tablas a 30 filas y pasa la base de datos a modo WAL, en el que las consultas de la
+ *      interfaz no bloquean las escrituras de los threads de los cargadores ni al revés. El modo
+ *      WAL queda guardado en el fichero, así que basta con hacerlo una vez al arrancar.
+ *  RETURN VALUE
+ *      Devuelve true si todo va bien.
+ *      Devuelve false en caso contrario.
+ */
+bool prepare_history_db(const char *db_path)
+{
+    sqlite3 *db;
+    if (sqlite3_open(db_path, &db) != SQLITE_OK) {
+        syslog(LOG_ERR, "%s: ERROR opening SQLite DB: %s\n", __func__, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return false;
+    }
+
+    // transaccions sin el transactionId (versión anterior)
+    char *errmsg;
+    if (sqlite3_exec(db, "SELECT transaccio FROM transaccions LIMIT 0;", 0, 0, NULL) != SQLITE_OK &&
+        sqlite3_exec(db, "ALTER TABLE transaccions ADD COLUMN transaccio INT;", 0, 0, &errmsg) != SQLITE_OK) {
+
+        syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, errmsg);
+        sqlite3_free(errmsg);
+        sqlite3_close(db);
+        return false;
+    }
+
+    if (sqlite3_exec(db, history_schema, 0, 0, &errmsg) != SQLITE_OK) {
+        syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, errmsg);
+        sqlite3_free(errmsg);
+        sqlite3_close(db);
+        return false;
+    }
+
+    sqlite3_close(db);
+    return true;
+}
+
+/*
+ *  NAME
+ *      read_history_page - Lee una página del historial.
+ *  SYNOPSIS
+ *      bool read_history_page(const char *db_path, enum history_table_t table, const HistoryFilter &filter,
+ *                             HistoryCursor &cursor, vector<HistoryRow> &rows, bool &more);
+ *  DESCRIPTION
+ *      Añade a rows hasta HISTORY_PAGE_ROWS filas de la tabla que cumplen el filtro, de más
+ *      nueva a más antigua, empezando después de cursor (o por la más nueva si cursor no es
+ *      válido). Deja en cursor la última fila leída para la página siguiente y en more si
+ *      quedan más filas. La base de datos se abre solo para leer, así que se puede llamar
+ *      desde cualquier thread.
+ *  RETURN VALUE
+ *      Devuelve true si todo va bien.
+ *      Devuelve false en caso contrario (rows y cursor no se modifican).
+ */
+bool read_history_page(const char *db_path, enum history_table_t table, const HistoryFilter &filter,
+                       HistoryCursor &cursor, vector<HistoryRow> &rows, bool &more)
+{
+    string query = string("SELECT id, charger_id, connector, hora, estat, ") + detail_column[table] +
+                   " FROM " + table_name[table] + " WHERE 1";
+    if (filter.charger_id >= 0)
+        query += " AND charger_id = ?";
+    if (filter.connector >= 0)
+        query += " AND connector = ?";
+    if (!filter.from.empty())
+        query += " AND hora >= ?";
+    if (!filter.to.empty())
+        query += " AND hora < ?";
+    if (!filter.state.empty())
+        query += " AND estat = ?";
+    if (cursor.valid)
+        query += " AND (hora, id) < (?, ?)";
+    query += " ORDER BY hora DESC, id DESC LIMIT ?;";
+
+    sqlite3 *db;
+    if (sqlite3_open_v2(db_path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        syslog(LOG_ERR, "%s: ERROR opening SQLite DB: %s\n", __func__, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return false;
+    }
+    sqlite3_busy_timeout(db, 1000);
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return false;
+    }
+
+    // los parámetros van en el mismo orden que las condiciones
+    int param = 1;
+    if (filter.charger_id >= 0)
+        sqlite3_bind_int(stmt, param++, filter.charger_id);
+    if (filter.connector >= 0)
+        sqlite3_bind_int(stmt, param++, filter.connector);
+    if (!filter.from.empty())
+        sqlite3_bind_text(stmt, param++, filter.from.c_str(), -1, SQLITE_STATIC);
+    if (!filter.to.empty())
+        sqlite3_bind_text(stmt, param++, filter.to.c_str(), -1, SQLITE_STATIC);
+    if (!filter.state.empty())
+        sqlite3_bind_text(stmt, param++, filter.state.c_str(), -1, SQLITE_STATIC);
+    if (cursor.valid) {
+        sqlite3_bind_text(stmt, param++, cursor.hora.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, param++, cursor.id);
+    }
+    sqlite3_bind_int(stmt, param, HISTORY_PAGE_ROWS + 1); // una de más para saber si hay otra página
+
+    vector<HistoryRow> page;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW && page.size() < HISTORY_PAGE_ROWS) {
+        const char *hora = (const char *)sqlite3_column_text(stmt, 3);
+        const char *state = (const char *)sqlite3_column_text(stmt, 4);
+        const char *detail = (const char *)sqlite3_column_text(stmt, 5);
+
+        page.push_back({sqlite3_column_int64(stmt, 0), sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 2),
+                        hora ? hora : "", state ? state : "", detail ? detail : ""});
+    }
+
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+        syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, sqlite3_errmsg(db));
+        sqlite3_finalize(stmt);
+        sqlite3_close(db);
+        return false;
+    }
+
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+
+    more = (rc == SQLITE_ROW);
+    if (!page.empty()) {
+        cursor.valid = true;
+        cursor.hora = page.back().hora;
+        cursor.id = page.back().id;
+    }
+    rows.insert(rows.end(), page.begin(), page.end());
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      prune_history - Borra el historial antiguo.
+ *  SYNOPSIS
+ *      long prune_history(const char *db_path, int days);
+ *  DESCRIPTION
+ *      Borra de estats, transaccions y meter_values las filas con la hora de hace más de days
+ *      días. La hora se guarda con el formato "AAAA-MM-DDTHH:MM:SS...", que se ordena como texto
+ *      (la zona horaria de cada fila no cambia nada con días de margen),
+ *      así que el borrado es un recorrido del índice de hora desde el principio. Se borra de
+ *      HISTORY_PRUNE_BATCH en HISTORY_PRUNE_BATCH filas, cada vez en una transacción, para que
+ *      los INSERT de los cargadores no esperen a que se borre todo.
+ *  RETURN VALUE
+ *      El número de filas borradas.
+ *      Devuelve -1 en caso de error.
+ */
+long prune_history(const char *db_path, int days)
+{
+    time_t limit = time(NULL) - (time_t)days * 24 * 3600;
+    struct tm tm;
+    char hora[32];
+    localtime_r(&limit, &tm);
+    strftime(hora, sizeof(hora), "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+    sqlite3 *db;
+    if (sqlite3_open(db_path, &db) != SQLITE_OK) {
+        syslog(LOG_ERR, "%s: ERROR opening SQLite DB: %s\n", __func__, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return -1;
+    }
+    sqlite3_busy_timeout(db, 1000);
+
+    long deleted = 0;
+    for (const char *table : pruned_tables) {
+        string query = string("DELETE FROM ") + table + " WHERE id IN (SELECT id FROM " + table +
+                       " WHERE hora < ? ORDER BY hora LIMIT ?);";
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+            syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, sqlite3_errmsg(db));
+            sqlite3_close(db);
+            return -1;
+        }
+        sqlite3_bind_text(stmt, 1, hora, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 2, HISTORY_PRUNE_BATCH);
+
+        int changes;
+        do {
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, sqlite3_errmsg(db));
+                sqlite3_finalize(stmt);
+                sqlite3_close(db);
+                return -1;
+            }
+            changes = sqlite3_changes(db);
+            deleted += changes;
+            sqlite3_reset(stmt);
+        } while (changes == HISTORY_PRUNE_BATCH);
+
+        sqlite3_finalize(stmt);
+    }
+
+    sqlite3_close(db);
+    return deleted;
+}
+
+/*
+ *  NAME
+ *      start_history_retention - Arranca la limpieza periódica del historial.
+ *  SYNOPSIS
+ *      void start_history_retention(const char *db_path);
+ *  DESCRIPTION
+ *      Arranca un thread que al empezar y cada HISTORY_RETENTION_PERIOD segundos borra el
+ *      historial de más de HISTORY_RETENTION_DAYS días. db_path se copia.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void start_history_retention(const char *db_path)
+{
+    thread([path = string(db_path)]() {
+        for (;;) {
+            long deleted = prune_history(path.c_str(), HISTORY_RETENTION_DAYS);
+            if (deleted > 0)
+                syslog(LOG_INFO, "historial: %ld filas de más de %d días borradas\n", deleted, HISTORY_RETENTION_DAYS);
+
+            this_thread::sleep_for(chrono::seconds(HISTORY_RETENTION_PERIOD));
+        }
+    }).detach();
+}
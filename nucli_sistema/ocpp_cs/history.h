@@ -0,0 +1,72 @@
+/*
+ *  FILE
+ *      history.h - header de history.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de history.cpp, declaración de las consultas paginadas del historial de
+ *      estados y transacciones de la base de datos.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#define HISTORY_PAGE_ROWS 200         // filas que se leen de cada vez
+#define HISTORY_RETENTION_DAYS 90     // días que se guardan los estados y las transacciones
+#define HISTORY_RETENTION_PERIOD 3600 // segundos entre dos limpiezas del historial
+#define HISTORY_PRUNE_BATCH 2000      // filas por DELETE, cada uno bloquea las escrituras poco tiempo
+
+using namespace std;
+
+enum history_table_t {
+    HISTORY_STATUS,       // tabla estats
+    HISTORY_TRANSACTIONS  // tabla transaccions
+};
+
+/*
+ * Filtros de una consulta. Los campos vacíos (o a -1) no filtran. from y to tienen el mismo
+ * formato que la columna hora ("AAAA-MM-DDTHH:MM:SSZ") y el intervalo es [from, to).
+ */
+struct HistoryFilter {
+    int charger_id = -1;
+    int connector = -1;
+    string from;
+    string to;
+    string state; // estat: p.ej. "Charging" o "Start"
+};
+
+struct HistoryRow {
+    int64_t id;
+    int charger_id;
+    int connector;
+    string hora;
+    string state;
+    string detail; // error_code de estats o motiu de transaccions
+};
+
+/*
+ * Posición de una consulta: la última fila de la página anterior. Las filas salen de más nueva
+ * a más antigua por (hora, id), así que la página siguiente empieza justo después de ella sin
+ * tener que saltar las anteriores (OFFSET), y el coste es el mismo en cualquier página.
+ */
+struct HistoryCursor {
+    bool valid = false; // false: primera página
+    string hora;
+    int64_t id = 0;
+};
+
+bool prepare_history_db(const char *db_path);
+long prune_history(const char *db_path, int days);
+void start_history_retention(const char *db_path);
+bool read_history_page(const char *db_path, enum history_table_t table, const HistoryFilter &filter,
+                       HistoryCursor &cursor, vector<HistoryRow> &rows, bool &more);
+
+#endif
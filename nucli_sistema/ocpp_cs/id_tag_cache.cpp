@@ -0,0 +1,316 @@
+/*
+ *  FILE
+ *      id_tag_cache.cpp - caché de IdTagInfo
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Caché LRU en memoria de los IdTagInfo (status, expiryDate y parentIdTag) de los idTags,
+ *      de manera que los Authorize, StartTransaction y StopTransaction de un mismo idTag no
+ *      tienen que consultar la base de datos cada vez.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <cctype>
+#include <cstdio>
+#include <syslog.h>
+#include "id_tag_cache.h"
+#include "policies.h"
+#include "auth_list.h"
+#include "ws_server.h"
+
+using namespace std;
+
+IdTagCache id_tag_cache(ID_TAG_CACHE_SIZE, ID_TAG_CACHE_TTL, ID_TAG_CACHE_NEG_TTL);
+
+static time_t parse_expiry_date(const string &expiry_date);
+
+/*
+ *  NAME
+ *      IdTagCache - Constructor de la clase IdTagCache
+ *  SYNOPSIS
+ *      IdTagCache(size_t capacity, int ttl, int negative_ttl);
+ *  DESCRIPTION
+ *      Crea una caché vacía de capacity entradas. Los idTags aceptados se guardan
+ *      ttl segundos y los no aceptados negative_ttl segundos.
+ *  RETURN VALUE
+ *      Nada.
+ */
+IdTagCache::IdTagCache(size_t capacity, int ttl, int negative_ttl)
+    : capacity(capacity), ttl(ttl), negative_ttl(negative_ttl), version(0), counters{}
+{
+    by_id_tag.reserve(capacity);
+}
+
+/*
+ *  NAME
+ *      erase - Elimina una entrada.
+ *  SYNOPSIS
+ *      void erase(list<entry_t>::iterator it);
+ *  DESCRIPTION
+ *      Elimina una entrada de la lista LRU y del índice. Se llama con el mutex cogido.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void IdTagCache::erase(list<entry_t>::iterator it)
+{
+    by_id_tag.erase(it->id_tag);
+    lru.erase(it);
+}
+
+/*
+ *  NAME
+ *      check_version - Vacía la caché si han cambiado las listas.
+ *  SYNOPSIS
+ *      void check_version(uint64_t version);
+ *  DESCRIPTION
+ *      Si la versión de las listas de autorización no es la de las entradas guardadas,
+ *      vacía la caché. Se llama con el mutex cogido.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void IdTagCache::check_version(uint64_t version)
+{
+    if (version == this->version)
+        return;
+
+    if (!lru.empty()) {
+        counters.invalidations++;
+        syslog(LOG_INFO, "%s: listas de autorización cambiadas, se vacía la caché (%zu idTags, aciertos %lu/%lu)",
+               __func__, lru.size(), (unsigned long) counters.hits, (unsigned long) (counters.hits + counters.misses));
+    }
+
+    lru.clear();
+    by_id_tag.clear();
+    this->version = version;
+}
+
+/*
+ *  NAME
+ *      lookup - Busca un idTag en la caché.
+ *  SYNOPSIS
+ *      bool lookup(const string &id_tag, uint64_t version, IdTagRecord &dest);
+ *  DESCRIPTION
+ *      Busca un idTag en la caché y, si está y no ha caducado, lo copia en dest y lo pasa
+ *      a ser el más reciente. version es la versión actual de las listas de autorización.
+ *  RETURN VALUE
+ *      Devuelve true si se ha encontrado.
+ *      Devuelve false en caso contrario.
+ */
+bool IdTagCache::lookup(const string &id_tag, uint64_t version, IdTagRecord &dest)
+{
+    string k = id_tag_key(id_tag);
+
+    lock_guard<mutex> lock(mtx);
+    check_version(version);
+
+    auto it = by_id_tag.find(k);
+    if (it == by_id_tag.end()) {
+        counters.misses++;
+        return false;
+    }
+
+    if (it->second->valid_until <= time(NULL)) { // entrada caducada
+        erase(it->second);
+        counters.expirations++;
+        counters.misses++;
+        return false;
+    }
+
+    lru.splice(lru.begin(), lru, it->second);
+    dest = it->second->record;
+
+    counters.hits++;
+    if (dest.status != STATUS_ACCEPTED)
+        counters.negative_hits++;
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      store - Guarda un idTag en la caché.
+ *  SYNOPSIS
+ *      void store(const string &id_tag, uint64_t version, const IdTagRecord &record);
+ *  DESCRIPTION
+ *      Guarda el IdTagInfo de un idTag como el más reciente. Si la caché está llena se elimina
+ *      el menos reciente. La entrada caduca a su TTL o al expiryDate del idTag, lo que llegue antes.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void IdTagCache::store(const string &id_tag, uint64_t version, const IdTagRecord &record)
+{
+    if (capacity == 0)
+        return;
+
+    string k = id_tag_key(id_tag);
+    time_t now = time(NULL);
+    time_t valid_until = now + (record.status == STATUS_ACCEPTED ? ttl : negative_ttl);
+
+    time_t expiry = parse_expiry_date(record.expiry_date);
+    if (record.status == STATUS_ACCEPTED && expiry > 0 && expiry < valid_until)
+        valid_until = expiry;
+
+    lock_guard<mutex> lock(mtx);
+    check_version(version);
+
+    auto it = by_id_tag.find(k);
+    if (it != by_id_tag.end())
+        erase(it->second);
+
+    while (lru.size() >= capacity) {
+        erase(prev(lru.end()));
+        counters.evictions++;
+    }
+
+    lru.push_front({k, record, valid_until});
+    by_id_tag.emplace(k, lru.begin());
+}
+
+/*
+ *  NAME
+ *      stats - Devuelve los contadores de la caché.
+ *  SYNOPSIS
+ *      IdTagCacheStats stats() const;
+ *  DESCRIPTION
+ *      Devuelve una copia de los contadores de la caché.
+ *  RETURN VALUE
+ *      Los contadores.
+ */
+IdTagCacheStats IdTagCache::stats() const
+{
+    lock_guard<mutex> lock(mtx);
+
+    IdTagCacheStats s = counters;
+    s.size = lru.size();
+
+    return s;
+}
+
+/*
+ *  NAME
+ *      hit_rate - Devuelve el porcentaje de aciertos.
+ *  SYNOPSIS
+ *      double hit_rate() const;
+ *  DESCRIPTION
+ *      Devuelve el porcentaje de búsquedas resueltas con la caché, es decir, de consultas
+ *      a la base de datos que se han ahorrado.
+ *  RETURN VALUE
+ *      El porcentaje (0 si aún no se ha hecho ninguna búsqueda).
+ */
+double IdTagCache::hit_rate() const
+{
+    IdTagCacheStats s = stats();
+    uint64_t total = s.hits + s.misses;
+
+    return total ? 100.0 * s.hits / total : 0;
+}
+
+/*
+ *  NAME
+ *      auth_cache_report - Devuelve los contadores de la caché en texto.
+ *  SYNOPSIS
+ *      string auth_cache_report();
+ *  DESCRIPTION
+ *      Una línea por contador de la caché de IdTagInfo, con el porcentaje de aciertos.
+ *  RETURN VALUE
+ *      El texto, vacío si aún no se ha buscado ningún idTag.
+ */
+string auth_cache_report()
+{
+    IdTagCacheStats s = id_tag_cache.stats();
+    if (s.hits + s.misses == 0)
+        return "";
+
+    char report[512];
+    snprintf(report, sizeof(report),
+             "entradas             %zu de %d\n"
+             "aciertos             %llu (%.1f %%)\n"
+             "  no aceptados       %llu\n"
+             "fallos               %llu\n"
+             "eliminadas (llena)   %llu\n"
+             "caducadas            %llu\n"
+             "vaciados por recarga %llu\n",
+             s.size, ID_TAG_CACHE_SIZE,
+             (unsigned long long)s.hits, id_tag_cache.hit_rate(),
+             (unsigned long long)s.negative_hits,
+             (unsigned long long)s.misses,
+             (unsigned long long)s.evictions,
+             (unsigned long long)s.expirations,
+             (unsigned long long)s.invalidations);
+
+    return report;
+}
+
+/*
+ *  NAME
+ *      parse_expiry_date - Pasa un expiryDate a time_t.
+ *  SYNOPSIS
+ *      static time_t parse_expiry_date(const string &expiry_date);
+ *  DESCRIPTION
+ *      Pasa un expiryDate en formato OCPP ("2025-12-31T23:59:59Z", en UTC) a time_t.
+ *  RETURN VALUE
+ *      El instante en el que caduca el idTag.
+ *      0 si no tiene expiryDate o no es válido.
+ */
+static time_t parse_expiry_date(const string &expiry_date)
+{
+    if (expiry_date.empty())
+        return 0;
+
+    struct tm tm_expiry = {};
+    if (strptime(expiry_date.c_str(), "%Y-%m-%dT%H:%M:%S", &tm_expiry) == NULL)
+        return 0;
+
+    return timegm(&tm_expiry);
+}
+
+/*
+ *  NAME
+ *      authorize_id_tag - Devuelve el IdTagInfo de un idTag.
+ *  SYNOPSIS
+ *      IdTagRecord authorize_id_tag(const char *id_tag);
+ *  DESCRIPTION
+ *      Busca el idTag en la caché. Si no está, lo comprueba en la lista de autorización y en la
+ *      tabla autoritzacions de la base de datos (expiryDate y parentIdTag) y guarda el resultado
+ *      en la caché, tanto si se acepta como si no. Si la base de datos falla, se usa solo la lista
+ *      y el resultado no se guarda.
+ *  RETURN VALUE
+ *      El IdTagInfo del idTag.
+ */
+IdTagRecord authorize_id_tag(const char *id_tag)
+{
+    IdTagRecord record = {STATUS_INVALID, "", ""};
+    uint64_t version;
+    bool listed;
+
+    {
+        PolicyGuard policies;
+        version = policies->version;
+        listed = policies->auth_list.contains(id_tag);
+    }
+
+    if (id_tag_cache.lookup(id_tag, version, record))
+        return record;
+
+    if (listed) {
+        int found = lookup_auth_record(database_path(), id_tag, record.expiry_date, record.parent_id_tag);
+        if (found < 0) { // error en la base de datos -> solo la lista, sin guardar
+            record.status = STATUS_ACCEPTED;
+            return record;
+        }
+
+        if (found == 0) // eliminado de la base de datos después de cargar la lista
+            record.status = STATUS_INVALID;
+        else if (parse_expiry_date(record.expiry_date) > 0 && parse_expiry_date(record.expiry_date) <= time(NULL))
+            record.status = STATUS_EXPIRED;
+        else
+            record.status = STATUS_ACCEPTED;
+    }
+
+    id_tag_cache.store(id_tag, version, record);
+
+    return record;
+}
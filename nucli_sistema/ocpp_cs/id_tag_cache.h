@@ -0,0 +1,93 @@
+/*
+ *  FILE
+ *      id_tag_cache.h - header de id_tag_cache.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de id_tag_cache.cpp, declaración de la caché LRU de IdTagInfo y de la función
+ *      que autoriza un idTag pasando por la caché.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _ID_TAG_CACHE_H_
+#define _ID_TAG_CACHE_H_
+
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+#include <ctime>
+#include "lib_json_includes.h"
+
+#define ID_TAG_CACHE_SIZE     4096 // idTags que se guardan como máximo
+#define ID_TAG_CACHE_TTL      300  // segundos que se guarda un idTag aceptado
+#define ID_TAG_CACHE_NEG_TTL  60   // segundos que se guarda un idTag no aceptado
+
+using namespace std;
+
+// IdTagInfo de un idTag, con el mismo contenido que se envía al cargador
+struct IdTagRecord {
+    enum Status status;   // Accepted, Blocked, Expired o Invalid
+    string expiry_date;   // expiryDate en formato OCPP, vacío si no caduca
+    string parent_id_tag; // parentIdTag, vacío si no tiene
+};
+
+// contadores de la caché
+struct IdTagCacheStats {
+    uint64_t hits;          // búsquedas resueltas con la caché
+    uint64_t negative_hits; // de estas, las de idTags no aceptados
+    uint64_t misses;        // búsquedas que han ido a la base de datos
+    uint64_t evictions;     // entradas eliminadas por falta de espacio
+    uint64_t expirations;   // entradas eliminadas por caducar
+    uint64_t invalidations; // veces que se ha vaciado por cambio de las listas
+    size_t size;            // entradas actuales
+};
+
+/*
+ * Caché LRU de IdTagInfo. Guarda tanto los idTags aceptados como los no aceptados (caché negativa,
+ * con un tiempo de vida más corto). Una entrada caduca a su TTL o al expiryDate del idTag, lo que
+ * llegue antes, de manera que un idTag caducado nunca se da por aceptado. La caché se vacía sola
+ * cuando cambia la versión de las listas de autorización, que es la única manera de que cambie
+ * un idTag de la tabla autoritzacions mientras el sistema está en marcha.
+ */
+class IdTagCache {
+public:
+    IdTagCache(size_t capacity, int ttl, int negative_ttl);
+
+    bool lookup(const string &id_tag, uint64_t version, IdTagRecord &dest); // busca un idTag
+    void store(const string &id_tag, uint64_t version, const IdTagRecord &record); // guarda un idTag
+
+    IdTagCacheStats stats() const; // contadores
+    double hit_rate() const;       // porcentaje de aciertos
+private:
+    struct entry_t {
+        string id_tag;      // clave (en mayúsculas)
+        IdTagRecord record; // IdTagInfo guardado
+        time_t valid_until; // instante en el que caduca la entrada
+    };
+
+    void erase(list<entry_t>::iterator it);
+    void check_version(uint64_t version);
+
+    size_t capacity;
+    int ttl;
+    int negative_ttl;
+
+    mutable mutex mtx;
+    list<entry_t> lru;                                          // la más reciente al principio
+    unordered_map<string, list<entry_t>::iterator> by_id_tag;   // idTag -> entrada
+    uint64_t version;                                           // versión de las listas de las entradas
+    IdTagCacheStats counters;
+};
+
+// caché de IdTagInfo compartida por todos los cargadores
+extern IdTagCache id_tag_cache;
+
+IdTagRecord authorize_id_tag(const char *id_tag);
+string auth_cache_report(); // contadores de la caché en texto
+
+#endif
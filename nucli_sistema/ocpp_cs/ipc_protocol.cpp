@@ -0,0 +1,291 @@
+/*
+ *  FILE
+ *      ipc_protocol.cpp - protocolo binario del socket local
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Codifica y decodifica los mensajes entre el sistema de control y las interfaces que se
+ *      conectan por el socket Unix local (estado de los cargadores, eventos y operaciones).
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <cstring>
+#include <algorithm>
+#include "ipc_protocol.h"
+#include "charger.h"
+
+using namespace std;
+
+/*
+ *  NAME
+ *      IpcWriter - Constructor de la clase IpcWriter
+ *  SYNOPSIS
+ *      IpcWriter(enum ipc_msg_t type);
+ *  DESCRIPTION
+ *      Empieza un mensaje de tipo type, con la longitud aún por escribir.
+ *  RETURN VALUE
+ *      Nada.
+ */
+IpcWriter::IpcWriter(enum ipc_msg_t type)
+    : buf(IPC_HEADER_LEN, 0)
+{
+    buf[4] = type;
+}
+
+void IpcWriter::put_u8(uint8_t v)
+{
+    buf.push_back(v);
+}
+
+void IpcWriter::put_u16(uint16_t v)
+{
+    buf.insert(buf.end(), (uint8_t *)&v, (uint8_t *)&v + sizeof(v));
+}
+
+void IpcWriter::put_u32(uint32_t v)
+{
+    buf.insert(buf.end(), (uint8_t *)&v, (uint8_t *)&v + sizeof(v));
+}
+
+void IpcWriter::put_i32(int32_t v)
+{
+    buf.insert(buf.end(), (uint8_t *)&v, (uint8_t *)&v + sizeof(v));
+}
+
+void IpcWriter::put_i64(int64_t v)
+{
+    buf.insert(buf.end(), (uint8_t *)&v, (uint8_t *)&v + sizeof(v));
+}
+
+void IpcWriter::put_str(const char *s, size_t len)
+{
+    len = min(len, (size_t)UINT16_MAX);
+    put_u16((uint16_t)len);
+    buf.insert(buf.end(), (const uint8_t *)s, (const uint8_t *)s + len);
+}
+
+void IpcWriter::put_str(const string &s)
+{
+    put_str(s.data(), s.size());
+}
+
+void IpcWriter::put_str32(const string &s)
+{
+    put_u32((uint32_t)s.size());
+    buf.insert(buf.end(), s.begin(), s.end());
+}
+
+/*
+ *  NAME
+ *      frame - Devuelve el mensaje completo.
+ *  SYNOPSIS
+ *      const vector<uint8_t> &frame();
+ *  DESCRIPTION
+ *      Escribe la longitud del cuerpo en la cabecera y devuelve el mensaje.
+ *  RETURN VALUE
+ *      El mensaje.
+ */
+const vector<uint8_t> &IpcWriter::frame()
+{
+    uint32_t len = buf.size() - IPC_HEADER_LEN;
+    memcpy(buf.data(), &len, sizeof(len));
+
+    return buf;
+}
+
+/*
+ *  NAME
+ *      IpcReader - Constructor de la clase IpcReader
+ *  SYNOPSIS
+ *      IpcReader(const uint8_t *data, size_t len);
+ *  DESCRIPTION
+ *      Prepara la lectura del cuerpo de un mensaje, sin la cabecera.
+ *  RETURN VALUE
+ *      Nada.
+ */
+IpcReader::IpcReader(const uint8_t *data, size_t len)
+    : p(data), end(data + len), good(true)
+{
+}
+
+bool IpcReader::get(void *dest, size_t n)
+{
+    if (!good || (size_t)(end - p) < n) {
+        good = false;
+        memset(dest, 0, n);
+        return false;
+    }
+
+    memcpy(dest, p, n);
+    p += n;
+    return true;
+}
+
+uint8_t IpcReader::get_u8()
+{
+    uint8_t v;
+    get(&v, sizeof(v));
+    return v;
+}
+
+uint16_t IpcReader::get_u16()
+{
+    uint16_t v;
+    get(&v, sizeof(v));
+    return v;
+}
+
+uint32_t IpcReader::get_u32()
+{
+    uint32_t v;
+    get(&v, sizeof(v));
+    return v;
+}
+
+int32_t IpcReader::get_i32()
+{
+    int32_t v;
+    get(&v, sizeof(v));
+    return v;
+}
+
+int64_t IpcReader::get_i64()
+{
+    int64_t v;
+    get(&v, sizeof(v));
+    return v;
+}
+
+string IpcReader::get_str()
+{
+    uint16_t len = get_u16();
+    if (!good || (size_t)(end - p) < len) {
+        good = false;
+        return string();
+    }
+
+    string s((const char *)p, len);
+    p += len;
+    return s;
+}
+
+string IpcReader::get_str32()
+{
+    uint32_t len = get_u32();
+    if (!good || (size_t)(end - p) < len) {
+        good = false;
+        return string();
+    }
+
+    string s((const char *)p, len);
+    p += len;
+    return s;
+}
+
+bool IpcReader::get_str(char *dest, size_t size)
+{
+    uint16_t len = get_u16();
+    if (!good || (size_t)(end - p) < len || len >= size) {
+        good = false;
+        dest[0] = '\0';
+        return false;
+    }
+
+    memcpy(dest, p, len);
+    dest[len] = '\0';
+    p += len;
+    return true;
+}
+
+bool IpcReader::ok() const
+{
+    return good;
+}
+
+/*
+ *  NAME
+ *      ipc_frame_length - Longitud del primer mensaje de un buffer.
+ *  SYNOPSIS
+ *      long ipc_frame_length(const uint8_t *data, size_t len);
+ *  DESCRIPTION
+ *      Mira si al principio de los len bytes recibidos en data hay un mensaje completo.
+ *  RETURN VALUE
+ *      La longitud del mensaje con la cabecera, 0 si aún no ha llegado entero, o -1 si es más
+ *      largo que IPC_MAX_FRAME (la conexión se tiene que cerrar).
+ */
+long ipc_frame_length(const uint8_t *data, size_t len)
+{
+    if (len < IPC_HEADER_LEN)
+        return 0;
+
+    uint32_t body;
+    memcpy(&body, data, sizeof(body));
+    if (body > IPC_MAX_FRAME)
+        return -1;
+
+    return len >= IPC_HEADER_LEN + body ? (long)(IPC_HEADER_LEN + body) : 0;
+}
+
+/*
+ *  NAME
+ *      ipc_put_charger - Escribe el estado de un cargador.
+ *  SYNOPSIS
+ *      void ipc_put_charger(IpcWriter &w, const struct ChargerSnapshot &snap, const vector<int32_t> &power);
+ *  DESCRIPTION
+ *      Escribe en un mensaje IPC_CHARGER el snapshot snap y la potencia de cada conector en W.
+ *      Solo se escriben los conectores que tiene el cargador, no todo el snapshot.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void ipc_put_charger(IpcWriter &w, const struct ChargerSnapshot &snap, const vector<int32_t> &power)
+{
+    w.put_u16((uint16_t)snap.charger_id);
+    w.put_u8(snap.connected);
+    w.put_u8((uint8_t)snap.boot_status);
+    w.put_str(snap.vendor, strlen(snap.vendor));
+    w.put_str(snap.model, strlen(snap.model));
+    w.put_u16((uint16_t)snap.connectors);
+
+    for (int i = 0; i <= snap.connectors; i++) {
+        w.put_u8(snap.status[i]);
+        w.put_i64(snap.transaction[i]);
+        w.put_str(snap.id_tag[i], strlen(snap.id_tag[i]));
+        w.put_i32((size_t)i < power.size() ? power[i] : 0);
+    }
+}
+
+/*
+ *  NAME
+ *      ipc_get_charger - Lee el estado de un cargador.
+ *  SYNOPSIS
+ *      bool ipc_get_charger(IpcReader &r, struct ChargerSnapshot &snap, vector<int32_t> &power);
+ *  DESCRIPTION
+ *      Lee el cuerpo de un mensaje IPC_CHARGER en snap y power.
+ *  RETURN VALUE
+ *      Devuelve true si el mensaje es correcto.
+ *      Devuelve false en caso contrario.
+ */
+bool ipc_get_charger(IpcReader &r, struct ChargerSnapshot &snap, vector<int32_t> &power)
+{
+    snap.charger_id = r.get_u16();
+    snap.connected = r.get_u8();
+    snap.boot_status = r.get_u8();
+    r.get_str(snap.vendor, sizeof(snap.vendor));
+    r.get_str(snap.model, sizeof(snap.model));
+    snap.connectors = r.get_u16();
+    if (!r.ok() || snap.connectors > CONN_MAX_CONNECTORS)
+        return false;
+
+    power.assign(snap.connectors + 1, 0);
+    for (int i = 0; i <= snap.connectors; i++) {
+        snap.status[i] = r.get_u8();
+        snap.transaction[i] = r.get_i64();
+        r.get_str(snap.id_tag[i], sizeof(snap.id_tag[i]));
+        power[i] = r.get_i32();
+    }
+
+    return r.ok();
+}
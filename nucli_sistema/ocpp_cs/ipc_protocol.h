@@ -0,0 +1,93 @@
+/*
+ *  FILE
+ *      ipc_protocol.h - header de ipc_protocol.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de ipc_protocol.cpp, declaración del protocolo binario entre el sistema de control
+ *      y las interfaces que se conectan por el socket Unix local.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _IPC_PROTOCOL_H_
+#define _IPC_PROTOCOL_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#define IPC_DEFAULT_PATH "/run/ocpp_cs/ocpp_cs.sock" // el directorio lo crea systemd (RuntimeDirectory=ocpp_cs) o start()
+#define IPC_HEADER_LEN 5          // longitud (uint32_t) y tipo (uint8_t)
+#define IPC_MAX_FRAME  (1 << 20)  // mensajes más largos cierran la conexión
+
+using namespace std;
+
+struct ChargerSnapshot;
+struct CallResult;
+
+/*
+ * Mensajes. Cada mensaje es la longitud del cuerpo (uint32_t), el tipo (uint8_t) y el cuerpo.
+ * Los enteros van en el orden de bytes de la máquina (el socket es local) y los strings como
+ * su longitud (uint16_t, uint32_t en IPC_RESULT) y los bytes, sin '\0'.
+ */
+enum ipc_msg_t {
+    IPC_CHARGER = 1,  // sistema -> interfaz: estado de un cargador (ipc_put_charger)
+    IPC_CONNECTED,    // sistema -> interfaz: uint16 charger_id
+    IPC_DISCONNECTED, // sistema -> interfaz: uint16 charger_id
+    IPC_BOOT,         // sistema -> interfaz: uint16 charger_id, str model, str vendor
+    IPC_COMMAND,      // interfaz -> sistema: uint32 request_id, str32 operación (como en select_request)
+    IPC_RESULT        // sistema -> interfaz: uint32 request_id, uint8 call_status_t, str32 payload
+};
+
+// escribe un mensaje
+class IpcWriter {
+public:
+    explicit IpcWriter(enum ipc_msg_t type);
+
+    void put_u8(uint8_t v);
+    void put_u16(uint16_t v);
+    void put_u32(uint32_t v);
+    void put_i32(int32_t v);
+    void put_i64(int64_t v);
+    void put_str(const char *s, size_t len);
+    void put_str(const string &s);
+    void put_str32(const string &s);
+
+    const vector<uint8_t> &frame(); // mensaje completo, con la longitud ya escrita
+private:
+    vector<uint8_t> buf;
+};
+
+// lee el cuerpo de un mensaje; si se acaba, ok() pasa a false y se leen ceros
+class IpcReader {
+public:
+    IpcReader(const uint8_t *data, size_t len);
+
+    uint8_t get_u8();
+    uint16_t get_u16();
+    uint32_t get_u32();
+    int32_t get_i32();
+    int64_t get_i64();
+    string get_str();
+    string get_str32();
+    bool get_str(char *dest, size_t size); // string a un buffer de tamaño size, acabado en '\0'
+
+    bool ok() const;
+private:
+    bool get(void *dest, size_t n);
+
+    const uint8_t *p;
+    const uint8_t *end;
+    bool good;
+};
+
+long ipc_frame_length(const uint8_t *data, size_t len); // primer mensaje completo de data
+
+void ipc_put_charger(IpcWriter &w, const struct ChargerSnapshot &snap, const vector<int32_t> &power);
+bool ipc_get_charger(IpcReader &r, struct ChargerSnapshot &snap, vector<int32_t> &power);
+
+#endif
@@ -0,0 +1,539 @@
+/*
+ *  FILE
+ *      ipc_server.cpp - servidor del socket Unix local
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Envía el estado de los cargadores y los eventos del sistema de control a las interfaces
+ *      de operador conectadas por un socket Unix local, y recibe de ellas las operaciones.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <syslog.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "ipc_server.h"
+#include "ipc_protocol.h"
+#include "charger.h"
+#include "fleet_state.h"
+#include "ws_server.h"
+
+using namespace std;
+
+static_assert(MAX_CHARGERS <= 32, "IpcServer::dirty tiene un bit por cargador");
+
+static bool prepare_socket_dir(const string &path);
+static bool peer_allowed(int fd);
+
+/*
+ *  NAME
+ *      IpcServer - Constructor de la clase IpcServer
+ *  SYNOPSIS
+ *      IpcServer(EventSink *next);
+ *  DESCRIPTION
+ *      Inicializa el servidor, sin abrir el socket. Los eventos también se pasan a next.
+ *  RETURN VALUE
+ *      Nada.
+ */
+IpcServer::IpcServer(EventSink *next)
+    : next(next), listen_fd(-1), wake_pipe{-1, -1}, running(false), dirty(0), next_client(1)
+{
+}
+
+/*
+ *  NAME
+ *      ~IpcServer - Destructor de la clase IpcServer
+ *  SYNOPSIS
+ *      ~IpcServer();
+ *  DESCRIPTION
+ *      Para el servidor.
+ *  RETURN VALUE
+ *      Nada.
+ */
+IpcServer::~IpcServer()
+{
+    stop();
+}
+
+/*
+ *  NAME
+ *      start - Arranca el servidor.
+ *  SYNOPSIS
+ *      bool start(const string &path);
+ *  DESCRIPTION
+ *      Crea el socket Unix path (borra el de una ejecución anterior), solo accesible para el
+ *      usuario y el grupo, y arranca el thread del servidor. El directorio del socket se crea
+ *      si no existe y no puede ser escribible por otros usuarios (como /tmp), donde cualquiera
+ *      podría sustituir el socket.
+ *  RETURN VALUE
+ *      Devuelve true si se ha arrancado.
+ *      Devuelve false en caso de error.
+ */
+bool IpcServer::start(const string &path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        syslog(LOG_ERR, "%s: ruta del socket demasiado larga: %s\n", __func__, path.c_str());
+        return false;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    if (!prepare_socket_dir(path))
+        return false;
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        syslog(LOG_ERR, "%s: socket: %s\n", __func__, strerror(errno));
+        return false;
+    }
+
+    unlink(path.c_str());
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || chmod(path.c_str(), 0660) < 0 ||
+        listen(listen_fd, 8) < 0 || pipe2(wake_pipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+
+        syslog(LOG_ERR, "%s: %s: %s\n", __func__, path.c_str(), strerror(errno));
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+
+    this->path = path;
+    running = true;
+    worker = thread(&IpcServer::run, this);
+
+    syslog(LOG_NOTICE, "%s: interfaces en %s\n", __func__, path.c_str());
+    return true;
+}
+
+/*
+ *  NAME
+ *      stop - Para el servidor.
+ *  SYNOPSIS
+ *      void stop();
+ *  DESCRIPTION
+ *      Para el thread del servidor, cierra las conexiones y borra el socket.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void IpcServer::stop()
+{
+    if (!running.exchange(false))
+        return;
+
+    char c = 0;
+    if (write(wake_pipe[1], &c, 1) < 0) {
+        // el pipe está lleno: el thread ya se va a despertar
+    }
+    worker.join();
+
+    for (auto &c : clients)
+        close(c.fd);
+    clients.clear();
+
+    close(listen_fd);
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    listen_fd = wake_pipe[0] = wake_pipe[1] = -1;
+    unlink(path.c_str());
+}
+
+void IpcServer::charger_connected(int charger_id)
+{
+    if (next)
+        next->charger_connected(charger_id);
+
+    IpcWriter w(IPC_CONNECTED);
+    w.put_u16(charger_id);
+    post(0, w.frame());
+}
+
+void IpcServer::charger_disconnected(int charger_id)
+{
+    if (next)
+        next->charger_disconnected(charger_id);
+
+    IpcWriter w(IPC_DISCONNECTED);
+    w.put_u16(charger_id);
+    post(0, w.frame());
+}
+
+void IpcServer::boot_notification(int charger_id, const string &model, const string &vendor)
+{
+    if (next)
+        next->boot_notification(charger_id, model, vendor);
+
+    IpcWriter w(IPC_BOOT);
+    w.put_u16(charger_id);
+    w.put_str(model);
+    w.put_str(vendor);
+    post(0, w.frame());
+}
+
+void IpcServer::charger_changed(int charger_id)
+{
+    if (next)
+        next->charger_changed(charger_id);
+
+    // sin mutex ni llamadas al sistema: el thread del servidor lo mira cada IPC_FRAME_MS
+    if (charger_id >= 1 && charger_id <= MAX_CHARGERS)
+        dirty.fetch_or(1u << (charger_id - 1), memory_order_relaxed);
+}
+
+/*
+ *  NAME
+ *      post - Pasa un mensaje al thread del servidor.
+ *  SYNOPSIS
+ *      void post(uint64_t client, const vector<uint8_t> &frame);
+ *  DESCRIPTION
+ *      Pone frame en la cola del thread del servidor para la interfaz client, o para todas si
+ *      client es 0, y lo despierta. Se puede llamar desde cualquier thread.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void IpcServer::post(uint64_t client, const vector<uint8_t> &frame)
+{
+    if (!running)
+        return;
+
+    {
+        lock_guard<mutex> lock(mtx);
+        outgoing.push_back({client, frame});
+    }
+
+    char c = 0;
+    if (write(wake_pipe[1], &c, 1) < 0) {
+        // el pipe está lleno: el thread ya se va a despertar
+    }
+}
+
+/*
+ *  NAME
+ *      charger_frame - Mensaje con el estado de un cargador.
+ *  SYNOPSIS
+ *      vector<uint8_t> charger_frame(int charger_id);
+ *  DESCRIPTION
+ *      Forma el mensaje IPC_CHARGER con el último snapshot del cargador y la potencia de sus
+ *      conectores. No coge el mutex del cargador.
+ *  RETURN VALUE
+ *      El mensaje, vacío si el cargador no existe.
+ */
+vector<uint8_t> IpcServer::charger_frame(int charger_id)
+{
+    Charger *charger = get_charger(charger_id);
+    if (charger == NULL)
+        return vector<uint8_t>();
+
+    struct ChargerSnapshot snap;
+    charger->get_snapshot(snap);
+    snap.charger_id = charger_id;
+
+    vector<int32_t> power;
+    fleet_state.get_power(charger_id, power);
+
+    IpcWriter w(IPC_CHARGER);
+    ipc_put_charger(w, snap, power);
+    return w.frame();
+}
+
+/*
+ *  NAME
+ *      run - Bucle del thread del servidor.
+ *  SYNOPSIS
+ *      void run();
+ *  DESCRIPTION
+ *      Espera con poll() conexiones, mensajes de las interfaces, mensajes de otros threads y
+ *      sitio para escribir, y cada IPC_FRAME_MS envía los cargadores que han cambiado.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void IpcServer::run()
+{
+    vector<struct pollfd> fds;
+
+    while (running) {
+        fds.clear();
+        fds.push_back({listen_fd, POLLIN, 0});
+        fds.push_back({wake_pipe[0], POLLIN, 0});
+        for (auto &c : clients)
+            fds.push_back({c.fd, (short)(POLLIN | (c.out.empty() ? 0 : POLLOUT)), 0});
+
+        if (poll(fds.data(), fds.size(), IPC_FRAME_MS) < 0 && errno != EINTR) {
+            syslog(LOG_ERR, "%s: poll: %s\n", __func__, strerror(errno));
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            char buf[64];
+            while (read(wake_pipe[0], buf, sizeof(buf)) > 0)
+                ;
+        }
+
+        // mensajes de otros threads (eventos y respuestas de operaciones)
+        vector<Outgoing> taken;
+        {
+            lock_guard<mutex> lock(mtx);
+            taken.swap(outgoing);
+        }
+        for (auto &o : taken) {
+            for (auto &c : clients) {
+                if (o.client == 0 || o.client == c.id)
+                    c.out.insert(c.out.end(), o.frame.begin(), o.frame.end());
+            }
+        }
+
+        // cargadores cambiados: un mensaje por cargador aunque haya cambiado muchas veces
+        uint32_t changed = dirty.exchange(0, memory_order_relaxed);
+        if (changed && !clients.empty()) {
+            for (int id = 1; id <= MAX_CHARGERS; id++) {
+                if (!(changed & (1u << (id - 1))))
+                    continue;
+                vector<uint8_t> frame = charger_frame(id);
+                for (auto &c : clients)
+                    c.out.insert(c.out.end(), frame.begin(), frame.end());
+            }
+        }
+
+        // conexiones existentes (las posiciones de fds corresponden a clients hasta aquí)
+        size_t n = clients.size();
+        vector<bool> drop(n, false);
+        for (size_t i = 0; i < n; i++) {
+            short ev = fds[i + 2].revents;
+            if ((ev & (POLLERR | POLLNVAL)) || ((ev & (POLLIN | POLLHUP)) && !read_client(clients[i])))
+                drop[i] = true;
+            else if (!clients[i].out.empty() && !flush_client(clients[i]))
+                drop[i] = true;
+        }
+        for (size_t i = n; i-- > 0;) {
+            if (drop[i]) {
+                syslog(LOG_INFO, "%s: interfaz %lu desconectada\n", __func__, (unsigned long)clients[i].id);
+                close(clients[i].fd);
+                clients.erase(clients.begin() + i);
+            }
+        }
+
+        if (fds[0].revents & POLLIN)
+            accept_clients();
+    }
+}
+
+/*
+ *  NAME
+ *      accept_clients - Acepta las conexiones nuevas.
+ *  SYNOPSIS
+ *      void accept_clients();
+ *  DESCRIPTION
+ *      Acepta las interfaces que se han conectado y les envía el estado de todos los cargadores.
+ *      Las de otros usuarios (peer_allowed) se cierran enseguida.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void IpcServer::accept_clients()
+{
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        if (!peer_allowed(fd)) {
+            close(fd);
+            continue;
+        }
+
+        Client c;
+        c.id = next_client++;
+        c.fd = fd;
+        for (int id = 1; id <= MAX_CHARGERS; id++) {
+            vector<uint8_t> frame = charger_frame(id);
+            c.out.insert(c.out.end(), frame.begin(), frame.end());
+        }
+
+        syslog(LOG_INFO, "%s: interfaz %lu conectada\n", __func__, (unsigned long)c.id);
+        clients.push_back(move(c));
+        flush_client(clients.back());
+    }
+}
+
+/*
+ *  NAME
+ *      read_client - Lee los mensajes de una interfaz.
+ *  SYNOPSIS
+ *      bool read_client(Client &c);
+ *  DESCRIPTION
+ *      Lee lo que ha llegado de la interfaz c y procesa los mensajes completos.
+ *  RETURN VALUE
+ *      Devuelve false si la interfaz se ha desconectado o ha enviado un mensaje incorrecto.
+ *      Devuelve true en caso contrario.
+ */
+bool IpcServer::read_client(Client &c)
+{
+    uint8_t buf[4096];
+
+    for (;;) {
+        ssize_t r = recv(c.fd, buf, sizeof(buf), 0);
+        if (r == 0)
+            return false;
+        if (r < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+        c.in.insert(c.in.end(), buf, buf + r);
+
+        size_t pos = 0;
+        long len;
+        while ((len = ipc_frame_length(c.in.data() + pos, c.in.size() - pos)) > 0) {
+            handle_frame(c, c.in[pos + 4], c.in.data() + pos + IPC_HEADER_LEN, len - IPC_HEADER_LEN);
+            pos += len;
+        }
+        if (len < 0)
+            return false;
+        c.in.erase(c.in.begin(), c.in.begin() + pos);
+    }
+}
+
+/*
+ *  NAME
+ *      flush_client - Envía lo pendiente a una interfaz.
+ *  SYNOPSIS
+ *      bool flush_client(Client &c);
+ *  DESCRIPTION
+ *      Escribe en el socket de c todo lo que se pueda sin bloquear.
+ *  RETURN VALUE
+ *      Devuelve false si hay un error o si la interfaz tiene más de IPC_MAX_BUFFERED bytes
+ *      pendientes (no lee).
+ *      Devuelve true en caso contrario.
+ */
+bool IpcServer::flush_client(Client &c)
+{
+    size_t sent = 0;
+    while (sent < c.out.size()) {
+        ssize_t r = send(c.fd, c.out.data() + sent, c.out.size() - sent, MSG_NOSIGNAL);
+        if (r < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        sent += r;
+    }
+    c.out.erase(c.out.begin(), c.out.begin() + sent);
+
+    if (c.out.size() > IPC_MAX_BUFFERED) {
+        syslog(LOG_WARNING, "%s: la interfaz %lu no lee, se desconecta\n", __func__, (unsigned long)c.id);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      handle_frame - Procesa un mensaje de una interfaz.
+ *  SYNOPSIS
+ *      void handle_frame(Client &c, uint8_t type, const uint8_t *body, size_t len);
+ *  DESCRIPTION
+ *      Las interfaces solo envían operaciones (IPC_COMMAND). La operación se pasa a
+ *      select_request, que no espera al cargador, y la respuesta se envía solo a la interfaz
+ *      que la ha pedido cuando llega.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void IpcServer::handle_frame(Client &c, uint8_t type, const uint8_t *body, size_t len)
+{
+    if (type != IPC_COMMAND) {
+        syslog(LOG_WARNING, "%s: mensaje %u desconocido de la interfaz %lu\n", __func__, type, (unsigned long)c.id);
+        return;
+    }
+
+    IpcReader r(body, len);
+    uint32_t request_id = r.get_u32();
+    string operation = r.get_str32();
+    if (!r.ok())
+        return;
+
+    uint64_t client = c.id;
+    select_request(operation.c_str(), [this, client, request_id](const struct CallResult &result) {
+        IpcWriter w(IPC_RESULT);
+        w.put_u32(request_id);
+        w.put_u8(result.status);
+        w.put_str32(result.payload);
+        post(client, w.frame());
+    });
+}
+
+/*
+ *  NAME
+ *      prepare_socket_dir - Prepara el directorio del socket.
+ *  SYNOPSIS
+ *      static bool prepare_socket_dir(const string &path);
+ *  DESCRIPTION
+ *      Crea el directorio del socket path con permisos 0750 si no existe y comprueba que otros
+ *      usuarios no pueden escribir en él.
+ *  RETURN VALUE
+ *      Devuelve true si todo va bien.
+ *      Devuelve false en caso contrario.
+ */
+static bool prepare_socket_dir(const string &path)
+{
+    size_t slash = path.rfind('/');
+    if (slash == string::npos || slash == 0)
+        return true; // directorio actual o raíz
+
+    string dir = path.substr(0, slash);
+    if (mkdir(dir.c_str(), 0750) < 0 && errno != EEXIST) {
+        syslog(LOG_ERR, "%s: %s: %s\n", __func__, dir.c_str(), strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (stat(dir.c_str(), &st) < 0 || !S_ISDIR(st.st_mode)) {
+        syslog(LOG_ERR, "%s: %s no es un directorio\n", __func__, dir.c_str());
+        return false;
+    }
+    if (st.st_mode & S_IWOTH) {
+        syslog(LOG_ERR, "%s: %s es escribible por todos los usuarios, usa p.ej. /run/ocpp_cs\n", __func__, dir.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      peer_allowed - Comprueba quién se ha conectado al socket.
+ *  SYNOPSIS
+ *      static bool peer_allowed(int fd);
+ *  DESCRIPTION
+ *      Lee con SO_PEERCRED el usuario y el grupo del proceso conectado en fd. Se aceptan root,
+ *      el mismo usuario que el sistema de control y los procesos de su grupo, los mismos que
+ *      pueden abrir el socket (0660); así no depende solo de los permisos del fichero.
+ *  RETURN VALUE
+ *      Devuelve true si se acepta la conexión.
+ *      Devuelve false en caso contrario.
+ */
+static bool peer_allowed(int fd)
+{
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+        syslog(LOG_WARNING, "%s: SO_PEERCRED: %s\n", __func__, strerror(errno));
+        return false;
+    }
+
+    if (cred.uid == 0 || cred.uid == geteuid() || cred.gid == getegid())
+        return true;
+
+    syslog(LOG_WARNING, "%s: interfaz rechazada (pid %d, uid %u, gid %u)\n", __func__,
+           (int)cred.pid, (unsigned)cred.uid, (unsigned)cred.gid);
+    return false;
+}
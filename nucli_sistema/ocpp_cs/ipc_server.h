@@ -0,0 +1,91 @@
+/*
+ *  FILE
+ *      ipc_server.h - header de ipc_server.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de ipc_server.cpp, declaración del servidor del socket Unix local por el que las
+ *      interfaces de operador siguen el estado del sistema de control y le envían operaciones.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _IPC_SERVER_H_
+#define _IPC_SERVER_H_
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include "event_sink.h"
+
+#define IPC_FRAME_MS     40              // cada cuánto se envían los cargadores que han cambiado
+#define IPC_MAX_BUFFERED (4 * 1024 * 1024) // bytes pendientes de enviar a una interfaz antes de desconectarla
+
+using namespace std;
+
+/*
+ * Servidor del socket Unix local (protocolo en ipc_protocol.h). Es el EventSink del núcleo: los
+ * eventos se pasan a next (p.ej. el syslog) y a todas las interfaces conectadas. Todo el trabajo
+ * se hace en un solo thread propio con poll(): charger_changed(), que llega con cada mensaje de
+ * un cargador, solo marca el cargador en un bitmap atómico, y cada IPC_FRAME_MS el thread envía
+ * el último snapshot de los cargadores marcados. Así el número de interfaces conectadas, y lo
+ * lentas que sean, no añade trabajo a los threads de los cargadores. Una interfaz conectada
+ * recibe primero el estado de todos los cargadores; si deja de leer, se desconecta.
+ * El objeto tiene que existir hasta el final del proceso (las respuestas de las operaciones
+ * llegan desde los threads de los cargadores).
+ */
+class IpcServer : public EventSink {
+public:
+    explicit IpcServer(EventSink *next = NULL);
+    ~IpcServer();
+
+    bool start(const string &path);
+    void stop();
+
+    // EventSink
+    void charger_connected(int charger_id) override;
+    void charger_disconnected(int charger_id) override;
+    void boot_notification(int charger_id, const string &model, const string &vendor) override;
+    void charger_changed(int charger_id) override;
+private:
+    struct Client {
+        uint64_t id;
+        int fd;
+        vector<uint8_t> in;  // bytes recibidos de un mensaje aún incompleto
+        vector<uint8_t> out; // bytes pendientes de enviar
+    };
+
+    // mensaje de otro thread para el thread del servidor; client 0 es para todas
+    struct Outgoing {
+        uint64_t client;
+        vector<uint8_t> frame;
+    };
+
+    void run();
+    void post(uint64_t client, const vector<uint8_t> &frame);
+    void accept_clients();
+    bool read_client(Client &c);
+    bool flush_client(Client &c);
+    void handle_frame(Client &c, uint8_t type, const uint8_t *body, size_t len);
+    vector<uint8_t> charger_frame(int charger_id);
+
+    EventSink *next;
+    string path;
+    int listen_fd;
+    int wake_pipe[2]; // despierta el poll() cuando hay mensajes en outgoing
+    thread worker;
+    atomic<bool> running;
+    atomic<uint32_t> dirty; // bit charger_id - 1: cargador cambiado desde el último envío
+
+    mutex mtx; // protege outgoing
+    vector<Outgoing> outgoing;
+
+    vector<Client> clients; // solo los usa el thread del servidor
+    uint64_t next_client;
+};
+
+#endif
@@ -0,0 +1,365 @@
+/*
+ *  FILE
+ *      latency.cpp - latencia de los mensajes recibidos
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Mide cuánto tarda system_on_receive en cada etapa de un mensaje (parse, validate,
+ *      handle, persist y respond) y lo acumula en histogramas por acción OCPP y cargador,
+ *      de los que se sacan los percentiles p50, p99 y p999 en cualquier momento.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "latency.h"
+#include "ws_server.h"
+
+using namespace std;
+
+// acciones que envían los cargadores (OCPP 1.6) y los otros tipos de mensaje
+static const char *action_names[] = {
+    "Authorize", "BootNotification", "DataTransfer", "DiagnosticsStatusNotification",
+    "FirmwareStatusNotification", "Heartbeat", "MeterValues", "StartTransaction",
+    "StatusNotification", "StopTransaction", "CALLRESULT", "CALLERROR", "Other"
+};
+#define LAT_ACTIONS (sizeof(action_names) / sizeof(action_names[0]))
+
+static const char *stage_names[LAT_STAGES] = {"parse", "validate", "handle", "persist", "respond", "total"};
+
+// histograma de una acción de un cargador en un thread
+struct LatencyHist {
+    atomic<uint32_t> counts[LAT_STAGES][LAT_BUCKETS];
+    atomic<uint64_t> max_ns[LAT_STAGES];
+};
+
+/*
+ * Histogramas de un thread. Solo escribe el thread que lo tiene (sin instrucciones atómicas de
+ * lectura-modificación-escritura ni esperas); los lectores suman los de todos los threads.
+ * Cuando el thread termina, el siguiente que empieza lo reutiliza y sigue sumando.
+ * La posición 0 de los cargadores es para los charger_id fuera de rango.
+ */
+struct LatencyShard {
+    atomic<bool> in_use;
+    atomic<LatencyHist *> hist[MAX_CHARGERS + 1][LAT_ACTIONS]; // se crean con el primer mensaje
+};
+
+// mensaje que se está midiendo en un thread
+struct LatencyTrace {
+    bool active = false;
+    enum latency_stage_t stage;
+    chrono::steady_clock::time_point start;
+    chrono::steady_clock::time_point last; // cambio de etapa anterior
+    uint64_t ns[LAT_STAGES];
+};
+
+// al terminar el thread, su LatencyShard queda libre
+struct ShardOwner {
+    LatencyShard *shard = NULL;
+    ~ShardOwner()
+    {
+        if (shard)
+            shard->in_use.store(false, memory_order_release);
+    }
+};
+
+static mutex registry_mtx;             // protege shards
+static vector<LatencyShard *> shards;  // no se liberan nunca
+static thread_local LatencyTrace trace;
+static thread_local ShardOwner owner;
+
+/*
+ *  NAME
+ *      bucket_of - Devuelve el intervalo del histograma de un valor.
+ *  SYNOPSIS
+ *      static int bucket_of(uint64_t ns);
+ *  DESCRIPTION
+ *      Los LAT_SUB_BUCKETS primeros intervalos son de 1 ns. A partir de ahí, el valor se
+ *      redondea a sus LAT_SUB_BITS bits más significativos: el intervalo depende de la
+ *      posición del bit más alto y de los LAT_SUB_BITS - 1 bits que le siguen.
+ *  RETURN VALUE
+ *      El índice del intervalo, entre 0 y LAT_BUCKETS - 1.
+ */
+static int bucket_of(uint64_t ns)
+{
+    if (ns < LAT_SUB_BUCKETS)
+        return ns;
+
+    int shift = (63 - __builtin_clzll(ns)) - (LAT_SUB_BITS - 1);
+    int bucket = LAT_SUB_BUCKETS + (shift - 1) * (LAT_SUB_BUCKETS / 2) + (int)((ns >> shift) - LAT_SUB_BUCKETS / 2);
+
+    return bucket < LAT_BUCKETS ? bucket : LAT_BUCKETS - 1;
+}
+
+/*
+ *  NAME
+ *      bucket_high - Devuelve el valor más alto de un intervalo del histograma.
+ *  SYNOPSIS
+ *      static uint64_t bucket_high(int bucket);
+ *  DESCRIPTION
+ *      Inversa de bucket_of: el valor más alto que va al intervalo.
+ *  RETURN VALUE
+ *      El valor en ns.
+ */
+static uint64_t bucket_high(int bucket)
+{
+    if (bucket < LAT_SUB_BUCKETS)
+        return bucket;
+
+    int shift = (bucket - LAT_SUB_BUCKETS) / (LAT_SUB_BUCKETS / 2) + 1;
+    uint64_t top = LAT_SUB_BUCKETS / 2 + (bucket - LAT_SUB_BUCKETS) % (LAT_SUB_BUCKETS / 2);
+
+    return ((top + 1) << shift) - 1;
+}
+
+static size_t action_index(const string &action)
+{
+    // en la cabecera la acción va entre comillas
+    size_t begin = (!action.empty() && action[0] == '"') ? 1 : 0;
+    size_t len = action.size() - begin;
+    if (len && action[begin + len - 1] == '"')
+        len--;
+
+    for (size_t i = 0; i < LAT_ACTIONS - 1; i++) {
+        if (strlen(action_names[i]) == len && action.compare(begin, len, action_names[i]) == 0)
+            return i;
+    }
+
+    return LAT_ACTIONS - 1;
+}
+
+/*
+ *  NAME
+ *      acquire_shard - Devuelve los histogramas del thread que llama.
+ *  SYNOPSIS
+ *      static LatencyShard *acquire_shard();
+ *  DESCRIPTION
+ *      La primera vez que un thread registra un mensaje, coge los histogramas de un thread
+ *      que ya ha terminado o, si no hay, crea unos nuevos. Es el único momento en que se
+ *      coge un mutex.
+ *  RETURN VALUE
+ *      Los histogramas del thread.
+ */
+static LatencyShard *acquire_shard()
+{
+    if (owner.shard)
+        return owner.shard;
+
+    lock_guard<mutex> lock(registry_mtx);
+
+    for (LatencyShard *shard : shards) {
+        if (!shard->in_use.load(memory_order_acquire)) {
+            shard->in_use.store(true, memory_order_relaxed);
+            owner.shard = shard;
+            return shard;
+        }
+    }
+
+    LatencyShard *shard = new LatencyShard();
+    shard->in_use.store(true, memory_order_relaxed);
+    shards.push_back(shard);
+    owner.shard = shard;
+
+    return shard;
+}
+
+/*
+ *  NAME
+ *      latency_begin - Empieza a medir un mensaje recibido.
+ *  SYNOPSIS
+ *      void latency_begin();
+ *  DESCRIPTION
+ *      Empieza a medir el mensaje que procesa el thread que llama, en la etapa LAT_PARSE.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void latency_begin()
+{
+    trace.active = true;
+    trace.stage = LAT_PARSE;
+    trace.start = trace.last = chrono::steady_clock::now();
+    memset(trace.ns, 0, sizeof(trace.ns));
+}
+
+/*
+ *  NAME
+ *      latency_stage - Cambia de etapa el mensaje que se está midiendo.
+ *  SYNOPSIS
+ *      enum latency_stage_t latency_stage(enum latency_stage_t stage);
+ *  DESCRIPTION
+ *      El tiempo desde el cambio de etapa anterior se suma a la etapa actual, y a partir de
+ *      ahora se suma a stage. Si el thread no está midiendo ningún mensaje (p.ej. ws_send desde
+ *      el thread de envío de peticiones) no hace nada.
+ *  RETURN VALUE
+ *      La etapa anterior, para volver a ella.
+ */
+enum latency_stage_t latency_stage(enum latency_stage_t stage)
+{
+    if (!trace.active)
+        return stage;
+
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    trace.ns[trace.stage] += chrono::duration_cast<chrono::nanoseconds>(now - trace.last).count();
+    trace.last = now;
+
+    enum latency_stage_t previous = trace.stage;
+    trace.stage = stage;
+
+    return previous;
+}
+
+/*
+ *  NAME
+ *      latency_end - Termina de medir un mensaje recibido.
+ *  SYNOPSIS
+ *      void latency_end(int charger_id, const string &action);
+ *  DESCRIPTION
+ *      Suma el tiempo de cada etapa, y el total, a los histogramas de la acción (con o sin
+ *      comillas) y el cargador en el thread que llama. Las etapas en las que el mensaje no ha
+ *      estado no se cuentan.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void latency_end(int charger_id, const string &action)
+{
+    if (!trace.active)
+        return;
+
+    latency_stage(trace.stage);
+    trace.ns[LAT_TOTAL] = chrono::duration_cast<chrono::nanoseconds>(trace.last - trace.start).count();
+    trace.active = false;
+
+    LatencyShard *shard = acquire_shard();
+    int slot = (charger_id >= 1 && charger_id <= MAX_CHARGERS) ? charger_id : 0;
+    atomic<LatencyHist *> &entry = shard->hist[slot][action_index(action)];
+
+    LatencyHist *hist = entry.load(memory_order_relaxed);
+    if (hist == NULL) {
+        hist = new LatencyHist();
+        entry.store(hist, memory_order_release); // los lectores lo ven ya a cero
+    }
+
+    // solo escribe este thread: basta con leer y escribir, sin fetch_add
+    for (int stage = 0; stage < LAT_STAGES; stage++) {
+        if (trace.ns[stage] == 0 && stage != LAT_TOTAL)
+            continue;
+
+        atomic<uint32_t> &count = hist->counts[stage][bucket_of(trace.ns[stage])];
+        count.store(count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        if (trace.ns[stage] > hist->max_ns[stage].load(memory_order_relaxed))
+            hist->max_ns[stage].store(trace.ns[stage], memory_order_relaxed);
+    }
+}
+
+/*
+ *  NAME
+ *      latency_stats - Devuelve los percentiles de una etapa.
+ *  SYNOPSIS
+ *      bool latency_stats(int charger_id, const char *action, enum latency_stage_t stage, struct LatencyStats &dest);
+ *  DESCRIPTION
+ *      Suma los histogramas de todos los threads del cargador (0: todos) y la acción (NULL:
+ *      todas) y calcula los percentiles de la etapa. Cada percentil es el valor más alto de su
+ *      intervalo. Los histogramas se siguen escribiendo mientras tanto, así que el resultado
+ *      puede no incluir los últimos mensajes.
+ *  RETURN VALUE
+ *      Devuelve true si hay algún mensaje.
+ *      Devuelve false en caso contrario.
+ */
+bool latency_stats(int charger_id, const char *action, enum latency_stage_t stage, struct LatencyStats &dest)
+{
+    static thread_local vector<uint64_t> counts; // 4 kB, mejor no en la pila de un thread de wsServer
+    counts.assign(LAT_BUCKETS, 0);
+    dest = {};
+
+    size_t only_action = action ? action_index(action) : LAT_ACTIONS;
+    {
+        lock_guard<mutex> lock(registry_mtx); // solo para recorrer shards
+
+        for (LatencyShard *shard : shards) {
+            for (int slot = 0; slot <= MAX_CHARGERS; slot++) {
+                if (charger_id && slot != charger_id)
+                    continue;
+
+                for (size_t a = 0; a < LAT_ACTIONS; a++) {
+                    LatencyHist *hist = shard->hist[slot][a].load(memory_order_acquire);
+                    if (hist == NULL || (only_action != LAT_ACTIONS && a != only_action))
+                        continue;
+
+                    for (int b = 0; b < LAT_BUCKETS; b++) {
+                        uint32_t n = hist->counts[stage][b].load(memory_order_relaxed);
+                        counts[b] += n;
+                        dest.count += n;
+                    }
+                    dest.max_ns = max(dest.max_ns, hist->max_ns[stage].load(memory_order_relaxed));
+                }
+            }
+        }
+    }
+
+    if (dest.count == 0)
+        return false;
+
+    // primer intervalo en el que la cuenta acumulada llega a cada percentil
+    uint64_t *percentiles[] = {&dest.p50_ns, &dest.p99_ns, &dest.p999_ns};
+    uint64_t ranks[] = {(dest.count * 500 + 999) / 1000, (dest.count * 990 + 999) / 1000, (dest.count * 999 + 999) / 1000};
+
+    uint64_t seen = 0;
+    int p = 0;
+    for (int b = 0; b < LAT_BUCKETS && p < 3; b++) {
+        seen += counts[b];
+        while (p < 3 && seen >= ranks[p])
+            *percentiles[p++] = min(bucket_high(b), dest.max_ns);
+    }
+    while (p < 3)
+        *percentiles[p++] = dest.max_ns; // un escritor ha sumado entre medio
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      latency_report - Devuelve la tabla de latencias en texto.
+ *  SYNOPSIS
+ *      string latency_report(int charger_id = 0);
+ *  DESCRIPTION
+ *      Una línea por acción y etapa con mensajes, del cargador (0: todos), con el número de
+ *      mensajes y los percentiles en microsegundos.
+ *  RETURN VALUE
+ *      El texto, vacío si no se ha recibido ningún mensaje.
+ */
+string latency_report(int charger_id)
+{
+    string report;
+    char line[160];
+
+    for (size_t a = 0; a < LAT_ACTIONS; a++) {
+        const char *name = action_names[a]; // solo en la primera línea de la acción
+        for (int stage = 0; stage < LAT_STAGES; stage++) {
+            struct LatencyStats stats;
+            if (!latency_stats(charger_id, action_names[a], static_cast<enum latency_stage_t>(stage), stats))
+                continue;
+
+            if (report.empty()) {
+                snprintf(line, sizeof(line), "%-31s %-8s %10s %10s %10s %10s %10s\n", // "ó" son dos bytes
+                         "acción", "etapa", "mensajes", "p50 us", "p99 us", "p999 us", "max us");
+                report += line;
+            }
+            snprintf(line, sizeof(line), "%-30s %-8s %10llu %10.1f %10.1f %10.1f %10.1f\n",
+                     name, stage_names[stage],
+                     (unsigned long long)stats.count, stats.p50_ns / 1e3, stats.p99_ns / 1e3,
+                     stats.p999_ns / 1e3, stats.max_ns / 1e3);
+            report += line;
+            name = "";
+        }
+    }
+
+    return report;
+}
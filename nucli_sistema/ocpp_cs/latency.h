@@ -0,0 +1,60 @@
+/*
+ *  FILE
+ *      latency.h - header de latency.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de latency.cpp, declaración de los histogramas de latencia de los mensajes
+ *      recibidos de los cargadores, por etapa, acción OCPP y cargador.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <string>
+#include <cstdint>
+
+/*
+ * Histograma logarítmico-lineal (como HdrHistogram): cada potencia de 2 se divide en
+ * LAT_SUB_BUCKETS / 2 intervalos, así el error relativo de los percentiles es como máximo
+ * 2 / LAT_SUB_BUCKETS (~6%) desde 1 ns hasta ~34 s. Los valores mayores van al último.
+ */
+#define LAT_SUB_BITS    5
+#define LAT_SUB_BUCKETS (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS     512
+
+using namespace std;
+
+// etapas de un mensaje recibido, LAT_TOTAL es el tiempo entero en system_on_receive
+enum latency_stage_t {
+    LAT_PARSE,    // separar el mensaje y pasar el payload a struct
+    LAT_VALIDATE, // comprobar los campos
+    LAT_HANDLE,   // aplicar el mensaje al estado del sistema
+    LAT_PERSIST,  // escribir en la base de datos
+    LAT_RESPOND,  // enviar la respuesta (ws_send)
+    LAT_TOTAL,
+    LAT_STAGES
+};
+
+struct LatencyStats {
+    uint64_t count;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+};
+
+// medida del mensaje que se procesa en el thread que llama
+void latency_begin();
+enum latency_stage_t latency_stage(enum latency_stage_t stage);
+void latency_end(int charger_id, const string &action);
+
+// lectura, desde cualquier thread
+bool latency_stats(int charger_id, const char *action, enum latency_stage_t stage, struct LatencyStats &dest);
+string latency_report(int charger_id = 0);
+
+#endif
@@ -24,6 +24,8 @@ extern "C" {
 #include "BootNotificationConfJSON.h"
 #include "ChangeAvailabilityReqJSON.h"
 #include "ChangeAvailabilityConfJSON.h"
+#include "ChangeConfigurationReqJSON.h"
+#include "ChangeConfigurationConfJSON.h"
 #include "ClearCacheConfJSON.h"
 #include "DataTransferReqJSON.h"
 #include "DataTransferConfJSON.h"
@@ -0,0 +1,437 @@
+/*
+ *  FILE
+ *      meter_history.cpp - histórico en memoria de los MeterValues
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Guarda las muestras recientes de potencia, corriente, energía, tensión y SoC de cada
+ *      conector en buffers circulares de medida fija sin mutex, las reduce a la resolución de
+ *      una gráfica y completa con la base de datos las consultas que van más atrás.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <syslog.h>
+#include <sqlite3.h>
+#include "meter_history.h"
+#include "connector_state.h"
+#include "lib_json_includes.h"
+#include "ws_server.h"
+
+#define METER_RINGS (MAX_CHARGERS * (CONN_MAX_CONNECTORS + 1) * METER_SERIES)
+#define METER_DB_MAX_ROWS 100000 // filas como máximo de una consulta a la base de datos
+
+using namespace std;
+
+MeterHistory meter_history;
+
+// measurand con el que se guarda cada magnitud en la tabla meter_values
+static const char *db_measurand[METER_SERIES] = {
+    "Power.Active.Import", "Current.Import", "Energy.Active.Import.Register", "Voltage", "SoC"
+};
+
+/*
+ *  NAME
+ *      ring_index - Posición del buffer de una magnitud de un conector.
+ *  SYNOPSIS
+ *      static int ring_index(int charger_id, int connector, enum meter_series_t series);
+ *  DESCRIPTION
+ *      Calcula la posición en la tabla de buffers del cargador charger_id (1..MAX_CHARGERS),
+ *      conector connector (0..CONN_MAX_CONNECTORS) y magnitud series.
+ *  RETURN VALUE
+ *      La posición, o -1 si alguno de los tres está fuera de rango.
+ */
+static int ring_index(int charger_id, int connector, enum meter_series_t series)
+{
+    if (charger_id < 1 || charger_id > MAX_CHARGERS || connector < 0 || connector > CONN_MAX_CONNECTORS ||
+        series < 0 || series >= METER_SERIES)
+        return -1;
+
+    return ((charger_id - 1) * (CONN_MAX_CONNECTORS + 1) + connector) * METER_SERIES + series;
+}
+
+static uint64_t pack(uint32_t time, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (uint64_t)time << 32 | bits;
+}
+
+static struct MeterSample unpack(uint64_t word)
+{
+    struct MeterSample s;
+    uint32_t bits = (uint32_t)word;
+    s.time = (uint32_t)(word >> 32);
+    memcpy(&s.value, &bits, sizeof(bits));
+    return s;
+}
+
+/*
+ *  NAME
+ *      scan - Recorre las muestras de un buffer.
+ *  SYNOPSIS
+ *      template <typename R, typename F> static void scan(const R &r, F f);
+ *  DESCRIPTION
+ *      Llama a f con cada muestra del buffer r, de la más nueva a la más antigua, sin bloquear
+ *      al escritor. Después de leer cada posición comprueba en claimed que el escritor no la
+ *      haya empezado a sobrescribir; si lo ha hecho, la descarta y para (las que faltan son
+ *      más antiguas y también se han perdido).
+ *  RETURN VALUE
+ *      Nada.
+ */
+template <typename R, typename F>
+static void scan(const R &r, F f)
+{
+    uint64_t end = r.written.load(memory_order_acquire);
+    uint64_t begin = end > METER_HISTORY_LEN ? end - METER_HISTORY_LEN : 0;
+
+    for (uint64_t i = end; i-- > begin;) {
+        uint64_t word = r.samples[i % METER_HISTORY_LEN].load(memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (r.claimed.load(memory_order_relaxed) > i + METER_HISTORY_LEN)
+            return;
+
+        f(unpack(word));
+    }
+}
+
+/*
+ *  NAME
+ *      MeterHistory - Constructor de la clase MeterHistory
+ *  SYNOPSIS
+ *      MeterHistory();
+ *  DESCRIPTION
+ *      Reserva la tabla de buffers, todos vacíos. Los buffers se reservan con su primera muestra.
+ *  RETURN VALUE
+ *      Nada.
+ */
+MeterHistory::MeterHistory()
+    : rings(new atomic<Ring *>[METER_RINGS])
+{
+    for (int i = 0; i < METER_RINGS; i++)
+        rings[i].store(NULL, memory_order_relaxed);
+}
+
+/*
+ *  NAME
+ *      ~MeterHistory - Destructor de la clase MeterHistory
+ *  SYNOPSIS
+ *      ~MeterHistory();
+ *  DESCRIPTION
+ *      Libera los buffers.
+ *  RETURN VALUE
+ *      Nada.
+ */
+MeterHistory::~MeterHistory()
+{
+    for (int i = 0; i < METER_RINGS; i++)
+        delete rings[i].load(memory_order_relaxed);
+}
+
+/*
+ *  NAME
+ *      ring - Devuelve el buffer de una magnitud de un conector.
+ *  SYNOPSIS
+ *      Ring *ring(int charger_id, int connector, enum meter_series_t series) const;
+ *  DESCRIPTION
+ *      Devuelve el buffer del cargador charger_id, conector connector y magnitud series.
+ *  RETURN VALUE
+ *      El buffer, o NULL si aún no tiene ninguna muestra o está fuera de rango.
+ */
+MeterHistory::Ring *MeterHistory::ring(int charger_id, int connector, enum meter_series_t series) const
+{
+    int i = ring_index(charger_id, connector, series);
+
+    return i < 0 ? NULL : rings[i].load(memory_order_acquire);
+}
+
+/*
+ *  NAME
+ *      series_of - Magnitud de un sampledValue.
+ *  SYNOPSIS
+ *      static bool series_of(int measurand, int unit, enum meter_series_t &series, double &scale);
+ *  DESCRIPTION
+ *      Indica en qué magnitud se guarda un sampledValue con measurand y unit (los valores de
+ *      enum Measurand y enum Unit, -1 si el cargador no los envía) y por cuánto se tiene que
+ *      multiplicar su valor (p.ej. 1000 de kW a W). Sin measurand es Energy.Active.Import.Register.
+ *  RETURN VALUE
+ *      Devuelve true si es una de las magnitudes que se guardan.
+ *      Devuelve false en caso contrario.
+ */
+bool MeterHistory::series_of(int measurand, int unit, enum meter_series_t &series, double &scale)
+{
+    if (measurand == -1)
+        measurand = MEASURAND_ENERGY_ACTIVE_IMPORT_REGISTER;
+
+    scale = 1;
+    switch (measurand) {
+        case MEASURAND_POWER_ACTIVE_IMPORT:
+            series = METER_POWER;
+            if (unit == UNIT_K_W)
+                scale = 1000;
+            return unit == -1 || unit == UNIT_W || unit == UNIT_K_W;
+        case MEASURAND_CURRENT_IMPORT:
+            series = METER_CURRENT;
+            return unit == -1 || unit == UNIT_A;
+        case MEASURAND_ENERGY_ACTIVE_IMPORT_REGISTER:
+            series = METER_ENERGY;
+            if (unit == UNIT_K_WH)
+                scale = 1000;
+            return unit == -1 || unit == UNIT_WH || unit == UNIT_K_WH;
+        case MEASURAND_VOLTAGE:
+            series = METER_VOLTAGE;
+            return unit == -1 || unit == UNIT_V;
+        case MEASURAND_SO_C:
+            series = METER_SOC;
+            return unit == -1 || unit == UNIT_PERCENT;
+        default:
+            return false;
+    }
+}
+
+/*
+ *  NAME
+ *      add - Guarda una muestra.
+ *  SYNOPSIS
+ *      void add(int charger_id, int connector, enum meter_series_t series, time_t time, double value);
+ *  DESCRIPTION
+ *      Guarda una muestra de una magnitud de un conector. Si el buffer está lleno, la nueva
+ *      muestra sustituye a la más antigua. Solo la puede llamar el thread del cargador.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void MeterHistory::add(int charger_id, int connector, enum meter_series_t series, time_t time, double value)
+{
+    int i = ring_index(charger_id, connector, series);
+    if (i < 0)
+        return;
+
+    Ring *r = rings[i].load(memory_order_acquire);
+    if (r == NULL) {
+        Ring *fresh = new Ring();
+        if (rings[i].compare_exchange_strong(r, fresh, memory_order_acq_rel))
+            r = fresh;
+        else
+            delete fresh;
+    }
+
+    // como en SeqLock: primero se anuncia la posición que se va a sobrescribir y después se escribe
+    uint64_t n = r->claimed.load(memory_order_relaxed);
+    r->claimed.store(n + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    r->samples[n % METER_HISTORY_LEN].store(pack((uint32_t)time, (float)value), memory_order_relaxed);
+    r->written.store(n + 1, memory_order_release);
+}
+
+/*
+ *  NAME
+ *      decimate - Reduce un intervalo a un mínimo y un máximo por columna.
+ *  SYNOPSIS
+ *      int decimate(int charger_id, int connector, enum meter_series_t series, time_t from, time_t to,
+ *                   int buckets, float *mins, float *maxs) const;
+ *  DESCRIPTION
+ *      Divide el intervalo [from, to) en buckets columnas iguales (normalmente una por píxel) y
+ *      guarda en mins[i] y maxs[i] el mínimo y el máximo de las muestras de la columna i, o NAN
+ *      si la columna no tiene ninguna. Recorre las muestras una sola vez, así el coste depende
+ *      del número de muestras y no de las columnas. Solo lee la memoria.
+ *  RETURN VALUE
+ *      El número de columnas con alguna muestra.
+ */
+int MeterHistory::decimate(int charger_id, int connector, enum meter_series_t series, time_t from, time_t to,
+                           int buckets, float *mins, float *maxs) const
+{
+    for (int i = 0; i < buckets; i++)
+        mins[i] = maxs[i] = NAN;
+
+    Ring *r = ring(charger_id, connector, series);
+    if (r == NULL || buckets <= 0 || to <= from)
+        return 0;
+
+    int64_t span = to - from;
+    int filled = 0;
+
+    scan(*r, [&](const struct MeterSample &s) {
+        if (s.time < from || s.time >= to)
+            return;
+
+        int b = (int)(((int64_t)s.time - from) * buckets / span);
+        if (std::isnan(mins[b])) {
+            mins[b] = maxs[b] = s.value;
+            filled++;
+        }
+        else if (s.value < mins[b])
+            mins[b] = s.value;
+        else if (s.value > maxs[b])
+            maxs[b] = s.value;
+    });
+
+    return filled;
+}
+
+/*
+ *  NAME
+ *      last - Devuelve la última muestra.
+ *  SYNOPSIS
+ *      bool last(int charger_id, int connector, enum meter_series_t series, struct MeterSample &sample) const;
+ *  DESCRIPTION
+ *      Copia en sample la última muestra recibida de una magnitud de un conector.
+ *  RETURN VALUE
+ *      Devuelve true si hay alguna muestra.
+ *      Devuelve false en caso contrario.
+ */
+bool MeterHistory::last(int charger_id, int connector, enum meter_series_t series, struct MeterSample &sample) const
+{
+    Ring *r = ring(charger_id, connector, series);
+    if (r == NULL)
+        return false;
+
+    for (;;) {
+        uint64_t end = r->written.load(memory_order_acquire);
+        if (end == 0)
+            return false;
+
+        uint64_t word = r->samples[(end - 1) % METER_HISTORY_LEN].load(memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (r->claimed.load(memory_order_relaxed) <= end - 1 + METER_HISTORY_LEN) {
+            sample = unpack(word);
+            return true;
+        }
+    }
+}
+
+/*
+ *  NAME
+ *      query - Devuelve las muestras de un intervalo.
+ *  SYNOPSIS
+ *      size_t query(int charger_id, int connector, enum meter_series_t series, time_t from, time_t to,
+ *                   vector<MeterSample> &dest) const;
+ *  DESCRIPTION
+ *      Copia en dest, ordenadas por hora, las muestras del intervalo [from, to). Las que están
+ *      en memoria no van a la base de datos: solo se consulta la tabla meter_values para la
+ *      parte del intervalo anterior a la muestra más antigua que hay en memoria (p.ej. después
+ *      de reiniciar o si el intervalo va más atrás que METER_HISTORY_LEN muestras).
+ *  RETURN VALUE
+ *      El número de muestras copiadas.
+ */
+size_t MeterHistory::query(int charger_id, int connector, enum meter_series_t series, time_t from, time_t to,
+                           vector<MeterSample> &dest) const
+{
+    dest.clear();
+    if (to <= from)
+        return 0;
+
+    uint32_t oldest = UINT32_MAX;
+    Ring *r = ring(charger_id, connector, series);
+    if (r)
+        read_ram(*r, from, to, dest, oldest);
+
+    if (from < (time_t)oldest)
+        read_db(charger_id, connector, series, from, min(to, (time_t)oldest), dest);
+
+    stable_sort(dest.begin(), dest.end(), [](const struct MeterSample &a, const struct MeterSample &b) {
+        return a.time < b.time;
+    });
+
+    return dest.size();
+}
+
+/*
+ *  NAME
+ *      read_ram - Lee las muestras de un intervalo de un buffer.
+ *  SYNOPSIS
+ *      size_t read_ram(const Ring &r, time_t from, time_t to, vector<MeterSample> &dest, uint32_t &oldest) const;
+ *  DESCRIPTION
+ *      Añade a dest las muestras del buffer r del intervalo [from, to) y guarda en oldest la
+ *      hora de la muestra más antigua del buffer (UINT32_MAX si está vacío): a partir de esa
+ *      hora la memoria tiene todas las muestras.
+ *  RETURN VALUE
+ *      El número de muestras añadidas.
+ */
+size_t MeterHistory::read_ram(const Ring &r, time_t from, time_t to, vector<MeterSample> &dest, uint32_t &oldest) const
+{
+    size_t before = dest.size();
+
+    scan(r, [&](const struct MeterSample &s) {
+        oldest = min(oldest, s.time);
+        if (s.time >= from && s.time < to)
+            dest.push_back(s);
+    });
+
+    return dest.size() - before;
+}
+
+/*
+ *  NAME
+ *      read_db - Lee las muestras de un intervalo de la base de datos.
+ *  SYNOPSIS
+ *      size_t read_db(int charger_id, int connector, enum meter_series_t series, time_t from, time_t to,
+ *                     vector<MeterSample> &dest) const;
+ *  DESCRIPTION
+ *      Añade a dest las muestras de la tabla meter_values del intervalo [from, to), pasadas a
+ *      la unidad de la magnitud. La tabla no guarda la fase, así que aquí también salen los
+ *      valores por fase que la memoria descarta. La hora de cada fila es el timestamp del
+ *      cargador, con su zona horaria: primero se acota como texto con un día de margen por
+ *      lado, con el índice (charger_id, connector, hora), y luego se compara en UTC.
+ *  RETURN VALUE
+ *      El número de muestras añadidas.
+ */
+size_t MeterHistory::read_db(int charger_id, int connector, enum meter_series_t series, time_t from, time_t to,
+                             vector<MeterSample> &dest) const
+{
+    sqlite3 *db;
+    if (sqlite3_open(database_path(), &db) != SQLITE_OK) {
+        syslog(LOG_ERR, "%s: ERROR opening SQLite DB: %s\n", __func__, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return 0;
+    }
+
+    // strftime('%s') entiende el timestamp OCPP con zona horaria; measurand vacío es Energy.Active.Import.Register
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT CAST(strftime('%s', hora) AS INTEGER) AS t, valor, unit FROM meter_values "
+                               "WHERE charger_id = ? AND connector = ? AND hora >= ? AND hora < ? "
+                               "AND (measurand = ? OR (? AND measurand = '')) "
+                               "AND t >= ? AND t < ? ORDER BY t LIMIT ?;", -1, &stmt, NULL) != SQLITE_OK) {
+
+        syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return 0;
+    }
+
+    // intervalo de texto de la hora, con margen para cualquier zona horaria
+    char hora_from[32], hora_to[32];
+    time_t first = from - 24 * 3600, last = to + 24 * 3600;
+    struct tm tm;
+    strftime(hora_from, sizeof(hora_from), "%Y-%m-%dT%H:%M:%S", gmtime_r(&first, &tm));
+    strftime(hora_to, sizeof(hora_to), "%Y-%m-%dT%H:%M:%S", gmtime_r(&last, &tm));
+
+    sqlite3_bind_int(stmt, 1, charger_id);
+    sqlite3_bind_int(stmt, 2, connector);
+    sqlite3_bind_text(stmt, 3, hora_from, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, hora_to, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, db_measurand[series], -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 6, series == METER_ENERGY);
+    sqlite3_bind_int64(stmt, 7, from);
+    sqlite3_bind_int64(stmt, 8, to);
+    sqlite3_bind_int(stmt, 9, METER_DB_MAX_ROWS);
+
+    size_t before = dest.size();
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *unit = (const char *)sqlite3_column_text(stmt, 2);
+        double value = sqlite3_column_double(stmt, 1);
+        if (unit && (strcmp(unit, "kW") == 0 || strcmp(unit, "kwH") == 0))
+            value *= 1000;
+
+        dest.push_back({(uint32_t)sqlite3_column_int64(stmt, 0), (float)value});
+    }
+
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+
+    return dest.size() - before;
+}
@@ -0,0 +1,89 @@
+/*
+ *  FILE
+ *      meter_history.h - header de meter_history.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de meter_history.cpp, declaración del histórico en memoria de los MeterValues
+ *      recientes de cada conector.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _METER_HISTORY_H_
+#define _METER_HISTORY_H_
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <vector>
+
+#define METER_HISTORY_LEN 14400 // muestras por conector y magnitud: 4 horas a una muestra por segundo
+
+using namespace std;
+
+// magnitudes que se guardan de cada conector
+enum meter_series_t {
+    METER_POWER,   // Power.Active.Import, en W
+    METER_CURRENT, // Current.Import, en A
+    METER_ENERGY,  // Energy.Active.Import.Register, en Wh
+    METER_VOLTAGE, // Voltage, en V
+    METER_SOC,     // SoC, en %
+    METER_SERIES
+};
+
+// una muestra: 8 bytes, la hora en segundos (sin signo, vale hasta 2106)
+struct MeterSample {
+    uint32_t time;
+    float value;
+};
+
+/*
+ * Últimas METER_HISTORY_LEN muestras de cada magnitud de cada conector, en un buffer circular de
+ * medida fija que se reserva con la primera muestra (así la memoria por conector no crece). Las
+ * muestras se guardan en el orden en que llegan. Para dibujar, decimate() reduce un intervalo a
+ * un mínimo y un máximo por columna de píxeles recorriendo las muestras una sola vez.
+ *
+ * No hay mutex: cada buffer tiene un solo escritor (el thread del cargador, que procesa sus
+ * MeterValues en orden) y los lectores nunca lo bloquean. Como en SeqLock, el escritor anuncia
+ * en claimed la posición que va a sobrescribir antes de escribirla, y el lector descarta las
+ * muestras que se han podido sobrescribir mientras las leía.
+ *
+ * query() es la consulta para cualquier intervalo: lo que está en memoria se lee de aquí y solo
+ * la parte anterior a la muestra más antigua en memoria se pide a la base de datos.
+ */
+class MeterHistory {
+public:
+    MeterHistory();
+    ~MeterHistory();
+
+    void add(int charger_id, int connector, enum meter_series_t series, time_t time, double value);
+    int decimate(int charger_id, int connector, enum meter_series_t series, time_t from, time_t to,
+                 int buckets, float *mins, float *maxs) const; // mínimo y máximo de cada columna
+    bool last(int charger_id, int connector, enum meter_series_t series, struct MeterSample &sample) const;
+    size_t query(int charger_id, int connector, enum meter_series_t series, time_t from, time_t to,
+                 vector<MeterSample> &dest) const; // memoria y, si no llega, base de datos
+
+    static bool series_of(int measurand, int unit, enum meter_series_t &series, double &scale);
+private:
+    struct Ring {
+        atomic<uint64_t> samples[METER_HISTORY_LEN]; // hora << 32 | bits del float
+        atomic<uint64_t> claimed{0};                 // muestras empezadas a escribir
+        atomic<uint64_t> written{0};                 // muestras escritas del todo
+    };
+
+    Ring *ring(int charger_id, int connector, enum meter_series_t series) const;
+    size_t read_ram(const Ring &r, time_t from, time_t to, vector<MeterSample> &dest, uint32_t &oldest) const;
+    size_t read_db(int charger_id, int connector, enum meter_series_t series, time_t from, time_t to,
+                   vector<MeterSample> &dest) const;
+
+    unique_ptr<atomic<Ring *>[]> rings; // un buffer por cargador, conector y magnitud, NULL hasta la primera muestra
+};
+
+// histórico de los MeterValues de todo el sistema
+extern MeterHistory meter_history;
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ *  FILE
+ *      ocpp_task.h - tipo de retorno de las corutinas del sistema
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Task<T>: corutina de C++20 que devuelve un T y que se puede esperar con co_await desde
+ *      otra corutina o lanzar sin esperarla con detach(). Delay: espera sin bloquear ningún thread.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _OCPP_TASK_H_
+#define _OCPP_TASK_H_
+
+#include <coroutine>
+#include <optional>
+#include <exception>
+#include <utility>
+#include <thread>
+#include <chrono>
+
+using namespace std;
+
+/*
+ * Parte común de las promesas de Task: la corutina empieza suspendida y, al terminar, continúa
+ * la corutina que la esperaba (si hay) o se destruye sola si se ha lanzado con detach().
+ * El sistema no usa excepciones, así que una excepción dentro de una corutina termina el programa.
+ */
+struct TaskPromiseBase {
+    coroutine_handle<> continuation; // corutina que ha hecho co_await de esta
+    bool detached = false;           // lanzada con detach(), nadie espera el resultado
+
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+
+        template <typename Promise>
+        coroutine_handle<> await_suspend(coroutine_handle<Promise> h) noexcept
+        {
+            TaskPromiseBase &p = h.promise();
+            if (p.continuation)
+                return p.continuation;
+            if (p.detached)
+                h.destroy();
+            return noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() const noexcept { terminate(); }
+};
+
+template <typename T>
+class Task;
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    optional<T> value;
+
+    Task<T> get_return_object();
+    void return_value(T v) { value = std::move(v); }
+    T result() { return std::move(*value); }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object();
+    void return_void() const noexcept {}
+    void result() const noexcept {}
+};
+
+/*
+ * Corutina que devuelve un T. No empieza hasta que se espera con co_await (y entonces la corutina
+ * que espera se suspende hasta que esta termina) o hasta que se lanza con detach(). Solo se puede
+ * mover, y si se destruye sin haberse lanzado se destruye también la corutina.
+ */
+template <typename T>
+class Task {
+public:
+    using promise_type = TaskPromise<T>;
+
+    explicit Task(coroutine_handle<promise_type> h) : handle{h} {}
+    Task(Task &&other) noexcept : handle{std::exchange(other.handle, nullptr)} {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task()
+    {
+        if (handle)
+            handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    coroutine_handle<> await_suspend(coroutine_handle<> caller) noexcept
+    {
+        handle.promise().continuation = caller;
+        return handle; // empieza la corutina en este mismo thread
+    }
+
+    T await_resume() { return handle.promise().result(); }
+
+    /*
+     *  NAME
+     *      detach - Lanza la corutina sin esperar el resultado.
+     *  SYNOPSIS
+     *      void detach();
+     *  DESCRIPTION
+     *      Empieza la corutina en el thread que llama. Se ejecuta hasta el primer co_await que
+     *      suspende y sigue en el thread que la reanude; al terminar se destruye sola.
+     *  RETURN VALUE
+     *      Nada.
+     */
+    void detach()
+    {
+        coroutine_handle<promise_type> h = std::exchange(handle, nullptr);
+        h.promise().detached = true;
+        h.resume();
+    }
+private:
+    coroutine_handle<promise_type> handle;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object()
+{
+    return Task<T>(coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+    return Task<void>(coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+/*
+ * co_await Delay(ms) suspende la corutina durante ms y la reanuda desde un thread que solo
+ * duerme, así no ocupa el thread que la estaba ejecutando (p.ej. el de un cargador). Después
+ * la corutina sigue en ese thread hasta el siguiente co_await.
+ */
+class Delay {
+public:
+    explicit Delay(chrono::milliseconds ms) : ms{ms} {}
+
+    bool await_ready() const noexcept { return ms.count() <= 0; }
+
+    void await_suspend(coroutine_handle<> h) const
+    {
+        thread([h, ms = ms]() {
+            this_thread::sleep_for(ms);
+            h.resume();
+        }).detach();
+    }
+
+    void await_resume() const noexcept {}
+private:
+    chrono::milliseconds ms;
+};
+
+#endif
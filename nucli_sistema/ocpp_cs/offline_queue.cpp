@@ -0,0 +1,521 @@
+/*
+ *  FILE
+ *      offline_queue.cpp - peticiones para cargadores desconectados
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Guarda en la base de datos las peticiones del operador a cargadores que no están conectados
+ *      y se las envía, por orden, cuando se acepta su BootNotification.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <ctime>
+#include <chrono>
+#include <syslog.h>
+#include <sqlite3.h>
+#include "offline_queue.h"
+#include "charger.h"
+#include "ws_server.h"
+
+using namespace std;
+
+OfflineQueue offline_queue;
+
+static sqlite3 *open_queue_table(const char *db_path);
+static void upgrade_queue_table(const char *db_path);
+static bool is_online(Charger *charger);
+static Charger *find_charger(const string &identity);
+
+/*
+ *  NAME
+ *      start - Arranca la cola persistente.
+ *  SYNOPSIS
+ *      void start(const string &db_path);
+ *  DESCRIPTION
+ *      Elimina las peticiones caducadas, cuenta las que quedan de cada cargador (las de antes
+ *      de reiniciar el sistema) y arranca los OFFLINE_DRAIN_WORKERS threads que las envían.
+ *      Las tablas de versiones anteriores, sin la identidad del cargador, se actualizan.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void OfflineQueue::start(const string &db_path)
+{
+    lock_guard<mutex> lock(mtx);
+
+    if (!threads.empty())
+        return;
+
+    this->db_path = db_path;
+    upgrade_queue_table(db_path.c_str());
+    purge_expired();
+
+    for (auto &elem : pending_count) {
+        if (elem.second)
+            syslog(LOG_INFO, "%s: cargador %s, %zu peticiones guardadas", __func__, elem.first.c_str(), elem.second);
+    }
+
+    for (int i = 0; i < OFFLINE_DRAIN_WORKERS; i++) {
+        threads.emplace_back(&OfflineQueue::drain_loop, this);
+        threads.back().detach();
+    }
+}
+
+/*
+ *  NAME
+ *      submit - Envía o guarda una petición.
+ *  SYNOPSIS
+ *      bool submit(Charger *charger, int option, const string &payload, function<void(const struct CallResult &)> done);
+ *  DESCRIPTION
+ *      Si el cargador está conectado y aceptado y no tiene peticiones guardadas, pone la petición
+ *      en su cola (enqueue_request) y done se llama con la respuesta. Si no, la guarda en la base
+ *      de datos con la identidad del cargador detrás de las que ya tiene, para que se envíen por
+ *      orden, y done se llama enseguida con CALL_PENDING (o CALL_NOT_SENT si no se ha podido
+ *      guardar o si aún no se conoce la identidad del cargador de esa posición): la respuesta de
+ *      una petición guardada no se devuelve a nadie.
+ *  RETURN VALUE
+ *      Devuelve true si la petición se ha puesto en la cola o se ha guardado.
+ *      Devuelve false si no se ha podido guardar.
+ */
+bool OfflineQueue::submit(Charger *charger, int option, const string &payload, function<void(const struct CallResult &)> done)
+{
+    int charger_id = charger->get_charger_id();
+    string identity = charger->get_identity();
+    bool online = is_online(charger);
+
+    unique_lock<mutex> lock(mtx);
+
+    if (online && (identity.empty() || pending_count[identity] == 0)) {
+        lock.unlock();
+        charger->enqueue_request(option, payload, done);
+        return true;
+    }
+
+    if (identity.empty() || !persist(charger_id, identity, option, payload)) {
+        lock.unlock();
+        if (identity.empty())
+            syslog(LOG_WARNING, "%s: no se conoce el cargador %d, la petición no se puede guardar", __func__, charger_id);
+        if (done)
+            done({CALL_NOT_SENT, ""});
+        return false;
+    }
+
+    pending_count[identity]++;
+    syslog(LOG_INFO, "%s: cargador %s %s, petición guardada (%zu pendientes)", __func__, identity.c_str(),
+           online ? "con peticiones pendientes" : "desconectado", pending_count[identity]);
+
+    if (online) // conectado pero aún vaciando las guardadas
+        schedule(identity);
+    lock.unlock();
+
+    if (done)
+        done({CALL_PENDING, ""});
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      charger_accepted - Avisa de que se ha aceptado el BootNotification de un cargador.
+ *  SYNOPSIS
+ *      void charger_accepted(const string &identity);
+ *  DESCRIPTION
+ *      Si el cargador con esta identidad tiene peticiones guardadas, lo pone en la cola de
+ *      cargadores a vaciar.
+ *      No envía nada desde el thread que llama (el del cargador), que tiene que contestar
+ *      el BootNotification primero.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void OfflineQueue::charger_accepted(const string &identity)
+{
+    lock_guard<mutex> lock(mtx);
+
+    if (!identity.empty() && pending_count[identity])
+        schedule(identity);
+}
+
+/*
+ *  NAME
+ *      pending - Devuelve las peticiones guardadas de un cargador.
+ *  SYNOPSIS
+ *      size_t pending(const string &identity);
+ *  DESCRIPTION
+ *      Devuelve cuántas peticiones guardadas esperan a que el cargador se conecte.
+ *  RETURN VALUE
+ *      El número de peticiones.
+ */
+size_t OfflineQueue::pending(const string &identity)
+{
+    lock_guard<mutex> lock(mtx);
+
+    auto it = pending_count.find(identity);
+
+    return it == pending_count.end() ? 0 : it->second;
+}
+
+/*
+ *  NAME
+ *      schedule - Pone un cargador en la cola de cargadores a vaciar.
+ *  SYNOPSIS
+ *      void schedule(const string &identity);
+ *  DESCRIPTION
+ *      Pone un cargador en la cola de cargadores a vaciar si no está ya. Se llama con el mutex cogido.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void OfflineQueue::schedule(const string &identity)
+{
+    if (scheduled.insert(identity).second) {
+        drain_queue.push_back(identity);
+        cv.notify_one();
+    }
+}
+
+/*
+ *  NAME
+ *      drain_loop - Bucle de un thread de envío de peticiones guardadas.
+ *  SYNOPSIS
+ *      void drain_loop();
+ *  DESCRIPTION
+ *      Va cogiendo cargadores de la cola de cargadores a vaciar y les envía sus peticiones.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void OfflineQueue::drain_loop()
+{
+    for (;;) {
+        string identity;
+        {
+            unique_lock<mutex> lock(mtx);
+            cv.wait(lock, [this] { return !drain_queue.empty(); });
+            identity = drain_queue.front();
+            drain_queue.pop_front();
+        }
+
+        drain(identity);
+    }
+}
+
+/*
+ *  NAME
+ *      drain - Envía a un cargador sus peticiones guardadas.
+ *  SYNOPSIS
+ *      void drain(const string &identity);
+ *  DESCRIPTION
+ *      Envía las peticiones guardadas de un cargador por orden, esperando la respuesta de cada una
+ *      y haciendo una pausa de OFFLINE_DRAIN_PAUSE_MS entre ellas. Una petición se elimina cuando el
+ *      cargador la contesta (también con un CALLERROR). Si el cargador se desconecta, deja de tener
+ *      esa identidad o no contesta, se para y las que quedan se envían en el próximo BootNotification
+ *      aceptado.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void OfflineQueue::drain(const string &identity)
+{
+    Charger *charger = find_charger(identity);
+    size_t sent = 0;
+
+    {
+        lock_guard<mutex> lock(mtx);
+        purge_expired();
+    }
+
+    for (;;) {
+        int64_t row_id;
+        int option;
+        string payload;
+        {
+            // se busca con el mutex cogido, de manera que submit no puede guardar una petición
+            // mientras se decide que el cargador ya no tiene ninguna
+            lock_guard<mutex> lock(mtx);
+
+            bool found = load_next(identity, row_id, option, payload);
+            if (!found)
+                pending_count[identity] = 0;
+
+            if (!found || charger == NULL || !is_online(charger) || charger->get_identity() != identity) {
+                scheduled.erase(identity);
+                break;
+            }
+        }
+
+        struct CallResult result = charger->send_request(option, payload);
+        if (result.status != CALL_ANSWERED && result.status != CALL_ERROR) {
+            syslog(LOG_WARNING, "%s: cargador %s no contesta, quedan %zu peticiones guardadas",
+                   __func__, identity.c_str(), pending(identity));
+            lock_guard<mutex> lock(mtx);
+            scheduled.erase(identity);
+            break;
+        }
+
+        remove(row_id);
+        sent++;
+        {
+            lock_guard<mutex> lock(mtx);
+            if (pending_count[identity])
+                pending_count[identity]--;
+        }
+
+        this_thread::sleep_for(chrono::milliseconds(OFFLINE_DRAIN_PAUSE_MS));
+    }
+
+    if (sent)
+        syslog(LOG_INFO, "%s: cargador %s, %zu peticiones guardadas enviadas", __func__, identity.c_str(), sent);
+}
+
+/*
+ *  NAME
+ *      persist - Guarda una petición en la base de datos.
+ *  SYNOPSIS
+ *      bool persist(int charger_id, const string &identity, int option, const string &payload);
+ *  DESCRIPTION
+ *      Guarda una petición en la tabla comandes_pendents, que caduca en OFFLINE_COMMAND_TTL segundos.
+ *      charger_id (la posición del cargador al guardarla) solo es informativo.
+ *  RETURN VALUE
+ *      Devuelve true si todo va bien.
+ *      Devuelve false en caso de error.
+ */
+bool OfflineQueue::persist(int charger_id, const string &identity, int option, const string &payload)
+{
+    sqlite3 *db = open_queue_table(db_path.c_str());
+    if (db == NULL)
+        return false;
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "INSERT INTO comandes_pendents(charger_id, identitat, opcio, payload, caducitat) VALUES(?, ?, ?, ?, ?);",
+        -1, &stmt, NULL) != SQLITE_OK) {
+
+        syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return false;
+    }
+
+    sqlite3_bind_int(stmt, 1, charger_id);
+    sqlite3_bind_text(stmt, 2, identity.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 3, option);
+    sqlite3_bind_text(stmt, 4, payload.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 5, time(NULL) + OFFLINE_COMMAND_TTL);
+
+    bool ok = (sqlite3_step(stmt) == SQLITE_DONE);
+    if (!ok)
+        syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, sqlite3_errmsg(db));
+
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+
+    return ok;
+}
+
+/*
+ *  NAME
+ *      load_next - Lee la petición guardada más antigua de un cargador.
+ *  SYNOPSIS
+ *      bool load_next(const string &identity, int64_t &row_id, int &option, string &payload);
+ *  DESCRIPTION
+ *      Lee la petición más antigua que aún no ha caducado de un cargador.
+ *  RETURN VALUE
+ *      Devuelve true si hay alguna.
+ *      Devuelve false si no hay ninguna o en caso de error.
+ */
+bool OfflineQueue::load_next(const string &identity, int64_t &row_id, int &option, string &payload)
+{
+    sqlite3 *db = open_queue_table(db_path.c_str());
+    if (db == NULL)
+        return false;
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT id, opcio, payload FROM comandes_pendents WHERE identitat = ? AND caducitat > ? "
+                               "ORDER BY id LIMIT 1;", -1, &stmt, NULL) != SQLITE_OK) {
+
+        syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return false;
+    }
+
+    sqlite3_bind_text(stmt, 1, identity.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, time(NULL));
+
+    bool found = false;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        found = true;
+        row_id = sqlite3_column_int64(stmt, 0);
+        option = sqlite3_column_int(stmt, 1);
+        payload = sqlite3_column_text(stmt, 2) ? reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2)) : "";
+    }
+
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+
+    return found;
+}
+
+/*
+ *  NAME
+ *      remove - Elimina una petición guardada.
+ *  SYNOPSIS
+ *      void remove(int64_t row_id);
+ *  DESCRIPTION
+ *      Elimina una petición de la tabla comandes_pendents una vez enviada.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void OfflineQueue::remove(int64_t row_id)
+{
+    sqlite3 *db = open_queue_table(db_path.c_str());
+    if (db == NULL)
+        return;
+
+    char query[128];
+    snprintf(query, sizeof(query), "DELETE FROM comandes_pendents WHERE id = %lld;", static_cast<long long>(row_id));
+
+    char *errmsg;
+    if (sqlite3_exec(db, query, 0, 0, &errmsg) != SQLITE_OK) {
+        syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, errmsg);
+        sqlite3_free(errmsg);
+    }
+
+    sqlite3_close(db);
+}
+
+/*
+ *  NAME
+ *      purge_expired - Elimina las peticiones caducadas.
+ *  SYNOPSIS
+ *      void purge_expired();
+ *  DESCRIPTION
+ *      Elimina las peticiones caducadas y vuelve a contar las de cada cargador.
+ *      Se llama con el mutex cogido.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void OfflineQueue::purge_expired()
+{
+    sqlite3 *db = open_queue_table(db_path.c_str());
+    if (db == NULL)
+        return;
+
+    char query[128];
+    snprintf(query, sizeof(query), "DELETE FROM comandes_pendents WHERE caducitat <= %lld;", static_cast<long long>(time(NULL)));
+    if (sqlite3_exec(db, query, 0, 0, NULL) == SQLITE_OK && sqlite3_changes(db) > 0)
+        syslog(LOG_INFO, "%s: %d peticiones guardadas caducadas", __func__, sqlite3_changes(db));
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT identitat, COUNT(*) FROM comandes_pendents GROUP BY identitat;",
+        -1, &stmt, NULL) == SQLITE_OK) {
+
+        pending_count.clear();
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char *identity = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+            pending_count[identity ? identity : ""] = sqlite3_column_int64(stmt, 1);
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    sqlite3_close(db);
+}
+
+/*
+ *  NAME
+ *      open_queue_table - Abre la base de datos con la tabla comandes_pendents.
+ *  SYNOPSIS
+ *      static sqlite3 *open_queue_table(const char *db_path);
+ *  DESCRIPTION
+ *      Abre la base de datos y crea la tabla comandes_pendents si no existe.
+ *  RETURN VALUE
+ *      Si todo va bien, devuelve la base de datos abierta.
+ *      En caso contrario, retorna NULL.
+ */
+static sqlite3 *open_queue_table(const char *db_path)
+{
+    sqlite3 *db;
+    if (sqlite3_open(db_path, &db) != SQLITE_OK) {
+        syslog(LOG_ERR, "%s: ERROR opening SQLite DB: %s\n", __func__, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return NULL;
+    }
+
+    char *errmsg;
+    if (sqlite3_exec(db, "CREATE TABLE IF NOT EXISTS comandes_pendents (id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                         "charger_id INTEGER NOT NULL, identitat TEXT NOT NULL DEFAULT '', opcio INTEGER NOT NULL, payload TEXT NOT NULL, "
+                         "caducitat INTEGER NOT NULL);", 0, 0, &errmsg) != SQLITE_OK) {
+
+        syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, errmsg);
+        sqlite3_free(errmsg);
+        sqlite3_close(db);
+        return NULL;
+    }
+
+    return db;
+}
+
+/*
+ *  NAME
+ *      upgrade_queue_table - Añade la identidad del cargador a una tabla comandes_pendents antigua.
+ *  SYNOPSIS
+ *      static void upgrade_queue_table(const char *db_path);
+ *  DESCRIPTION
+ *      Las versiones anteriores guardaban las peticiones solo con la posición del cargador, que no
+ *      dice a qué cargador iban. Si la tabla no tiene la columna identitat se añade y se descartan
+ *      las peticiones que ya había.
+ *  RETURN VALUE
+ *      Nada.
+ */
+static void upgrade_queue_table(const char *db_path)
+{
+    sqlite3 *db = open_queue_table(db_path);
+    if (db == NULL)
+        return;
+
+    if (sqlite3_exec(db, "SELECT identitat FROM comandes_pendents LIMIT 0;", 0, 0, NULL) != SQLITE_OK) {
+        char *errmsg;
+        if (sqlite3_exec(db, "ALTER TABLE comandes_pendents ADD COLUMN identitat TEXT NOT NULL DEFAULT '';"
+                             "DELETE FROM comandes_pendents;", 0, 0, &errmsg) != SQLITE_OK) {
+            syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, errmsg);
+            sqlite3_free(errmsg);
+        }
+        else if (sqlite3_changes(db) > 0)
+            syslog(LOG_WARNING, "%s: %d peticiones guardadas sin la identidad del cargador descartadas", __func__, sqlite3_changes(db));
+    }
+
+    sqlite3_close(db);
+}
+
+/*
+ *  NAME
+ *      is_online - Indica si un cargador puede recibir peticiones.
+ *  SYNOPSIS
+ *      static bool is_online(Charger *charger);
+ *  DESCRIPTION
+ *      Indica si un cargador está conectado y se ha aceptado su BootNotification.
+ *  RETURN VALUE
+ *      Devuelve true si puede recibir peticiones.
+ *      Devuelve false en caso contrario.
+ */
+static bool is_online(Charger *charger)
+{
+    return charger->get_client() != static_cast<ws_cli_conn_t>(-1) && charger->get_boot().status == STATUS_BOOT_ACCEPTED;
+}
+
+/*
+ *  NAME
+ *      find_charger - Busca el cargador conectado con una identidad.
+ *  SYNOPSIS
+ *      static Charger *find_charger(const string &identity);
+ *  DESCRIPTION
+ *      Busca entre las posiciones de cargador el que está conectado y aceptado con esta identidad.
+ *  RETURN VALUE
+ *      El cargador, NULL si no hay ninguno.
+ */
+static Charger *find_charger(const string &identity)
+{
+    for (int i = 1; i <= MAX_CHARGERS; i++) {
+        Charger *charger = get_charger(i);
+        if (charger && is_online(charger) && charger->get_identity() == identity)
+            return charger;
+    }
+
+    return NULL;
+}
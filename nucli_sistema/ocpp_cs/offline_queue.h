@@ -0,0 +1,76 @@
+/*
+ *  FILE
+ *      offline_queue.h - header de offline_queue.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de offline_queue.cpp, declaración de la cola persistente de peticiones
+ *      para los cargadores que no están conectados.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _OFFLINE_QUEUE_H_
+#define _OFFLINE_QUEUE_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+#include <functional>
+
+#define OFFLINE_COMMAND_TTL    86400 // segundos que se guarda una petición para un cargador desconectado
+#define OFFLINE_DRAIN_WORKERS  2     // cargadores a los que se envían las peticiones guardadas a la vez
+#define OFFLINE_DRAIN_PAUSE_MS 50    // pausa entre dos peticiones guardadas de un mismo cargador
+
+using namespace std;
+
+class Charger;
+struct CallResult;
+
+/*
+ * Cola persistente de las peticiones del operador a cargadores que no están conectados (o que aún
+ * no han sido aceptados). Las peticiones se guardan en la tabla comandes_pendents de la base de
+ * datos con una caducidad, de manera que no se pierden si se reinicia el sistema. Las peticiones van
+ * con la identidad del cargador (Charger::get_identity) y no con su posición, que cambia en cada
+ * conexión. Cuando se acepta el BootNotification de un cargador, las peticiones guardadas para su
+ * identidad se le envían por orden, esté en la posición que esté. Solo se vacían
+ * OFFLINE_DRAIN_WORKERS cargadores a la vez y con una pausa entre peticiones, para que una
+ * reconexión masiva no deje sin recursos a los mensajes que envían los cargadores.
+ */
+class OfflineQueue {
+public:
+    void start(const string &db_path); // carga las peticiones guardadas y arranca los threads
+    bool submit(Charger *charger, int option, const string &payload,
+                function<void(const struct CallResult &)> done = nullptr); // envía o guarda una petición
+    void charger_accepted(const string &identity); // el cargador ya puede recibir sus peticiones guardadas
+    size_t pending(const string &identity); // peticiones guardadas de un cargador
+private:
+    bool persist(int charger_id, const string &identity, int option, const string &payload);
+    bool load_next(const string &identity, int64_t &row_id, int &option, string &payload);
+    void remove(int64_t row_id);
+    void purge_expired();
+    void schedule(const string &identity); // se llama con el mutex cogido
+    void drain_loop();
+    void drain(const string &identity);
+
+    string db_path;
+    mutex mtx;
+    condition_variable cv;
+    unordered_map<string, size_t> pending_count; // identidad -> peticiones guardadas
+    deque<string> drain_queue;                   // cargadores esperando a ser vaciados
+    set<string> scheduled;                       // cargadores en drain_queue o vaciándose
+    vector<thread> threads;
+};
+
+// cola de peticiones de todo el sistema
+extern OfflineQueue offline_queue;
+
+#endif
@@ -0,0 +1,357 @@
+/*
+ *  FILE
+ *      policies.cpp - listas de autorización del sistema
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Las listas de autorización (idTags, chargePointModels y chargePointVendors) se publican
+ *      como snapshots inmutables. Los threads de los cargadores las leen sin locks y un
+ *      administrador las puede recargar de la base de datos en cualquier momento: el snapshot
+ *      nuevo se construye aparte, se publica con un intercambio atómico del puntero y el anterior
+ *      se libera cuando ningún lector lo está usando (reclamación por épocas, estilo RCU).
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <syslog.h>
+#include <sqlite3.h>
+#include "policies.h"
+
+#define MAX_POLICY_READERS 128 // threads que pueden leer las listas a la vez
+
+using namespace std;
+
+// posición de la tabla de lectores, una por thread lector
+struct alignas(64) reader_slot_t {
+    atomic<bool> used{false};    // posición asignada a un thread
+    atomic<uint64_t> epoch{0};   // época con la que ha empezado a leer, 0 si no está leyendo
+};
+
+// datos de lectura de cada thread
+struct reader_state_t {
+    int slot = -1;   // posición asignada, -1 si aún no tiene
+    int depth = 0;   // PolicyGuard anidados
+    ~reader_state_t();
+};
+
+static reader_slot_t readers[MAX_POLICY_READERS];
+static atomic<uint64_t> global_epoch{1};
+static atomic<Policies *> current_policies{nullptr};
+static mutex publish_mtx; // solo serializa a los que publican, nunca a los lectores
+static thread_local reader_state_t reader_state;
+
+// chargePointModels y chargePointVendors que se insertan al crear las tablas por primera vez
+static const char *default_models[] = {"MicroOcpp Simulator", "model2", "model3", "model4", "model5"};
+static const char *default_vendors[] = {"MicroOcpp", "vendor2", "vendor3", "vendor4", "vendor5"};
+
+static Policies *default_policies();
+static Policies *get_current();
+static int claim_reader_slot();
+static bool load_string_table(sqlite3 *db, const char *table, const char *column,
+                              const char **defaults, size_t num_defaults, vector<string> &dest);
+
+/*
+ *  NAME
+ *      ~reader_state_t - Libera la posición de lector del thread.
+ *  SYNOPSIS
+ *      ~reader_state_t();
+ *  DESCRIPTION
+ *      Se ejecuta al terminar el thread, deja libre su posición en la tabla de lectores
+ *      (los threads de los clientes WebSocket terminan al cerrar la conexión).
+ *  RETURN VALUE
+ *      Nada.
+ */
+reader_state_t::~reader_state_t()
+{
+    if (slot >= 0) {
+        readers[slot].epoch.store(0, memory_order_release);
+        readers[slot].used.store(false, memory_order_release);
+    }
+}
+
+/*
+ *  NAME
+ *      default_policies - Devuelve el snapshot por defecto.
+ *  SYNOPSIS
+ *      static Policies *default_policies();
+ *  DESCRIPTION
+ *      Devuelve el snapshot que se usa antes de la primera carga: sin idTags y con
+ *      los chargePointModels y chargePointVendors por defecto. No se libera nunca.
+ *  RETURN VALUE
+ *      Un puntero al snapshot.
+ */
+static Policies *default_policies()
+{
+    static Policies *policies = [] {
+        Policies *p = new Policies;
+        p->cp_models.assign(begin(default_models), end(default_models));
+        p->cp_vendors.assign(begin(default_vendors), end(default_vendors));
+        p->version = 0;
+        return p;
+    }();
+
+    return policies;
+}
+
+/*
+ *  NAME
+ *      get_current - Devuelve el snapshot publicado.
+ *  SYNOPSIS
+ *      static Policies *get_current();
+ *  DESCRIPTION
+ *      Devuelve el snapshot publicado o el de por defecto si aún no se ha publicado ninguno.
+ *  RETURN VALUE
+ *      Un puntero al snapshot.
+ */
+static Policies *get_current()
+{
+    Policies *p = current_policies.load(memory_order_seq_cst);
+
+    return p ? p : default_policies();
+}
+
+/*
+ *  NAME
+ *      claim_reader_slot - Asigna una posición de lector al thread.
+ *  SYNOPSIS
+ *      static int claim_reader_slot();
+ *  DESCRIPTION
+ *      Busca una posición libre en la tabla de lectores. Solo se ejecuta la primera
+ *      vez que un thread lee las listas. Si la tabla está llena espera a que un thread termine.
+ *  RETURN VALUE
+ *      La posición asignada.
+ */
+static int claim_reader_slot()
+{
+    bool warned = false;
+    for (;;) {
+        for (int i = 0; i < MAX_POLICY_READERS; i++) {
+            bool expected = false;
+            if (!readers[i].used.load(memory_order_relaxed) &&
+                readers[i].used.compare_exchange_strong(expected, true, memory_order_acq_rel))
+                return i;
+        }
+
+        if (!warned) {
+            syslog(LOG_ERR, "%s: tabla de lectores llena (%d threads)", __func__, MAX_POLICY_READERS);
+            warned = true;
+        }
+        this_thread::yield();
+    }
+}
+
+/*
+ *  NAME
+ *      PolicyGuard - Constructor de la clase PolicyGuard
+ *  SYNOPSIS
+ *      PolicyGuard();
+ *  DESCRIPTION
+ *      Marca el thread como lector con la época actual y lee el snapshot publicado.
+ *      Son dos escrituras y dos lecturas atómicas, sin locks ni memoria dinámica. La marca y
+ *      la lectura del puntero son seq_cst, como el intercambio y el recorrido de los lectores de
+ *      publish_policies: así, o el que publica ve la marca, o el lector ve el puntero nuevo.
+ *  RETURN VALUE
+ *      Nada.
+ */
+PolicyGuard::PolicyGuard()
+{
+    if (reader_state.slot < 0)
+        reader_state.slot = claim_reader_slot();
+
+    slot = reader_state.slot;
+    if (reader_state.depth++ == 0)
+        readers[slot].epoch.store(global_epoch.load(memory_order_acquire), memory_order_seq_cst);
+
+    policies = get_current();
+}
+
+/*
+ *  NAME
+ *      ~PolicyGuard - Destructor de la clase PolicyGuard
+ *  SYNOPSIS
+ *      ~PolicyGuard();
+ *  DESCRIPTION
+ *      Indica que el thread ya no está leyendo, de manera que se puede liberar el snapshot.
+ *  RETURN VALUE
+ *      Nada.
+ */
+PolicyGuard::~PolicyGuard()
+{
+    if (--reader_state.depth == 0)
+        readers[slot].epoch.store(0, memory_order_release);
+}
+
+/*
+ *  NAME
+ *      publish_policies - Publica un snapshot nuevo.
+ *  SYNOPSIS
+ *      void publish_policies(Policies *policies);
+ *  DESCRIPTION
+ *      Publica un snapshot nuevo (pasa a ser propiedad del sistema). Los lectores que empiezan
+ *      después ya ven el nuevo; el anterior se libera cuando todos los lectores que han empezado
+ *      antes han terminado. Los lectores no se bloquean en ningún momento, solo espera quien publica.
+ *      No se debe llamar con un PolicyGuard activo en el mismo thread.
+ *  RETURN VALUE
+ *      Nada.
+ */
+void publish_policies(Policies *policies)
+{
+    lock_guard<mutex> lock(publish_mtx);
+
+    Policies *old = current_policies.load(memory_order_relaxed);
+    policies->version = (old ? old->version : 0) + 1;
+
+    old = current_policies.exchange(policies, memory_order_seq_cst);
+    uint64_t epoch = global_epoch.fetch_add(1, memory_order_seq_cst) + 1;
+
+    // espero a que terminen los lectores que han empezado antes del intercambio. La lectura es
+    // seq_cst: con acquire se podría leer una marca anterior a la del lector (que ya tiene el
+    // puntero viejo) aunque el intercambio esté antes en el orden total
+    for (int i = 0; i < MAX_POLICY_READERS; i++) {
+        for (;;) {
+            uint64_t reader_epoch = readers[i].epoch.load(memory_order_seq_cst);
+            if (reader_epoch == 0 || reader_epoch >= epoch)
+                break;
+            this_thread::yield();
+        }
+    }
+
+    if (old && old != default_policies())
+        delete old;
+}
+
+/*
+ *  NAME
+ *      policies_version - Devuelve la versión del snapshot publicado.
+ *  SYNOPSIS
+ *      uint64_t policies_version();
+ *  DESCRIPTION
+ *      Devuelve la versión del snapshot publicado, 0 si aún no se ha cargado ninguno.
+ *      Sirve para saber si las listas han cambiado (p.ej. para invalidar cachés).
+ *  RETURN VALUE
+ *      La versión.
+ */
+uint64_t policies_version()
+{
+    PolicyGuard policies;
+
+    return policies->version;
+}
+
+/*
+ *  NAME
+ *      load_string_table - Carga una tabla de una columna de texto.
+ *  SYNOPSIS
+ *      static bool load_string_table(sqlite3 *db, const char *table, const char *column,
+ *                                    const char **defaults, size_t num_defaults, vector<string> &dest);
+ *  DESCRIPTION
+ *      Crea la tabla si no existe (insertando los valores por defecto) y carga todos
+ *      sus valores en dest.
+ *  RETURN VALUE
+ *      Devuelve true si todo va bien.
+ *      Devuelve false en caso contrario.
+ */
+static bool load_string_table(sqlite3 *db, const char *table, const char *column,
+                              const char **defaults, size_t num_defaults, vector<string> &dest)
+{
+    char query[256];
+    sqlite3_stmt *stmt;
+
+    // miro si la tabla existe para insertar los valores por defecto solo la primera vez
+    bool exists = false;
+    if (sqlite3_prepare_v2(db, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?;", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+        exists = (sqlite3_step(stmt) == SQLITE_ROW);
+        sqlite3_finalize(stmt);
+    }
+
+    if (!exists) {
+        snprintf(query, sizeof(query), "CREATE TABLE IF NOT EXISTS %s (%s TEXT PRIMARY KEY NOT NULL);", table, column);
+        if (sqlite3_exec(db, query, 0, 0, NULL) != SQLITE_OK) {
+            syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, sqlite3_errmsg(db));
+            return false;
+        }
+
+        snprintf(query, sizeof(query), "INSERT OR IGNORE INTO %s(%s) VALUES(?);", table, column);
+        if (sqlite3_prepare_v2(db, query, -1, &stmt, NULL) == SQLITE_OK) {
+            for (size_t i = 0; i < num_defaults; i++) {
+                sqlite3_bind_text(stmt, 1, defaults[i], -1, SQLITE_STATIC);
+                sqlite3_step(stmt);
+                sqlite3_reset(stmt);
+            }
+            sqlite3_finalize(stmt);
+        }
+    }
+
+    snprintf(query, sizeof(query), "SELECT %s FROM %s;", column, table);
+    if (sqlite3_prepare_v2(db, query, -1, &stmt, NULL) != SQLITE_OK) {
+        syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, sqlite3_errmsg(db));
+        return false;
+    }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+        dest.push_back(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)));
+
+    sqlite3_finalize(stmt);
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      reload_policies - Recarga las listas de autorización de la base de datos.
+ *  SYNOPSIS
+ *      bool reload_policies(const char *db_path);
+ *  DESCRIPTION
+ *      Construye un snapshot nuevo con las tablas autoritzacions, models_autoritzats y
+ *      fabricants_autoritzats y lo publica. La carga se hace en el thread que llama, sin
+ *      afectar al procesado de mensajes de los cargadores, que siguen usando el snapshot
+ *      anterior hasta que se publica el nuevo.
+ *  RETURN VALUE
+ *      Devuelve true si todo va bien.
+ *      Devuelve false en caso contrario (se mantiene el snapshot anterior).
+ */
+bool reload_policies(const char *db_path)
+{
+    Policies *policies = new Policies;
+
+    if (!load_auth_list(db_path, policies->auth_list)) {
+        delete policies;
+        return false;
+    }
+
+    sqlite3 *db;
+    if (sqlite3_open(db_path, &db) != SQLITE_OK) {
+        syslog(LOG_ERR, "%s: ERROR opening SQLite DB: %s\n", __func__, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        delete policies;
+        return false;
+    }
+
+    bool ok = load_string_table(db, "models_autoritzats", "model", default_models,
+                                sizeof(default_models) / sizeof(default_models[0]), policies->cp_models) &&
+              load_string_table(db, "fabricants_autoritzats", "fabricant", default_vendors,
+                                sizeof(default_vendors) / sizeof(default_vendors[0]), policies->cp_vendors);
+    sqlite3_close(db);
+
+    if (!ok) {
+        delete policies;
+        return false;
+    }
+
+    // después de publicar el snapshot ya no es de este thread, copio los datos del log antes
+    size_t num_tags = policies->auth_list.size();
+    size_t num_models = policies->cp_models.size();
+    size_t num_vendors = policies->cp_vendors.size();
+
+    publish_policies(policies);
+    syslog(LOG_INFO, "%s: listas recargadas (versión %lu): %zu idTags, %zu models, %zu vendors", __func__,
+           (unsigned long) policies_version(), num_tags, num_models, num_vendors);
+
+    return true;
+}
@@ -0,0 +1,57 @@
+/*
+ *  FILE
+ *      policies.h - header de policies.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de policies.cpp, declaración de las listas de autorización del sistema
+ *      (idTags, chargePointModels y chargePointVendors) publicadas como snapshots inmutables.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _POLICIES_H_
+#define _POLICIES_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "auth_list.h"
+
+using namespace std;
+
+// snapshot inmutable de las listas de autorización
+struct Policies {
+    IdTagSet auth_list;        // idTags que se podrán autorizar
+    vector<string> cp_models;  // chargePointModels que podrán hacer bootNotification
+    vector<string> cp_vendors; // chargePointVendors que podrán hacer bootNotification
+    uint64_t version;          // se incrementa en cada recarga
+};
+
+/*
+ * Acceso de lectura al snapshot actual. Mientras el objeto existe el snapshot no se libera.
+ * No usa ningún lock: solo marca el thread como lector con la época actual (RCU), y quien
+ * publica un snapshot nuevo espera a que los lectores de épocas anteriores terminen antes
+ * de liberar el anterior. Se debe usar en un ámbito corto (p.ej. dentro de un handler).
+ */
+class PolicyGuard {
+public:
+    PolicyGuard();
+    ~PolicyGuard();
+    PolicyGuard(const PolicyGuard &) = delete;
+    PolicyGuard &operator=(const PolicyGuard &) = delete;
+
+    const Policies *operator->() const { return policies; }
+    const Policies &operator*() const { return *policies; }
+private:
+    int slot;                 // posición del thread en la tabla de lectores
+    const Policies *policies; // snapshot leído
+};
+
+void publish_policies(Policies *policies);
+bool reload_policies(const char *db_path);
+uint64_t policies_version();
+
+#endif
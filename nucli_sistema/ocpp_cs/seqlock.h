@@ -0,0 +1,107 @@
+/*
+ *  FILE
+ *      seqlock.h - copia consistente de un estado sin bloquear a los lectores
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Seqlock: un escritor publica una estructura y cualquier número de lectores obtiene una
+ *      copia consistente sin coger ningún mutex ni reservar memoria.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _SEQLOCK_H_
+#define _SEQLOCK_H_
+
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+using namespace std;
+
+/*
+ * Seqlock de una estructura T (que se tiene que poder copiar con memcpy). El contador seq es impar
+ * mientras se está escribiendo: el lector copia los datos y vuelve a empezar si seq ha cambiado
+ * durante la copia o era impar. Los datos se guardan como palabras atómicas y se copian con
+ * accesos relaxed, así la copia de un lector que coincide con una escritura no es una carrera
+ * (solo se descarta). Los escritores se serializan con un mutex, los lectores nunca lo cogen.
+ */
+template <typename T>
+class SeqLock {
+    static_assert(is_trivially_copyable<T>::value, "SeqLock necesita un tipo que se pueda copiar con memcpy");
+public:
+    SeqLock() : seq{0}
+    {
+        T empty{};
+        write(empty);
+    }
+
+    /*
+     *  NAME
+     *      write - Publica un nuevo valor.
+     *  SYNOPSIS
+     *      void write(const T &value);
+     *  DESCRIPTION
+     *      Publica value. Los lectores que estén copiando mientras tanto lo vuelven a intentar.
+     *  RETURN VALUE
+     *      Nada.
+     */
+    void write(const T &value)
+    {
+        uint64_t buffer[WORDS] = {0};
+        memcpy(buffer, &value, sizeof(T));
+
+        lock_guard<mutex> lock(write_mtx);
+        uint64_t s = seq.load(memory_order_relaxed);
+        seq.store(s + 1, memory_order_relaxed); // impar: escritura en curso
+        atomic_thread_fence(memory_order_release);
+
+        for (size_t i = 0; i < WORDS; i++)
+            data[i].store(buffer[i], memory_order_relaxed);
+
+        seq.store(s + 2, memory_order_release);
+    }
+
+    /*
+     *  NAME
+     *      read - Obtiene una copia consistente.
+     *  SYNOPSIS
+     *      uint64_t read(T &dest) const;
+     *  DESCRIPTION
+     *      Copia en dest el último valor publicado completo, sin bloquear al escritor.
+     *  RETURN VALUE
+     *      La versión del valor copiado (número de escrituras).
+     */
+    uint64_t read(T &dest) const
+    {
+        uint64_t buffer[WORDS];
+        uint64_t s1, s2;
+
+        do {
+            s1 = seq.load(memory_order_acquire);
+            for (size_t i = 0; i < WORDS; i++)
+                buffer[i] = data[i].load(memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            s2 = seq.load(memory_order_relaxed);
+        } while ((s1 & 1) || s1 != s2);
+
+        memcpy(&dest, buffer, sizeof(T));
+
+        return s1 / 2;
+    }
+
+    // versión actual, sin copiar los datos
+    uint64_t version() const { return seq.load(memory_order_acquire) / 2; }
+private:
+    static const size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    atomic<uint64_t> seq;
+    atomic<uint64_t> data[WORDS];
+    mutex write_mtx;
+};
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ *  FILE
+ *      startup.cpp - opciones de arranque del núcleo
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Lee y aplica las opciones de la línea de comandos del núcleo del sistema de control,
+ *      las mismas para la interfaz gráfica y para el daemon.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <string>
+#include "startup.h"
+#include "ws_server.h"
+#include "auth_list.h"
+#include "authorizer.h"
+#include "auth_stand_in.h"
+
+using namespace std;
+
+/*
+ *  NAME
+ *      apply_core_options - Aplica las opciones de arranque.
+ *  SYNOPSIS
+ *      bool apply_core_options(int argc, char *argv[]);
+ *  DESCRIPTION
+ *      Aplica las opciones del núcleo de argv, antes de arrancar el servidor:
+ *          --db fichero                     base de datos (por defecto DATABASE_PATH)
+ *          --import-auth-list fichero.csv   importa idTags autorizados y termina el programa
+ *          --auth-backend url               autorización externa por HTTP
+ *          --auth-timeout ms                tiempo máximo de la autorización externa
+ *          --auth-stand-in puerto           autorización externa de pruebas en local
+ *          --auth-stand-in-delay ms         retardo de la autorización de pruebas
+ *      La ruta de la base de datos se resuelve aquí, respecto al directorio de arranque,
+ *      antes que las demás opciones (--import-auth-list ya la usa). Las opciones que no
+ *      conoce las ignora. Los errores se escriben en stderr.
+ *  RETURN VALUE
+ *      Devuelve true si se han aplicado todas.
+ *      Devuelve false en caso de error.
+ */
+bool apply_core_options(int argc, char *argv[])
+{
+    int auth_timeout = AUTH_TIMEOUT_MS;
+    int stand_in_port = 0;
+    int stand_in_delay = 0;
+    const char *auth_backend = NULL;
+    const char *db = DATABASE_PATH;
+
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--db") == 0)
+            db = argv[++i];
+    }
+    if (!set_database_path(db)) {
+        fprintf(stderr, "Base de datos no válida: %s: %s\n", db, strerror(errno));
+        return false;
+    }
+
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--db") == 0) { // ya aplicada
+            i++;
+        }
+        // importación de idTags autorizados: --import-auth-list fichero.csv
+        else if (strcmp(argv[i], "--import-auth-list") == 0) {
+            long inserted = import_auth_list_csv(database_path(), argv[++i]);
+            if (inserted < 0) {
+                fprintf(stderr, "No se ha podido importar %s\n", argv[i]);
+                return false;
+            }
+            printf("%ld idTags importados\n", inserted);
+            exit(EXIT_SUCCESS); // solo se importa, el sistema de control no arranca
+        }
+        // autorización externa: --auth-backend http://host:port/path [--auth-timeout ms]
+        else if (strcmp(argv[i], "--auth-backend") == 0) {
+            auth_backend = argv[++i];
+        }
+        else if (strcmp(argv[i], "--auth-timeout") == 0) {
+            auth_timeout = atoi(argv[++i]);
+        }
+        // autorización externa de pruebas en local: --auth-stand-in puerto [--auth-stand-in-delay ms]
+        else if (strcmp(argv[i], "--auth-stand-in-delay") == 0) {
+            stand_in_delay = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--auth-stand-in") == 0) {
+            stand_in_port = atoi(argv[++i]);
+        }
+    }
+
+    string stand_in_url;
+    if (stand_in_port > 0 && start_auth_stand_in(stand_in_port, stand_in_delay)) {
+        stand_in_url = "http://127.0.0.1:" + to_string(stand_in_port) + "/authorize";
+        auth_backend = stand_in_url.c_str();
+    }
+
+    if (auth_backend) {
+        auto authorizer = HttpAuthorizer::from_url(auth_backend, auth_timeout);
+        if (authorizer == nullptr) {
+            fprintf(stderr, "URL de autorización no válida: %s\n", auth_backend);
+            return false;
+        }
+        authorization_service.set_authorizer(move(authorizer), auth_timeout);
+    }
+
+    return true;
+}
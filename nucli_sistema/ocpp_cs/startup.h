@@ -0,0 +1,20 @@
+/*
+ *  FILE
+ *      startup.h - header de startup.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de startup.cpp, declaración de las opciones de arranque comunes a la interfaz
+ *      gráfica y al daemon.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _STARTUP_H_
+#define _STARTUP_H_
+
+bool apply_core_options(int argc, char *argv[]);
+
+#endif
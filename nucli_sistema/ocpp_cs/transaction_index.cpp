@@ -0,0 +1,349 @@
+/*
+ *  FILE
+ *      transaction_index.cpp - índice global de transacciones activas
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Índice compartido por todos los cargadores con las transacciones activas del sistema.
+ *      Permite buscar una transacción por transactionId o por idTag en O(1), sin recorrer
+ *      las listas de cada cargador, y resolver transacciones iniciadas en otro cargador.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#include <cctype>
+#include <cstdio>
+#include <mutex>
+#include <algorithm>
+#include <syslog.h>
+#include <sqlite3.h>
+#include "transaction_index.h"
+#include "auth_list.h"
+
+using namespace std;
+
+TransactionIndex transaction_index;
+
+/*
+ *  NAME
+ *      restore_last_id - Sigue la numeración de las transacciones guardadas.
+ *  SYNOPSIS
+ *      bool restore_last_id(const char *db_path);
+ *  DESCRIPTION
+ *      Lee el mayor transactionId guardado en la tabla transaccions (con el índice de la columna
+ *      transaccio) para que los transactionIds nuevos empiecen después y no coincidan con los de
+ *      antes de reiniciar el sistema. Las bases de datos anteriores no guardan el transactionId
+ *      en transaccions: si no hay ninguno se busca en meter_values, que sí lo tiene. Se llama al
+ *      arrancar, antes de que se conecte ningún cargador.
+ *  RETURN VALUE
+ *      Devuelve true si todo va bien.
+ *      Devuelve false en caso contrario (la numeración no cambia).
+ */
+bool TransactionIndex::restore_last_id(const char *db_path)
+{
+    sqlite3 *db;
+    if (sqlite3_open_v2(db_path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        syslog(LOG_ERR, "%s: ERROR opening SQLite DB: %s\n", __func__, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return false;
+    }
+
+    static const char *queries[] = {
+        "SELECT MAX(transaccio) FROM transaccions;",
+        "SELECT MAX(transaccio) FROM meter_values;"
+    };
+
+    int64_t last = 0;
+    bool found = false;
+    for (const char *query : queries) {
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, query, -1, &stmt, NULL) != SQLITE_OK) {
+            syslog(LOG_ERR, "%s: SQL error: %s\n", __func__, sqlite3_errmsg(db));
+            sqlite3_close(db);
+            return false;
+        }
+
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+            last = sqlite3_column_int64(stmt, 0);
+            found = true;
+        }
+        sqlite3_finalize(stmt);
+
+        if (found)
+            break;
+    }
+
+    sqlite3_close(db);
+
+    {
+        unique_lock<shared_mutex> lock(mtx);
+        if (last > last_transaction_id)
+            last_transaction_id = last;
+    }
+
+    syslog(LOG_INFO, "%s: los transactionIds siguen a partir de %ld", __func__, (long) last);
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      begin - Registra una transacción iniciada.
+ *  SYNOPSIS
+ *      bool begin(TransactionInfo &info);
+ *  DESCRIPTION
+ *      Asigna a info un transactionId nuevo, único en todo el sistema, y la registra en los dos
+ *      índices. La comprobación de que el idTag no tiene ninguna otra transacción activa, la
+ *      asignación y la inserción se hacen bajo el mismo lock, de manera que dos StartTransaction
+ *      simultáneos con el mismo idTag no se pueden aceptar y un StartTransaction rechazado no
+ *      gasta ningún transactionId.
+ *  RETURN VALUE
+ *      Devuelve true si se ha registrado (info.transaction_id tiene el transactionId).
+ *      Devuelve false si el idTag ya tiene una transacción activa.
+ */
+bool TransactionIndex::begin(TransactionInfo &info)
+{
+    string k = id_tag_key(info.id_tag);
+
+    unique_lock<shared_mutex> lock(mtx);
+
+    auto it = by_id_tag.find(k);
+    if (it != by_id_tag.end() && !it->second.empty()) // idTag ya en una transacción activa
+        return false;
+
+    info.transaction_id = ++last_transaction_id;
+    by_id.emplace(info.transaction_id, info);
+    by_id_tag[k].push_back(info.transaction_id);
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      end - Elimina una transacción finalizada.
+ *  SYNOPSIS
+ *      bool end(int64_t transaction_id, TransactionInfo *info);
+ *  DESCRIPTION
+ *      Elimina una transacción de los dos índices. Si info no es NULL, se copia en él
+ *      la información de la transacción eliminada.
+ *  RETURN VALUE
+ *      Devuelve true si la transacción existía.
+ *      Devuelve false en caso contrario.
+ */
+bool TransactionIndex::end(int64_t transaction_id, TransactionInfo *info)
+{
+    unique_lock<shared_mutex> lock(mtx);
+
+    auto it = by_id.find(transaction_id);
+    if (it == by_id.end())
+        return false;
+
+    auto tag = by_id_tag.find(id_tag_key(it->second.id_tag));
+    if (tag != by_id_tag.end()) {
+        auto &ids = tag->second;
+        ids.erase(remove(ids.begin(), ids.end(), transaction_id), ids.end());
+        if (ids.empty())
+            by_id_tag.erase(tag);
+    }
+
+    if (info)
+        *info = it->second;
+
+    by_id.erase(it);
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      release_id_tag - Libera el idTag de una transacción sin terminarla.
+ *  SYNOPSIS
+ *      bool release_id_tag(int64_t transaction_id);
+ *  DESCRIPTION
+ *      Se llama cuando el conector pasa a Available sin que haya llegado el StopTransaction.
+ *      El idTag deja de contar como activo (puede volver a iniciar una carga), pero la
+ *      transacción se queda en el índice por transactionId hasta que llegue su StopTransaction
+ *      (end), para poder contestarlo y guardarlo con su cargador y su conector.
+ *  RETURN VALUE
+ *      Devuelve true si la transacción existía.
+ *      Devuelve false en caso contrario.
+ */
+bool TransactionIndex::release_id_tag(int64_t transaction_id)
+{
+    unique_lock<shared_mutex> lock(mtx);
+
+    auto it = by_id.find(transaction_id);
+    if (it == by_id.end())
+        return false;
+
+    auto tag = by_id_tag.find(id_tag_key(it->second.id_tag));
+    if (tag != by_id_tag.end()) {
+        auto &ids = tag->second;
+        ids.erase(remove(ids.begin(), ids.end(), transaction_id), ids.end());
+        if (ids.empty())
+            by_id_tag.erase(tag);
+    }
+    it->second.id_tag_released = true;
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      find - Busca una transacción por transactionId.
+ *  SYNOPSIS
+ *      bool find(int64_t transaction_id, TransactionInfo &dest) const;
+ *  DESCRIPTION
+ *      Busca una transacción activa por transactionId y la copia en dest.
+ *  RETURN VALUE
+ *      Devuelve true si se ha encontrado.
+ *      Devuelve false en caso contrario.
+ */
+bool TransactionIndex::find(int64_t transaction_id, TransactionInfo &dest) const
+{
+    shared_lock<shared_mutex> lock(mtx);
+
+    auto it = by_id.find(transaction_id);
+    if (it == by_id.end())
+        return false;
+
+    dest = it->second;
+
+    return true;
+}
+
+/*
+ *  NAME
+ *      find_by_id_tag - Devuelve las transacciones activas de un idTag.
+ *  SYNOPSIS
+ *      vector<TransactionInfo> find_by_id_tag(const string &id_tag) const;
+ *  DESCRIPTION
+ *      Devuelve las transacciones activas iniciadas con un idTag, en cualquier cargador.
+ *  RETURN VALUE
+ *      Un vector con las transacciones (vacío si no hay ninguna).
+ */
+vector<TransactionInfo> TransactionIndex::find_by_id_tag(const string &id_tag) const
+{
+    vector<TransactionInfo> result;
+
+    shared_lock<shared_mutex> lock(mtx);
+
+    auto tag = by_id_tag.find(id_tag_key(id_tag));
+    if (tag != by_id_tag.end()) {
+        for (auto id : tag->second) {
+            auto it = by_id.find(id);
+            if (it != by_id.end())
+                result.push_back(it->second);
+        }
+    }
+
+    return result;
+}
+
+/*
+ *  NAME
+ *      id_tag_active - Indica si un idTag tiene alguna transacción activa.
+ *  SYNOPSIS
+ *      bool id_tag_active(const string &id_tag) const;
+ *  DESCRIPTION
+ *      Indica si un idTag tiene alguna transacción activa en cualquier cargador.
+ *  RETURN VALUE
+ *      Devuelve true si tiene alguna.
+ *      Devuelve false en caso contrario.
+ */
+bool TransactionIndex::id_tag_active(const string &id_tag) const
+{
+    shared_lock<shared_mutex> lock(mtx);
+
+    auto tag = by_id_tag.find(id_tag_key(id_tag));
+
+    return tag != by_id_tag.end() && !tag->second.empty();
+}
+
+/*
+ *  NAME
+ *      snapshot - Devuelve una copia de todas las transacciones activas.
+ *  SYNOPSIS
+ *      vector<TransactionInfo> snapshot() const;
+ *  DESCRIPTION
+ *      Devuelve una copia de todas las transacciones activas, ordenadas por transactionId.
+ *      Pensado para la interfaz de usuario y las consultas de administración.
+ *  RETURN VALUE
+ *      Un vector con las transacciones.
+ */
+vector<TransactionInfo> TransactionIndex::snapshot() const
+{
+    vector<TransactionInfo> result;
+
+    {
+        shared_lock<shared_mutex> lock(mtx);
+        result.reserve(by_id.size());
+        for (auto &elem : by_id)
+            result.push_back(elem.second);
+    }
+
+    sort(result.begin(), result.end(), [](const TransactionInfo &a, const TransactionInfo &b) {
+        return a.transaction_id < b.transaction_id;
+    });
+
+    return result;
+}
+
+/*
+ *  NAME
+ *      size - Devuelve el número de transacciones activas.
+ *  SYNOPSIS
+ *      size_t size() const;
+ *  DESCRIPTION
+ *      Devuelve el número de transacciones activas en todo el sistema.
+ *  RETURN VALUE
+ *      El número de transacciones.
+ */
+size_t TransactionIndex::size() const
+{
+    shared_lock<shared_mutex> lock(mtx);
+
+    return by_id.size();
+}
+
+/*
+ *  NAME
+ *      transaction_report - Devuelve las transacciones activas en texto.
+ *  SYNOPSIS
+ *      string transaction_report(const string &id_tag);
+ *  DESCRIPTION
+ *      Una línea por transacción activa, ordenadas por transactionId, con el cargador, el
+ *      conector, el idTag, la hora de inicio (UTC) y el contador al iniciar. Si id_tag no está
+ *      vacío, solo las de ese idTag. Se marcan las que esperan el StopTransaction con el conector
+ *      ya en Available. Es lo que ven la interfaz y las consultas de administración.
+ *  RETURN VALUE
+ *      El texto, vacío si no hay ninguna transacción.
+ */
+string transaction_report(const string &id_tag)
+{
+    vector<TransactionInfo> txs = id_tag.empty() ? transaction_index.snapshot() : transaction_index.find_by_id_tag(id_tag);
+    if (txs.empty())
+        return "";
+
+    string report;
+    char line[160];
+    snprintf(line, sizeof(line), "%13s %8s %8s  %-20s  %-20s %12s\n",
+             "transactionId", "cargador", "conector", "idTag", "inicio (UTC)", "meterStart Wh");
+    report += line;
+
+    for (auto &tx : txs) {
+        struct tm tm;
+        char inicio[32];
+        gmtime_r(&tx.start_time, &tm);
+        strftime(inicio, sizeof(inicio), "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+        snprintf(line, sizeof(line), "%13ld %8d %8d  %-20s  %-20s %12ld%s\n", (long) tx.transaction_id, tx.charger_id,
+                 tx.connector_id, tx.id_tag.c_str(), inicio, (long) tx.meter_start,
+                 tx.id_tag_released ? "  (Available, falta el StopTransaction)" : "");
+        report += line;
+    }
+
+    return report;
+}
@@ -0,0 +1,63 @@
+/*
+ *  FILE
+ *      transaction_index.h - header de transaction_index.cpp
+ *  PROJECT
+ *      TFG - Implementació d'un Sistema de Control per Punts de Càrrega de Vehicles Elèctrics.
+ *  DESCRIPTION
+ *      Header de transaction_index.cpp, declaración del índice global de transacciones activas
+ *      de todos los cargadores del sistema.
+ *  AUTHOR
+ *      Sergio Abate
+ *  OPERATING SYSTEM
+ *      Linux
+ */
+
+#ifndef _TRANSACTION_INDEX_H_
+#define _TRANSACTION_INDEX_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include <cstdint>
+#include <ctime>
+
+using namespace std;
+
+// información de una transacción activa
+struct TransactionInfo {
+    int64_t transaction_id; // transactionId asignado en el StartTransaction
+    int charger_id;         // cargador donde se ha iniciado
+    int connector_id;       // conector donde se ha iniciado
+    string id_tag;          // idTag con el que se ha iniciado
+    int64_t meter_start;    // valor del contador al iniciar (Wh)
+    time_t start_time;      // timestamp del StartTransaction
+    bool id_tag_released = false; // el conector ha pasado a Available antes del StopTransaction
+};
+
+class TransactionIndex {
+public:
+    bool restore_last_id(const char *db_path); // sigue la numeración de las transacciones guardadas
+
+    bool begin(TransactionInfo &info); // registra una transacción iniciada y le asigna el transactionId
+    bool end(int64_t transaction_id, TransactionInfo *info = nullptr); // elimina una transacción finalizada
+    bool release_id_tag(int64_t transaction_id); // el idTag deja de estar cargando, la transacción espera el StopTransaction
+
+    bool find(int64_t transaction_id, TransactionInfo &dest) const; // busca una transacción por transactionId
+    vector<TransactionInfo> find_by_id_tag(const string &id_tag) const; // transacciones activas de un idTag
+    bool id_tag_active(const string &id_tag) const; // indica si un idTag tiene alguna transacción activa
+    vector<TransactionInfo> snapshot() const; // copia de todas las transacciones activas
+    size_t size() const; // número de transacciones activas
+private:
+    mutable shared_mutex mtx;                              // protege los dos mapas y last_transaction_id
+    unordered_map<int64_t, TransactionInfo> by_id;         // transactionId -> transacción
+    unordered_map<string, vector<int64_t>> by_id_tag;      // idTag -> transactionIds activos
+    int64_t last_transaction_id = 0;                       // último transactionId asignado
+};
+
+// índice de transacciones de todo el sistema, compartido por todos los cargadores
+extern TransactionIndex transaction_index;
+
+string transaction_report(const string &id_tag = ""); // transacciones activas (de un idTag) en texto
+
+#endif
@@ -66,7 +66,7 @@ void split_message(struct req_rx &dest, string src)
  *      void split_header(struct header_st &dest, struct req_rx &src);
  *  DESCRIPTION
  *      A partir de un struct de header y payload, coge el header y
- *      lo divide en messageTypeId, uniqueId y action.
+ *      lo divide en messageTypeId, uniqueId y action. Tambin guarda el hash del payload.
  *  RETURN VALUE
  *      Nada.
  */
@@ -84,6 +84,8 @@ void split_header(struct header_st &dest, struct req_rx &src)
     i++;
     while (i < (src.header.length()))
         dest.action += src.header[i++];
+
+    dest.payload_hash = hash<string>()(src.payload);
 }
 
 /*
@@ -33,6 +33,7 @@ struct header_st {
     int message_type_id;
     string unique_id;
     string action;
+    size_t payload_hash; // hash del payload, distingue un reenvo de un uniqueId repetido
 };
 
 void split_message(struct req_rx &dest, string src);
@@ -14,16 +14,26 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
 #include <syslog.h>
 #include <ws.h>
-#include <QObject>
+#include <memory>
+#include <vector>
 #include "ws_server.h"
 #include "charger.h"
-#include "BootNotificationConfJSON.h"
-#include "../../backend_notifier.h"
+#include "transaction_index.h"
+#include "id_tag_cache.h"
+#include "fleet_state.h"
+#include "policies.h"
+#include "config_store.h"
+#include "offline_queue.h"
+#include "history.h"
+#include "latency.h"
+#include "lib_json_includes.h"
+#include "event_sink.h"
 
 #define RESET   "\e[0m"
 #define YELLOW  "\e[0;33m"
@@ -33,8 +43,7 @@
 #define GREEN   "\e[0;32m"
 
 uint8_t current_num_chargers = 0;
-
-Charger charger1 = Charger(1, -1);
+static char db_path[PATH_MAX]; // ruta absoluta de la base de datos (set_database_path)
 
 // Prototipos de las funciones
 static void onopen(ws_cli_conn_t client);
@@ -42,8 +51,10 @@ static void onclose(ws_cli_conn_t client);
 static void onmessage(ws_cli_conn_t client, const unsigned char *msg, uint64_t size, int type);
 static int get_charger_index();
 static int get_charger_index(int charger_id);
+static vector<unique_ptr<Charger>> create_chargers();
 static void send_information1(Charger &ch);
 static void send_information2(Charger &ch);
+static void submit_request(Charger *charger, int option, const char *request, function<void(const struct CallResult &)> done);
 
 /*
  *  NAME
@@ -63,6 +74,25 @@ void web_socket_server()
     setlogmask(LOG_UPTO(loglevel));
     openlog(NULL, LOG_PID | LOG_NDELAY | LOG_PERROR, LOG_USER);
 
+    // cargo las listas de autorización de la base de datos
+    if (!reload_policies(database_path()))
+        syslog(LOG_ERR, "%s: no se han podido cargar las listas de autorización\n", __func__);
+
+    // actualización periódica de las claves de configuración de los cargadores
+    start_config_refresh();
+
+    // peticiones guardadas para los cargadores desconectados
+    offline_queue.start(database_path());
+
+    // índices y modo WAL: el historial de la interfaz no bloquea a los cargadores
+    if (!prepare_history_db(database_path()))
+        syslog(LOG_ERR, "%s: no se ha podido preparar el historial\n", __func__);
+    start_history_retention(database_path());
+
+    // los transactionIds siguen después de los guardados antes de reiniciar
+    if (!transaction_index.restore_last_id(database_path()))
+        syslog(LOG_ERR, "%s: no se ha podido leer el último transactionId\n", __func__);
+
     // crea un thread por cada connexión, este se encarga de recibir las peticiones del cargador y los mensajes de la web
     struct ws_server ws;
     ws.host          = "localhost";
@@ -94,19 +124,14 @@ static void onopen(ws_cli_conn_t client)
     // busco el primer index de cargador disponible y lo assigno si hay espacio
     int index = get_charger_index();
     printf("%s, index = %d\n", __func__, index);
-    switch(index) {
-        case 1:
-            printf("set_client1\n");
-            charger1.set_client(client);
-
-            QMetaObject::invokeMethod(&BackendNotifier::instance(),
-                                      "chargerConnected",
-                                      Qt::QueuedConnection);
-            break;
-        default:
-            syslog(LOG_WARNING, "%s: Warning: Cargador no existente\n", __func__);
-            break;
+    Charger *charger = get_charger(index);
+    if (charger) {
+        printf("set_client%d\n", index);
+        charger->set_client(client);
+        event_sink().charger_connected(index);
     }
+    else
+        syslog(LOG_WARNING, "%s: Warning: Cargador no existente\n", __func__);
 }
 
 /*
@@ -129,20 +154,16 @@ static void onclose(ws_cli_conn_t client)
         syslog(LOG_NOTICE, "Connection closed, addr: %s\n", cli);
 
         // Reseteo la información de los cargadores que se muestra en la web
-        switch(index) {
-        case 1:
-            charger1.set_client(-1);
-            charger1.set_current_vendor("");
-            charger1.set_current_model("");
-
-            QMetaObject::invokeMethod(&BackendNotifier::instance(),
-                                      "chargerDisconnected",
-                                      Qt::QueuedConnection);
-            break;
-        default:
-            syslog(LOG_WARNING, "%s: Cargador no existente\n", __func__);
-            break;
+        Charger *charger = get_charger(index);
+        if (charger) {
+            charger->set_client(-1);
+            charger->reset_boot(); // la cola offline no le envía nada hasta el próximo BootNotification
+            charger->set_current_vendor("");
+            charger->set_current_model("");
+            event_sink().charger_disconnected(index);
         }
+        else
+            syslog(LOG_WARNING, "%s: Cargador no existente\n", __func__);
     }
     else
         syslog(LOG_WARNING, "%s: Warning: no se ha encontrado el cargador\n", __func__);
@@ -169,13 +190,11 @@ static void onmessage(ws_cli_conn_t client, const unsigned char *msg, uint64_t s
         syslog(LOG_INFO, "%sRECEIVED MESSAGE: %s (%lu), from: %s%s\n", BLUE, msg,
             size, cli, RESET);
 
-        switch(index) {
-        case 1:
-            charger1.system_on_receive((char *) msg);
-            break;
-        default:
+        Charger *charger = get_charger(index);
+        if (charger)
+            charger->system_on_receive((char *) msg);
+        else
             syslog(LOG_WARNING, "%s: Warning: Cargador no existente\n", __func__);
-        }
     }
     else
         syslog(LOG_ERR, "%s: Error: no se ha encontrado el cargador\n", __func__);
@@ -195,6 +214,8 @@ static void onmessage(ws_cli_conn_t client, const unsigned char *msg, uint64_t s
  */
 void ws_send(const char *option, char *text, ws_cli_conn_t client)
 {
+    enum latency_stage_t previous = latency_stage(LAT_RESPOND); // si es la respuesta a un mensaje recibido
+
     if (strcmp(option, "CALL") == 0) {
         ws_sendframe_txt(client, text);
         syslog(LOG_INFO, "%sSENDING REQUEST: %s%s\n", CYAN, text, RESET);
@@ -207,66 +228,140 @@ void ws_send(const char *option, char *text, ws_cli_conn_t client)
         ws_sendframe_txt(client, text);
         syslog(LOG_INFO, "%sSENDING ERROR: %s%s\n", RED, text, RESET);
     }
+
+    latency_stage(previous);
 }
 
 /*
  *  NAME
  *      select_request - Permite al usuario enviar peticiones al cargador.
  *  SYNOPSIS
- *      void *select_request(ChargerVars *vars, const char *operation)
+ *      void select_request(const char *operation, function<void(const struct CallResult &)> done);
  *  DESCRIPTION
- *      El usuario escoge qué mensaje enviar, se envia al objecto Charger correspondiente
- *      para gestionarlo, y este posteriormente lo envia al cargador.
+ *      El usuario escoge qué mensaje enviar, se pone en la cola del objecto Charger correspondiente
+ *      para gestionarlo, y este posteriormente lo envia al cargador. No espera la respuesta:
+ *      si done no es nulo se llama desde el thread del cargador cuando llega (o salta el timeout).
+ *      Si el cargador no está conectado, la petición se guarda hasta que se conecte.
+ *      operation es "acción:payload"; si falta la acción, o el payload de una petición que lo
+ *      necesita, done se llama con CALL_NOT_SENT.
  *  RETURN VALUE
  *      Res.
  */
-void select_request(const char *operation)
+void select_request(const char *operation, function<void(const struct CallResult &)> done)
 {
     char message[1024];
     memset(message, 0, 1024); // limpio el buffer
     snprintf(message, sizeof(message), "%s", operation);
 
     // se analiza el mensaje del servidor web para saber qué operación se tiene que enviar
-    char *action = strtok(message, ":");
+    char *action = strtok(message, ":"); // NULL si operation está vacío o es solo ":"
+    char *request = action ? strtok(0, "") : NULL; // NULL si no hay payload
+    if (action == NULL) {
+        syslog(LOG_WARNING, "%s: operación vacía\n", __func__);
+        if (done)
+            done({CALL_NOT_SENT, ""});
+        return;
+    }
+
     syslog(LOG_DEBUG, "action: %s\n", action);
+    Charger *charger1 = get_charger(1);
     if (strcmp(action, "changeAvailability") == 0) {
-        char *request = strtok(0, "");
-        charger1.send_request('1', request);
+        submit_request(charger1, '1', request, done);
     }
     else if (strcmp(action, "clearCache") == 0) {
-        char *request = strtok(0, "");
-        charger1.send_request('2', request);
+        submit_request(charger1, '2', request ? request : "{}", done); // no lleva payload
     }
     else if (strcmp(action, "dataTransfer") == 0) {
-        char *request = strtok(0, "");
-        charger1.send_request('3', request);
+        submit_request(charger1, '3', request, done);
     }
     else if (strcmp(action, "getConfiguration") == 0) {
-        char *request = strtok(0, "");
-        charger1.send_request('4', request);
+        submit_request(charger1, '4', request, done);
     }
     else if (strcmp(action, "remoteStartTransaction") == 0) {
-        char *request = strtok(0, "");
-        charger1.send_request('5', request);
+        submit_request(charger1, '5', request, done);
     }
     else if (strcmp(action, "remoteStopTransaction") == 0) {
-        char *request = strtok(0, "");
-        charger1.send_request('6', request);
+        // la petición se envia al cargador donde se inició la transacción
+        Charger *owner = charger1;
+        struct RemoteStopTransactionReq *stop_req = request ? cJSON_ParseRemoteStopTransactionReq(request) : NULL;
+        struct TransactionInfo tx;
+        if (stop_req && transaction_index.find(stop_req->transaction_id, tx) && get_charger(tx.charger_id))
+            owner = get_charger(tx.charger_id);
+        free(stop_req);
+
+        submit_request(owner, '6', request, done);
     }
     else if (strcmp(action, "reset") == 0) {
-        char *request = strtok(0, "");
-        charger1.send_request('7', request);
+        submit_request(charger1, '7', request, done);
     }
     else if (strcmp(action, "unlockConnector") == 0) {
-        char *request = strtok(0, "");
-        charger1.send_request('8', request);
+        submit_request(charger1, '8', request, done);
     }
-    else
+    else if (strcmp(action, "changeConfiguration") == 0) {
+        submit_request(charger1, '9', request, done);
+    }
+    else if (strcmp(action, "databasePath") == 0) {
+        // no va al cargador: la base de datos de este proceso, para el historial de las interfaces
+        if (done)
+            done({CALL_ANSWERED, database_path()});
+    }
+    else if (strcmp(action, "latencyReport") == 0) {
+        // no va al cargador: la tabla de latencias de los mensajes recibidos (opcional, de un cargador)
+        if (done)
+            done({CALL_ANSWERED, latency_report(request ? atoi(request) : 0)});
+    }
+    else if (strcmp(action, "transactionReport") == 0) {
+        // no va al cargador: las transacciones activas de todos los cargadores (opcional, de un idTag)
+        if (done)
+            done({CALL_ANSWERED, transaction_report(request ? request : "")});
+    }
+    else if (strcmp(action, "chargerReport") == 0) {
+        // no va al cargador: la cola de peticiones y los reenvíos de los cargadores (opcional, de un cargador)
+        if (done)
+            done({CALL_ANSWERED, charger_report(request ? atoi(request) : 0)});
+    }
+    else if (strcmp(action, "fleetReport") == 0) {
+        // no va al cargador: el resumen de la flota (estados, transacciones, potencia y cargadores sin mensajes)
+        if (done)
+            done({CALL_ANSWERED, fleet_report()});
+    }
+    else if (strcmp(action, "authCacheReport") == 0) {
+        // no va al cargador: los contadores de la caché de idTags
+        if (done)
+            done({CALL_ANSWERED, auth_cache_report()});
+    }
+    else {
         syslog(LOG_DEBUG, "desconocido\n");
+        if (done)
+            done({CALL_NOT_SENT, ""});
+    }
 
     memset(message, 0, 1024); // limpio el buffer
 }
 
+/*
+ *  NAME
+ *      submit_request - Pone una petición del usuario en la cola del cargador.
+ *  SYNOPSIS
+ *      static void submit_request(Charger *charger, int option, const char *request, function<void(const struct CallResult &)> done);
+ *  DESCRIPTION
+ *      Pasa la petición a offline_queue, que la envía o la guarda si el cargador no está
+ *      conectado. Si no hay cargador o payload, no se envía y done se llama con CALL_NOT_SENT.
+ *  RETURN VALUE
+ *      Nada.
+ */
+static void submit_request(Charger *charger, int option, const char *request, function<void(const struct CallResult &)> done)
+{
+    if (charger == NULL || request == NULL) {
+        syslog(LOG_WARNING, "%s: petición %c sin %s\n", __func__, option, charger ? "payload" : "cargador");
+        if (done)
+            done({CALL_NOT_SENT, ""});
+        return;
+    }
+
+    offline_queue.submit(charger, option, request, done);
+}
+
 
 /*
  *  NAME
@@ -281,10 +376,12 @@ void select_request(const char *operation)
  */
 static int get_charger_index()
 {
-    if (charger1.get_client() == static_cast<ws_cli_conn_t>(-1))
-        return 1;
-    else
-        return -1; // no hay posiciones libres
+    for (int i = 1; i <= MAX_CHARGERS; i++) {
+        if (get_charger(i)->get_client() == static_cast<ws_cli_conn_t>(-1))
+            return i;
+    }
+
+    return -1; // no hay posiciones libres
 }
 
 /*
@@ -300,9 +397,137 @@ static int get_charger_index()
  */
 static int get_charger_index(int client)
 {
-    if (charger1.get_client() == static_cast<ws_cli_conn_t>(client))
-        return 1;
-    else
-        return -1; // no hay posiciones libres
+    for (int i = 1; i <= MAX_CHARGERS; i++) {
+        if (get_charger(i)->get_client() == static_cast<ws_cli_conn_t>(client))
+            return i;
+    }
+
+    return -1; // no hay posiciones libres
+}
+
+/*
+ *  NAME
+ *      create_chargers - Crea los Charger del sistema.
+ *  SYNOPSIS
+ *      static vector<unique_ptr<Charger>> create_chargers();
+ *  DESCRIPTION
+ *      Crea un Charger sin cliente por cada posición de cargador (de 1 a MAX_CHARGERS).
+ *  RETURN VALUE
+ *      Un vector con los cargadores, el índice i corresponde al charger_id i + 1.
+ */
+static vector<unique_ptr<Charger>> create_chargers()
+{
+    vector<unique_ptr<Charger>> chargers;
+    for (int i = 1; i <= MAX_CHARGERS; i++)
+        chargers.push_back(make_unique<Charger>(i, -1));
+
+    return chargers;
 }
 
+/*
+ *  NAME
+ *      get_charger - Devuelve el Charger con un charger_id.
+ *  SYNOPSIS
+ *      Charger *get_charger(int charger_id);
+ *  DESCRIPTION
+ *      Devuelve el Charger con un charger_id. La tabla de cargadores se crea la primera
+ *      vez que se llama, de manera que el thread de la interfaz y el del servidor
+ *      WebSocket pueden usarla en cualquier orden.
+ *  RETURN VALUE
+ *      Si todo va bien, devuelve un puntero al Charger.
+ *      En caso contrario, retorna NULL.
+ */
+Charger *get_charger(int charger_id)
+{
+    static vector<unique_ptr<Charger>> chargers = create_chargers();
+
+    if (charger_id < 1 || charger_id > MAX_CHARGERS)
+        return NULL;
+
+    return chargers[charger_id - 1].get();
+}
+
+/*
+ *  NAME
+ *      charger_report - Devuelve el estado de la cola de peticiones de los cargadores en texto.
+ *  SYNOPSIS
+ *      string charger_report(int charger_id = 0);
+ *  DESCRIPTION
+ *      Una línea por cargador (0: todos los conectados o que han recibido alguna petición), con
+ *      las peticiones que esperan en la cola, si hay una en curso, las enviadas, el tiempo medio
+ *      y máximo que han esperado en la cola, lo que lleva esperando la primera de la cola y los
+ *      mensajes reenviados por el cargador que se han contestado con la respuesta guardada.
+ *  RETURN VALUE
+ *      El texto, vacío si no hay ningún cargador que mostrar.
+ */
+string charger_report(int charger_id)
+{
+    string report;
+    char line[160];
+
+    for (int i = 1; i <= MAX_CHARGERS; i++) {
+        if (charger_id != 0 && i != charger_id)
+            continue;
+
+        Charger *charger = get_charger(i);
+        struct CommandQueueStats stats = charger->get_queue_stats();
+        bool connected = charger->get_client() != static_cast<ws_cli_conn_t>(-1);
+        if (charger_id == 0 && !connected && stats.sent == 0 && stats.depth == 0)
+            continue;
+
+        if (report.empty()) {
+            snprintf(line, sizeof(line), "%8s %9s %6s %8s %9s %13s %13s %13s %9s\n",
+                     "cargador", "conectado", "cola", "en curso", "enviadas", "espera med ms", "espera max ms", "primera ms",
+                     "reenvíos");
+            report += line;
+        }
+        snprintf(line, sizeof(line), "%8d %*s %6zu %*s %9llu %13.1f %13.1f %13.1f %8llu\n", // "í" son dos bytes
+                 i, connected ? 10 : 9, connected ? "sí" : "no", stats.depth,
+                 stats.in_flight ? 9 : 8, stats.in_flight ? "sí" : "no",
+                 (unsigned long long)stats.sent, stats.sent ? stats.total_wait_ms / stats.sent : 0.0,
+                 stats.max_wait_ms, stats.depth ? stats.oldest_wait_ms : 0.0,
+                 (unsigned long long)charger->get_duplicates_suppressed());
+        report += line;
+    }
+
+    return report;
+}
+
+
+/*
+ *  NAME
+ *      set_database_path - Fija la base de datos del sistema de control.
+ *  SYNOPSIS
+ *      bool set_database_path(const char *path);
+ *  DESCRIPTION
+ *      Guarda la ruta absoluta de path, resuelta respecto al directorio actual. Se llama al
+ *      arrancar, antes de crear ningún thread: después el directorio actual ya no importa.
+ *  RETURN VALUE
+ *      Devuelve true si todo va bien.
+ *      Devuelve false si el fichero no existe, con errno (la ruta anterior no cambia).
+ */
+bool set_database_path(const char *path)
+{
+    char resolved[PATH_MAX];
+    if (realpath(path, resolved) == NULL)
+        return false;
+
+    snprintf(db_path, sizeof(db_path), "%s", resolved);
+    return true;
+}
+
+/*
+ *  NAME
+ *      database_path - Devuelve la ruta de la base de datos.
+ *  SYNOPSIS
+ *      const char *database_path();
+ *  DESCRIPTION
+ *      Devuelve la ruta absoluta fijada con set_database_path, o DATABASE_PATH si no se ha
+ *      fijado ninguna.
+ *  RETURN VALUE
+ *      La ruta de la base de datos.
+ */
+const char *database_path()
+{
+    return db_path[0] ? db_path : DATABASE_PATH;
+}
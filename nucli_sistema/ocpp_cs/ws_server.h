@@ -12,15 +12,24 @@
  */
 
 #include <ws.h>
+#include <functional>
+#include <string>
 
 #ifndef _SERVER_H_
 #define _SERVER_H_
 
-#define DATABASE_PATH "../../base_dades/base_dades.db"
+#define DATABASE_PATH "../../base_dades/base_dades.db" // por defecto, relativo al directorio de arranque
 #define MAX_CHARGERS 4
 
+class Charger;
+struct CallResult;
+
 void web_socket_server();
 void ws_send(const char *option, char *text, ws_cli_conn_t client);
-void select_request(const char *operation);
+void select_request(const char *operation, std::function<void(const struct CallResult &)> done = nullptr);
+Charger *get_charger(int charger_id);
+std::string charger_report(int charger_id = 0); // cola de peticiones y reenvíos de los cargadores en texto
+bool set_database_path(const char *path);
+const char *database_path();
 
 #endif
@@ -0,0 +1,217 @@
+#include "operationrequest.h"
+#include <QCoreApplication>
+#include <QPointer>
+#include <QByteArray>
+#include <QStringList>
+#include <cstring>
+#include <cstdlib>
+#include "ipcclient.h"
+#include "nucli_sistema/ocpp_cs/ws_server.h"
+#include "nucli_sistema/ocpp_cs/lib_json_includes.h"
+
+void sendOperation(const QString &operation, QObject *receiver, std::function<void(const CallResult &)> done)
+{
+    QPointer<QObject> guard(receiver);
+
+    // sistema de control en otro proceso: la respuesta ya llega en el thread de la interfaz
+    if (IpcClient *client = IpcClient::instance()) {
+        client->sendOperation(operation, [guard, done](const CallResult &result) {
+            if (guard)
+                done(result);
+        });
+        return;
+    }
+
+    // la copia en UTF-8 tiene que vivir mientras select_request la lee
+    QByteArray op = operation.toUtf8();
+
+    select_request(op.constData(), [guard, done](const CallResult &result) {
+        // estamos en el thread del cargador: el resultado se pasa al thread de la interfaz, donde
+        // se comprueba si receiver sigue existiendo (QPointer solo se puede mirar desde ese thread)
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [guard, done, result]() {
+            if (guard)
+                done(result);
+        }, Qt::QueuedConnection);
+    });
+}
+
+QString operationStatusText(const CallResult &result)
+{
+    switch (result.status) {
+    case CALL_ANSWERED:
+        return QString();
+    case CALL_PENDING:
+        return "Cargador no conectado: la operación se enviará cuando se conecte";
+    case CALL_ERROR:
+        return "El cargador ha contestado con un error (CALLERROR)";
+    case CALL_TIMEOUT:
+        return "El cargador no ha contestado a tiempo";
+    case CALL_NOT_SENT:
+    default:
+        return "No se ha podido enviar la operación";
+    }
+}
+
+// Formateadores de las respuestas, uno por operación: devuelven el texto para el usuario o un
+// QString nulo si la respuesta no se puede parsear. Liberan todo lo que reserva el parser.
+
+static QString formatChangeAvailability(const char *payload)
+{
+    struct ChangeAvailabilityConf *conf = cJSON_ParseChangeAvailabilityConf(payload);
+    QString text;
+    if (conf && static_cast<int>(conf->status) >= 0) {
+        if (conf->status == STATUS_AVAILABILITY_ACCEPTED)
+            text = "Cambio de disponibilidad aceptado";
+        else if (conf->status == STATUS_AVAILABILITY_SCHEDULED)
+            text = "Cambio de disponibilidad programado para cuando acabe la transacción";
+        else
+            text = "Cambio de disponibilidad rechazado";
+    }
+    free(conf);
+
+    return text;
+}
+
+static QString formatClearCache(const char *payload)
+{
+    struct ClearCacheConf *conf = cJSON_ParseClearCacheConf(payload);
+    QString text;
+    if (conf && static_cast<int>(conf->status) >= 0)
+        text = conf->status == STATUS_CACHE_ACCEPTED ? "Caché borrada" : "El cargador ha rechazado borrar la caché";
+    free(conf);
+
+    return text;
+}
+
+static QString formatDataTransfer(const char *payload)
+{
+    struct DataTransferConf *conf = cJSON_ParseDataTransferConf(payload);
+    QString text;
+    if (conf && static_cast<int>(conf->status) >= 0) {
+        if (conf->status == STATUS_DATA_TRANSFER_ACCEPTED)
+            text = "DataTransfer aceptado";
+        else if (conf->status == STATUS_DATA_TRANSFER_REJECTED)
+            text = "DataTransfer rechazado";
+        else if (conf->status == STATUS_DATA_TRANSFER_UNKNOWN_MESSAGE_ID)
+            text = "messageId desconocido";
+        else
+            text = "vendorId desconocido";
+        if (conf->data)
+            text += QString("\ndata: %1").arg(QString::fromUtf8(conf->data));
+    }
+    if (conf)
+        free(conf->data);
+    free(conf);
+
+    return text;
+}
+
+static QString formatGetConfiguration(const char *payload)
+{
+    struct GetConfigurationConf *conf = cJSON_ParseGetConfigurationConf(payload);
+    if (conf == NULL)
+        return QString();
+
+    QStringList lines;
+    if (conf->configuration_key) {
+        for (void *p = list_get_head(conf->configuration_key); p; p = list_get_next(conf->configuration_key)) {
+            struct ConfigurationKey *key = static_cast<struct ConfigurationKey *>(p);
+            lines << QString("%1 = %2%3").arg(QString::fromUtf8(key->key ? key->key : ""),
+                                             QString::fromUtf8(key->value ? key->value : ""),
+                                             key->readonly ? " (solo lectura)" : "");
+            free(key->key);
+            free(key->value);
+            free(key);
+        }
+        list_release(conf->configuration_key);
+    }
+    if (conf->unknown_key) {
+        for (void *p = list_get_head(conf->unknown_key); p; p = list_get_next(conf->unknown_key)) {
+            lines << QString("%1: clave desconocida").arg(QString::fromUtf8(static_cast<char *>(p)));
+            free(p);
+        }
+        list_release(conf->unknown_key);
+    }
+    free(conf);
+
+    return lines.isEmpty() ? "El cargador no ha devuelto ninguna clave" : lines.join('\n');
+}
+
+static QString formatRemoteStartTransaction(const char *payload)
+{
+    struct RemoteStartTransactionConf *conf = cJSON_ParseRemoteStartTransactionConf(payload);
+    QString text;
+    if (conf && static_cast<int>(conf->status) >= 0)
+        text = conf->status == STATUS_REMOTE_START_ACCEPTED ? "Inicio de transacción aceptado" : "Inicio de transacción rechazado";
+    free(conf);
+
+    return text;
+}
+
+static QString formatRemoteStopTransaction(const char *payload)
+{
+    struct RemoteStopTransactionConf *conf = cJSON_ParseRemoteStopTransactionConf(payload);
+    QString text;
+    if (conf && static_cast<int>(conf->status) >= 0)
+        text = conf->status == STATUS_REMOTE_STOP_ACCEPTED ? "Parada de transacción aceptada" : "Parada de transacción rechazada";
+    free(conf);
+
+    return text;
+}
+
+static QString formatReset(const char *payload)
+{
+    struct ResetConf *conf = cJSON_ParseResetConf(payload);
+    QString text;
+    if (conf && static_cast<int>(conf->status) >= 0)
+        text = conf->status == STATUS_RESET_ACCEPTED ? "Reset aceptado" : "Reset rechazado";
+    free(conf);
+
+    return text;
+}
+
+static QString formatUnlockConnector(const char *payload)
+{
+    struct UnlockConnectorConf *conf = cJSON_ParseUnlockConnectorConf(payload);
+    QString text;
+    if (conf && static_cast<int>(conf->status) >= 0) {
+        if (conf->status == STATUS_UNLOCK_UNLOCKED)
+            text = "Conector desbloqueado";
+        else if (conf->status == STATUS_UNLOCK_UNLOCK_FAILED)
+            text = "No se ha podido desbloquear el conector";
+        else
+            text = "El cargador no permite desbloquear el conector";
+    }
+    free(conf);
+
+    return text;
+}
+
+static const struct {
+    const char *action;
+    QString (*format)(const char *payload);
+} formatters[] = {
+    {"changeAvailability", formatChangeAvailability},
+    {"clearCache", formatClearCache},
+    {"dataTransfer", formatDataTransfer},
+    {"getConfiguration", formatGetConfiguration},
+    {"remoteStartTransaction", formatRemoteStartTransaction},
+    {"remoteStopTransaction", formatRemoteStopTransaction},
+    {"reset", formatReset},
+    {"unlockConnector", formatUnlockConnector},
+};
+
+QString operationResultText(const char *action, const CallResult &result)
+{
+    if (result.status != CALL_ANSWERED)
+        return operationStatusText(result);
+
+    for (const auto &f : formatters) {
+        if (strcmp(f.action, action) == 0) {
+            QString text = f.format(result.payload.c_str());
+            return text.isNull() ? "Respuesta no válida del cargador" : text;
+        }
+    }
+
+    return QString::fromStdString(result.payload); // acción sin formateador: la respuesta tal cual
+}
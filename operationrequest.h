@@ -0,0 +1,24 @@
+#ifndef OPERATIONREQUEST_H
+#define OPERATIONREQUEST_H
+
+#include <QObject>
+#include <QString>
+#include <functional>
+#include "nucli_sistema/ocpp_cs/charger.h"
+
+/*
+ * Envío de operaciones desde la interfaz sin bloquearla. sendOperation vuelve enseguida y done
+ * se ejecuta más tarde en el thread de la interfaz con la respuesta, el timeout o el aviso de que
+ * la operación se ha guardado porque el cargador no está conectado. Si receiver (normalmente el
+ * diálogo) se ha cerrado antes, done no se ejecuta.
+ */
+void sendOperation(const QString &operation, QObject *receiver, std::function<void(const CallResult &)> done);
+
+// texto para los resultados que no son una respuesta del cargador (CALL_ANSWERED devuelve un texto vacío)
+QString operationStatusText(const CallResult &result);
+
+// texto del resultado de una operación de la acción action ("reset", "getConfiguration"...): la
+// respuesta del cargador formateada según la operación, o el de operationStatusText si no la hay
+QString operationResultText(const char *action, const CallResult &result);
+
+#endif // OPERATIONREQUEST_H
@@ -1,6 +1,7 @@
+#include <cstdio>
 #include "remotestarttransaction.h"
 #include "ui_remotestarttransaction.h"
-#include "nucli_sistema/ocpp_cs/ws_server.h"
+#include "operationrequest.h"
 
 RemoteStartTransaction::RemoteStartTransaction(int connectorId, QWidget *parent)
     : QDialog(parent)
@@ -19,6 +20,12 @@ void RemoteStartTransaction::on_pushButton_clicked()
 {
     char operation[256];
     snprintf(operation, sizeof(operation), "remoteStartTransaction:{\"connectorId\":%d,\"idTag\":\"%s\"}", connectorId, ui->lineEdit->text().toUtf8().constData());
-    select_request(operation);
+
+    ui->pushButton->setEnabled(false);
+    ui->label_resultado->setText("Enviando operación...");
+    sendOperation(operation, this, [this](const CallResult &result) {
+        ui->pushButton->setEnabled(true);
+        ui->label_resultado->setText(operationResultText("remoteStartTransaction", result));
+    });
 }
 
@@ -1,6 +1,7 @@
+#include <cstdio>
 #include "remotestoptransaction.h"
 #include "ui_remotestoptransaction.h"
-#include "nucli_sistema/ocpp_cs/ws_server.h"
+#include "operationrequest.h"
 
 RemoteStopTransaction::RemoteStopTransaction(int connectorId, QWidget *parent)
     : QDialog(parent)
@@ -19,6 +20,12 @@ void RemoteStopTransaction::on_pushButton_clicked()
 {
     char operation[256];
     snprintf(operation, sizeof(operation), "remoteStopTransaction:{\"transactionId\":%d}", ui->lineEdit->text().toInt());
-    select_request(operation);
+
+    ui->pushButton->setEnabled(false);
+    ui->label_resultado->setText("Enviando operación...");
+    sendOperation(operation, this, [this](const CallResult &result) {
+        ui->pushButton->setEnabled(true);
+        ui->label_resultado->setText(operationResultText("remoteStopTransaction", result));
+    });
 }
 
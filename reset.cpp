@@ -1,6 +1,7 @@
+#include <cstdio>
 #include "reset.h"
 #include "ui_reset.h"
-#include "nucli_sistema/ocpp_cs/ws_server.h"
+#include "operationrequest.h"
 
 Reset::Reset(int connectorId, QWidget *parent)
     : QDialog(parent)
@@ -19,6 +20,12 @@ void Reset::on_pushButton_clicked()
 {
     char operation[256];
     snprintf(operation, sizeof(operation), "reset:{\"connectorId\":%d,\"type\":\"%s\"}", connectorId, ui->comboBox->currentText().toUtf8().constData());
-    select_request(operation);
+
+    ui->pushButton->setEnabled(false);
+    ui->label_resultado->setText("Enviando operación...");
+    sendOperation(operation, this, [this](const CallResult &result) {
+        ui->pushButton->setEnabled(true);
+        ui->label_resultado->setText(operationResultText("reset", result));
+    });
 }
 
@@ -0,0 +1,92 @@
+#include "statsdialog.h"
+#include "ui_statsdialog.h"
+#include <QFontDatabase>
+#include "operationrequest.h"
+#include "nucli_sistema/ocpp_cs/ws_server.h"
+
+// parámetro de la operación de cada informe
+enum Filtro {
+    SinFiltro,
+    FiltroCargador, // charger_id, 0 para todos
+    FiltroIdTag     // idTag, vacío para todos
+};
+
+// informes del desplegable, en el mismo orden
+static const struct {
+    const char *nombre;
+    const char *operacion; // operación de select_request que devuelve el texto
+    Filtro filtro;
+    const char *vacio;     // texto si el informe está vacío
+} informes[] = {
+    {"Transacciones activas", "transactionReport", FiltroIdTag, "No hay ninguna transacción activa"},
+    {"Resumen de la flota", "fleetReport", SinFiltro, "No hay ningún cargador conectado"},
+    {"Colas y reenvíos de los cargadores", "chargerReport", FiltroCargador, "No hay ningún cargador conectado"},
+    {"Caché de idTags", "authCacheReport", SinFiltro, "Aún no se ha autorizado ningún idTag"},
+};
+
+StatsDialog::StatsDialog(QWidget *parent)
+    : QDialog(parent)
+    , ui(new Ui::StatsDialog)
+{
+    ui->setupUi(this);
+    ui->cargador->setMaximum(MAX_CHARGERS);
+    ui->tabla->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont)); // columnas alineadas
+
+    for (const auto &informe : informes)
+        ui->informe->addItem(informe.nombre);
+
+    connect(ui->informe, &QComboBox::currentIndexChanged, this, &StatsDialog::cambiarInforme);
+    connect(ui->boton_actualizar, &QPushButton::clicked, this, &StatsDialog::actualizar);
+    connect(ui->cargador, &QSpinBox::valueChanged, this, &StatsDialog::actualizar);
+    connect(ui->id_tag, &QLineEdit::editingFinished, this, &StatsDialog::actualizar);
+
+    refreshTimer.setInterval(5000);
+    connect(&refreshTimer, &QTimer::timeout, this, &StatsDialog::actualizar);
+    refreshTimer.start();
+
+    cambiarInforme(); // filtros del primer informe y primera petición
+}
+
+StatsDialog::~StatsDialog()
+{
+    delete ui;
+}
+
+void StatsDialog::cambiarInforme()
+{
+    Filtro filtro = informes[ui->informe->currentIndex()].filtro;
+    ui->cargador->setEnabled(filtro == FiltroCargador);
+    ui->id_tag->setEnabled(filtro == FiltroIdTag);
+
+    ui->tabla->clear();
+    actualizar();
+}
+
+void StatsDialog::actualizar()
+{
+    if (waiting)
+        return;
+    waiting = true;
+
+    int index = ui->informe->currentIndex();
+    QString operation = informes[index].operacion;
+    if (informes[index].filtro == FiltroCargador)
+        operation += QString(":%1").arg(ui->cargador->value());
+    else if (informes[index].filtro == FiltroIdTag && !ui->id_tag->text().trimmed().isEmpty())
+        operation += ":" + ui->id_tag->text().trimmed();
+
+    sendOperation(operation, this, [this, index](const CallResult &result) {
+        waiting = false;
+        if (index != ui->informe->currentIndex()) { // se ha cambiado de informe mientras tanto
+            actualizar();
+            return;
+        }
+
+        if (result.status != CALL_ANSWERED)
+            ui->tabla->setPlainText(operationStatusText(result));
+        else if (result.payload.empty())
+            ui->tabla->setPlainText(informes[index].vacio);
+        else
+            ui->tabla->setPlainText(QString::fromStdString(result.payload));
+    });
+}
@@ -0,0 +1,34 @@
+#ifndef STATSDIALOG_H
+#define STATSDIALOG_H
+
+#include <QDialog>
+#include <QTimer>
+
+namespace Ui {
+class StatsDialog;
+}
+
+/*
+ * Estadísticas del sistema de control (transacciones activas...). Cada informe es un texto que
+ * devuelve el núcleo como una operación más, igual que las latencias, así funciona también
+ * conectada a un ocpp_csd, y se vuelve a pedir cada pocos segundos.
+ */
+class StatsDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit StatsDialog(QWidget *parent = nullptr);
+    ~StatsDialog();
+
+private slots:
+    void cambiarInforme(); // habilita el filtro que usa el informe elegido
+    void actualizar();
+
+private:
+    Ui::StatsDialog *ui;
+    QTimer refreshTimer;
+    bool waiting = false; // hay una petición sin respuesta
+};
+
+#endif // STATSDIALOG_H
@@ -1,6 +1,7 @@
+#include <cstdio>
 #include "unlockconnector.h"
 #include "ui_unlockconnector.h"
-#include "nucli_sistema/ocpp_cs/ws_server.h"
+#include "operationrequest.h"
 
 UnlockConnector::UnlockConnector(int connectorId, QWidget *parent)
     : QDialog(parent)
@@ -19,6 +20,12 @@ void UnlockConnector::on_pushButton_clicked()
 {
     char operation[256];
     snprintf(operation, sizeof(operation), "unlockConnector:{\"connectorId\":%d}", connectorId);
-    select_request(operation);
+
+    ui->pushButton->setEnabled(false);
+    ui->label_resultado->setText("Enviando operación...");
+    sendOperation(operation, this, [this](const CallResult &result) {
+        ui->pushButton->setEnabled(true);
+        ui->label_resultado->setText(operationResultText("unlockConnector", result));
+    });
 }
 